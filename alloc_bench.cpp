@@ -0,0 +1,319 @@
+/***********************************************************************//**
+@file
+
+Counts the heap allocations of the receive chain in the steady state,
+with the buffers on the heap and with each kind of block_pool
+
+The chain is the one of rxtest: simulated source -> sampling task with
+squelch and capture writer -> host DDC, polyphase channelizer, QPSK
+demodulator, Viterbi decoder and frame sync in the consumer. Every
+operator new of the process is counted while the -n blocks following the
+first WARMUP_BLOCKS ones are processed, together with the buffers
+pool_alloc() had to take from the heap and the minor page faults.
+
+The program checks that the steady state allocates nothing in every
+configuration, that with a pool every buffer of the chain comes from it,
+and that the blocks have the alignment of the pool.
+
+Usage: allocbench [-n blocks] [-H] [-l label] [-j file]
+
+-n number of blocks measured (default 400)
+-H also run with a page aligned pool on huge pages
+-l label stored in the results (e.g. the release)
+-j file receiving the results, one JSON object per line (default alloc_bench.json)
+
+The exit code is 1 if a check fails.
+
+***************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <atomic>
+#include <new>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "task_sampling.h"
+#include "sim_source.h"
+#include "ddc.h"
+#include "polyphase.h"
+#include "demodulator.h"
+#include "viterbi.h"
+#include "frame_sync.h"
+#include "baseband.h"
+#include "bench_common.h"
+
+
+#define BENCH_RATE 1e6
+#define BENCH_CENTER -20e3
+#define BENCH_SYMBOL_RATE 12500
+#define BLOCK_SAMPS 8192
+#define NUM_CHANNELS 8
+#define DDC_DECIM 4
+#define WARMUP_BLOCKS 50		/// Blocks processed before the counting starts
+#define TAIL_BLOCKS 20			/// Blocks after the counting, so that the end of the stream is not measured
+#define POOL_BYTES (32 << 20)
+#define CAPTURE_NAME "alloc_bench.cap"
+
+
+/// Counting of operator new, switched on by the consumer
+static std::atomic<bool> counting(false);
+static std::atomic<uint64_t> num_new(0);
+
+static void * counted_new(size_t size)
+{
+	if(counting.load(std::memory_order_relaxed))
+		num_new.fetch_add(1, std::memory_order_relaxed);
+	void * p = malloc(size ? size : 1);
+	if(p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void * operator new(size_t size) {return counted_new(size);}
+void * operator new[](size_t size) {return counted_new(size);}
+void * operator new(size_t size, const std::nothrow_t &) throw() {try {return counted_new(size);} catch(...) {return NULL;}}
+void * operator new[](size_t size, const std::nothrow_t &) throw() {try {return counted_new(size);} catch(...) {return NULL;}}
+void operator delete(void * p) throw() {free(p);}
+void operator delete[](void * p) throw() {free(p);}
+void operator delete(void * p, const std::nothrow_t &) throw() {free(p);}
+void operator delete[](void * p, const std::nothrow_t &) throw() {free(p);}
+
+
+/// Configuration of one run
+struct alloc_test
+{
+	const char * name;
+	bool use_pool;
+	size_t alignment;
+	bool hugepages;
+};
+
+
+/// Counters of the steady state of one run
+struct alloc_result
+{
+	uint64_t blocks;			/// Blocks processed while counting
+	uint64_t news;				/// operator new calls
+	uint64_t heap_buffers;		/// Buffers of pool_alloc() taken from the heap
+	uint64_t startup_heap_buffers;	/// Same before the counting, with the stages configured
+	long page_faults;			/// Minor page faults of the process
+	uint64_t misaligned;		/// Blocks not aligned as the pool
+	uint64_t frames;
+};
+
+
+/// Installs a pool as the default pool of the process until the end of the scope
+struct default_pool_scope
+{
+	default_pool_scope(block_pool * pool) {set_block_pool(pool);}
+	~default_pool_scope() {set_block_pool(NULL);}
+};
+
+
+/***********************************************************************//**
+Runs the chain with the given pool until the source ends
+
+@return true if the chain could not be started
+
+***************************************************************************/
+static bool run_chain(const alloc_test & test, uint64_t measured, alloc_result & result)
+{
+	block_pool pool;
+	if(test.use_pool)
+	{
+		block_pool_config config;
+		config.bytes = POOL_BYTES;
+		config.alignment = test.alignment;
+		config.hugepages = test.hugepages;
+		if(pool.create(config))
+			return true;
+	}
+	default_pool_scope scope(test.use_pool ? &pool : NULL);
+	uint64_t heap_before = get_heap_allocations();
+	memset(&result, 0, sizeof(result));
+
+	sim_config sim;
+	sim.rate = BENCH_RATE;
+	sim.noise_rms = 0.05;
+	sim.burst_amplitude = 0.5;
+	sim.burst_freq = BENCH_CENTER;
+	sim.symbol_rate = BENCH_SYMBOL_RATE;
+	sim.burst_symbols = 256;
+	sim.burst_period = 0.1;
+	sim.preamble = frame_sync_default_preamble();
+	sim.num_samples = (WARMUP_BLOCKS + measured + TAIL_BLOCKS) * BLOCK_SAMPS;
+	sim.paced = false;
+	bool failed = false;
+	{
+		sim_source source(sim);
+
+		// The stages of rxtest, configured before the stream starts
+		ddc_stage ddc(BENCH_RATE, DDC_DECIM, design_lowpass(8 * DDC_DECIM + 1, 0.4 * BENCH_RATE / DDC_DECIM, BENCH_RATE));
+		ddc.set_frequency(BENCH_CENTER);
+		fc32_buffer ddc_out(ddc.max_output(BLOCK_SAMPS));
+		pfb_channelizer channelizer;
+		demod_config demod_cfg;
+		demod_cfg.rate = BENCH_RATE;
+		demod_cfg.center_freq = BENCH_CENTER;
+		demod_cfg.symbol_rate = BENCH_SYMBOL_RATE;
+		qpsk_demodulator demod;
+		viterbi_config fec_cfg;
+		viterbi_decoder fec;
+		frame_sync_config sync_cfg;
+		sync_cfg.rate = BENCH_RATE;
+		sync_cfg.center_freq = BENCH_CENTER;
+		sync_cfg.symbol_rate = BENCH_SYMBOL_RATE;
+		frame_sync sync;
+		if(channelizer.configure(BENCH_RATE, NUM_CHANNELS, design_lowpass(8 * NUM_CHANNELS, 0.5 * BENCH_RATE / NUM_CHANNELS, BENCH_RATE))
+			|| demod.configure(demod_cfg) || fec.configure(fec_cfg) || sync.configure(sync_cfg))
+			return true;
+		std::vector<fc32_buffer> channels(NUM_CHANNELS, fc32_buffer(channelizer.max_output(BLOCK_SAMPS)));
+		std::vector<sample_fc32 *> channel_out;
+		for(size_t c = 0; c < NUM_CHANNELS; c++)
+			channel_out.push_back(&channels[c][0]);
+		fc32_buffer symbols(demod.max_output(BLOCK_SAMPS));
+		pool_vector<int8_t>::type soft_bits(2 * symbols.size());
+		pool_vector<uint8_t>::type decoded(fec.max_output(soft_bits.size()));
+		pool_vector<frame_detection>::type detections(sync.max_output(BLOCK_SAMPS));
+
+		// Squelch always open: the held blocks are forwarded by the sampling task
+		task_sampling rx_task(source, BLOCK_SAMPS, 8, CAPTURE_NAME);
+		squelch_config squelch;
+		squelch.enable = true;
+		squelch.open_level = -100;
+		squelch.close_level = -103;
+		rx_task.set_squelch_config(squelch);
+		rx_task.set_consumer_policy(FANOUT_BLOCK);
+		if(rx_task.start())
+			return true;
+
+		uint64_t processed = 0;
+		long faults = 0;
+		uint64_t heap_start = 0;
+		size_t align = pool_alignment();
+		struct rusage usage;
+		for(;;)
+		{
+			const input_block_t * block = rx_task.wait_buffer(1000);
+			if(block == NULL)
+			{
+				if(rx_task.get_fanout().is_closed())
+					break;
+				continue;
+			}
+			if(processed == WARMUP_BLOCKS)
+			{
+				result.startup_heap_buffers = get_heap_allocations() - heap_before;
+				heap_start = get_heap_allocations();
+				getrusage(RUSAGE_SELF, &usage);
+				faults = usage.ru_minflt;
+				num_new.store(0);
+				counting.store(true);
+			}
+			if(reinterpret_cast<uintptr_t>(block->samples) & (align - 1))
+				result.misaligned++;
+
+			ddc.process(block->samples, block->num_samps, &ddc_out[0]);
+			channelizer.process(block->samples, block->num_samps, &channel_out[0]);
+			size_t count = demod.process(block->samples, block->num_samps, &symbols[0], &soft_bits[0]);
+			fec.process(&soft_bits[0], 2 * count, &decoded[0]);
+			result.frames += sync.process(block->samples, block->num_samps, block->first_sample, block->md, &detections[0]);
+			rx_task.release_buffer();
+
+			processed++;
+			if(processed == WARMUP_BLOCKS + measured)
+			{
+				counting.store(false);
+				result.news = num_new.load();
+				result.heap_buffers = get_heap_allocations() - heap_start;
+				getrusage(RUSAGE_SELF, &usage);
+				result.page_faults = usage.ru_minflt - faults;
+				result.blocks = measured;
+			}
+		}
+		pthread_join(rx_task.get_tid(), NULL);
+		failed = result.blocks != measured;
+		if(failed)
+			std::cout << "The stream ended after " << processed << " blocks" << std::endl;
+		if(test.use_pool)
+			pool.print_stats(std::cout);
+	}
+	return failed;
+}
+
+
+int main(int argc, char ** argv)
+{
+	uint64_t measured = 400;
+	bool huge = false;
+	bench_context bench("alloc_bench.json");
+	for(int index = 1; index < argc; index++)
+	{
+		if(strcmp(argv[index], "-n") == 0 && index + 1 < argc)
+			measured = strtoull(argv[++index], NULL, 10);
+		else if(strcmp(argv[index], "-H") == 0)
+			huge = true;
+		else if(bench.parse_option(argc, argv, index))
+		{
+			std::cout << "Usage: allocbench [-n blocks] [-H] [-l label] [-j file]" << std::endl;
+			return 1;
+		}
+	}
+	if(bench.open())
+		return 1;
+
+	// The counter must see the allocations of the program
+	counting.store(true);
+	int * probe = new int(1);
+	counting.store(false);
+	delete probe;
+	if(num_new.load() != 1)
+	{
+		std::cout << "operator new is not counted" << std::endl;
+		return 1;
+	}
+
+	size_t page = sysconf(_SC_PAGESIZE);
+	alloc_test tests[] = {
+		{"heap", false, CACHE_LINE_SIZE, false},
+		{"pool", true, CACHE_LINE_SIZE, false},
+		{"pool-page-huge", true, page, true}
+	};
+	size_t num_tests = huge ? 3 : 2;
+
+	alloc_result results[3];
+	for(size_t t = 0; t < num_tests; t++)
+	{
+		std::cout << std::endl << "-----> " << tests[t].name << std::endl;
+		if(run_chain(tests[t], measured, results[t]))
+		{
+			std::cout << "FAILED: the chain could not run" << std::endl;
+			bench.errors++;
+			results[t].blocks = 0;
+		}
+	}
+	unlink(CAPTURE_NAME);
+	unlink("rx_log.bin");
+
+	printf("\n%-16s %8s %10s %12s %14s %12s %10s %8s\n", "config", "blocks", "new calls", "heap buffers", "startup heap", "page faults", "misaligned", "frames");
+	for(size_t t = 0; t < num_tests; t++)
+	{
+		const alloc_test & test = tests[t];
+		const alloc_result & r = results[t];
+		bool ok = r.blocks == measured && r.news == 0 && r.heap_buffers == 0 && r.misaligned == 0
+			&& (!test.use_pool || r.startup_heap_buffers == 0);
+		printf("%-16s %8llu %10llu %12llu %14llu %12ld %10llu %8llu %s\n", test.name, (unsigned long long)r.blocks,
+			(unsigned long long)r.news, (unsigned long long)r.heap_buffers, (unsigned long long)r.startup_heap_buffers, r.page_faults,
+			(unsigned long long)r.misaligned, (unsigned long long)r.frames, ok ? "ok" : "FAILED");
+		if(!ok)
+			bench.errors++;
+		fprintf(bench.record("alloc"), "\"config\":\"%s\",\"blocks\":%llu,\"new_calls\":%llu,\"heap_buffers\":%llu,"
+			"\"startup_heap_buffers\":%llu,\"page_faults\":%ld,\"ok\":%s}\n", test.name, (unsigned long long)r.blocks, (unsigned long long)r.news,
+			(unsigned long long)r.heap_buffers, (unsigned long long)r.startup_heap_buffers, r.page_faults, ok ? "true" : "false");
+	}
+
+	printf("\n");
+	return bench.finish("No allocation in the steady state");
+}
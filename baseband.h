@@ -0,0 +1,148 @@
+/***********************************************************************//**
+@file
+
+Baseband processing chain applied to the blocks of the sampling task
+
+mixer (NCO) -> FIR low-pass + decimation -> AGC -> magnitude
+
+The chain exists in two implementations with the same configuration:
+- baseband_q15: saturating Q15/Q31 fixed point working directly on the
+  sc16 samples, for the E100 whose VFP is too slow for float DSP
+- baseband_fc32: float, the reference of the fixed point version and the
+  faster choice on x86
+
+baseband_chain is the implementation chosen for the target. basebandsnr
+measures the SNR lost by the fixed point version against the float one.
+
+***************************************************************************/
+
+#ifndef BASEBAND_H
+#define BASEBAND_H
+
+#include <vector>
+#include <cstddef>
+#include "sample_format.h"
+#include "block_pool.h"
+#include "fixed_point.h"
+
+
+/// Configuration shared by the fixed point and the float chains
+struct baseband_config
+{
+	baseband_config() : rate(125000), nco_freq(0), decimation(1), agc_enable(false), agc_reference(0.25),
+		agc_rate_shift(10), agc_max_gain(1024) {}
+
+	double rate;				/// Input sample rate in samples/s
+	double nco_freq;			/// Frequency shift applied by the mixer in Hz
+	std::vector<double> taps;	/// Low-pass FIR coefficients. Empty for no filter
+	size_t decimation;			/// Decimation factor after the filter
+	bool agc_enable;			/// True to apply the AGC
+	double agc_reference;		/// Output level targeted by the AGC (fraction of full scale)
+	int agc_rate_shift;			/// The AGC corrects 2^-agc_rate_shift of the error per sample
+	double agc_max_gain;		/// Maximum gain of the AGC
+};
+
+
+std::vector<double> design_lowpass(size_t num_taps, double cutoff, double rate);
+std::vector<double> design_rrc(size_t num_taps, double sps, double rolloff);
+
+
+/// Number of entries of the sine table of the NCO (12 bits of phase)
+#define NCO_TABLE_BITS 12
+#define NCO_TABLE_SIZE (1 << NCO_TABLE_BITS)
+
+
+/***********************************************************************//**
+Fixed point chain
+
+All the samples are Q15. The NCO is a 32 bits phase accumulator reading a
+table of Q15 sines (spurs below -70 dBc). The FIR products are Q30 summed
+in a 64 bits accumulator (SMLAL) and rounded once per output. The AGC
+gain is Q16.16 and its level detector is a Q31 average.
+
+***************************************************************************/
+class baseband_q15
+{
+public:
+	typedef sample_sc16 output_type;
+
+	baseband_q15();
+	void configure(const baseband_config & config);
+	void reset();
+	size_t process(const sample_sc16 * in, size_t num_samps, sample_sc16 * out);
+	/// Maximum number of outputs produced from num_samps inputs
+	size_t max_output(size_t num_samps) const {return num_samps / config.decimation + 1;}
+	static void magnitude(const sample_sc16 * in, size_t num_samps, q15_t * out);
+
+	// The stages, usable on their own
+	void mix(const sample_sc16 * in, size_t num_samps, sample_sc16 * out);
+	size_t filter(const sample_sc16 * in, size_t num_samps, sample_sc16 * out);
+	void agc(sample_sc16 * data, size_t num_samps);
+
+	/// Current gain of the AGC
+	double get_agc_gain() const {return agc_gain / 65536.0;}
+
+private:
+	baseband_config config;
+	uint32_t nco_phase;			/// Phase of the NCO (2^32 = one turn)
+	uint32_t nco_step;			/// Phase increment per sample
+	pool_vector<q15_t>::type taps;	/// Quantised FIR coefficients
+	sc16_buffer delay;	/// Delay line, written twice so that the window is contiguous
+	size_t delay_pos;			/// Position of the next input in the delay line
+	size_t decim_phase;			/// Number of inputs since the last output
+	int32_t agc_gain;			/// Gain Q16.16
+	int32_t agc_max;			/// Maximum gain Q16.16
+	q15_t agc_ref;				/// Target level Q15
+	q31_t agc_level;			/// Average level Q31
+	sc16_buffer work;	/// Output of the mixer
+};
+
+
+/***********************************************************************//**
+Float chain, same structure and same configuration as baseband_q15
+
+The input sc16 samples are converted with the SIMD kernels and the
+output is relative to full scale (1.0 = 32768).
+
+***************************************************************************/
+class baseband_fc32
+{
+public:
+	typedef sample_fc32 output_type;
+
+	baseband_fc32();
+	void configure(const baseband_config & config);
+	void reset();
+	size_t process(const sample_sc16 * in, size_t num_samps, sample_fc32 * out);
+	size_t max_output(size_t num_samps) const {return num_samps / config.decimation + 1;}
+	static void magnitude(const sample_fc32 * in, size_t num_samps, float * out);
+
+	void mix(const sample_fc32 * in, size_t num_samps, sample_fc32 * out);
+	size_t filter(const sample_fc32 * in, size_t num_samps, sample_fc32 * out);
+	void agc(sample_fc32 * data, size_t num_samps);
+
+	double get_agc_gain() const {return agc_gain;}
+
+private:
+	baseband_config config;
+	uint32_t nco_phase;			/// Same phase accumulator as the fixed point NCO
+	uint32_t nco_step;
+	fc32_buffer taps;	/// FIR coefficients (as complex numbers, for the dot product kernel)
+	fc32_buffer delay;
+	size_t delay_pos;
+	size_t decim_phase;
+	float agc_gain;
+	float agc_level;
+	fc32_buffer work;
+};
+
+
+// Fixed point on the ARM targets without a fast FPU, float elsewhere
+#if defined(__arm__) && !defined(__aarch64__)
+typedef baseband_q15 baseband_chain;
+#else
+typedef baseband_fc32 baseband_chain;
+#endif
+
+
+#endif
@@ -0,0 +1,202 @@
+#include "baseband.h"
+#include "dsp_kernels.h"
+
+
+/***********************************************************************//**
+Windowed sinc low-pass filter (Hamming window) with a unit gain at DC
+
+@param num_taps Number of coefficients
+@param cutoff Cut-off frequency in Hz
+@param rate Sample rate in samples/s
+
+@return Coefficients
+
+***************************************************************************/
+
+std::vector<double> design_lowpass(size_t num_taps, double cutoff, double rate)
+{
+	std::vector<double> taps(num_taps);
+	double fc = cutoff / rate;
+	double middle = (num_taps - 1) / 2.0;
+	double sum = 0;
+	for(size_t index = 0; index < num_taps; index++)
+	{
+		double t = index - middle;
+		double sinc = t == 0 ? 2 * fc : sin(2 * M_PI * fc * t) / (M_PI * t);
+		double window = num_taps > 1 ? 0.54 - 0.46 * cos(2 * M_PI * index / (num_taps - 1)) : 1;
+		taps[index] = sinc * window;
+		sum += taps[index];
+	}
+	for(size_t index = 0; index < num_taps; index++)
+		taps[index] /= sum;
+	return taps;
+}
+
+
+/***********************************************************************//**
+Root raised cosine pulse with a unit energy, centred between the first
+and the last coefficient. The same filter shapes the symbols of the
+modulator and serves as the matched filter of the demodulator
+
+@param num_taps Number of coefficients
+@param sps Samples per symbol
+@param rolloff Excess bandwidth (0 .. 1)
+
+@return Coefficients
+
+***************************************************************************/
+
+std::vector<double> design_rrc(size_t num_taps, double sps, double rolloff)
+{
+	std::vector<double> taps(num_taps);
+	double middle = (num_taps - 1) / 2.0;
+	double energy = 0;
+	for(size_t index = 0; index < num_taps; index++)
+	{
+		// Time in symbols; the two singular points have their limits
+		double t = (index - middle) / sps;
+		double value;
+		if(fabs(t) < 1e-9)
+			value = 1 - rolloff + 4 * rolloff / M_PI;
+		else if(rolloff > 0 && fabs(fabs(4 * rolloff * t) - 1) < 1e-9)
+			value = rolloff / sqrt(2.0) * ((1 + 2 / M_PI) * sin(M_PI / (4 * rolloff)) + (1 - 2 / M_PI) * cos(M_PI / (4 * rolloff)));
+		else
+			value = (sin(M_PI * t * (1 - rolloff)) + 4 * rolloff * t * cos(M_PI * t * (1 + rolloff)))
+				/ (M_PI * t * (1 - 16 * rolloff * rolloff * t * t));
+		taps[index] = value;
+		energy += value * value;
+	}
+	double norm = energy > 0 ? 1 / sqrt(energy) : 1;
+	for(size_t index = 0; index < num_taps; index++)
+		taps[index] *= norm;
+	return taps;
+}
+
+
+baseband_fc32::baseband_fc32()
+:nco_phase(0), nco_step(0), delay_pos(0), decim_phase(0), agc_gain(1), agc_level(0)
+{
+}
+
+
+void baseband_fc32::configure(const baseband_config & cfg)
+{
+	config = cfg;
+	if(config.decimation == 0)
+		config.decimation = 1;
+	double turns = config.nco_freq / config.rate;
+	turns -= floor(turns);
+	nco_step = uint32_t(int64_t(floor(turns * 4294967296.0 + 0.5)));
+
+	taps.resize(config.taps.size());
+	for(size_t index = 0; index < taps.size(); index++)
+		taps[index] = sample_fc32(float(config.taps[taps.size() - 1 - index]), 0);
+	reset();
+}
+
+
+void baseband_fc32::reset()
+{
+	nco_phase = 0;
+	delay.assign(2 * taps.size(), sample_fc32(0, 0));
+	delay_pos = 0;
+	decim_phase = 0;
+	agc_gain = 1;
+	agc_level = 0;
+}
+
+
+size_t baseband_fc32::process(const sample_sc16 * in, size_t num_samps, sample_fc32 * out)
+{
+	if(work.size() < num_samps)
+		work.resize(num_samps);
+	dsp_sc16_to_fc32(in, &work[0], num_samps);
+	if(nco_step != 0)
+		mix(&work[0], num_samps, &work[0]);
+	size_t count = filter(&work[0], num_samps, out);
+	if(config.agc_enable)
+		agc(out, count);
+	return count;
+}
+
+
+/***********************************************************************//**
+Mixer. The phase of each block comes from the same accumulator as the
+fixed point NCO, so both chains stay aligned; inside the block the phasor
+is rotated in double precision.
+
+***************************************************************************/
+
+void baseband_fc32::mix(const sample_fc32 * in, size_t num_samps, sample_fc32 * out)
+{
+	const double turn = 2 * M_PI / 4294967296.0;
+	std::complex<double> phasor = std::polar(1.0, turn * nco_phase);
+	std::complex<double> step = std::polar(1.0, turn * nco_step);
+	for(size_t n = 0; n < num_samps; n++)
+	{
+		float c = float(phasor.real()), s = float(phasor.imag());
+		float i = in[n].real(), q = in[n].imag();
+		out[n] = sample_fc32(i * c - q * s, i * s + q * c);
+		phasor *= step;
+	}
+	nco_phase += uint32_t(nco_step * uint64_t(num_samps));
+}
+
+
+size_t baseband_fc32::filter(const sample_fc32 * in, size_t num_samps, sample_fc32 * out)
+{
+	size_t num_taps = taps.size();
+	size_t count = 0;
+	for(size_t n = 0; n < num_samps; n++)
+	{
+		if(num_taps)
+		{
+			delay[delay_pos] = in[n];
+			delay[delay_pos + num_taps] = in[n];
+			if(++delay_pos == num_taps)
+				delay_pos = 0;
+		}
+		if(++decim_phase < config.decimation)
+			continue;
+		decim_phase = 0;
+		if(num_taps == 0)
+			out[count++] = in[n];
+		else
+			out[count++] = dsp_fc32_dot(&delay[delay_pos], &taps[0], num_taps);
+	}
+	return count;
+}
+
+
+/// Same alpha max + beta min detector as the fixed point AGC
+static inline float fc32_level(float i, float q)
+{
+	i = fabsf(i);
+	q = fabsf(q);
+	float hi = i > q ? i : q;
+	float lo = i > q ? q : i;
+	return hi * (15.0f / 16) + lo * (15.0f / 32);
+}
+
+
+void baseband_fc32::agc(sample_fc32 * data, size_t num_samps)
+{
+	const float rate = ldexpf(1.0f, -config.agc_rate_shift);
+	const float reference = float(config.agc_reference);
+	const float max_gain = float(config.agc_max_gain);
+	for(size_t n = 0; n < num_samps; n++)
+	{
+		data[n] *= agc_gain;
+		agc_level += (fc32_level(data[n].real(), data[n].imag()) - agc_level) * (1.0f / 64);
+		agc_gain += agc_gain * (reference - agc_level) * rate;
+		agc_gain = agc_gain < 1.0f / 256 ? 1.0f / 256 : (agc_gain > max_gain ? max_gain : agc_gain);
+	}
+}
+
+
+void baseband_fc32::magnitude(const sample_fc32 * in, size_t num_samps, float * out)
+{
+	dsp_fc32_mag_squared(in, out, num_samps);
+	for(size_t n = 0; n < num_samps; n++)
+		out[n] = sqrtf(out[n]);
+}
@@ -0,0 +1,225 @@
+#include "baseband.h"
+#include <cstdlib>
+
+
+/// Q15 sine table of the NCO, filled on first use
+static q15_t nco_table[NCO_TABLE_SIZE];
+static bool nco_table_ready = false;
+
+static void init_nco_table()
+{
+	if(nco_table_ready)
+		return;
+	for(int index = 0; index < NCO_TABLE_SIZE; index++)
+		nco_table[index] = q15_t(lrint(Q15_MAX * sin(2 * M_PI * index / NCO_TABLE_SIZE)));
+	nco_table_ready = true;
+}
+
+
+/// Phase increment of the NCO for a frequency
+static uint32_t nco_step_for(double freq, double rate)
+{
+	double turns = freq / rate;
+	turns -= floor(turns);
+	return uint32_t(int64_t(floor(turns * 4294967296.0 + 0.5)));
+}
+
+
+baseband_q15::baseband_q15()
+:nco_phase(0), nco_step(0), delay_pos(0), decim_phase(0), agc_gain(65536), agc_max(65536), agc_ref(0), agc_level(0)
+{
+	init_nco_table();
+}
+
+
+/***********************************************************************//**
+Sets the parameters of the chain and resets its state
+
+@param cfg Configuration, shared with the float chain
+
+***************************************************************************/
+
+void baseband_q15::configure(const baseband_config & cfg)
+{
+	config = cfg;
+	if(config.decimation == 0)
+		config.decimation = 1;
+	nco_step = nco_step_for(config.nco_freq, config.rate);
+
+	// The coefficients are stored in reverse order, so that the filter is a
+	// dot product with the delay line taken from the oldest sample
+	taps.resize(config.taps.size());
+	for(size_t index = 0; index < taps.size(); index++)
+		taps[index] = q15_from_double(config.taps[taps.size() - 1 - index]);
+
+	agc_ref = q15_from_double(config.agc_reference);
+	double max_gain = config.agc_max_gain < 32767 ? config.agc_max_gain : 32767;
+	agc_max = int32_t(max_gain * 65536);
+	reset();
+}
+
+
+void baseband_q15::reset()
+{
+	nco_phase = 0;
+	delay.assign(2 * taps.size(), sample_sc16(0, 0));
+	delay_pos = 0;
+	decim_phase = 0;
+	agc_gain = 65536;
+	agc_level = 0;
+}
+
+
+/***********************************************************************//**
+Runs the whole chain on a block
+
+@param in Input samples
+@param num_samps Number of input samples
+@param out Receives the output, at most num_samps / decimation + 1 samples
+
+@return Number of output samples
+
+***************************************************************************/
+
+size_t baseband_q15::process(const sample_sc16 * in, size_t num_samps, sample_sc16 * out)
+{
+	const sample_sc16 * data = in;
+	if(nco_step != 0)
+	{
+		if(work.size() < num_samps)
+			work.resize(num_samps);
+		mix(in, num_samps, &work[0]);
+		data = &work[0];
+	}
+	size_t count = filter(data, num_samps, out);
+	if(config.agc_enable)
+		agc(out, count);
+	return count;
+}
+
+
+/***********************************************************************//**
+Mixer: multiplies the samples by exp(j * phase of the NCO)
+
+in and out may be the same buffer.
+
+***************************************************************************/
+
+void baseband_q15::mix(const sample_sc16 * in, size_t num_samps, sample_sc16 * out)
+{
+	const uint32_t round = uint32_t(1) << (31 - NCO_TABLE_BITS);
+	const uint32_t quarter = NCO_TABLE_SIZE / 4;
+	uint32_t phase = nco_phase;
+	for(size_t n = 0; n < num_samps; n++)
+	{
+		uint32_t index = (phase + round) >> (32 - NCO_TABLE_BITS);
+		int32_t s = nco_table[index & (NCO_TABLE_SIZE - 1)];
+		int32_t c = nco_table[(index + quarter) & (NCO_TABLE_SIZE - 1)];
+		int32_t i = in[n].real();
+		int32_t q = in[n].imag();
+		// |c| and |s| are at most 32767: the sums fit in 32 bits
+		int32_t re = i * c - q * s;
+		int32_t im = i * s + q * c;
+		out[n] = sample_sc16(q15_sat((re + (1 << 14)) >> 15), q15_sat((im + (1 << 14)) >> 15));
+		phase += nco_step;
+	}
+	nco_phase = phase;
+}
+
+
+/***********************************************************************//**
+FIR low-pass filter followed by the decimation. Only the samples kept by
+the decimation are computed.
+
+@return Number of output samples
+
+***************************************************************************/
+
+size_t baseband_q15::filter(const sample_sc16 * in, size_t num_samps, sample_sc16 * out)
+{
+	size_t num_taps = taps.size();
+	size_t count = 0;
+	for(size_t n = 0; n < num_samps; n++)
+	{
+		if(num_taps)
+		{
+			delay[delay_pos] = in[n];
+			delay[delay_pos + num_taps] = in[n];
+			if(++delay_pos == num_taps)
+				delay_pos = 0;
+		}
+		if(++decim_phase < config.decimation)
+			continue;
+		decim_phase = 0;
+		if(num_taps == 0)
+		{
+			out[count++] = in[n];
+			continue;
+		}
+		const sample_sc16 * window = &delay[delay_pos];
+		int64_t acc_i = 0, acc_q = 0;
+		for(size_t k = 0; k < num_taps; k++)
+		{
+			acc_i += int32_t(window[k].real()) * taps[k];
+			acc_q += int32_t(window[k].imag()) * taps[k];
+		}
+		out[count++] = sample_sc16(q15_from_q30(acc_i), q15_from_q30(acc_q));
+	}
+	return count;
+}
+
+
+/// Level of a sample: alpha max + beta min with alpha = 15/16, beta = 15/32,
+/// saturated to 32767 so that it can be shifted to Q31 (up to 46078 for I = Q)
+static inline int32_t q15_level(int32_t i, int32_t q)
+{
+	i = abs(i);
+	q = abs(q);
+	int32_t hi = i > q ? i : q;
+	int32_t lo = i > q ? q : i;
+	int32_t level = (hi * 15 >> 4) + (lo * 15 >> 5);
+	return level > Q15_MAX ? Q15_MAX : level;
+}
+
+
+/***********************************************************************//**
+AGC: scales the samples so that their average level reaches the
+reference. The gain follows the error of the level with a time constant
+of 2^agc_rate_shift samples.
+
+***************************************************************************/
+
+void baseband_q15::agc(sample_sc16 * data, size_t num_samps)
+{
+	const int shift = 15 + config.agc_rate_shift;
+	for(size_t n = 0; n < num_samps; n++)
+	{
+		int32_t i = q15_sat(int32_t((int64_t(data[n].real()) * agc_gain + (1 << 15)) >> 16));
+		int32_t q = q15_sat(int32_t((int64_t(data[n].imag()) * agc_gain + (1 << 15)) >> 16));
+		data[n] = sample_sc16(q15_t(i), q15_t(q));
+
+		// Average of the level in Q31, then correction of the gain
+		q31_t level = q15_level(i, q) << 16;
+		agc_level = q31_add(agc_level, (level - agc_level) >> 6);
+		int32_t error = agc_ref - (agc_level >> 16);
+		int64_t gain = agc_gain + ((int64_t(agc_gain) * error) >> shift);
+		agc_gain = int32_t(gain < 256 ? 256 : (gain > agc_max ? agc_max : gain));
+	}
+}
+
+
+/***********************************************************************//**
+Magnitude of the samples in Q15, saturated to 32767
+
+***************************************************************************/
+
+void baseband_q15::magnitude(const sample_sc16 * in, size_t num_samps, q15_t * out)
+{
+	for(size_t n = 0; n < num_samps; n++)
+	{
+		int32_t i = in[n].real();
+		int32_t q = in[n].imag();
+		uint32_t root = isqrt32(uint32_t(i * i) + uint32_t(q * q));
+		out[n] = q15_t(root > Q15_MAX ? Q15_MAX : root);
+	}
+}
@@ -0,0 +1,475 @@
+/***********************************************************************//**
+@file
+
+Measures the SNR lost by the fixed point baseband chain against the float
+one, and the throughput of both chains
+
+A tone is mixed down, filtered and decimated by both chains. The output
+SNR of each chain is measured against the float chain run on the same
+tone without noise, for several levels and input SNRs; the difference is
+the loss due to the fixed point arithmetic. The AGC of both chains is then
+compared on a long run: the gains must converge to the same value, also
+on a burst which follows silence and starts with saturated samples.
+Finally the host DDC (ddc_stage), which fuses the mixer with the
+decimating filter, is compared with the separate mixer and filter of the
+float chain, in blocks which are not a multiple of the decimation, and so
+are the polyphase decimator and every channel of the polyphase FFT
+channelizer (polyphase.h), and the overlap-save filter against the direct
+form with real and complex coefficients. The throughput of the direct
+form and of overlap-save are compared for several filter lengths.
+
+Usage: basebandsnr [-b dB] [-t seconds] [-l label] [-j file]
+
+-b maximum loss allowed in dB (default 0.5)
+-t measuring time of the throughput of each chain in seconds (default 0.5)
+-l label stored in the results (e.g. the release)
+-j file receiving the results, one JSON object per line (default baseband_bench.json)
+
+The exit code is 1 if the loss or the difference of the AGC gains exceeds
+the bound, or if the DDC, the polyphase filters or the overlap-save filter
+do not match the float chain.
+
+***************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "baseband.h"
+#include "ddc.h"
+#include "polyphase.h"
+#include "overlap_save.h"
+#include "dsp_kernels.h"
+#include "sim_source.h"
+#include "latency_stats.h"
+#include "bench_common.h"
+
+
+#define TEST_RATE 125000.0
+#define TEST_TONE 12500.0		/// Frequency of the tone at the input
+#define TEST_NCO -12000.0		/// Shift of the mixer: the tone ends at 500 Hz
+#define TEST_TAPS 63
+#define TEST_CUTOFF 5000.0
+#define TEST_DECIMATION 8
+#define BLOCK_SAMPS 4096
+#define DDC_MIN_SNR 55.0		/// Minimum SNR of the DDC against the float chain (NCO table spurs)
+#define PFB_MIN_SNR 80.0		/// Minimum SNR of the polyphase filters against the float chain
+#define PFB_CHANNELS 8
+#define OLS_MIN_SNR 80.0		/// Minimum SNR of the overlap-save filter against the direct form
+
+
+static baseband_config test_config(bool agc)
+{
+	baseband_config config;
+	config.rate = TEST_RATE;
+	config.nco_freq = TEST_NCO;
+	config.taps = design_lowpass(TEST_TAPS, TEST_CUTOFF, TEST_RATE);
+	config.decimation = TEST_DECIMATION;
+	config.agc_enable = agc;
+	return config;
+}
+
+
+/// Generates a tone at the given level (relative to full scale) and noise
+static void make_input(std::vector<sample_sc16> & samples, size_t num_samps, double amplitude, double noise_rms, unsigned seed)
+{
+	sim_config config;
+	config.rate = TEST_RATE;
+	sim_tone tone = {TEST_TONE, amplitude};
+	config.tones.push_back(tone);
+	config.noise_rms = noise_rms;
+	config.seed = seed;
+	sim_source source(config);
+	source.start(num_samps);
+	samples.resize(num_samps);
+	source.generate(&samples[0], num_samps);
+}
+
+
+/// Runs a chain block by block, like the sampling task does
+template <typename C>
+static void run_chain(C & chain, const std::vector<sample_sc16> & in, std::vector<sample_fc32> & out, size_t block_samps = BLOCK_SAMPS)
+{
+	std::vector<typename C::output_type> block(chain.max_output(block_samps));
+	out.clear();
+	for(size_t start = 0; start < in.size(); start += block_samps)
+	{
+		size_t num_samps = in.size() - start < block_samps ? in.size() - start : block_samps;
+		size_t count = chain.process(&in[start], num_samps, &block[0]);
+		for(size_t n = 0; n < count; n++)
+			out.push_back(sample_fc32(block[n].real(), block[n].imag()));
+	}
+}
+
+
+/***********************************************************************//**
+SNR of a signal against a reference, after the best complex gain is
+applied to the reference
+
+@param signal Measured signal
+@param ref Reference
+@param first First sample compared (skips the transients)
+
+@return SNR in dB
+
+***************************************************************************/
+
+static double snr_db(const std::vector<sample_fc32> & signal, const std::vector<sample_fc32> & ref, size_t first)
+{
+	std::complex<double> cross(0, 0);
+	double ref_power = 0;
+	for(size_t n = first; n < signal.size() && n < ref.size(); n++)
+	{
+		cross += std::complex<double>(signal[n]) * std::conj(std::complex<double>(ref[n]));
+		ref_power += std::norm(std::complex<double>(ref[n]));
+	}
+	std::complex<double> gain = cross / ref_power;
+	double error_power = 0;
+	for(size_t n = first; n < signal.size() && n < ref.size(); n++)
+		error_power += std::norm(std::complex<double>(signal[n]) - gain * std::complex<double>(ref[n]));
+	return 10 * log10(std::norm(gain) * ref_power / error_power);
+}
+
+
+/// Throughput of a chain in millions of input samples per second
+template <typename C>
+static double bench_chain(C & chain, const std::vector<sample_sc16> & in, double seconds)
+{
+	std::vector<typename C::output_type> block(chain.max_output(BLOCK_SAMPS));
+	uint64_t samples = 0;
+	uint64_t start = monotonic_ns();
+	uint64_t end = start + uint64_t(seconds * 1e9);
+	uint64_t now = start;
+	while(now < end)
+	{
+		for(size_t offset = 0; offset + BLOCK_SAMPS <= in.size(); offset += BLOCK_SAMPS)
+		{
+			chain.process(&in[offset], BLOCK_SAMPS, &block[0]);
+			samples += BLOCK_SAMPS;
+		}
+		now = monotonic_ns();
+	}
+	bench_sink = block[0].real();
+	return samples / ((now - start) * 1e-9) * 1e-6;
+}
+
+
+int main(int argc, char ** argv)
+{
+	double bound = 0.5;
+	bench_context bench("baseband_bench.json", 0.5);
+	for(int index = 1; index < argc; index++)
+	{
+		if(strcmp(argv[index], "-b") == 0 && index + 1 < argc)
+			bound = atof(argv[++index]);
+		else if(bench.parse_option(argc, argv, index))
+		{
+			std::cout << "Usage: basebandsnr [-b dB] [-t seconds] [-l label] [-j file]" << std::endl;
+			return 1;
+		}
+	}
+
+	if(bench.open())
+		return 1;
+
+	// SNR without the AGC, so that both chains see the same gain
+	const size_t num_samps = 1 << 17;
+	const size_t first = 2 * TEST_TAPS;
+	const double levels[] = {-6, -30};
+	const double input_snrs[] = {0, 10, 20, 30, 40};
+	baseband_config config = test_config(false);
+	printf("%8s %10s %10s %10s %10s %10s\n", "dBFS", "in SNR", "fc32 SNR", "q15 SNR", "loss", "impl SNR");
+	for(size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++)
+	{
+		double amplitude = pow(10, levels[l] / 20);
+		std::vector<sample_sc16> clean;
+		std::vector<sample_fc32> ref;
+		make_input(clean, num_samps, amplitude, 0, 1);
+		baseband_fc32 ref_chain;
+		ref_chain.configure(config);
+		run_chain(ref_chain, clean, ref);
+
+		for(size_t s = 0; s < sizeof(input_snrs) / sizeof(input_snrs[0]); s++)
+		{
+			std::vector<sample_sc16> noisy;
+			make_input(noisy, num_samps, amplitude, amplitude * pow(10, -input_snrs[s] / 20), 1);
+			baseband_fc32 float_chain;
+			baseband_q15 fixed_chain;
+			float_chain.configure(config);
+			fixed_chain.configure(config);
+			std::vector<sample_fc32> float_out, fixed_out;
+			run_chain(float_chain, noisy, float_out);
+			run_chain(fixed_chain, noisy, fixed_out);
+			for(size_t n = 0; n < fixed_out.size(); n++)
+				fixed_out[n] /= float(Q15_ONE);
+
+			double float_snr = snr_db(float_out, ref, first);
+			double fixed_snr = snr_db(fixed_out, ref, first);
+			double impl_snr = snr_db(fixed_out, float_out, first);
+			double loss = float_snr - fixed_snr;
+			bool failed = loss > bound;
+			bench.errors += failed;
+			printf("%8.0f %10.0f %10.2f %10.2f %10.3f %10.2f%s\n", levels[l], input_snrs[s], float_snr, fixed_snr, loss, impl_snr,
+				failed ? "  FAILED" : "");
+			fprintf(bench.record("baseband_snr"), "\"level_dbfs\":%.0f,\"input_snr\":%.0f,"
+				"\"snr_fc32\":%.2f,\"snr_q15\":%.2f,\"loss_db\":%.3f,\"impl_snr\":%.2f}\n",
+				levels[l], input_snrs[s], float_snr, fixed_snr, loss, impl_snr);
+		}
+	}
+
+	// AGC: both gains must settle to the same value
+	{
+		baseband_config agc_config = test_config(true);
+		std::vector<sample_sc16> input;
+		make_input(input, 1 << 20, 0.03, 0.003, 2);
+		baseband_fc32 float_chain;
+		baseband_q15 fixed_chain;
+		float_chain.configure(agc_config);
+		fixed_chain.configure(agc_config);
+		std::vector<sample_fc32> float_out, fixed_out;
+		run_chain(float_chain, input, float_out);
+		run_chain(fixed_chain, input, fixed_out);
+		for(size_t n = 0; n < fixed_out.size(); n++)
+			fixed_out[n] /= float(Q15_ONE);
+		double difference = 20 * log10(fixed_chain.get_agc_gain() / float_chain.get_agc_gain());
+		double impl_snr = snr_db(fixed_out, float_out, fixed_out.size() / 2);
+		bool failed = fabs(difference) > bound;
+		bench.errors += failed;
+		printf("AGC gain fc32 %.3f q15 %.3f (%+.3f dB), implementation SNR %.2f dB%s\n", float_chain.get_agc_gain(),
+			fixed_chain.get_agc_gain(), difference, impl_snr, failed ? "  FAILED" : "");
+		fprintf(bench.record("baseband_agc"), "\"gain_fc32\":%.4f,\"gain_q15\":%.4f,\"impl_snr\":%.2f}\n",
+			float_chain.get_agc_gain(), fixed_chain.get_agc_gain(), impl_snr);
+	}
+
+	// AGC on a burst after silence: the gain is at its maximum when the burst
+	// starts, so the first outputs saturate with I = Q. The AGC must recover
+	// and settle to the gain of the float chain
+	{
+		baseband_config agc_config = test_config(true);
+		std::vector<sample_sc16> input(1 << 16, sample_sc16(0, 0));
+		std::vector<sample_sc16> burst;
+		make_input(burst, 1 << 19, 0.25, 0.003, 7);
+		input.insert(input.end(), burst.begin(), burst.end());
+		baseband_fc32 float_chain;
+		baseband_q15 fixed_chain;
+		float_chain.configure(agc_config);
+		fixed_chain.configure(agc_config);
+		std::vector<sample_fc32> float_out, fixed_out;
+		run_chain(float_chain, input, float_out);
+		run_chain(fixed_chain, input, fixed_out);
+		size_t clipped = 0;
+		for(size_t n = fixed_out.size() / 2; n < fixed_out.size(); n++)
+			clipped += fabs(fixed_out[n].real()) >= Q15_MAX || fabs(fixed_out[n].imag()) >= Q15_MAX;
+		double difference = 20 * log10(fixed_chain.get_agc_gain() / float_chain.get_agc_gain());
+		bool failed = fabs(difference) > bound || clipped;
+		bench.errors += failed;
+		printf("AGC after silence: gain fc32 %.3f q15 %.3f (%+.3f dB), %zu clipped samples at the end%s\n",
+			float_chain.get_agc_gain(), fixed_chain.get_agc_gain(), difference, clipped, failed ? "  FAILED" : "");
+		fprintf(bench.record("baseband_agc_burst"), "\"gain_fc32\":%.4f,\"gain_q15\":%.4f,\"clipped\":%zu}\n",
+			float_chain.get_agc_gain(), fixed_chain.get_agc_gain(), clipped);
+	}
+
+	// DDC against the mixer and the filter of the float chain, then after a
+	// frequency correction in the middle of the stream
+	{
+		baseband_config config = test_config(false);
+		std::vector<sample_sc16> input;
+		make_input(input, 1 << 17, 0.25, 0.01, 4);
+		baseband_fc32 float_chain;
+		float_chain.configure(config);
+		ddc_stage ddc(TEST_RATE, TEST_DECIMATION, config.taps);
+		ddc.set_frequency(TEST_NCO);
+		std::vector<sample_fc32> float_out, ddc_out;
+		run_chain(float_chain, input, float_out);
+		run_chain(ddc, input, ddc_out, 1001);
+		double ddc_snr = snr_db(ddc_out, float_out, first);
+
+		config.nco_freq = TEST_NCO - 250;
+		float_chain.configure(config);
+		// The DDC keeps its phase and its history: the fit of snr_db() absorbs the phase offset
+		ddc.set_frequency(config.nco_freq);
+		run_chain(float_chain, input, float_out);
+		run_chain(ddc, input, ddc_out, 1001);
+		double retuned_snr = snr_db(ddc_out, float_out, first);
+
+		bool failed = ddc_snr < DDC_MIN_SNR || retuned_snr < DDC_MIN_SNR;
+		bench.errors += failed;
+		printf("DDC against mixer + filter: SNR %.2f dB, %.2f dB after a correction of -250 Hz%s\n", ddc_snr, retuned_snr,
+			failed ? "  FAILED" : "");
+		fprintf(bench.record("ddc_check"), "\"snr\":%.2f,\"retuned_snr\":%.2f}\n", ddc_snr, retuned_snr);
+	}
+
+	// Polyphase decimator and channelizer against the mixer and the filter,
+	// with a tone in some of the channels
+	std::vector<double> pfb_taps = design_lowpass(8 * PFB_CHANNELS, 0.5 * TEST_RATE / PFB_CHANNELS, TEST_RATE);
+	{
+		sim_config sim;
+		sim.rate = TEST_RATE;
+		sim.noise_rms = 0.01;
+		sim.seed = 5;
+		sim_tone tones[] = {{1000, 0.1}, {TEST_RATE / PFB_CHANNELS + 2000, 0.1}, {-2 * TEST_RATE / PFB_CHANNELS - 500, 0.05}};
+		sim.tones.assign(tones, tones + 3);
+		sim_source source(sim);
+		source.start(1 << 16);
+		std::vector<sample_sc16> input(1 << 16);
+		source.generate(&input[0], input.size());
+
+		baseband_config config = test_config(false);
+		config.taps = pfb_taps;
+		config.decimation = PFB_CHANNELS;
+		config.nco_freq = 0;
+		baseband_fc32 float_chain;
+		float_chain.configure(config);
+		pfb_decimator decimator;
+		decimator.configure(PFB_CHANNELS, pfb_taps);
+		std::vector<sample_fc32> float_out, pfb_out;
+		run_chain(float_chain, input, float_out);
+		pfb_out.resize(decimator.max_output(input.size()));
+		pfb_out.resize(decimator.process(&input[0], input.size(), &pfb_out[0]));
+		double worst = snr_db(pfb_out, float_out, first);
+		printf("Polyphase decimator against the filter: SNR %.2f dB\n", worst);
+
+		pfb_channelizer channelizer;
+		channelizer.configure(TEST_RATE, PFB_CHANNELS, pfb_taps);
+		std::vector<std::vector<sample_fc32> > channels(PFB_CHANNELS);
+		std::vector<sample_fc32 *> outputs(PFB_CHANNELS);
+		size_t count = 0;
+		for(size_t c = 0; c < PFB_CHANNELS; c++)
+			channels[c].resize(channelizer.max_output(input.size()));
+		for(size_t start = 0; start < input.size(); start += 1001)
+		{
+			for(size_t c = 0; c < PFB_CHANNELS; c++)
+				outputs[c] = &channels[c][count];
+			count += channelizer.process(&input[start], input.size() - start < 1001 ? input.size() - start : 1001, &outputs[0]);
+		}
+		printf("Channelizer against mixer + filter, SNR per channel:");
+		for(size_t c = 0; c < PFB_CHANNELS; c++)
+		{
+			channels[c].resize(count);
+			config.nco_freq = -channelizer.get_channel_freq(c);
+			float_chain.configure(config);
+			run_chain(float_chain, input, float_out);
+			double snr = snr_db(channels[c], float_out, first);
+			printf(" %.1f", snr);
+			worst = snr < worst ? snr : worst;
+		}
+		bool failed = worst < PFB_MIN_SNR;
+		bench.errors += failed;
+		printf(" dB%s\n", failed ? "  FAILED" : "");
+		fprintf(bench.record("pfb_check"), "\"channels\":%d,\"worst_snr\":%.2f}\n", PFB_CHANNELS, worst);
+	}
+
+	// Overlap-save against the direct form, with a long low-pass filter then
+	// with complex coefficients (a matched filter of random QPSK symbols)
+	{
+		std::vector<sample_sc16> input;
+		make_input(input, 1 << 16, 0.25, 0.05, 6);
+		baseband_config config = test_config(false);
+		config.taps = design_lowpass(257, 3000, TEST_RATE);
+		config.decimation = 1;
+		config.nco_freq = 0;
+		baseband_fc32 direct;
+		direct.configure(config);
+		overlap_save_filter ols;
+		ols.configure(config.taps);
+		std::vector<sample_fc32> direct_out, ols_out;
+		run_chain(direct, input, direct_out);
+		run_chain(ols, input, ols_out, 1001);
+		double real_snr = snr_db(ols_out, direct_out, 0);
+
+		std::vector<sample_fc32> taps(100);
+		for(size_t k = 0; k < taps.size(); k++)
+			taps[k] = sample_fc32((k * 7 % 3) ? 0.1f : -0.1f, (k * 5 % 7) < 3 ? 0.1f : -0.1f);
+		ols.configure(taps);
+		run_chain(ols, input, ols_out, 777);
+		direct_out.resize(8192);
+		for(size_t n = 0; n < direct_out.size(); n++)
+		{
+			sample_fc32 sum(0, 0);
+			for(size_t k = 0; k < taps.size() && k <= n; k++)
+				sum += taps[k] * sample_fc32(input[n - k].real() / 32768.0f, input[n - k].imag() / 32768.0f);
+			direct_out[n] = sum;
+		}
+		double complex_snr = snr_db(ols_out, direct_out, 0);
+
+		bool failed = real_snr < OLS_MIN_SNR || complex_snr < OLS_MIN_SNR;
+		bench.errors += failed;
+		printf("Overlap-save against the direct form: SNR %.2f dB (257 real taps, FFT %zu), %.2f dB (100 complex taps, FFT %zu)%s\n",
+			real_snr, overlap_save_filter::choose_fft_size(257), complex_snr, ols.get_fft_size(), failed ? "  FAILED" : "");
+		fprintf(bench.record("ols_check"), "\"real_snr\":%.2f,\"complex_snr\":%.2f}\n", real_snr, complex_snr);
+	}
+
+	// Throughput of the whole chain with the AGC
+	{
+		baseband_config agc_config = test_config(true);
+		std::vector<sample_sc16> input;
+		make_input(input, 16 * BLOCK_SAMPS, 0.25, 0.01, 3);
+		baseband_fc32 float_chain;
+		baseband_q15 fixed_chain;
+		float_chain.configure(agc_config);
+		fixed_chain.configure(agc_config);
+		double float_msps = bench_chain(float_chain, input, bench.seconds);
+		double fixed_msps = bench_chain(fixed_chain, input, bench.seconds);
+		printf("Throughput (%d taps, decimation %d): fc32 %.2f MS/s, q15 %.2f MS/s (%s kernels)\n", TEST_TAPS, TEST_DECIMATION,
+			float_msps, fixed_msps, dsp_kernels().name);
+		fprintf(bench.record("baseband"), "\"chain\":\"fc32\",\"isa\":\"%s\",\"msps\":%.2f}\n", dsp_kernels().name, float_msps);
+		fprintf(bench.record("baseband"), "\"chain\":\"q15\",\"msps\":%.2f}\n", fixed_msps);
+
+		ddc_stage ddc(TEST_RATE, TEST_DECIMATION, agc_config.taps);
+		ddc.set_frequency(TEST_NCO);
+		double ddc_msps = bench_chain(ddc, input, bench.seconds);
+		printf("Throughput of the DDC (mixer fused with the filter): %.2f MS/s\n", ddc_msps);
+		fprintf(bench.record("baseband"), "\"chain\":\"ddc\",\"isa\":\"%s\",\"msps\":%.2f}\n", dsp_kernels().name, ddc_msps);
+
+		// All the channels at once, against one DDC per channel
+		pfb_channelizer channelizer;
+		channelizer.configure(TEST_RATE, PFB_CHANNELS, pfb_taps);
+		std::vector<std::vector<sample_fc32> > channels(PFB_CHANNELS, std::vector<sample_fc32>(channelizer.max_output(BLOCK_SAMPS)));
+		std::vector<sample_fc32 *> outputs(PFB_CHANNELS);
+		for(size_t c = 0; c < PFB_CHANNELS; c++)
+			outputs[c] = &channels[c][0];
+		uint64_t samples = 0;
+		uint64_t start = monotonic_ns();
+		uint64_t now = start;
+		while(now < start + uint64_t(bench.seconds * 1e9))
+		{
+			for(size_t offset = 0; offset + BLOCK_SAMPS <= input.size(); offset += BLOCK_SAMPS)
+			{
+				channelizer.process(&input[offset], BLOCK_SAMPS, &outputs[0]);
+				samples += BLOCK_SAMPS;
+			}
+			now = monotonic_ns();
+		}
+		double pfb_msps = samples / ((now - start) * 1e-9) * 1e-6;
+		ddc_stage channel_ddc(TEST_RATE, PFB_CHANNELS, pfb_taps);
+		double one_channel = bench_chain(channel_ddc, input, bench.seconds);
+		printf("Throughput of the %d channels: channelizer %.2f MS/s, one DDC per channel %.2f MS/s\n", PFB_CHANNELS,
+			pfb_msps, one_channel / PFB_CHANNELS);
+		fprintf(bench.record("baseband"), "\"chain\":\"channelizer\",\"channels\":%d,\"msps\":%.2f,\"ddc_msps\":%.2f}\n",
+			PFB_CHANNELS, pfb_msps, one_channel / PFB_CHANNELS);
+
+		// Direct form against overlap-save, without decimation
+		printf("%-10s %10s %10s %10s %8s\n", "taps", "FFT", "direct", "overlap", "speedup");
+		const size_t lengths[] = {16, 32, 64, 128, 256, 512};
+		for(size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+		{
+			baseband_config config = test_config(false);
+			config.taps = design_lowpass(lengths[l], 3000, TEST_RATE);
+			config.decimation = 1;
+			config.nco_freq = 0;
+			baseband_fc32 direct;
+			direct.configure(config);
+			overlap_save_filter ols;
+			ols.configure(config.taps);
+			double direct_msps = bench_chain(direct, input, bench.seconds / 2);
+			double ols_msps = bench_chain(ols, input, bench.seconds / 2);
+			printf("%-10zu %10zu %10.2f %10.2f %7.1fx\n", lengths[l], ols.get_fft_size(), direct_msps, ols_msps, ols_msps / direct_msps);
+			fprintf(bench.record("fir"), "\"taps\":%zu,\"fft\":%zu,\"direct_msps\":%.2f,\"ols_msps\":%.2f}\n",
+				lengths[l], ols.get_fft_size(), direct_msps, ols_msps);
+		}
+	}
+
+	return bench.finish("Fixed point chain within the bound");
+}
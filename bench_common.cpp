@@ -0,0 +1,130 @@
+#include "bench_common.h"
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+
+
+static uint32_t rng_state = 1;
+
+volatile float bench_sink;
+
+
+uint32_t bench_random()
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+
+void bench_seed(uint32_t seed)
+{
+	rng_state = seed ? seed : 1;
+}
+
+
+/***********************************************************************//**
+Constructor
+
+@param default_json Results file used without -j
+@param default_seconds Measuring time used without -t. Negative if the
+program does not accept -t
+
+***************************************************************************/
+
+bench_context::bench_context(const char * default_json, double default_seconds)
+:seconds(default_seconds), label(""), json_name(default_json), json(NULL), date(0), errors(0)
+{
+	memset(host, 0, sizeof(host));
+}
+
+
+bench_context::~bench_context()
+{
+	if(json)
+		fclose(json);
+}
+
+
+/***********************************************************************//**
+Parses one of the common options -t, -l and -j
+
+@param index Index of the option in argv, moved to its value if it has one
+
+@return true if argv[index] is not a common option or lacks its value,
+false otherwise
+
+***************************************************************************/
+
+bool bench_context::parse_option(int argc, char ** argv, int & index)
+{
+	if(index + 1 >= argc)
+		return true;
+	if(strcmp(argv[index], "-t") == 0 && seconds >= 0)
+		seconds = atof(argv[++index]);
+	else if(strcmp(argv[index], "-l") == 0)
+		label = argv[++index];
+	else if(strcmp(argv[index], "-j") == 0)
+		json_name = argv[++index];
+	else
+		return true;
+	return false;
+}
+
+
+/***********************************************************************//**
+Opens the results file for appending and notes the host and the date
+
+@return true if the file could not be opened, false otherwise
+
+***************************************************************************/
+
+bool bench_context::open()
+{
+	json = fopen(json_name, "a");
+	if(json == NULL)
+	{
+		std::cout << "Can not open " << json_name << std::endl;
+		return true;
+	}
+	gethostname(host, sizeof(host) - 1);
+	date = time(NULL);
+	return false;
+}
+
+
+/***********************************************************************//**
+Starts a line of results with the fields common to every line
+
+@param bench Name of the measurement
+
+@return File receiving the other fields of the line
+
+***************************************************************************/
+
+FILE * bench_context::record(const char * bench)
+{
+	fprintf(json, "{\"bench\":\"%s\",\"label\":\"%s\",\"host\":\"%s\",\"date\":%ld,", bench, label, host, long(date));
+	return json;
+}
+
+
+/***********************************************************************//**
+Prints the summary of the run and closes the results file
+
+@param success Summary printed when every check passed
+
+@return Exit code of the program: 1 if a check failed, 0 otherwise
+
+***************************************************************************/
+
+int bench_context::finish(const char * success)
+{
+	printf("%s, results appended to %s\n", errors ? "FAILED" : success, json_name);
+	if(json)
+		fclose(json);
+	json = NULL;
+	return errors ? 1 : 0;
+}
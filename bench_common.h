@@ -0,0 +1,69 @@
+/***********************************************************************//**
+@file
+
+Helpers shared by the benchmark programs
+
+Every benchmark accepts -l and -j, most of them -t, and appends its
+results to a file, one JSON object per line, each object starting with
+the name of the measurement, the label, the host and the date of the run.
+bench_context parses these options, opens the file, writes the common
+fields and counts the failed checks. The random generator and the sink
+are the same in every program, so that the inputs do not depend on the
+machine.
+
+
+***************************************************************************/
+
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <cstdio>
+#include <ctime>
+#include <stdint.h>
+
+
+/// xorshift32 generator, identical results on every machine. Seeded with 1
+uint32_t bench_random();
+/// Restarts the sequence of bench_random()
+void bench_seed(uint32_t seed);
+
+/// Volatile sink which keeps the results of the benchmarks alive
+extern volatile float bench_sink;
+
+
+/***********************************************************************//**
+Options and results file of a benchmark program
+
+main() passes each argument to parse_option() after its own options, then
+calls open(). record() starts a JSON line with the common fields and
+returns the file for the fields of the measurement, ending with "}\n".
+finish() prints the summary line and gives the exit code: 1 if a check
+failed.
+
+***************************************************************************/
+class bench_context
+{
+public:
+	bench_context(const char * json_name, double seconds = -1);
+	~bench_context();
+
+	bool parse_option(int argc, char ** argv, int & index);
+	bool open();
+	FILE * record(const char * bench);
+	int finish(const char * success);
+
+	double seconds;				/// Measuring time given with -t. Negative if the program has no -t option
+	const char * label;			/// Label given with -l (e.g. the release)
+	const char * json_name;		/// Results file given with -j
+	FILE * json;				/// Results file, open between open() and finish()
+	char host[64];				/// Name of the machine
+	time_t date;				/// Start of the run
+	int errors;					/// Number of failed checks
+
+private:
+	bench_context(const bench_context &);
+	bench_context & operator=(const bench_context &);
+};
+
+
+#endif
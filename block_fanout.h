@@ -0,0 +1,721 @@
+/***********************************************************************//**
+@file
+
+Pool of reference counted sample blocks published to several consumers
+
+The sampling task fills each block once with recv() and publishes it to
+every subscriber (consumer thread, capture writer, monitors): each
+subscriber has its own single producer / single consumer queue of
+pointers to the shared blocks, so the samples are never copied. A block
+goes back to the pool when the last subscriber releases it.
+
+When the queue of a subscriber is full, its policy decides:
+
+- FANOUT_DROP: the block is not given to this subscriber, which only
+  loses this block, and its drop counter is incremented
+- FANOUT_BLOCK: the producer waits until the subscriber releases a block
+  (or closes its subscription), and the time spent waiting is counted
+
+If every block of the pool is in use, the producer gets the spill block
+instead, which is never published, and the overrun counter is
+incremented, as with sample_ring. reset() sizes the pool after the
+queues of the subscribers so that this only happens if a consumer keeps
+a block it has released.
+
+***************************************************************************/
+
+#ifndef BLOCK_FANOUT_H
+#define BLOCK_FANOUT_H
+
+#include <atomic>
+#include <vector>
+#include <ostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <stdint.h>
+#include "sample_ring.h"
+
+/// Index of no block in the free stack
+#define FANOUT_NONE 0xffffffffu
+/// Sleep of the producer waiting for a FANOUT_BLOCK subscriber in us
+#define FANOUT_BLOCK_WAIT_US 20
+
+
+/// What the producer does when the queue of a subscriber is full
+enum fanout_policy
+{
+	FANOUT_DROP,		/// The subscriber misses the block
+	FANOUT_BLOCK		/// The producer waits for the subscriber
+};
+
+
+/***********************************************************************//**
+Block of the pool: a sample_block shared by the subscribers
+
+***************************************************************************/
+template <typename T>
+struct shared_block : public sample_block<T>
+{
+	std::atomic<unsigned> refs;	/// Subscribers which have not released the block
+	uint32_t index;				/// Slot of the block in the pool
+	uint32_t next_free;			/// Next block of the free stack
+};
+
+
+template <typename T>
+class block_fanout;
+
+
+/***********************************************************************//**
+Subscription of one consumer to a block_fanout
+
+The consumer functions (try_read, wait_read, release) are called by the
+consumer thread only. The blocks are read in order: try_read() returns
+the oldest block not yet released.
+
+***************************************************************************/
+template <typename T>
+class fanout_subscriber
+{
+public:
+	typedef shared_block<T> block_t;
+
+	~fanout_subscriber();
+
+	const block_t * try_read();
+	const block_t * wait_read(int timeout_ms = -1);
+	void release();
+	/// Ends the subscription: the producer stops sending blocks and wait_read() returns NULL once the queue is empty
+	void close();
+
+	const char * get_name() const {return name;}
+	fanout_policy get_policy() const {return policy;}
+	/// Changes the policy. Only while the producer is not running
+	void set_policy(fanout_policy queue_policy) {policy = queue_policy;}
+	/// True if the blocks of zero samples filling a gap are given to this subscriber
+	bool get_zero_fill() const {return zero_fill;}
+	bool is_closed() const {return closed.load(std::memory_order_acquire);}
+	/// Number of slots of the queue
+	size_t size() const {return num_slots;}
+	/// Number of blocks queued and not yet released
+	size_t depth() const {return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);}
+	/// Size of the blocks in samples
+	size_t block_size() const;
+	/// Number of blocks given to the subscriber
+	uint64_t get_delivered() const {return delivered.load(std::memory_order_relaxed);}
+	/// Number of blocks missed because the queue was full (FANOUT_DROP)
+	uint64_t get_drops() const {return drops.load(std::memory_order_relaxed);}
+	/// Time the producer waited for a free slot in ns (FANOUT_BLOCK)
+	uint64_t get_blocked_ns() const {return blocked_ns.load(std::memory_order_relaxed);}
+	/// Largest number of queued blocks seen by the producer
+	size_t get_max_depth() const {return max_depth.load(std::memory_order_relaxed);}
+
+private:
+	friend class block_fanout<T>;
+	fanout_subscriber(block_fanout<T> & fanout, const char * name, size_t num_slots, fanout_policy policy, bool zero_fill);
+	fanout_subscriber(const fanout_subscriber &);
+	fanout_subscriber & operator=(const fanout_subscriber &);
+
+	bool push(block_t * block);
+	void notify_consumer();
+	void reset();
+
+	block_fanout<T> & fanout;
+	const char * name;
+	fanout_policy policy;
+	bool zero_fill;
+	size_t num_slots;			/// Number of slots (power of two)
+	size_t mask;
+	block_t ** slots;			/// Queued blocks
+
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> head;	/// Count of pushed blocks (written by the producer)
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail;	/// Count of released blocks (written by the consumer)
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> delivered;
+	std::atomic<uint64_t> drops;
+	std::atomic<uint64_t> blocked_ns;
+	std::atomic<size_t> max_depth;
+	std::atomic<bool> closed;
+	std::atomic<bool> consumer_waiting;
+	pthread_mutex_t wait_mutex;
+	pthread_cond_t wait_cond;
+};
+
+
+/***********************************************************************//**
+Pool of shared blocks and its subscribers
+
+The subscribers are added with subscribe() before the producer starts.
+Exactly one thread calls the producer functions (acquire_write, publish,
+publish_zeros_before, close). The blocks come back to the pool from the
+consumer threads through a lock-free stack which only the producer pops,
+so it has no ABA problem.
+
+***************************************************************************/
+template <typename T>
+class block_fanout
+{
+public:
+	typedef T value_type;
+	typedef shared_block<T> block_t;
+	typedef fanout_subscriber<T> subscriber_t;
+
+	block_fanout(size_t num_blocks, size_t samps_per_block);
+	~block_fanout();
+
+	subscriber_t & subscribe(const char * name, size_t num_slots, fanout_policy policy = FANOUT_DROP, bool zero_fill = true);
+
+	// Producer side
+	block_t * acquire_write();
+	void publish();
+	size_t publish_zeros_before(size_t count, double rate);
+	/// Closes every subscription: the consumers finish the queued blocks then get NULL
+	void close();
+	/// Sizes the pool, empties the queues and returns every block to the pool. Must be called before the producer starts
+	void reset();
+
+	/// True once close() has been called
+	bool is_closed() const {return closed.load(std::memory_order_acquire);}
+	/// Number of blocks of the pool
+	size_t size() const {return num_blocks;}
+	/// Number of samples in each block
+	size_t block_size() const {return samps_per_block;}
+	size_t get_num_subscribers() const {return subscribers.size();}
+	subscriber_t & get_subscriber(size_t index) const {return *subscribers[index];}
+	/// Number of blocks published
+	uint64_t get_published() const {return published.load(std::memory_order_relaxed);}
+	/// Number of blocks lost because every block of the pool was in use
+	uint64_t get_overruns() const {return overruns.load(std::memory_order_relaxed);}
+	size_t count_free() const;
+	void print_stats(std::ostream & os) const;
+
+private:
+	friend class fanout_subscriber<T>;
+	block_fanout(const block_fanout &);
+	block_fanout & operator=(const block_fanout &);
+
+	void allocate(size_t count);
+	block_t * pop_free();
+	void recycle(block_t * block);
+	void unref(block_t * block)
+	{
+		if(block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			recycle(block);
+	}
+	void deliver(block_t * block, bool fill);
+
+	size_t num_blocks;
+	size_t min_blocks;			/// Size requested at construction
+	size_t samps_per_block;
+	block_t * blocks;			/// Array of num_blocks blocks
+	block_t spill;				/// Block used by the producer when the pool is empty
+	T * storage;				/// Single allocation holding the samples of all the blocks, from the block_pool
+	size_t storage_bytes;		/// Size of the allocation
+	block_t * pending;			/// Block returned by acquire_write() and not yet published, NULL for the spill block
+	std::vector<subscriber_t *> subscribers;
+
+	alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> free_head;	/// Top of the free stack (pushed by every thread)
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> published;
+	std::atomic<uint64_t> overruns;
+	std::atomic<bool> closed;
+};
+
+
+/***********************************************************************//**
+Constructor: The blocks are allocated by the first reset(), once the
+subscribers are known
+
+@param num_blocks Minimum number of blocks of the pool. reset() enlarges
+the pool so that it cannot be exhausted by the queues of the subscribers
+@param samps_per_block Number of samples in each block
+
+***************************************************************************/
+template <typename T>
+block_fanout<T>::block_fanout(size_t blocks_in_pool, size_t samps)
+:num_blocks(0), min_blocks(blocks_in_pool < 2 ? 2 : blocks_in_pool), samps_per_block(samps), blocks(NULL), storage(NULL),
+ storage_bytes(0), pending(NULL), free_head(FANOUT_NONE), published(0), overruns(0), closed(false)
+{
+}
+
+
+template <typename T>
+block_fanout<T>::~block_fanout()
+{
+	for(size_t index = 0; index < subscribers.size(); index++)
+	{
+		subscribers[index]->~fanout_subscriber();
+		free(subscribers[index]);
+	}
+	delete [] blocks;
+	pool_free(storage, storage_bytes);
+}
+
+
+/***********************************************************************//**
+Allocates the blocks from the block_pool, every one starting on a cache
+line boundary, or on a page boundary if the pool is page aligned
+
+***************************************************************************/
+template <typename T>
+void block_fanout<T>::allocate(size_t count)
+{
+	size_t align = pool_alignment();
+	size_t block_bytes = samps_per_block * sizeof(T);
+	block_bytes = (block_bytes + align - 1) & ~(align - 1);
+	size_t stride = block_bytes / sizeof(T);
+
+	delete [] blocks;
+	pool_free(storage, storage_bytes);
+	storage_bytes = block_bytes * (count + 1);
+	storage = static_cast<T*>(pool_alloc(storage_bytes));
+	num_blocks = count;
+
+	blocks = new block_t[num_blocks];
+	for(size_t index = 0; index <= num_blocks; index++)
+	{
+		block_t & block = index < num_blocks ? blocks[index] : spill;
+		block.samples = storage + index * stride;
+		block.capacity = samps_per_block;
+		block.num_samps = 0;
+		block.sequence = 0;
+		block.first_sample = 0;
+		block.skipped = 0;
+		block.publish_time = 0;
+		block.index = index < num_blocks ? uint32_t(index) : FANOUT_NONE;
+	}
+}
+
+
+/***********************************************************************//**
+Adds a subscriber. Must be called before the producer starts
+
+@param name Name of the subscriber in the statistics
+@param num_slots Size of its queue in blocks. Rounded up to a power of two (minimum 2)
+@param policy What the producer does when the queue is full
+@param zero_fill True to receive the blocks of zeros of publish_zeros_before()
+
+@return The subscription, valid until the fan-out is destroyed
+
+***************************************************************************/
+template <typename T>
+fanout_subscriber<T> & block_fanout<T>::subscribe(const char * name, size_t num_slots, fanout_policy policy, bool zero_fill)
+{
+	// The indexes of the queue are on their own cache lines
+	void * mem = NULL;
+	if(posix_memalign(&mem, CACHE_LINE_SIZE, sizeof(subscriber_t)))
+		throw std::bad_alloc();
+	subscribers.push_back(new(mem) subscriber_t(*this, name, num_slots, policy, zero_fill));
+	return *subscribers.back();
+}
+
+
+/***********************************************************************//**
+Producer: Returns the block to fill next
+
+The same block is returned until it is published. If every block of the
+pool is in use, the spill block is returned and the overrun counter is
+incremented: its samples are never delivered.
+
+@return Pointer to the block to fill. Never NULL
+
+***************************************************************************/
+template <typename T>
+typename block_fanout<T>::block_t * block_fanout<T>::acquire_write()
+{
+	if(pending)
+		return pending;
+	pending = pop_free();
+	if(pending == NULL)
+	{
+		overruns.fetch_add(1, std::memory_order_relaxed);
+		return &spill;
+	}
+	return pending;
+}
+
+
+/***********************************************************************//**
+Producer: Gives the block returned by the last acquire_write() to every
+subscriber
+
+***************************************************************************/
+template <typename T>
+void block_fanout<T>::publish()
+{
+	if(pending == NULL)
+		return;
+	block_t * block = pending;
+	pending = NULL;
+	deliver(block, false);
+}
+
+
+/***********************************************************************//**
+Producer: Publishes blocks of zero samples ahead of the block being
+written, to fill a gap in the stream
+
+The block returned by the last acquire_write() must already contain its
+samples, first_sample and metadata. The zero blocks get the metadata of
+the received block with their time moved back by the length of the gap.
+They are only given to the subscribers which asked for zero fill.
+
+@param count Number of zero samples to insert
+@param rate Sample rate, used to compute the time of the zero blocks
+
+@return Number of zero samples inserted. Less than count if the pool
+became empty
+
+***************************************************************************/
+template <typename T>
+size_t block_fanout<T>::publish_zeros_before(size_t count, double rate)
+{
+	if(pending == NULL)
+		return 0;
+	size_t inserted = 0;
+	while(inserted < count)
+	{
+		block_t * zero = pop_free();
+		if(zero == NULL)
+			break;
+		size_t n = count - inserted;
+		if(n > samps_per_block)
+			n = samps_per_block;
+		for(size_t index = 0; index < n; index++)
+			zero->samples[index] = T();
+		zero->num_samps = n;
+		zero->first_sample = pending->first_sample - (count - inserted);
+		zero->md = pending->md;
+		zero->md.time_spec = pending->md.time_spec - uhd::time_spec_t::from_ticks(count - inserted, rate);
+		zero->md.error_code = uhd::rx_metadata_t::ERROR_CODE_NONE;
+		zero->skipped = 0;
+		inserted += n;
+		deliver(zero, true);
+	}
+	return inserted;
+}
+
+
+/***********************************************************************//**
+Gives a block to the subscribers. The producer holds a reference while
+the block is queued, so that it cannot come back to the pool before
+every subscriber has it.
+
+@param fill True for a block of zeros, only given to the subscribers with zero fill
+
+***************************************************************************/
+template <typename T>
+void block_fanout<T>::deliver(block_t * block, bool fill)
+{
+	block->sequence = published.load(std::memory_order_relaxed);
+	block->publish_time = monotonic_ns();
+	block->refs.store(1, std::memory_order_relaxed);
+	for(size_t index = 0; index < subscribers.size(); index++)
+	{
+		subscriber_t & subscriber = *subscribers[index];
+		if(fill && !subscriber.zero_fill)
+			continue;
+		block->refs.fetch_add(1, std::memory_order_relaxed);
+		if(!subscriber.push(block))
+			block->refs.fetch_sub(1, std::memory_order_relaxed);
+	}
+	published.fetch_add(1, std::memory_order_relaxed);
+	unref(block);
+}
+
+
+template <typename T>
+void block_fanout<T>::close()
+{
+	closed.store(true, std::memory_order_release);
+	for(size_t index = 0; index < subscribers.size(); index++)
+		subscribers[index]->close();
+}
+
+
+template <typename T>
+void block_fanout<T>::reset()
+{
+	size_t needed = 1;
+	for(size_t index = 0; index < subscribers.size(); index++)
+	{
+		// A released slot may be reused before its block is back in the pool
+		subscribers[index]->reset();
+		needed += subscribers[index]->size() + 1;
+	}
+	if(needed < min_blocks)
+		needed = min_blocks;
+	if(needed > num_blocks)
+		allocate(needed);
+	pending = NULL;
+	free_head.store(FANOUT_NONE);
+	for(size_t index = num_blocks; index-- > 0; )
+		recycle(&blocks[index]);
+	closed.store(false);
+}
+
+
+/***********************************************************************//**
+Producer: Takes a block from the free stack
+
+@return The block or NULL if the pool is empty
+
+***************************************************************************/
+template <typename T>
+typename block_fanout<T>::block_t * block_fanout<T>::pop_free()
+{
+	uint32_t top = free_head.load(std::memory_order_acquire);
+	while(top != FANOUT_NONE)
+	{
+		// Only the producer pops, so top cannot be popped and pushed again meanwhile
+		uint32_t next = blocks[top].next_free;
+		if(free_head.compare_exchange_weak(top, next, std::memory_order_acquire, std::memory_order_acquire))
+			return &blocks[top];
+	}
+	return NULL;
+}
+
+
+/// Returns a block to the pool, from any thread
+template <typename T>
+void block_fanout<T>::recycle(block_t * block)
+{
+	uint32_t top = free_head.load(std::memory_order_relaxed);
+	do
+		block->next_free = top;
+	while(!free_head.compare_exchange_weak(top, block->index, std::memory_order_release, std::memory_order_relaxed));
+}
+
+
+/***********************************************************************//**
+Counts the blocks in the pool, to check that every block came back. Only
+while no thread is active
+
+***************************************************************************/
+template <typename T>
+size_t block_fanout<T>::count_free() const
+{
+	size_t count = 0;
+	for(uint32_t index = free_head.load(); index != FANOUT_NONE && count <= num_blocks; index = blocks[index].next_free)
+		count++;
+	return count;
+}
+
+
+/***********************************************************************//**
+Displays the counters of the pool and of each subscriber
+
+***************************************************************************/
+template <typename T>
+void block_fanout<T>::print_stats(std::ostream & os) const
+{
+	char line[160];
+	snprintf(line, sizeof(line), "Fan-out: %llu blocks published to %zu subscribers, pool of %zu blocks, %llu overruns",
+		(unsigned long long)get_published(), subscribers.size(), num_blocks, (unsigned long long)get_overruns());
+	os << line << std::endl;
+	for(size_t index = 0; index < subscribers.size(); index++)
+	{
+		const subscriber_t & subscriber = *subscribers[index];
+		snprintf(line, sizeof(line), "  %-12s %5s %10llu delivered %8llu dropped, max depth %zu/%zu, producer blocked %.1f ms",
+			subscriber.get_name(), subscriber.get_policy() == FANOUT_BLOCK ? "block" : "drop",
+			(unsigned long long)subscriber.get_delivered(), (unsigned long long)subscriber.get_drops(), subscriber.get_max_depth(),
+			subscriber.size(), subscriber.get_blocked_ns() * 1e-6);
+		os << line << std::endl;
+	}
+}
+
+
+template <typename T>
+fanout_subscriber<T>::fanout_subscriber(block_fanout<T> & owner, const char * subscriber_name, size_t queue_slots,
+	fanout_policy queue_policy, bool fill)
+:fanout(owner), name(subscriber_name), policy(queue_policy), zero_fill(fill), num_slots(2), slots(NULL),
+ head(0), tail(0), delivered(0), drops(0), blocked_ns(0), max_depth(0), closed(false), consumer_waiting(false)
+{
+	while(num_slots < queue_slots)
+		num_slots <<= 1;
+	mask = num_slots - 1;
+	slots = new block_t *[num_slots];
+	pthread_mutex_init(&wait_mutex, NULL);
+	pthread_cond_init(&wait_cond, NULL);
+}
+
+
+template <typename T>
+fanout_subscriber<T>::~fanout_subscriber()
+{
+	delete [] slots;
+	pthread_cond_destroy(&wait_cond);
+	pthread_mutex_destroy(&wait_mutex);
+}
+
+
+template <typename T>
+size_t fanout_subscriber<T>::block_size() const
+{
+	return fanout.block_size();
+}
+
+
+/***********************************************************************//**
+Producer: Queues a block, applying the policy when the queue is full
+
+@return true if the block was queued
+
+***************************************************************************/
+template <typename T>
+bool fanout_subscriber<T>::push(block_t * block)
+{
+	if(is_closed())
+		return false;
+	size_t h = head.load(std::memory_order_relaxed);
+	if(h - tail.load(std::memory_order_acquire) >= num_slots)
+	{
+		if(policy == FANOUT_DROP)
+		{
+			drops.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		uint64_t start = monotonic_ns();
+		struct timespec pause = {0, FANOUT_BLOCK_WAIT_US * 1000L};
+		while(h - tail.load(std::memory_order_acquire) >= num_slots && !is_closed())
+			nanosleep(&pause, NULL);
+		blocked_ns.fetch_add(monotonic_ns() - start, std::memory_order_relaxed);
+		if(is_closed())
+			return false;
+	}
+	slots[h & mask] = block;
+	head.store(h + 1, std::memory_order_release);
+	delivered.fetch_add(1, std::memory_order_relaxed);
+	size_t d = h + 1 - tail.load(std::memory_order_relaxed);
+	if(d > max_depth.load(std::memory_order_relaxed))
+		max_depth.store(d, std::memory_order_relaxed);
+	notify_consumer();
+	return true;
+}
+
+
+/***********************************************************************//**
+Consumer: Returns the oldest block not yet released, without blocking
+
+@return Pointer to the block or NULL if the queue is empty
+
+***************************************************************************/
+template <typename T>
+const typename fanout_subscriber<T>::block_t * fanout_subscriber<T>::try_read()
+{
+	size_t t = tail.load(std::memory_order_relaxed);
+	if(head.load(std::memory_order_acquire) == t)
+		return NULL;
+	return slots[t & mask];
+}
+
+
+/***********************************************************************//**
+Consumer: Waits for the next block
+
+@param timeout_ms Maximum time to wait in milliseconds. A negative value waits forever
+
+@return Pointer to the block or NULL on timeout or when the subscription
+is closed and the queue empty
+
+***************************************************************************/
+template <typename T>
+const typename fanout_subscriber<T>::block_t * fanout_subscriber<T>::wait_read(int timeout_ms)
+{
+	const block_t * b = try_read();
+	if(b)
+		return b;
+
+	struct timespec deadline;
+	if(timeout_ms >= 0)
+	{
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += timeout_ms / 1000;
+		deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+		if(deadline.tv_nsec >= 1000000000L)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+	}
+
+	pthread_mutex_lock(&wait_mutex);
+	consumer_waiting.store(true, std::memory_order_seq_cst);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	while((b = try_read()) == NULL && !is_closed())
+	{
+		int res;
+		if(timeout_ms >= 0)
+			res = pthread_cond_timedwait(&wait_cond, &wait_mutex, &deadline);
+		else
+			res = pthread_cond_wait(&wait_cond, &wait_mutex);
+		if(res == ETIMEDOUT)
+		{
+			b = try_read();
+			break;
+		}
+	}
+	consumer_waiting.store(false, std::memory_order_relaxed);
+	pthread_mutex_unlock(&wait_mutex);
+	if(b == NULL)
+		b = try_read();
+	return b;
+}
+
+
+/***********************************************************************//**
+Consumer: Releases the block returned by try_read() or wait_read(). The
+block goes back to the pool if no other subscriber holds it.
+
+***************************************************************************/
+template <typename T>
+void fanout_subscriber<T>::release()
+{
+	size_t t = tail.load(std::memory_order_relaxed);
+	block_t * block = slots[t & mask];
+	tail.store(t + 1, std::memory_order_release);
+	fanout.unref(block);
+}
+
+
+template <typename T>
+void fanout_subscriber<T>::close()
+{
+	closed.store(true, std::memory_order_release);
+	pthread_mutex_lock(&wait_mutex);
+	pthread_cond_broadcast(&wait_cond);
+	pthread_mutex_unlock(&wait_mutex);
+}
+
+
+/// Empties the queue without returning the blocks: block_fanout::reset() rebuilds the pool
+template <typename T>
+void fanout_subscriber<T>::reset()
+{
+	head.store(0);
+	tail.store(0);
+	closed.store(false);
+}
+
+
+/***********************************************************************//**
+Wakes up the consumer if it is sleeping in wait_read(). The mutex is only
+taken when the consumer is actually waiting.
+
+***************************************************************************/
+template <typename T>
+void fanout_subscriber<T>::notify_consumer()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(!consumer_waiting.load(std::memory_order_seq_cst))
+		return;
+	pthread_mutex_lock(&wait_mutex);
+	pthread_cond_signal(&wait_cond);
+	pthread_mutex_unlock(&wait_mutex);
+}
+
+
+#endif
@@ -0,0 +1,266 @@
+
+#include "block_pool.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <atomic>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Size of the huge pages (x86 and ARM default)
+#define POOL_HUGE_PAGE_SIZE (2 << 20)
+
+
+/// Default pool of the process, NULL to allocate the buffers on the heap
+static block_pool * default_pool = NULL;
+/// Buffers allocated on the heap by pool_alloc()
+static std::atomic<uint64_t> heap_allocations(0);
+
+
+block_pool::block_pool()
+:base(NULL), capacity(0), mapped(0), alignment(CACHE_LINE_SIZE), top(0), peak(0), allocations(0), failures(0),
+ huge(false), locked(false)
+{
+	pthread_mutex_init(&mutex, NULL);
+}
+
+
+block_pool::~block_pool()
+{
+	destroy();
+	pthread_mutex_destroy(&mutex);
+}
+
+
+/***********************************************************************//**
+Maps, locks and touches the region of the pool
+
+When the huge pages cannot be mapped (none reserved in
+/proc/sys/vm/nr_hugepages), the pool uses normal pages and asks for
+transparent huge pages. When it cannot be locked (RLIMIT_MEMLOCK), it is
+used unlocked. Both cases only display a message.
+
+@param config Size, alignment and options of the pool
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool block_pool::create(const block_pool_config & config)
+{
+	destroy();
+	size_t page = sysconf(_SC_PAGESIZE);
+	if(config.alignment < CACHE_LINE_SIZE || config.alignment > page || (config.alignment & (config.alignment - 1)))
+	{
+		std::cout << "Pool alignment must be a power of two between " << CACHE_LINE_SIZE << " and " << page << std::endl;
+		return true;
+	}
+	alignment = config.alignment;
+	capacity = (config.bytes + page - 1) & ~(page - 1);
+
+	void * mem = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	if(config.hugepages)
+	{
+		mapped = (capacity + POOL_HUGE_PAGE_SIZE - 1) & ~size_t(POOL_HUGE_PAGE_SIZE - 1);
+		mem = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if(mem == MAP_FAILED)
+			std::cout << "Pool: no huge pages (" << strerror(errno) << "), using normal pages" << std::endl;
+		else
+			capacity = mapped;
+	}
+#endif
+	huge = mem != MAP_FAILED;
+	if(!huge)
+	{
+		mapped = capacity;
+		mem = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(mem == MAP_FAILED)
+		{
+			std::cout << "Pool of " << capacity << " bytes could not be mapped: " << strerror(errno) << std::endl;
+			return true;
+		}
+#ifdef MADV_HUGEPAGE
+		if(config.hugepages)
+			madvise(mem, mapped, MADV_HUGEPAGE);
+#endif
+	}
+	base = static_cast<char*>(mem);
+
+	locked = false;
+	if(config.lock)
+	{
+		if(mlock(base, mapped))
+			std::cout << "Pool could not be locked: " << strerror(errno) << std::endl;
+		else
+			locked = true;
+	}
+
+	// Take the page faults now rather than in the stream
+	memset(base, 0, mapped);
+	top = 0;
+	peak = 0;
+	allocations = 0;
+	failures = 0;
+	return false;
+}
+
+
+/***********************************************************************//**
+Unmaps the region. The buffers allocated from the pool must not be used
+anymore
+
+***************************************************************************/
+
+void block_pool::destroy()
+{
+	if(base == NULL)
+		return;
+	if(default_pool == this)
+		default_pool = NULL;
+	if(locked)
+		munlock(base, mapped);
+	munmap(base, mapped);
+	base = NULL;
+	capacity = 0;
+	mapped = 0;
+	top = 0;
+	huge = false;
+	locked = false;
+}
+
+
+/***********************************************************************//**
+Allocates an aligned buffer from the pool
+
+@param bytes Size of the buffer
+
+@return Pointer to the buffer or NULL if the pool is full
+
+***************************************************************************/
+
+void * block_pool::allocate(size_t bytes)
+{
+	pthread_mutex_lock(&mutex);
+	void * buffer = NULL;
+	size_t size = (bytes + alignment - 1) & ~(alignment - 1);
+	if(base && size <= capacity - top)
+	{
+		buffer = base + top;
+		top += size;
+		if(top > peak)
+			peak = top;
+		allocations++;
+	}
+	else
+		failures++;
+	pthread_mutex_unlock(&mutex);
+	return buffer;
+}
+
+
+/***********************************************************************//**
+Gives a buffer back. Only the last buffer allocated returns to the pool
+
+@param buffer Pointer returned by allocate()
+@param bytes Size given to allocate()
+
+***************************************************************************/
+
+void block_pool::release(void * buffer, size_t bytes)
+{
+	pthread_mutex_lock(&mutex);
+	size_t size = (bytes + alignment - 1) & ~(alignment - 1);
+	if(static_cast<char*>(buffer) + size == base + top)
+		top -= size;
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void block_pool::print_stats(std::ostream & os) const
+{
+	char line[160];
+	pthread_mutex_lock(&mutex);
+	snprintf(line, sizeof(line), "Block pool: %.1f of %.1f MB used (peak %.1f MB) in %llu buffers, %zu bytes alignment%s%s, %llu refused",
+		top / 1048576.0, capacity / 1048576.0, peak / 1048576.0, (unsigned long long)allocations, alignment,
+		huge ? ", huge pages" : "", locked ? ", locked" : "", (unsigned long long)failures);
+	pthread_mutex_unlock(&mutex);
+	os << line << std::endl;
+}
+
+
+/***********************************************************************//**
+Installs the default pool of the process. Must be called before the
+sampling task and the DSP stages are created, and the pool must outlive
+them
+
+@param pool The pool, NULL to allocate the buffers on the heap
+
+***************************************************************************/
+
+void set_block_pool(block_pool * pool)
+{
+	default_pool = pool;
+}
+
+
+block_pool * get_block_pool()
+{
+	return default_pool;
+}
+
+
+/// Alignment of the buffers returned by pool_alloc()
+size_t pool_alignment()
+{
+	return default_pool ? default_pool->get_alignment() : CACHE_LINE_SIZE;
+}
+
+
+/***********************************************************************//**
+Allocates a buffer from the default pool, or from the heap with the same
+alignment when there is no pool or when it is full
+
+@param bytes Size of the buffer
+
+@return Pointer to the buffer. Throws std::bad_alloc if the heap is exhausted
+
+***************************************************************************/
+
+void * pool_alloc(size_t bytes)
+{
+	if(bytes == 0)
+		bytes = 1;
+	if(default_pool)
+	{
+		void * buffer = default_pool->allocate(bytes);
+		if(buffer)
+			return buffer;
+	}
+	void * buffer = NULL;
+	if(posix_memalign(&buffer, pool_alignment(), bytes))
+		throw std::bad_alloc();
+	heap_allocations.fetch_add(1, std::memory_order_relaxed);
+	return buffer;
+}
+
+
+/// Frees a buffer of pool_alloc()
+void pool_free(void * buffer, size_t bytes)
+{
+	if(buffer == NULL)
+		return;
+	if(default_pool && default_pool->owns(buffer))
+		default_pool->release(buffer, bytes ? bytes : 1);
+	else
+		free(buffer);
+}
+
+
+/// Number of buffers pool_alloc() took from the heap
+uint64_t get_heap_allocations()
+{
+	return heap_allocations.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,165 @@
+/***********************************************************************//**
+@file
+
+Memory pool of the sample blocks and of the buffers of the DSP stages
+
+The pool is one region mapped at startup, optionally backed by huge pages
+(MAP_HUGETLB) and locked in RAM, and touched once so that the stream never
+takes a page fault. The blocks of the sampling task and the work buffers
+of the DSP stages are carved out of it when they are configured; in the
+steady state nothing is allocated.
+
+Every allocation is aligned on at least a cache line, or on a page when
+the pool is created with a page alignment, so that the SIMD kernels can
+use aligned loads.
+
+The process has one default pool, installed with set_block_pool(). The
+stages reach it through pool_alloc() and pool_allocator: without a pool,
+or when it is full, the buffers come from the heap with the same
+alignment and are counted by get_heap_allocations().
+
+***************************************************************************/
+
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+
+#include <vector>
+#include <cstddef>
+#include <new>
+#include <ostream>
+#include <pthread.h>
+#include <stdint.h>
+#include "sample_format.h"
+
+/// Size of a cache line, alignment of the blocks and of the buffers
+#define CACHE_LINE_SIZE 64
+
+
+/// Configuration of a block_pool
+struct block_pool_config
+{
+	block_pool_config() : bytes(64 << 20), alignment(CACHE_LINE_SIZE), hugepages(false), lock(false) {}
+
+	size_t bytes;			/// Capacity of the pool in bytes
+	size_t alignment;		/// Alignment of every allocation: CACHE_LINE_SIZE or the page size
+	bool hugepages;			/// True to map the pool on huge pages, with a fallback to normal pages
+	bool lock;				/// True to lock the pool in RAM
+};
+
+
+/***********************************************************************//**
+Fixed capacity region from which the buffers are allocated at startup
+
+Allocations are taken from the top of the region. release() only gives
+the memory back when the buffer is the last one allocated (a buffer
+resized by a reconfiguration); the pool is meant to be filled once and
+destroyed at exit. allocate() and release() take a mutex: they are not
+meant for the streaming loop.
+
+***************************************************************************/
+class block_pool
+{
+public:
+	block_pool();
+	~block_pool();
+
+	bool create(const block_pool_config & config);
+	void destroy();
+
+	void * allocate(size_t bytes);
+	void release(void * buffer, size_t bytes);
+	/// True if the buffer comes from this pool
+	bool owns(const void * buffer) const {return base && buffer >= base && buffer < base + capacity;}
+
+	size_t get_capacity() const {return capacity;}
+	size_t get_alignment() const {return alignment;}
+	/// Number of bytes in use, alignment included
+	size_t get_used() const {return top;}
+	/// Highest number of bytes in use
+	size_t get_peak() const {return peak;}
+	/// Number of buffers allocated since create()
+	uint64_t get_allocations() const {return allocations;}
+	/// Number of allocations refused because the pool was full
+	uint64_t get_failures() const {return failures;}
+	/// True if the pool is backed by huge pages
+	bool is_huge() const {return huge;}
+	/// True if the pool is locked in RAM
+	bool is_locked() const {return locked;}
+	void print_stats(std::ostream & os) const;
+
+private:
+	block_pool(const block_pool &);
+	block_pool & operator=(const block_pool &);
+
+	char * base;			/// Start of the mapped region, NULL before create()
+	size_t capacity;		/// Size of the region in bytes
+	size_t mapped;			/// Size given to mmap(), a whole number of huge pages with MAP_HUGETLB
+	size_t alignment;
+	size_t top;				/// Offset of the first free byte
+	size_t peak;
+	uint64_t allocations;
+	uint64_t failures;
+	bool huge;
+	bool locked;
+	mutable pthread_mutex_t mutex;
+};
+
+
+void set_block_pool(block_pool * pool);
+block_pool * get_block_pool();
+size_t pool_alignment();
+void * pool_alloc(size_t bytes);
+void pool_free(void * buffer, size_t bytes);
+uint64_t get_heap_allocations();
+
+
+/***********************************************************************//**
+Allocator of the std::vector buffers of the DSP stages: the memory comes
+from the default block_pool (see pool_alloc())
+
+***************************************************************************/
+template <typename T>
+class pool_allocator
+{
+public:
+	typedef T value_type;
+	typedef T * pointer;
+	typedef const T * const_pointer;
+	typedef T & reference;
+	typedef const T & const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	template <typename U> struct rebind {typedef pool_allocator<U> other;};
+
+	pool_allocator() {}
+	template <typename U> pool_allocator(const pool_allocator<U> &) {}
+
+	pointer address(reference x) const {return &x;}
+	const_pointer address(const_reference x) const {return &x;}
+	pointer allocate(size_type n, const void * = 0) {return static_cast<pointer>(pool_alloc(n * sizeof(T)));}
+	void deallocate(pointer p, size_type n) {pool_free(p, n * sizeof(T));}
+	size_type max_size() const {return size_t(-1) / sizeof(T);}
+	void construct(pointer p, const T & value) {new(p) T(value);}
+	void destroy(pointer p) {p->~T();}
+};
+
+template <typename T, typename U>
+bool operator==(const pool_allocator<T> &, const pool_allocator<U> &) {return true;}
+template <typename T, typename U>
+bool operator!=(const pool_allocator<T> &, const pool_allocator<U> &) {return false;}
+
+
+/// Vector of T allocated from the default pool
+template <typename T>
+struct pool_vector
+{
+	typedef std::vector<T, pool_allocator<T> > type;
+};
+
+// Buffers of the DSP stages
+typedef std::vector<sample_fc32, pool_allocator<sample_fc32> > fc32_buffer;
+typedef std::vector<sample_sc16, pool_allocator<sample_sc16> > sc16_buffer;
+typedef std::vector<float, pool_allocator<float> > float_buffer;
+
+
+#endif
@@ -0,0 +1,335 @@
+#include "capture_file.h"
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Size of the window used to map the samples
+#define CAPTURE_WINDOW_SIZE (64 << 20)
+
+static_assert(sizeof(capture_header) == CAPTURE_HEADER_SIZE, "capture_header must be CAPTURE_HEADER_SIZE bytes");
+static_assert(sizeof(capture_index_entry) == 32, "capture_index_entry must be 32 bytes");
+
+
+/*************************************************************************//**
+@brief Initializes a capture header with the default values
+
+@param header header to initialize
+
+*****************************************************************************/
+
+void init_capture_header(capture_header & header)
+{
+	memset(&header, 0, sizeof(header));
+	header.magic = CAPTURE_MAGIC;
+	header.version = CAPTURE_VERSION;
+	header.index_interval = CAPTURE_INDEX_INTERVAL;
+}
+
+
+/***********************************************************************//**
+Constructor
+
+***************************************************************************/
+
+capture_reader::capture_reader()
+:fd(-1), file_size(0), index_map(NULL), index_map_size(0), index(NULL), index_count(0),
+ window(NULL), window_offset(0), window_size(0)
+{
+	init_capture_header(header);
+}
+
+
+capture_reader::~capture_reader()
+{
+	close();
+}
+
+
+/***********************************************************************//**
+Opens a capture file and maps its index
+
+If the capture was not closed properly the index is missing: the number of
+samples is then derived from the size of the file and seek_time() assumes
+that there is no gap.
+
+@param filename Name of the capture file
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool capture_reader::open(const char * filename)
+{
+	close();
+	fd = ::open(filename, O_RDONLY);
+	if(fd < 0)
+	{
+		std::cout << "Capture file could not be opened" << std::endl;
+		return true;
+	}
+	struct stat st;
+	if(fstat(fd, &st) || pread(fd, &header, sizeof(header), 0) != sizeof(header))
+	{
+		std::cout << "Capture header could not be read" << std::endl;
+		close();
+		return true;
+	}
+	file_size = st.st_size;
+	if(header.magic != CAPTURE_MAGIC || header.version != CAPTURE_VERSION || header.sample_size == 0)
+	{
+		std::cout << "Not a capture file (or written with a different byte order)" << std::endl;
+		close();
+		return true;
+	}
+
+	if(!header.complete)
+	{
+		header.num_samples = (file_size - header.data_offset) / header.sample_size;
+		return false;
+	}
+	if(header.index_count == 0)
+		return false;
+
+	// Map the index. mmap() requires an offset aligned on a page
+	uint64_t page = sysconf(_SC_PAGESIZE);
+	uint64_t map_start = header.index_offset & ~(page - 1);
+	index_map_size = header.index_offset - map_start + header.index_count * sizeof(capture_index_entry);
+	index_map = mmap(NULL, index_map_size, PROT_READ, MAP_SHARED, fd, map_start);
+	if(index_map == MAP_FAILED)
+	{
+		index_map = NULL;
+		std::cout << "Capture index could not be mapped" << std::endl;
+		close();
+		return true;
+	}
+	index = reinterpret_cast<const capture_index_entry *>(static_cast<const char*>(index_map) + (header.index_offset - map_start));
+	index_count = header.index_count;
+	return false;
+}
+
+
+/***********************************************************************//**
+Unmaps the file and closes it
+
+***************************************************************************/
+
+void capture_reader::close()
+{
+	if(window)
+		munmap(window, window_size);
+	if(index_map)
+		munmap(index_map, index_map_size);
+	if(fd >= 0)
+		::close(fd);
+	fd = -1;
+	window = NULL;
+	index_map = NULL;
+	index = NULL;
+	index_count = 0;
+}
+
+
+/***********************************************************************//**
+Returns the output of get_rx_parameters() stored when the capture started
+
+***************************************************************************/
+
+std::string capture_reader::get_snapshot() const
+{
+	std::string text(header.snapshot_size, '\0');
+	if(fd < 0 || header.snapshot_size == 0)
+		return std::string();
+	if(pread(fd, &text[0], header.snapshot_size, header.snapshot_offset) != (ssize_t)header.snapshot_size)
+		return std::string();
+	return text;
+}
+
+
+/***********************************************************************//**
+Finds the sample received at a given device time
+
+The index is searched for the last entry which is not later than the
+requested time; the position is then extrapolated with the sample rate up
+to the next entry. A time falling in a gap returns the first sample after
+the gap.
+
+@param full_secs Integer part of the time
+@param frac_secs Fractional part of the time
+@param sample Set to the number of the sample
+
+@return true if the time is outside the capture, false otherwise
+
+***************************************************************************/
+
+bool capture_reader::seek_time(int64_t full_secs, double frac_secs, uint64_t & sample) const
+{
+	if(header.num_samples == 0 || header.sample_rate <= 0)
+		return true;
+
+	// Reference point: the start of the capture or the closest index entry
+	int64_t ref_full = header.start_full_secs;
+	double ref_frac = header.start_frac_secs;
+	uint64_t ref_sample = 0;
+	uint64_t limit = header.num_samples;
+
+	if(index_count)
+	{
+		// Binary search of the last entry <= requested time
+		size_t low = 0, high = index_count;
+		while(low < high)
+		{
+			size_t mid = low + (high - low) / 2;
+			const capture_index_entry & e = index[mid];
+			if(e.full_secs < full_secs || (e.full_secs == full_secs && e.frac_secs <= frac_secs))
+				low = mid + 1;
+			else
+				high = mid;
+		}
+		if(low == 0)
+			return true;
+		const capture_index_entry & e = index[low - 1];
+		ref_full = e.full_secs;
+		ref_frac = e.frac_secs;
+		ref_sample = e.sample;
+		if(low < index_count)
+			limit = index[low].sample;
+	}
+
+	double delta = double(full_secs - ref_full) + (frac_secs - ref_frac);
+	if(delta < 0)
+		return true;
+	uint64_t offset = uint64_t(delta * header.sample_rate + 0.5);
+	if(ref_sample + offset >= limit)
+	{
+		// After the last sample of the capture or inside a gap
+		if(limit == header.num_samples)
+			return true;
+		sample = limit;
+		return false;
+	}
+	sample = ref_sample + offset;
+	return false;
+}
+
+
+/***********************************************************************//**
+Returns the device time of a sample, in seconds
+
+@param sample Number of the sample since the start of the capture
+
+***************************************************************************/
+
+double capture_reader::sample_time(uint64_t sample) const
+{
+	int64_t full_secs;
+	double frac_secs;
+	sample_time(sample, full_secs, frac_secs);
+	return double(full_secs) + frac_secs;
+}
+
+
+/***********************************************************************//**
+Returns the device time of a sample
+
+The time is extrapolated from the last index entry which is not after the
+sample, so that the gaps of the capture are taken into account.
+
+@param sample Number of the sample since the start of the capture
+@param full_secs Receives the integer part of the time
+@param frac_secs Receives the fractional part of the time
+
+***************************************************************************/
+
+void capture_reader::sample_time(uint64_t sample, int64_t & full_secs, double & frac_secs) const
+{
+	full_secs = header.start_full_secs;
+	frac_secs = header.start_frac_secs;
+	uint64_t ref_sample = 0;
+
+	// Last entry whose sample is <= the requested one
+	size_t next = find_entry(sample + 1);
+	if(next)
+	{
+		full_secs = index[next - 1].full_secs;
+		frac_secs = index[next - 1].frac_secs;
+		ref_sample = index[next - 1].sample;
+	}
+	if(header.sample_rate > 0)
+		frac_secs += double(sample - ref_sample) / header.sample_rate;
+	double whole = double(int64_t(frac_secs));
+	full_secs += int64_t(whole);
+	frac_secs -= whole;
+}
+
+
+/***********************************************************************//**
+Binary search of the index
+
+@param sample Number of a sample
+
+@return Number of the first index entry whose sample is >= sample, or
+get_index_size() if there is none
+
+***************************************************************************/
+
+size_t capture_reader::find_entry(uint64_t sample) const
+{
+	size_t low = 0, high = index_count;
+	while(low < high)
+	{
+		size_t mid = low + (high - low) / 2;
+		if(index[mid].sample < sample)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+
+/***********************************************************************//**
+Maps samples of the capture
+
+The returned pointer stays valid until the next call to get_samples() or
+close().
+
+@param first Number of the first sample
+@param count Number of samples
+
+@return Pointer to the first sample or NULL if the range is outside the capture
+
+***************************************************************************/
+
+const void * capture_reader::get_samples(uint64_t first, size_t count)
+{
+	if(fd < 0 || first + count > header.num_samples)
+		return NULL;
+	uint64_t begin = header.data_offset + first * header.sample_size;
+	uint64_t end = begin + uint64_t(count) * header.sample_size;
+
+	if(window == NULL || begin < window_offset || end > window_offset + window_size)
+	{
+		if(window)
+			munmap(window, window_size);
+		window = NULL;
+		uint64_t page = sysconf(_SC_PAGESIZE);
+		window_offset = begin & ~(page - 1);
+		uint64_t size = end - window_offset;
+		if(size < CAPTURE_WINDOW_SIZE)
+			size = CAPTURE_WINDOW_SIZE;
+		if(window_offset + size > file_size)
+			size = file_size - window_offset;
+		window_size = size;
+		window = mmap(NULL, window_size, PROT_READ, MAP_SHARED, fd, window_offset);
+		if(window == MAP_FAILED)
+		{
+			window = NULL;
+			return NULL;
+		}
+		madvise(window, window_size, MADV_SEQUENTIAL);
+	}
+	return static_cast<const char*>(window) + (begin - window_offset);
+}
@@ -0,0 +1,143 @@
+/***********************************************************************//**
+@file
+
+Format of the capture files and reader of these files
+
+A capture file is made of:
+- a capture_header (CAPTURE_HEADER_SIZE bytes) describing the radio
+  configuration at the start of the capture
+- the text output of get_rx_parameters() taken at the same time
+- the samples, starting at header.data_offset (multiple of 4096 so that
+  the writer can use O_DIRECT)
+- an index of capture_index_entry, starting at header.index_offset, which
+  maps the time of the samples to their position in the file. An entry is
+  written at least every header.index_interval samples and at the first
+  block following a discontinuity (overflow, time jump or idle channel
+  left out by the squelch)
+
+All the fields are stored in the native byte order of the machine which
+wrote the file. This file does not depend on UHD so that captures can be
+analysed on a machine without the driver.
+
+***************************************************************************/
+
+#ifndef CAPTURE_FILE_H
+#define CAPTURE_FILE_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+
+#define CAPTURE_MAGIC 0x50433145	// "E1CP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER_SIZE 512
+#define CAPTURE_DATA_ALIGNMENT 4096
+#define CAPTURE_INDEX_INTERVAL 65536
+
+// Bits of capture_index_entry::flags
+#define CAPTURE_INDEX_GAP		0x01	// Samples were lost just before this entry
+#define CAPTURE_INDEX_OVERFLOW	0x02	// The gap was reported as an overflow by the device
+#define CAPTURE_INDEX_SQUELCH	0x04	// Samples were left out by the squelch just before this entry (not lost)
+
+
+/// Header at the start of a capture file. Padded to CAPTURE_HEADER_SIZE bytes
+struct capture_header
+{
+	uint32_t magic;				/// CAPTURE_MAGIC
+	uint16_t version;			/// CAPTURE_VERSION
+	uint16_t complete;			/// 1 once the index has been written
+	uint32_t sample_size;		/// Size in bytes of one complex sample
+	uint32_t index_interval;	/// Maximum number of samples between two index entries
+	char cpu_format[8];			/// Host sample format ("sc16", ...)
+	char otw_format[8];			/// Over the wire sample format
+	char antenna[16];			/// Receive antenna
+	double sample_rate;			/// Actual sample rate in samples/s
+	double center_freq;			/// Actual center frequency in Hz
+	double target_rf_freq;		/// tune_result_t of the last tune request
+	double actual_rf_freq;
+	double target_dsp_freq;
+	double actual_dsp_freq;
+	double gain;				/// Total RX gain in dB
+	double bandwidth;			/// RX bandwidth in Hz
+	int64_t host_start_time;	/// Host time (seconds since epoch) when the capture started
+	int64_t start_full_secs;	/// Device time of the first sample
+	double start_frac_secs;
+	uint64_t snapshot_offset;	/// Offset of the get_rx_parameters() text
+	uint64_t snapshot_size;		/// Size of the get_rx_parameters() text
+	uint64_t data_offset;		/// Offset of the first sample
+	uint64_t num_samples;		/// Number of samples in the file
+	uint64_t index_offset;		/// Offset of the first index entry
+	uint64_t index_count;		/// Number of index entries
+	uint64_t num_gaps;			/// Number of discontinuities found during the capture
+	uint64_t num_squelched;		/// Number of samples left out by the squelch
+	uint8_t reserved[CAPTURE_HEADER_SIZE - 200];
+};
+
+
+/// Entry of the time index. 32 bytes
+struct capture_index_entry
+{
+	int64_t full_secs;		/// Device time of the sample
+	double frac_secs;
+	uint64_t sample;		/// Number of the sample since the start of the capture
+	uint32_t flags;			/// CAPTURE_INDEX_xxx
+	uint32_t reserved;
+};
+
+
+void init_capture_header(capture_header & header);
+
+
+/***********************************************************************//**
+This class gives access to a capture file using memory mappings
+
+The index is mapped once; the samples are mapped through a window which is
+moved on demand, so that captures larger than the address space of the
+E100 can be read. Seeking to a time is a binary search of the index.
+
+***************************************************************************/
+class capture_reader
+{
+public:
+	capture_reader();
+	~capture_reader();
+
+	bool open(const char * filename);
+	void close();
+
+	/// Header of the capture
+	const capture_header & get_header() const {return header;}
+	/// Output of get_rx_parameters() when the capture started
+	std::string get_snapshot() const;
+	/// Number of samples in the capture
+	uint64_t get_num_samples() const {return header.num_samples;}
+	/// Number of index entries
+	size_t get_index_size() const {return index_count;}
+	/// Entry number i of the index
+	const capture_index_entry & get_index_entry(size_t i) const {return index[i];}
+
+	bool seek_time(int64_t full_secs, double frac_secs, uint64_t & sample) const;
+	double sample_time(uint64_t sample) const;
+	void sample_time(uint64_t sample, int64_t & full_secs, double & frac_secs) const;
+	/// Number of the first index entry whose sample is >= the given one
+	size_t find_entry(uint64_t sample) const;
+	const void * get_samples(uint64_t first, size_t count);
+
+private:
+	capture_reader(const capture_reader &);
+	capture_reader & operator=(const capture_reader &);
+
+	int fd;						/// File descriptor of the capture
+	uint64_t file_size;			/// Size of the file in bytes
+	capture_header header;		/// Copy of the header
+	void * index_map;			/// Mapping containing the index
+	size_t index_map_size;
+	const capture_index_entry * index;	/// First entry of the index
+	size_t index_count;			/// Number of entries
+	void * window;				/// Current mapping of the samples
+	uint64_t window_offset;		/// File offset of the window
+	size_t window_size;			/// Size of the window in bytes
+};
+
+
+#endif
@@ -0,0 +1,97 @@
+/***********************************************************************//**
+@file
+
+Displays the content of a capture file
+
+Usage: capinfo [-s] [-i] [-t seconds] rx_data.cap
+
+-s prints the get_rx_parameters() snapshot stored in the file
+-i prints every entry of the time index
+-t prints the sample received at the given device time
+
+***************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include "capture_file.h"
+
+
+int main(int argc, char ** argv)
+{
+	bool show_snapshot = false;
+	bool show_index = false;
+	bool seek = false;
+	double seek_time = 0;
+	const char * filename = NULL;
+	for(int index = 1; index < argc; index++)
+	{
+		if(strcmp(argv[index], "-s") == 0)
+			show_snapshot = true;
+		else if(strcmp(argv[index], "-i") == 0)
+			show_index = true;
+		else if(strcmp(argv[index], "-t") == 0 && index + 1 < argc)
+		{
+			seek = true;
+			seek_time = atof(argv[++index]);
+		}
+		else
+			filename = argv[index];
+	}
+	if(filename == NULL)
+	{
+		std::cout << "Usage: " << argv[0] << " [-s] [-i] [-t seconds] rx_data.cap" << std::endl;
+		return 1;
+	}
+
+	capture_reader reader;
+	if(reader.open(filename))
+		return 2;
+
+	const capture_header & h = reader.get_header();
+	std::cout << "Complete: " << h.complete << std::endl;
+	std::cout << "Format (cpu/otw): " << h.cpu_format << "/" << h.otw_format << "  Sample size: " << h.sample_size << std::endl;
+	std::cout << "Sample rate: " << h.sample_rate << std::endl;
+	std::cout << "Center frequency: " << h.center_freq << std::endl;
+	std::cout << "Target RF frequency: " << h.target_rf_freq << std::endl;
+	std::cout << "Actual RF frequency: " << h.actual_rf_freq << std::endl;
+	std::cout << "Target DSP frequency: " << h.target_dsp_freq << std::endl;
+	std::cout << "Actual DSP frequency: " << h.actual_dsp_freq << std::endl;
+	std::cout << "Gain: " << h.gain << "  Bandwidth: " << h.bandwidth << "  Antenna: " << h.antenna << std::endl;
+	std::cout << "Host start time: " << h.host_start_time << std::endl;
+	std::cout << "Device start time: " << h.start_full_secs + h.start_frac_secs << std::endl;
+	std::cout << "Samples: " << reader.get_num_samples() << "  Gaps: " << h.num_gaps << "  Index entries: " << reader.get_index_size() << std::endl;
+	if(h.num_squelched)
+		std::cout << "Squelched samples: " << h.num_squelched << " (" << 100.0 * h.num_squelched / (h.num_squelched + h.num_samples)
+			<< "% of the stream not stored)" << std::endl;
+
+	if(show_snapshot)
+		std::cout << std::endl << reader.get_snapshot() << std::endl;
+
+	for(size_t index = 0; index < reader.get_index_size(); index++)
+	{
+		const capture_index_entry & e = reader.get_index_entry(index);
+		if(!show_index && !(e.flags & (CAPTURE_INDEX_GAP | CAPTURE_INDEX_SQUELCH)))
+			continue;
+		std::cout << "Sample " << e.sample << "  Seconds " << e.full_secs + e.frac_secs;
+		if(e.flags & CAPTURE_INDEX_GAP)
+			std::cout << "  Gap" << ((e.flags & CAPTURE_INDEX_OVERFLOW) ? " (Overflow)" : "");
+		if(e.flags & CAPTURE_INDEX_SQUELCH)
+			std::cout << "  Squelch";
+		std::cout << std::endl;
+	}
+
+	if(seek)
+	{
+		double full = floor(seek_time);
+		uint64_t sample;
+		if(reader.seek_time(int64_t(full), seek_time - full, sample))
+			std::cout << "Time " << seek_time << " is outside the capture" << std::endl;
+		else
+			std::cout << "Time " << seek_time << " -> sample " << sample << " (file offset "
+				<< h.data_offset + sample * h.sample_size << ")" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,457 @@
+
+#include "capture_writer.h"
+#include "uhd_utilities.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Alignment required for O_DIRECT transfers
+#define CAPTURE_ALIGNMENT CAPTURE_DATA_ALIGNMENT
+// The data file is extended by this amount each time it becomes full
+#define CAPTURE_PREALLOC_BYTES (64 << 20)
+
+
+/***********************************************************************//**
+Constructor: Allocates the staging buffer
+
+@param sample_size Size in bytes of one complex sample
+@param chunk_bytes Size of the writes to the data file. Rounded to CAPTURE_ALIGNMENT
+
+***************************************************************************/
+
+capture_writer::capture_writer(size_t sample_sz, size_t chunk_sz)
+:sample_size(sample_sz), feed(NULL), chunk(NULL), chunk_fill(0),
+ data_fd(-1), direct_io(false), file_offset(0), allocated(0), pending_overflow(false), text_log(false), num_records(0),
+ running(false), bytes_written(0)
+{
+	chunk_bytes = (chunk_sz + CAPTURE_ALIGNMENT - 1) & ~size_t(CAPTURE_ALIGNMENT - 1);
+	void * mem = NULL;
+	if(posix_memalign(&mem, CAPTURE_ALIGNMENT, chunk_bytes))
+		throw std::bad_alloc();
+	chunk = static_cast<char*>(mem);
+	memset(chunk, 0, chunk_bytes);
+	init_capture_header(header);
+	header.sample_size = sample_size;
+	index.reserve(4096);
+}
+
+
+/***********************************************************************//**
+Destructor: Stops the thread and closes the files
+
+***************************************************************************/
+
+capture_writer::~capture_writer()
+{
+	stop();
+	close_files();
+	free(chunk);
+}
+
+
+/***********************************************************************//**
+Opens the output files
+
+The sample file is opened with O_DIRECT when the file system supports it,
+otherwise normal buffered writes are used.
+
+@param data_filename Name of the file receiving the samples
+@param log_filename Name of the file receiving the metadata of each block
+@param text true to write the metadata in the text format (debug), false for the binary format
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool capture_writer::open(const char * data_filename, const char * log_filename, bool text)
+{
+	text_log = text;
+	num_records = 0;
+	if(text_log)
+		rx_log.open(log_filename, std::ofstream::out);
+	else
+		rx_log.open(log_filename, std::ofstream::out | std::ofstream::binary);
+	if(rx_log.fail())
+	{
+		std::cout << " Metadata file could not be opened" << std::endl;
+		return true;
+	}
+	if(!text_log)
+	{
+		rx_log_header header;
+		memset(&header, 0, sizeof(header));
+		header.magic = RX_LOG_MAGIC;
+		header.version = RX_LOG_VERSION;
+		header.record_size = sizeof(rx_log_record);
+		header.sample_size = sample_size;
+		rx_log.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	}
+
+	direct_io = true;
+	data_fd = ::open(data_filename, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+	if(data_fd < 0)
+	{
+		// tmpfs and some SD card file systems refuse O_DIRECT
+		direct_io = false;
+		data_fd = ::open(data_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+	if(data_fd < 0)
+	{
+		std::cout << " Sample file could not be opened" << std::endl;
+		return true;
+	}
+	file_offset = 0;
+	allocated = 0;
+	return false;
+}
+
+
+/***********************************************************************//**
+Sets the header of the capture file. Must be called before start()
+
+@param hdr Header describing the configuration of the radio
+@param text Output of get_rx_parameters() stored after the header
+
+***************************************************************************/
+
+void capture_writer::set_header(const capture_header & hdr, const std::string & text)
+{
+	header = hdr;
+	header.sample_size = sample_size;
+	snapshot = text;
+}
+
+
+/***********************************************************************//**
+Starts the writer thread
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool capture_writer::start()
+{
+	if(feed == NULL)
+	{
+		std::cout << "No block feed given to the capture writer" << std::endl;
+		return true;
+	}
+	if(file_offset == 0 && write_header())
+		return true;
+	if(create_rt_thread(&thread_id, rt_config, &capture_writer::helper, this, "capture_writer"))
+		return true;
+	running = true;
+	return false;
+}
+
+
+/***********************************************************************//**
+Stops the writer thread once every queued block has been written
+
+***************************************************************************/
+
+void capture_writer::stop()
+{
+	if(!running)
+		return;
+	feed->close();
+	pthread_join(thread_id, NULL);
+	running = false;
+}
+
+
+/***********************************************************************//**
+Main function of the writer thread
+
+***************************************************************************/
+
+void * capture_writer::run()
+{
+	prefault_stack(rt_config.prefault_stack);
+	verify_rt_thread(rt_config, "capture_writer");
+
+	capture_block block;
+	while(feed->wait_block(block))
+	{
+		write_block(&block);
+		feed->release_block();
+	}
+
+	// Queue closed and empty: write what is left in the staging buffer
+	flush_chunk();
+	flush_records();
+	rx_log.flush();
+	return NULL;
+}
+
+
+/***********************************************************************//**
+Logs the metadata of a block and copies its samples into the staging
+buffer, writing the buffer every time it becomes full
+
+***************************************************************************/
+
+void capture_writer::write_block(const capture_block * block)
+{
+	log_metadata(block);
+	index_block(block);
+
+	// We write the data to the binary data file in an unformatted way
+	// Fromat of data is I16Q16I16Q16....
+	const char * src = block->samples;
+	size_t remaining = block->num_samps * sample_size;
+	while(remaining)
+	{
+		size_t n = chunk_bytes - chunk_fill;
+		if(n > remaining)
+			n = remaining;
+		memcpy(chunk + chunk_fill, src, n);
+		chunk_fill += n;
+		src += n;
+		remaining -= n;
+		if(chunk_fill == chunk_bytes)
+			flush_chunk();
+	}
+}
+
+
+/***********************************************************************//**
+Logs the metadata of a block, either as text or as a binary record
+
+Must be called before the samples of the block are added to the staging
+buffer so that the recorded file offset points to the first sample.
+
+***************************************************************************/
+
+void capture_writer::log_metadata(const capture_block * block)
+{
+	const uhd::rx_metadata_t & md = block->md;
+	if(text_log)
+	{
+		rx_log << std::endl;
+		rx_log << "Samples Received: " << block->num_samps <<std::endl;
+		display_rx_metadata(const_cast<uhd::rx_metadata_t &>(md), rx_log);
+		return;
+	}
+
+	rx_log_record & rec = records[num_records];
+	rec.full_secs = md.time_spec.get_full_secs();
+	rec.frac_secs = md.time_spec.get_frac_secs();
+	rec.file_offset = file_offset + chunk_fill;
+	rec.num_samps = block->num_samps;
+	rec.error_code = md.error_code;
+	rec.flags = (md.has_time_spec ? RX_LOG_FLAG_HAS_TIME_SPEC : 0)
+		| (md.more_fragments ? RX_LOG_FLAG_MORE_FRAGMENTS : 0)
+		| (md.start_of_burst ? RX_LOG_FLAG_START_OF_BURST : 0)
+		| (md.end_of_burst ? RX_LOG_FLAG_END_OF_BURST : 0);
+	rec.fragment_offset = uint32_t(md.fragment_offset);
+	rec.reserved = 0;
+	rec.reserved2 = 0;
+	if(++num_records == RX_LOG_BATCH)
+		flush_records();
+}
+
+
+/***********************************************************************//**
+Writes the pending binary records to the log with a single call
+
+***************************************************************************/
+
+void capture_writer::flush_records()
+{
+	if(num_records == 0)
+		return;
+	rx_log.write(reinterpret_cast<const char*>(records), num_records * sizeof(rx_log_record));
+	num_records = 0;
+}
+
+
+/***********************************************************************//**
+Adds an entry to the time index when needed
+
+An entry is added for the first block, at least every index_interval
+samples, for every block which does not start at the time expected
+from the previous entry and the sample rate (samples were lost), and for
+every block following samples left out by the squelch. Must be called
+before the samples of the block are added to the staging buffer.
+
+***************************************************************************/
+
+void capture_writer::index_block(const capture_block * block)
+{
+	const uhd::rx_metadata_t & md = block->md;
+	if(md.error_code == uhd::rx_metadata_t::ERROR_CODE_OVERFLOW)
+		pending_overflow = true;
+	if(block->num_samps == 0)
+		return;
+
+	capture_index_entry entry;
+	entry.full_secs = md.time_spec.get_full_secs();
+	entry.frac_secs = md.time_spec.get_frac_secs();
+	entry.sample = (file_offset + chunk_fill - header.data_offset) / sample_size;
+	entry.flags = pending_overflow ? (CAPTURE_INDEX_GAP | CAPTURE_INDEX_OVERFLOW) : 0;
+	entry.reserved = 0;
+	pending_overflow = false;
+	if(block->skipped)
+	{
+		entry.flags |= CAPTURE_INDEX_SQUELCH;
+		header.num_squelched += block->skipped;
+	}
+
+	if(index.empty())
+	{
+		header.start_full_secs = entry.full_secs;
+		header.start_frac_secs = entry.frac_secs;
+	}
+	else if(md.has_time_spec && header.sample_rate > 0)
+	{
+		// Compare the time of the block with the one expected from the last entry
+		const capture_index_entry & last = index.back();
+		double elapsed = double(entry.full_secs - last.full_secs) + (entry.frac_secs - last.frac_secs);
+		double expected = double(entry.sample - last.sample + block->skipped) / header.sample_rate;
+		if(fabs(elapsed - expected) * header.sample_rate > 0.5)
+			entry.flags |= CAPTURE_INDEX_GAP;
+	}
+
+	if(entry.flags & CAPTURE_INDEX_GAP)
+		header.num_gaps++;
+	if(index.empty() || entry.flags || entry.sample - index.back().sample >= header.index_interval)
+		index.push_back(entry);
+}
+
+
+/***********************************************************************//**
+Writes the header and the get_rx_parameters() text at the start of the
+capture file. The samples start on the next CAPTURE_ALIGNMENT boundary.
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool capture_writer::write_header()
+{
+	if(data_fd < 0)
+		return true;
+	header.snapshot_offset = CAPTURE_HEADER_SIZE;
+	header.snapshot_size = snapshot.size();
+	header.data_offset = (CAPTURE_HEADER_SIZE + snapshot.size() + CAPTURE_ALIGNMENT - 1) & ~uint64_t(CAPTURE_ALIGNMENT - 1);
+
+	// The buffer must be aligned for O_DIRECT
+	void * mem = NULL;
+	if(posix_memalign(&mem, CAPTURE_ALIGNMENT, header.data_offset))
+		return true;
+	char * buf = static_cast<char*>(mem);
+	memset(buf, 0, header.data_offset);
+	memcpy(buf, &header, sizeof(header));
+	memcpy(buf + CAPTURE_HEADER_SIZE, snapshot.data(), snapshot.size());
+	bool error = pwrite(data_fd, buf, header.data_offset, 0) != (ssize_t)header.data_offset;
+	free(buf);
+	if(error)
+	{
+		std::cout << "Capture header could not be written" << std::endl;
+		return true;
+	}
+	file_offset = header.data_offset;
+	bytes_written.store(file_offset, std::memory_order_relaxed);
+	return false;
+}
+
+
+/***********************************************************************//**
+Writes the staging buffer to the data file
+
+Full chunks are written with O_DIRECT. A partial chunk (end of capture)
+is written after switching the descriptor back to buffered mode since
+O_DIRECT requires aligned lengths.
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool capture_writer::flush_chunk()
+{
+	if(chunk_fill == 0 || data_fd < 0)
+		return false;
+
+	// Extend the preallocated area so that the file system does not have to
+	// allocate blocks during each write. The size of the file is kept so
+	// that an interrupted capture does not end with preallocated zeros
+	if(file_offset + chunk_fill > allocated)
+	{
+		if(fallocate(data_fd, FALLOC_FL_KEEP_SIZE, allocated, CAPTURE_PREALLOC_BYTES) == 0)
+			allocated += CAPTURE_PREALLOC_BYTES;
+		else
+			allocated = ~uint64_t(0);	// Not supported by the file system
+	}
+
+	if(chunk_fill != chunk_bytes && direct_io)
+	{
+		fcntl(data_fd, F_SETFL, fcntl(data_fd, F_GETFL) & ~O_DIRECT);
+		direct_io = false;
+	}
+
+	size_t done = 0;
+	while(done < chunk_fill)
+	{
+		ssize_t res = pwrite(data_fd, chunk + done, chunk_fill - done, file_offset + done);
+		if(res <= 0)
+		{
+			std::cout << "Error writing the sample file" << std::endl;
+			chunk_fill = 0;
+			return true;
+		}
+		done += res;
+	}
+	file_offset += chunk_fill;
+	bytes_written.store(file_offset, std::memory_order_relaxed);
+	chunk_fill = 0;
+	return false;
+}
+
+
+/***********************************************************************//**
+Appends the index to the capture file, updates its header, removes the
+unused preallocated area and closes the files
+
+***************************************************************************/
+
+void capture_writer::close_files()
+{
+	if(data_fd >= 0)
+	{
+		flush_chunk();
+		if(header.data_offset)
+		{
+			// The index and the header are not aligned: leave O_DIRECT mode
+			if(direct_io)
+			{
+				fcntl(data_fd, F_SETFL, fcntl(data_fd, F_GETFL) & ~O_DIRECT);
+				direct_io = false;
+			}
+			size_t index_bytes = index.size() * sizeof(capture_index_entry);
+			header.num_samples = (file_offset - header.data_offset) / sample_size;
+			header.index_offset = file_offset;
+			header.index_count = index.size();
+			header.complete = 1;
+			if(index_bytes && pwrite(data_fd, &index[0], index_bytes, file_offset) != (ssize_t)index_bytes)
+				std::cout << "Capture index could not be written" << std::endl;
+			else
+				file_offset += index_bytes;
+			if(pwrite(data_fd, &header, sizeof(header), 0) != sizeof(header))
+				std::cout << "Capture header could not be updated" << std::endl;
+		}
+		if(ftruncate(data_fd, file_offset))
+			std::cout << "Sample file could not be truncated" << std::endl;
+		::close(data_fd);
+		data_fd = -1;
+	}
+	if(rx_log.is_open())
+	{
+		flush_records();
+		rx_log.close();
+	}
+}
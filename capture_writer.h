@@ -0,0 +1,187 @@
+/***********************************************************************//**
+@file
+
+Declaration of the capture writer which stores the received samples on
+disk from its own thread
+
+
+***************************************************************************/
+
+#ifndef CAPTURE_WRITER_H
+#define CAPTURE_WRITER_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <atomic>
+#include <pthread.h>
+#include <stdint.h>
+#include "sample_ring.h"
+#include "block_fanout.h"
+#include "rx_log_format.h"
+#include "capture_file.h"
+#include "rt_thread.h"
+
+// Number of metadata records written to the binary log at once
+#define RX_LOG_BATCH 128
+
+/// Block as seen by the writer: its samples as raw bytes
+typedef sample_block<char> capture_block;
+
+
+/***********************************************************************//**
+Queue of blocks read by the capture writer thread
+
+The writer does not own the blocks: it reads them in place from the queue
+given to set_feed() and releases each one once its samples are copied
+into the staging buffer.
+
+***************************************************************************/
+class capture_feed
+{
+public:
+	virtual ~capture_feed() {}
+	/// Waits for the next block. Returns false once the feed is closed and empty
+	virtual bool wait_block(capture_block & block) = 0;
+	/// Releases the block returned by the last wait_block()
+	virtual void release_block() = 0;
+	/// Wakes up the writer: wait_block() returns false once the queued blocks are written
+	virtual void close() = 0;
+	/// Number of blocks waiting
+	virtual size_t depth() const = 0;
+	/// Largest number of blocks observed waiting
+	virtual size_t get_max_depth() const = 0;
+	/// Number of blocks the writer missed because the queue was full
+	virtual uint64_t get_drops() const = 0;
+};
+
+
+/***********************************************************************//**
+Feed reading the blocks of a block_fanout subscription, without copy
+
+***************************************************************************/
+template <typename T>
+class capture_subscription : public capture_feed
+{
+public:
+	capture_subscription() : subscriber(NULL) {}
+	void attach(fanout_subscriber<T> & sub) {subscriber = &sub;}
+
+	bool wait_block(capture_block & block)
+	{
+		const typename fanout_subscriber<T>::block_t * b = subscriber->wait_read();
+		if(b == NULL)
+			return false;
+		block.samples = reinterpret_cast<char*>(b->samples);
+		block.capacity = b->capacity * sizeof(T);
+		block.num_samps = b->num_samps;
+		block.sequence = b->sequence;
+		block.first_sample = b->first_sample;
+		block.md = b->md;
+		block.skipped = b->skipped;
+		block.publish_time = b->publish_time;
+		return true;
+	}
+	void release_block() {subscriber->release();}
+	void close() {subscriber->close();}
+	size_t depth() const {return subscriber->depth();}
+	size_t get_max_depth() const {return subscriber->get_max_depth();}
+	uint64_t get_drops() const {return subscriber->get_drops();}
+
+private:
+	fanout_subscriber<T> * subscriber;
+};
+
+
+/***********************************************************************//**
+This class represents the thread which writes the captured samples and
+their metadata to disk
+
+The writer thread reads the blocks published by the sampling task from its
+feed (see capture_feed, a subscription to the block_fanout of the task),
+gathers the samples in a large page aligned staging buffer and writes it
+with O_DIRECT into a file preallocated with fallocate(). If the queue of
+the feed is full, the block is dropped and counted instead of stalling the
+sampling task.
+
+The metadata of each block is stored as a fixed size rx_log_record in a
+binary log, written in batches of RX_LOG_BATCH records. The text format of
+display_rx_metadata() is still available for debugging.
+
+The sample file is a capture file (see capture_file.h): the header given
+to set_header() is written by start(), the time index is built while the
+blocks are written and appended when the file is closed.
+
+***************************************************************************/
+class capture_writer
+{
+public:
+	capture_writer(size_t sample_size, size_t chunk_bytes = 1 << 20);
+	~capture_writer();
+
+	bool open(const char * data_filename, const char * log_filename, bool text_log = false);
+	void set_header(const capture_header & header, const std::string & snapshot);
+	/// Real-time settings of the writer thread, used by the next start()
+	void set_rt_config(const thread_rt_config & config) {rt_config = config;}
+	/// Queue of the blocks to write. Must be set before start()
+	void set_feed(capture_feed * blocks) {feed = blocks;}
+	bool start();
+	void stop();
+
+	/// Counts the samples left out by the squelch after the last block. Only once the thread is stopped
+	void add_squelched(uint64_t num_samps) {header.num_squelched += num_samps;}
+
+	/// Number of blocks waiting in the queue
+	size_t get_queue_depth() const {return feed ? feed->depth() : 0;}
+	/// Largest number of blocks observed in the queue
+	size_t get_max_queue_depth() const {return feed ? feed->get_max_depth() : 0;}
+	/// Number of blocks dropped because the queue was full
+	uint64_t get_drops() const {return feed ? feed->get_drops() : 0;}
+	/// Number of bytes written to the data file
+	uint64_t get_bytes_written() const {return bytes_written.load(std::memory_order_relaxed);}
+	/// Number of discontinuities recorded in the index. Valid once the thread is stopped
+	uint64_t get_num_gaps() const {return header.num_gaps;}
+	/// Number of samples left out by the squelch. Valid once the thread is stopped
+	uint64_t get_num_squelched() const {return header.num_squelched;}
+	/// True if the data file has been opened with O_DIRECT
+	bool is_direct() const {return direct_io;}
+
+private:
+	capture_writer(const capture_writer &);
+	capture_writer & operator=(const capture_writer &);
+
+	static void * helper(void * arg) {return static_cast<capture_writer*>(arg)->run();}
+	void * run();				/// Main routine of the writer thread
+	void write_block(const capture_block * block);
+	bool flush_chunk();
+	void log_metadata(const capture_block * block);
+	void flush_records();
+	void index_block(const capture_block * block);
+	bool write_header();
+	void close_files();
+
+	size_t sample_size;		/// Size in bytes of one complex sample
+	capture_feed * feed;		/// Bounded queue of blocks waiting to be written
+	size_t chunk_bytes;		/// Size of each write() to the data file
+	char * chunk;			/// Page aligned staging buffer
+	size_t chunk_fill;		/// Number of bytes currently in the staging buffer
+	int data_fd;			/// File descriptor of the sample file
+	bool direct_io;			/// True if data_fd was opened with O_DIRECT
+	uint64_t file_offset;		/// Number of bytes written to the sample file so far
+	uint64_t allocated;		/// Number of bytes preallocated in the sample file
+	capture_header header;		/// Header of the capture file
+	std::string snapshot;		/// get_rx_parameters() text stored after the header
+	std::vector<capture_index_entry> index;	/// Time index of the capture
+	bool pending_overflow;		/// An overflow was reported since the last block with samples
+	std::ofstream rx_log;		/// ostream to write the metadata associated with each buffer
+	bool text_log;			/// True if rx_log is written in the text format
+	rx_log_record records[RX_LOG_BATCH];	/// Binary records waiting to be written
+	size_t num_records;		/// Number of records in the records array
+	pthread_t thread_id;		/// ID of the writer thread
+	thread_rt_config rt_config;	/// Real-time settings of the writer thread
+	bool running;			/// True while the thread exists
+	std::atomic<uint64_t> bytes_written;
+};
+
+
+#endif
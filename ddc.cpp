@@ -0,0 +1,157 @@
+#include "ddc.h"
+#include "baseband.h"
+#include "dsp_kernels.h"
+#include <cmath>
+
+
+/// cos + j sin of the NCO phases, filled on first use
+static sample_fc32 nco_lut[NCO_TABLE_SIZE];
+static bool nco_lut_ready = false;
+
+static void init_nco_lut()
+{
+	if(nco_lut_ready)
+		return;
+	for(int index = 0; index < NCO_TABLE_SIZE; index++)
+	{
+		double angle = 2 * M_PI * index / NCO_TABLE_SIZE;
+		nco_lut[index] = sample_fc32(float(cos(angle)), float(sin(angle)));
+	}
+	nco_lut_ready = true;
+}
+
+
+/***********************************************************************//**
+Constructor
+
+@param input_rate Sample rate of the input in samples/s
+@param decim Decimation factor
+@param prototype Coefficients of the low-pass filter (see design_lowpass())
+
+***************************************************************************/
+
+ddc_stage::ddc_stage(double input_rate, size_t decim, const std::vector<double> & prototype)
+:rate(input_rate), decimation(decim ? decim : 1), proto(prototype), requested_step(0), nco_step(0), nco_phase(0), next_output(0)
+{
+	init_nco_lut();
+	if(proto.empty())
+		proto.push_back(1.0);
+	retune(0);
+	reset();
+}
+
+
+void ddc_stage::set_frequency(double freq)
+{
+	double turns = freq / rate;
+	turns -= floor(turns);
+	requested_step.store(uint32_t(int64_t(floor(turns * 4294967296.0 + 0.5))), std::memory_order_relaxed);
+}
+
+
+double ddc_stage::get_frequency() const
+{
+	double freq = requested_step.load(std::memory_order_relaxed) / 4294967296.0 * rate;
+	return freq >= rate / 2 ? freq - rate : freq;
+}
+
+
+/// Forgets the past samples and restarts the NCO at phase 0. Like the
+/// baseband chains, the first output is computed at input decimation - 1
+void ddc_stage::reset()
+{
+	nco_phase = 0;
+	next_output = decimation - 1;
+	history.assign(proto.size() - 1, sample_fc32(0, 0));
+}
+
+
+/***********************************************************************//**
+Rotates the coefficients for a new frequency: tap k is multiplied by
+exp(-j w k). The angles are computed exactly, the table is only used for
+the output rotation.
+
+***************************************************************************/
+
+void ddc_stage::retune(uint32_t step)
+{
+	size_t num_taps = proto.size();
+	double w = 2 * M_PI * step / 4294967296.0;
+	taps.resize(num_taps);
+	for(size_t k = 0; k < num_taps; k++)
+	{
+		std::complex<double> tap = std::polar(proto[k], -w * double(k));
+		taps[num_taps - 1 - k] = sample_fc32(float(tap.real()), float(tap.imag()));
+	}
+	nco_step = step;
+}
+
+
+/***********************************************************************//**
+Filters a float block. The outputs whose window starts in the previous
+block read the history followed by the first inputs of the block; the
+others read the block directly.
+
+@return Number of output samples
+
+***************************************************************************/
+
+size_t ddc_stage::filter(const sample_fc32 * in, size_t num_samps, sample_fc32 * out)
+{
+	const dsp_kernel_table & k = dsp_kernels();
+	const size_t num_taps = taps.size();
+	const size_t span = num_taps - 1;
+	const uint32_t round = uint32_t(1) << (31 - NCO_TABLE_BITS);
+
+	size_t head = num_samps < span ? num_samps : span;
+	history.insert(history.end(), in, in + head);
+
+	size_t count = 0;
+	size_t index = next_output;
+	for(; index < num_samps; index += decimation)
+	{
+		uint32_t phase = nco_phase + nco_step * uint32_t(index);
+		const sample_fc32 * window = index >= span ? in + index - span : &history[index];
+		sample_fc32 value = k.fc32_dot(window, &taps[0], num_taps);
+		const sample_fc32 & rotation = nco_lut[((phase + round) >> (32 - NCO_TABLE_BITS)) & (NCO_TABLE_SIZE - 1)];
+		out[count++] = sample_fc32(value.real() * rotation.real() - value.imag() * rotation.imag(),
+			value.real() * rotation.imag() + value.imag() * rotation.real());
+	}
+	nco_phase += nco_step * uint32_t(num_samps);
+	next_output = index - num_samps;
+
+	// Keep the last span inputs for the next block
+	if(num_samps >= span)
+		history.assign(in + num_samps - span, in + num_samps);
+	else
+		history.erase(history.begin(), history.begin() + num_samps);
+	return count;
+}
+
+
+/***********************************************************************//**
+Down-converts one block. A frequency set since the previous block is
+applied first.
+
+@param in Input samples, in any host format of the sampling task
+@param num_samps Number of input samples
+@param out Receives max_output(num_samps) samples at most
+
+@return Number of output samples
+
+***************************************************************************/
+
+template <typename T>
+size_t ddc_stage::process(const T * in, size_t num_samps, sample_fc32 * out)
+{
+	uint32_t step = requested_step.load(std::memory_order_relaxed);
+	if(step != nco_step)
+		retune(step);
+	// The float samples are filtered where they are
+	return filter(dsp_as_fc32(in, num_samps, converted), num_samps, out);
+}
+
+
+template size_t ddc_stage::process(const sample_sc8 * in, size_t num_samps, sample_fc32 * out);
+template size_t ddc_stage::process(const sample_sc16 * in, size_t num_samps, sample_fc32 * out);
+template size_t ddc_stage::process(const sample_fc32 * in, size_t num_samps, sample_fc32 * out);
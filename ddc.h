@@ -0,0 +1,75 @@
+/***********************************************************************//**
+@file
+
+Host digital down-converter applied to the blocks of the sampling ring
+
+The stage shifts the spectrum by a frequency which can be changed at any
+time, then filters and decimates. The mixer is fused with the decimating
+filter (frequency translating FIR): the NCO rotation is moved onto the
+coefficients, so the filter runs directly on the input samples and the
+NCO only turns at the output rate. A frequency correction rotates the
+coefficients again before the next block; the phase of the NCO is kept.
+
+Unlike a retune of the USRP (tune_request_t), a correction costs no
+round trip on the control path and does not disturb the stream.
+
+***************************************************************************/
+
+#ifndef DDC_H
+#define DDC_H
+
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+#include "sample_format.h"
+#include "block_pool.h"
+
+
+/***********************************************************************//**
+Frequency translating decimating FIR
+
+The output is float, relative to full scale. The input is any host
+sample type of the sampling task; fc32 blocks are filtered in place,
+the integer formats are converted once with the DSP kernels.
+
+y[n] = exp(j phase(n)) * sum_k h[k] exp(-j w k) x[n - k], for every
+decimation-th input n
+
+***************************************************************************/
+class ddc_stage
+{
+public:
+	typedef sample_fc32 output_type;
+
+	ddc_stage(double rate, size_t decimation, const std::vector<double> & taps);
+
+	/// Shift applied to the spectrum in Hz (-offset to bring a signal at offset to 0). Thread safe
+	void set_frequency(double freq);
+	double get_frequency() const;
+	/// Output sample rate
+	double get_output_rate() const {return rate / decimation;}
+	/// Maximum number of outputs produced from num_samps inputs
+	size_t max_output(size_t num_samps) const {return num_samps / decimation + 1;}
+	void reset();
+
+	template <typename T>
+	size_t process(const T * in, size_t num_samps, sample_fc32 * out);
+
+private:
+	void retune(uint32_t step);
+	size_t filter(const sample_fc32 * in, size_t num_samps, sample_fc32 * out);
+
+	double rate;				/// Input sample rate
+	size_t decimation;			/// Decimation factor
+	std::vector<double> proto;	/// Low-pass prototype
+	fc32_buffer taps;	/// Prototype rotated by the NCO, in reverse order
+	std::atomic<uint32_t> requested_step;	/// Phase increment set by set_frequency()
+	uint32_t nco_step;			/// Phase increment of the coefficients (2^32 = one turn)
+	uint32_t nco_phase;			/// Phase of the NCO at the first input of the next block
+	size_t next_output;			/// Index in the next block of the input of the next output
+	fc32_buffer history;	/// Last taps - 1 inputs, followed by the start of the block
+	fc32_buffer converted;	/// Integer input converted to float
+};
+
+
+#endif
@@ -0,0 +1,192 @@
+/***********************************************************************//**
+@file
+
+Checks the QPSK demodulator (demodulator.h) on simulated signals and
+measures its cost per block
+
+The simulated source sends continuous QPSK with rectangular pulses, off
+the nominal carrier and symbol rate, with several noise levels. For each
+signal the program checks that both loops locked (carrier frequency and
+symbol period estimates, no symbol slipped, modulation error ratio above
+a bound), and that the symbols do not depend on how the stream is cut
+into blocks. The CPU time of the demodulator is then measured on the
+blocks of the sampling task (2172 samples, 20 ms at 125 kS/s).
+
+Usage: demodbench [-t seconds] [-l label] [-j file]
+
+-t measuring time in seconds (default 0.5)
+-l label stored in the results (e.g. the release)
+-j file receiving the results, one JSON object per line (default demod_bench.json)
+
+The exit code is 1 if the demodulator did not lock on a signal or if its
+output depends on the block size.
+
+***************************************************************************/
+
+#include <cstdio>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "demodulator.h"
+#include "sim_source.h"
+#include "latency_stats.h"
+#include "bench_common.h"
+
+
+#define BENCH_RATE 125000.0
+#define BENCH_CENTER -20000.0	/// Carrier of the simulated signal, as in receiver_test --sim
+#define BENCH_SYMBOL_RATE 12500.0
+#define BENCH_SAMPLES 250000	/// 2 s of signal
+#define BLOCK_SAMPS 2172		/// Block of the sampling task for 20 ms
+#define ODD_BLOCK_SAMPS 997		/// Block size which is not a multiple of anything
+#define MAX_FREQ_ERROR 10.0		/// Error allowed on the carrier frequency estimate in Hz
+#define MAX_PERIOD_ERROR 5e-4	/// Error allowed on the symbol period estimate (relative)
+
+
+/// One simulated signal
+struct demod_case
+{
+	const char * name;
+	double noise_rms;			/// RMS of the noise at the input (signal amplitude 0.5)
+	double freq_offset;			/// Carrier offset from the center of the demodulator in Hz
+	double rate_error_ppm;		/// Error of the symbol rate
+	double min_mer;				/// Lowest modulation error ratio accepted in dB
+};
+
+static const demod_case cases[] = {
+	{"clean", 0.01, 150, 1000, 20},
+	{"noise 0.1", 0.1, -250, -200, 15},
+	{"noise 0.3", 0.3, 100, 50, 9},
+};
+
+
+/// Continuous QPSK: a single burst longer than the test
+static std::vector<sample_sc16> make_signal(const demod_case & test)
+{
+	sim_config sim;
+	sim.rate = BENCH_RATE;
+	sim.noise_rms = test.noise_rms;
+	sim.burst_amplitude = 0.5;
+	sim.burst_freq = BENCH_CENTER + test.freq_offset;
+	sim.symbol_rate = BENCH_SYMBOL_RATE * (1 + test.rate_error_ppm * 1e-6);
+	sim.burst_symbols = 2 * BENCH_SAMPLES;
+	sim.burst_period = 100 * BENCH_SAMPLES / BENCH_RATE;
+	sim_source source(sim);
+	source.start(0);
+	std::vector<sample_sc16> signal(BENCH_SAMPLES);
+	source.generate(&signal[0], signal.size());
+	return signal;
+}
+
+
+/// Demodulates the whole signal in blocks of block_samps
+static size_t demodulate(qpsk_demodulator & demod, const std::vector<sample_sc16> & signal, size_t block_samps,
+	std::vector<sample_fc32> & symbols)
+{
+	std::vector<int8_t> soft(2 * demod.max_output(block_samps));
+	symbols.resize(demod.max_output(signal.size()) + signal.size() / block_samps + 1);
+	size_t count = 0;
+	for(size_t start = 0; start < signal.size(); start += block_samps)
+	{
+		size_t n = signal.size() - start < block_samps ? signal.size() - start : block_samps;
+		count += demod.process(&signal[start], n, &symbols[count], &soft[0]);
+	}
+	symbols.resize(count);
+	return count;
+}
+
+
+/// MER in dB of the symbols from first on
+static double measure_mer(const std::vector<sample_fc32> & symbols, size_t first)
+{
+	double error = 0;
+	for(size_t n = first; n < symbols.size(); n++)
+	{
+		sample_fc32 decision(symbols[n].real() < 0 ? -1.0f : 1.0f, symbols[n].imag() < 0 ? -1.0f : 1.0f);
+		error += std::norm(symbols[n] - decision);
+	}
+	return first < symbols.size() && error > 0 ? 10 * log10(2 * (symbols.size() - first) / error) : 0;
+}
+
+
+int main(int argc, char ** argv)
+{
+	bench_context bench("demod_bench.json", 0.5);
+	for(int index = 1; index < argc; index++)
+	{
+		if(bench.parse_option(argc, argv, index))
+		{
+			std::cout << "Usage: demodbench [-t seconds] [-l label] [-j file]" << std::endl;
+			return 1;
+		}
+	}
+	if(bench.open())
+		return 1;
+
+	demod_config config;
+	config.rate = BENCH_RATE;
+	config.center_freq = BENCH_CENTER;
+	config.symbol_rate = BENCH_SYMBOL_RATE;
+
+	//------------------------------------------------
+	// Acquisition and tracking
+	//------------------------------------------------
+	printf("%-10s %9s %9s %9s %9s %8s %8s\n", "signal", "freq Hz", "est. Hz", "period", "symbols", "MER dB", "blocks");
+	for(size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+	{
+		const demod_case & test = cases[c];
+		std::vector<sample_sc16> signal = make_signal(test);
+		qpsk_demodulator demod;
+		if(demod.configure(config))
+			return 1;
+		std::vector<sample_fc32> symbols, odd_symbols;
+		size_t count = demodulate(demod, signal, BLOCK_SAMPS, symbols);
+		double freq = demod.get_freq_offset();
+		double period = demod.get_symbol_period();
+
+		// Same demodulator, other block size: the symbols must be the same
+		qpsk_demodulator odd_demod;
+		odd_demod.configure(config);
+		demodulate(odd_demod, signal, ODD_BLOCK_SAMPS, odd_symbols);
+		bool same = odd_symbols.size() == symbols.size() &&
+			memcmp(&odd_symbols[0], &symbols[0], symbols.size() * sizeof(sample_fc32)) == 0;
+
+		// The loops have settled after a quarter of the signal
+		double true_period = BENCH_RATE / (BENCH_SYMBOL_RATE * (1 + test.rate_error_ppm * 1e-6));
+		double expected = BENCH_SAMPLES / true_period;
+		double mer = measure_mer(symbols, symbols.size() / 4);
+		bool locked = fabs(freq - test.freq_offset) < MAX_FREQ_ERROR && fabs(period / true_period - 1) < MAX_PERIOD_ERROR &&
+			fabs(count - expected) < 3 && mer >= test.min_mer;
+		bench.errors += !locked + !same;
+		printf("%-10s %9.1f %9.1f %9.4f %9zu %8.1f %8s%s\n", test.name, test.freq_offset, freq, period, count, mer,
+			same ? "same" : "DIFFER", locked ? "" : "  NOT LOCKED");
+		fprintf(bench.record("demod_check"), "\"signal\":\"%s\",\"freq\":%.1f,\"freq_estimate\":%.2f,\"period\":%.5f,"
+			"\"period_estimate\":%.5f,\"symbols\":%zu,\"expected\":%.1f,\"mer\":%.2f,\"block_independent\":%s}\n",
+			test.name, test.freq_offset, freq, true_period, period, count, expected, mer, same ? "true" : "false");
+	}
+
+	//------------------------------------------------
+	// CPU time per block
+	//------------------------------------------------
+	{
+		std::vector<sample_sc16> signal = make_signal(cases[1]);
+		qpsk_demodulator demod;
+		demod.configure(config);
+		std::vector<sample_fc32> symbols(demod.max_output(BLOCK_SAMPS));
+		std::vector<int8_t> soft(2 * symbols.size());
+		uint64_t start = monotonic_ns();
+		while(monotonic_ns() < start + uint64_t(bench.seconds * 1e9))
+			for(size_t offset = 0; offset + BLOCK_SAMPS <= signal.size(); offset += BLOCK_SAMPS)
+				demod.process(&signal[offset], BLOCK_SAMPS, &symbols[0], &soft[0]);
+		const latency_histogram & cost = demod.get_block_cost();
+		double block_ns = BLOCK_SAMPS / BENCH_RATE * 1e9;
+		double msps = BLOCK_SAMPS / cost.get_mean() * 1e3;
+		printf("CPU per block of %d samples: mean %.1f us, p99 %.1f us, max %.1f us, %.2f MS/s, %.2f%% of real time\n",
+			BLOCK_SAMPS, cost.get_mean() * 1e-3, cost.percentile(99) * 1e-3, cost.get_max() * 1e-3, msps,
+			100 * cost.get_mean() / block_ns);
+		fprintf(bench.record("demod"), "\"block\":%d,\"mean_us\":%.2f,\"p99_us\":%.2f,\"max_us\":%.2f,\"msps\":%.2f,\"load\":%.4f}\n",
+			BLOCK_SAMPS, cost.get_mean() * 1e-3, cost.percentile(99) * 1e-3, cost.get_max() * 1e-3, msps, cost.get_mean() / block_ns);
+	}
+
+	return bench.finish("Demodulator locked on every signal");
+}
@@ -0,0 +1,282 @@
+#include "demodulator.h"
+#include <cmath>
+#include <complex>
+#include <algorithm>
+#include <iostream>
+
+
+/// Matched filter outputs kept between blocks for the cubic interpolator
+#define INTERP_HISTORY 3
+/// Samples per symbol targeted at the output of the DDC
+#define DEMOD_SPS 4
+/// Largest error of the symbol period followed by the timing loop (relative)
+#define TIMING_MAX_PERIOD_ERROR 0.05
+/// Largest phase correction of the timing loop per symbol (in symbols)
+#define TIMING_MAX_CORRECTION 0.25
+/// Averaging of the amplitude and of the error vector: 2^-7 per symbol
+#define SYMBOL_AVERAGING (1.0f / 128)
+
+
+/***********************************************************************//**
+Gains of a second order loop (proportional and integral paths)
+
+@param bandwidth Noise bandwidth relative to the update rate
+@param damping Damping factor
+@param detector_gain Slope of the error detector
+@param kp Receives the proportional gain
+@param ki Receives the integral gain
+
+***************************************************************************/
+
+static void loop_gains(double bandwidth, double damping, double detector_gain, float & kp, float & ki)
+{
+	double theta = bandwidth / (damping + 0.25 / damping);
+	double d = 1 + 2 * damping * theta + theta * theta;
+	kp = float(4 * damping * theta / d / detector_gain);
+	ki = float(4 * theta * theta / d / detector_gain);
+}
+
+
+/// Cubic Lagrange interpolation between x[0] and x[1] (uses x[-1] .. x[2])
+static inline sample_fc32 interpolate(const sample_fc32 * x, float mu)
+{
+	sample_fc32 c1 = x[-1] * (-1.0f / 3) - x[0] * 0.5f + x[1] - x[2] * (1.0f / 6);
+	sample_fc32 c2 = (x[-1] + x[1]) * 0.5f - x[0];
+	sample_fc32 c3 = (x[2] - x[-1]) * (1.0f / 6) + (x[0] - x[1]) * 0.5f;
+	return ((c3 * mu + c2) * mu + c1) * mu + x[0];
+}
+
+
+static inline float sign(float x)
+{
+	return x < 0 ? -1.0f : 1.0f;
+}
+
+
+static inline int8_t soft_bit(float value)
+{
+	float rounded = floorf(value + 0.5f);
+	return int8_t(rounded > 127 ? 127 : (rounded < -127 ? -127 : rounded));
+}
+
+
+qpsk_demodulator::qpsk_demodulator()
+:ddc(NULL), sps(1)
+{
+	reset();
+}
+
+
+qpsk_demodulator::~qpsk_demodulator()
+{
+	delete ddc;
+}
+
+
+/***********************************************************************//**
+Builds the stages
+
+The DDC decimates by the largest factor leaving DEMOD_SPS samples per
+symbol at least; its low-pass filter passes 80% of the output band, the
+matched filter does the rest.
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool qpsk_demodulator::configure(const demod_config & cfg)
+{
+	if(cfg.rate <= 0 || cfg.symbol_rate <= 0 || cfg.rate < 2 * cfg.symbol_rate)
+	{
+		std::cout << "Demodulator needs 2 samples per symbol at least (" << cfg.rate << " samples/s, "
+			<< cfg.symbol_rate << " symbols/s)" << std::endl;
+		return true;
+	}
+	config = cfg;
+	size_t decimation = size_t(config.rate / config.symbol_rate / DEMOD_SPS);
+	if(decimation == 0)
+		decimation = 1;
+	double output_rate = config.rate / decimation;
+	double cutoff = 0.4 * output_rate;
+	delete ddc;
+	ddc = new ddc_stage(config.rate, decimation, design_lowpass(8 * decimation + 1, cutoff, config.rate));
+	ddc->set_frequency(-config.center_freq);
+	sps = output_rate / config.symbol_rate;
+
+	baseband_config chain_config;
+	chain_config.rate = output_rate;
+	chain_config.taps = config.matched_taps;
+	if(chain_config.taps.empty())
+		chain_config.taps.assign(size_t(floor(sps + 0.5)), 1.0 / floor(sps + 0.5));
+	chain_config.agc_enable = true;
+	chain_config.agc_reference = config.agc_reference;
+	chain_config.agc_rate_shift = config.agc_rate_shift;
+	chain.configure(chain_config);
+
+	// Gardner detector: slope 4 per symbol of timing error on the normalised
+	// constellation. Decision directed carrier detector: slope 1 per radian
+	loop_gains(config.timing_bandwidth, config.damping, 4, timing_kp, timing_ki);
+	loop_gains(config.carrier_bandwidth, config.damping, 1, carrier_kp, carrier_ki);
+	reset();
+	return false;
+}
+
+
+/// Forgets the signal: delay lines, AGC and both loops
+void qpsk_demodulator::reset()
+{
+	if(ddc)
+		ddc->reset();
+	chain.reset();
+	work.assign(INTERP_HISTORY, sample_fc32(0, 0));
+	strobe_index = 1;
+	strobe_mu = 0;
+	half_step = sps / 2;
+	timing_integrator = 0;
+	mid_next = false;
+	mid_sample = sample_fc32(0, 0);
+	prev_sample = sample_fc32(0, 0);
+	carrier_phase = 0;
+	carrier_freq = 0;
+	amplitude = float(config.agc_reference * M_SQRT1_2);
+	error_power = 0;
+	num_symbols = 0;
+	num_samples = 0;
+	block_cost.reset();
+}
+
+
+size_t qpsk_demodulator::max_output(size_t num_samps) const
+{
+	double min_period = sps * (1 - TIMING_MAX_PERIOD_ERROR - TIMING_MAX_CORRECTION);
+	return ddc ? size_t((ddc->max_output(num_samps) + INTERP_HISTORY) / min_period) + 2 : 0;
+}
+
+
+double qpsk_demodulator::get_freq_offset() const
+{
+	return carrier_freq * config.symbol_rate / (2 * M_PI);
+}
+
+
+double qpsk_demodulator::get_symbol_period() const
+{
+	return config.rate / config.symbol_rate * (1 + timing_integrator);
+}
+
+
+double qpsk_demodulator::get_mer() const
+{
+	return error_power > 0 ? 10 * log10(2 / error_power) : 0;
+}
+
+
+/***********************************************************************//**
+Carrier recovery and decisions on one symbol
+
+The symbol is rotated by the phase of the carrier loop and normalised so
+that the constellation points are at (+-1, +-1). The loop error is the
+phase between the symbol and its decision.
+
+@param y Symbol at the output of the timing recovery
+@param symbol Receives the normalised symbol
+@param soft_bits Receives the soft bits of I and Q
+
+***************************************************************************/
+
+void qpsk_demodulator::slice(sample_fc32 y, sample_fc32 & symbol, int8_t * soft_bits)
+{
+	sample_fc32 z = y * sample_fc32(float(cos(carrier_phase)), float(-sin(carrier_phase)));
+	amplitude += ((fabsf(z.real()) + fabsf(z.imag())) * 0.5f - amplitude) * SYMBOL_AVERAGING;
+	z /= amplitude > 1e-9f ? amplitude : 1e-9f;
+
+	float decision_i = sign(z.real()), decision_q = sign(z.imag());
+	float error = (decision_i * z.imag() - decision_q * z.real()) * 0.5f;
+	error = error > 1 ? 1 : (error < -1 ? -1 : error);
+	carrier_freq += carrier_ki * error;
+	carrier_phase += carrier_freq + carrier_kp * error;
+	carrier_phase -= 2 * M_PI * floor(carrier_phase / (2 * M_PI));
+
+	sample_fc32 distance = z - sample_fc32(decision_i, decision_q);
+	error_power += (std::norm(distance) - error_power) * SYMBOL_AVERAGING;
+
+	symbol = z;
+	soft_bits[0] = soft_bit(z.real() * float(config.soft_scale));
+	soft_bits[1] = soft_bit(z.imag() * float(config.soft_scale));
+}
+
+
+/***********************************************************************//**
+Demodulates one block
+
+@param in Input samples, in any host format of the sampling task
+@param num_samps Number of input samples
+@param symbols Receives max_output(num_samps) symbols at most,
+normalised to (+-1, +-1)
+@param soft_bits Receives two soft bits per symbol
+
+@return Number of symbols
+
+***************************************************************************/
+
+template <typename T>
+size_t qpsk_demodulator::process(const T * in, size_t num_samps, sample_fc32 * symbols, int8_t * soft_bits)
+{
+	uint64_t start = thread_cpu_ns();
+
+	// Buffers are sized by the first block, the next ones do not allocate
+	size_t max_ddc = ddc->max_output(num_samps);
+	if(ddc_out.size() < max_ddc)
+	{
+		ddc_out.resize(max_ddc);
+		work.resize(INTERP_HISTORY + max_ddc);
+	}
+	size_t n = ddc->process(in, num_samps, &ddc_out[0]);
+	chain.agc(&ddc_out[0], n);
+	chain.filter(&ddc_out[0], n, &work[INTERP_HISTORY]);
+	const size_t len = INTERP_HISTORY + n;
+
+	// Strobes every half symbol; the interpolator needs one sample before
+	// the strobe and two after
+	size_t count = 0;
+	while(strobe_index + 2 < len)
+	{
+		sample_fc32 y = interpolate(&work[strobe_index], float(strobe_mu));
+		if(mid_next)
+			mid_sample = y;
+		else
+		{
+			// Gardner: the sample between two symbols is 0 at the right time,
+			// it leans towards the later symbol when the strobes are late
+			float norm = amplitude * amplitude;
+			float error = std::real((prev_sample - y) * std::conj(mid_sample)) / (norm > 1e-18f ? norm : 1e-18f);
+			timing_integrator += timing_ki * error;
+			timing_integrator = std::max(-TIMING_MAX_PERIOD_ERROR, std::min(TIMING_MAX_PERIOD_ERROR, timing_integrator));
+			double correction = std::max(-TIMING_MAX_CORRECTION, std::min(TIMING_MAX_CORRECTION, double(timing_kp * error)));
+			half_step = sps * (1 + timing_integrator + correction) / 2;
+			prev_sample = y;
+			slice(y, symbols[count], &soft_bits[2 * count]);
+			count++;
+		}
+		mid_next = !mid_next;
+
+		strobe_mu += half_step;
+		double whole = floor(strobe_mu);
+		strobe_index += size_t(whole);
+		strobe_mu -= whole;
+	}
+
+	// Keep the samples around the next strobe for the next block
+	std::copy(work.begin() + n, work.begin() + len, work.begin());
+	strobe_index -= n;
+
+	num_symbols += count;
+	num_samples += num_samps;
+	block_cost.record(thread_cpu_ns() - start);
+	return count;
+}
+
+
+template size_t qpsk_demodulator::process(const sample_sc8 * in, size_t num_samps, sample_fc32 * symbols, int8_t * soft_bits);
+template size_t qpsk_demodulator::process(const sample_sc16 * in, size_t num_samps, sample_fc32 * symbols, int8_t * soft_bits);
+template size_t qpsk_demodulator::process(const sample_fc32 * in, size_t num_samps, sample_fc32 * symbols, int8_t * soft_bits);
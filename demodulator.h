@@ -0,0 +1,131 @@
+/***********************************************************************//**
+@file
+
+Streaming QPSK demodulator fed by the blocks of the sampling task
+
+The stages run one after the other on each block:
+
+- host DDC (ddc_stage): brings the signal to 0 Hz and decimates to about
+  four samples per symbol
+- AGC of the float baseband chain
+- matched filter (a rectangular pulse of one symbol by default, the pulse
+  of the simulated bursts)
+- Gardner symbol timing recovery, with a cubic interpolator running at
+  two strobes per symbol
+- decision directed (Costas) carrier recovery, second order loop
+- slicer: hard decisions and soft bits
+
+Every stage keeps its state between blocks (delay lines, AGC gain, the
+three last matched filter outputs needed by the interpolator, the loop
+integrators), so a sample is processed exactly once and the symbols do
+not depend on how the stream is cut into blocks.
+
+***************************************************************************/
+
+#ifndef DEMODULATOR_H
+#define DEMODULATOR_H
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+#include "sample_format.h"
+#include "block_pool.h"
+#include "baseband.h"
+#include "ddc.h"
+#include "latency_stats.h"
+
+
+/// Configuration of the demodulator
+struct demod_config
+{
+	demod_config() : rate(125000), center_freq(0), symbol_rate(12500), agc_reference(0.25), agc_rate_shift(8),
+		timing_bandwidth(0.01), carrier_bandwidth(0.02), damping(0.707), soft_scale(32) {}
+
+	double rate;				/// Input sample rate in samples/s
+	double center_freq;			/// Frequency of the signal in the input in Hz
+	double symbol_rate;			/// Symbol rate in symbols/s
+	std::vector<double> matched_taps;	/// Matched filter at the DDC output rate. Empty for a rectangular pulse
+	double agc_reference;		/// Level of the samples after the AGC (fraction of full scale)
+	int agc_rate_shift;			/// The AGC corrects 2^-agc_rate_shift of the error per sample
+	double timing_bandwidth;	/// Noise bandwidth of the timing loop, relative to the symbol rate
+	double carrier_bandwidth;	/// Noise bandwidth of the carrier loop, relative to the symbol rate
+	double damping;				/// Damping factor of both loops
+	double soft_scale;			/// Soft bit of a symbol on the ideal constellation point
+};
+
+
+/***********************************************************************//**
+QPSK demodulator
+
+Each symbol gives two soft bits, I then Q: the component of the symbol
+normalised to +-1, times soft_scale, saturated to +-127. A negative soft
+bit is a hard 1.
+
+The CPU time of each process() call (CLOCK_THREAD_CPUTIME_ID) is recorded
+in a histogram, read with get_block_cost() once the consumer has stopped.
+
+***************************************************************************/
+class qpsk_demodulator
+{
+public:
+	typedef sample_fc32 output_type;
+
+	qpsk_demodulator();
+	~qpsk_demodulator();
+	bool configure(const demod_config & config);
+	void reset();
+
+	/// Maximum number of symbols produced from num_samps inputs
+	size_t max_output(size_t num_samps) const;
+
+	template <typename T>
+	size_t process(const T * in, size_t num_samps, sample_fc32 * symbols, int8_t * soft_bits);
+
+	/// Residual carrier frequency tracked by the carrier loop in Hz
+	double get_freq_offset() const;
+	/// Symbol period tracked by the timing loop, in input samples
+	double get_symbol_period() const;
+	/// Modulation error ratio of the recent symbols in dB
+	double get_mer() const;
+	uint64_t get_num_symbols() const {return num_symbols;}
+	uint64_t get_num_samples() const {return num_samples;}
+	/// CPU time of the blocks in ns
+	const latency_histogram & get_block_cost() const {return block_cost;}
+
+private:
+	qpsk_demodulator(const qpsk_demodulator &);
+	qpsk_demodulator & operator=(const qpsk_demodulator &);
+
+	void slice(sample_fc32 y, sample_fc32 & symbol, int8_t * soft_bits);
+
+	demod_config config;
+	ddc_stage * ddc;			/// Shift to 0 Hz and first decimation
+	baseband_fc32 chain;		/// AGC and matched filter
+	fc32_buffer ddc_out;
+	fc32_buffer work;	/// Last INTERP_HISTORY matched filter outputs, then those of the block
+	double sps;					/// Nominal samples per symbol at the DDC output
+
+	// Timing recovery
+	float timing_kp, timing_ki;	/// Loop gains
+	size_t strobe_index;		/// Index in work of the sample before the next strobe
+	double strobe_mu;			/// Fractional position of the next strobe (0 .. 1)
+	double half_step;			/// Distance between two strobes in samples
+	double timing_integrator;	/// Relative error of the symbol period
+	bool mid_next;				/// The next strobe is between two symbols
+	sample_fc32 mid_sample;		/// Last strobe between two symbols
+	sample_fc32 prev_sample;	/// Last strobe on a symbol
+
+	// Carrier recovery
+	float carrier_kp, carrier_ki;
+	double carrier_phase;		/// Phase removed from the next symbol in radians
+	double carrier_freq;		/// Phase increment per symbol in radians
+	float amplitude;			/// Average amplitude of the components of the symbols
+	float error_power;			/// Average power of the error vector, on the normalised constellation
+
+	uint64_t num_symbols;
+	uint64_t num_samples;
+	latency_histogram block_cost;
+};
+
+
+#endif
@@ -0,0 +1,304 @@
+/***********************************************************************//**
+@file
+
+Checks and benchmarks the DSP kernels of every instruction set available
+on the machine
+
+Each SIMD kernel is first compared with the scalar reference on random
+samples, including the extreme values of the int16 samples and sizes
+which are not a multiple of the vector length. The element-wise kernels
+and the interpolation must match bit for bit, the dot product within
+1e-5 per term of the sum. The throughput of every kernel is then
+measured in millions of samples per second. The interpolation is measured
+like a modulator uses it: INTERP_PHASES output samples per call from
+INTERP_TAPS history samples, the throughput counting the output samples.
+
+Usage: dspbench [-n samples] [-t seconds] [-l label] [-j file]
+
+-n number of samples per call (default 4096)
+-t measuring time of each kernel in seconds (default 0.2)
+-l label stored in the results (e.g. the release)
+-j file receiving the results, one JSON object per line (default dsp_bench.json)
+
+The exit code is 1 if a kernel does not match the reference.
+
+***************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "dsp_kernels.h"
+#include "latency_stats.h"
+#include "bench_common.h"
+
+
+#define INTERP_TAPS 8		/// Taps of each phase of the interpolation (filter span in symbols)
+#define INTERP_PHASES 8		/// Phases of the interpolation (samples per symbol)
+
+/// Buffers shared by the checks and the benchmarks
+struct bench_buffers
+{
+	std::vector<sample_sc16> sc16;
+	std::vector<sample_fc32> a, b, out;
+	std::vector<uint32_t> mag16;
+	std::vector<float> mag;
+	std::vector<sample_sc16> out16;
+	std::vector<sample_fc32> taps;		/// Random complex taps
+	std::vector<float> taps_real;		/// Random real taps
+};
+
+
+static void fill_buffers(bench_buffers & buf, size_t num_samps)
+{
+	buf.sc16.resize(num_samps);
+	buf.a.resize(num_samps);
+	buf.b.resize(num_samps);
+	buf.out.resize(num_samps);
+	buf.mag16.resize(num_samps);
+	buf.mag.resize(num_samps);
+	buf.out16.resize(num_samps);
+	for(size_t index = 0; index < num_samps; index++)
+	{
+		buf.sc16[index] = sample_sc16(short(bench_random()), short(bench_random()));
+		buf.a[index] = sample_fc32(int32_t(bench_random()) / 2147483648.0f, int32_t(bench_random()) / 2147483648.0f);
+		buf.b[index] = sample_fc32(int32_t(bench_random()) / 2147483648.0f, int32_t(bench_random()) / 2147483648.0f);
+	}
+	// Room for the checks, whose stride reaches 43
+	size_t num_taps = INTERP_TAPS * ((num_samps > INTERP_PHASES ? num_samps : INTERP_PHASES) + 44);
+	buf.taps.resize(num_taps);
+	buf.taps_real.resize(num_taps);
+	for(size_t index = 0; index < num_taps; index++)
+	{
+		buf.taps[index] = sample_fc32(int32_t(bench_random()) / 2147483648.0f, int32_t(bench_random()) / 2147483648.0f);
+		buf.taps_real[index] = int32_t(bench_random()) / 2147483648.0f;
+	}
+	// The extreme values of the int16 samples
+	if(num_samps >= 3)
+	{
+		buf.sc16[0] = sample_sc16(-32768, -32768);
+		buf.sc16[1] = sample_sc16(32767, -32768);
+		buf.sc16[2] = sample_sc16(32767, 32767);
+	}
+}
+
+
+/***********************************************************************//**
+Compares every kernel of a table with the scalar reference
+
+@return Number of kernels which do not match
+
+***************************************************************************/
+
+static int check_table(const dsp_kernel_table & k, bench_buffers & buf)
+{
+	const dsp_kernel_table & ref = dsp_scalar_kernels();
+	size_t max_samps = buf.sc16.size();
+	int errors = 0;
+	const char * failed = NULL;
+
+	// Every length up to 40 then the whole buffer, to cover all the tails
+	std::vector<size_t> lengths;
+	for(size_t num_samps = 0; num_samps <= 40 && num_samps < max_samps; num_samps++)
+		lengths.push_back(num_samps);
+	lengths.push_back(max_samps);
+
+	// Rounding of the halves and saturation
+	const float edges[] = {0.5f, -0.5f, 1.5f, -1.5f, 2.5f, -0.0f, 32766.5f, 32767.5f, -32767.5f, -32768.5f, 1e9f, -1e9f,
+		32767.49f, -32768.49f, 0.49999997f, -0.49999997f};
+	const size_t num_edges = sizeof(edges) / sizeof(edges[0]) / 2;
+	sample_sc16 e1[num_edges], e2[num_edges];
+	ref.fc32_to_sc16(reinterpret_cast<const sample_fc32 *>(edges), e1, num_edges, 1.0f);
+	k.fc32_to_sc16(reinterpret_cast<const sample_fc32 *>(edges), e2, num_edges, 1.0f);
+	if(memcmp(e1, e2, sizeof(e1)) != 0)
+	{
+		std::cout << k.name << ": fc32_to_sc16 does not round or saturate like the scalar reference" << std::endl;
+		errors++;
+	}
+
+	for(size_t l = 0; l < lengths.size(); l++)
+	{
+		size_t num_samps = lengths[l];
+		std::vector<sample_fc32> f1(num_samps + 1), f2(num_samps + 1);
+		std::vector<uint32_t> u1(num_samps + 1), u2(num_samps + 1);
+		std::vector<float> m1(num_samps + 1), m2(num_samps + 1);
+
+		ref.sc16_to_fc32(&buf.sc16[0], &f1[0], num_samps, 1.0f / 32768);
+		k.sc16_to_fc32(&buf.sc16[0], &f2[0], num_samps, 1.0f / 32768);
+		if(memcmp(&f1[0], &f2[0], (num_samps + 1) * sizeof(sample_fc32)) != 0)
+			failed = "sc16_to_fc32";
+
+		ref.sc16_mag_squared(&buf.sc16[0], &u1[0], num_samps);
+		k.sc16_mag_squared(&buf.sc16[0], &u2[0], num_samps);
+		if(memcmp(&u1[0], &u2[0], (num_samps + 1) * sizeof(uint32_t)) != 0)
+			failed = "sc16_mag_squared";
+
+		ref.fc32_scale(&buf.a[0], &f1[0], num_samps, 0.7f);
+		k.fc32_scale(&buf.a[0], &f2[0], num_samps, 0.7f);
+		if(memcmp(&f1[0], &f2[0], (num_samps + 1) * sizeof(sample_fc32)) != 0)
+			failed = "fc32_scale";
+
+		ref.fc32_multiply(&buf.a[0], &buf.b[0], &f1[0], num_samps);
+		k.fc32_multiply(&buf.a[0], &buf.b[0], &f2[0], num_samps);
+		if(memcmp(&f1[0], &f2[0], (num_samps + 1) * sizeof(sample_fc32)) != 0)
+			failed = "fc32_multiply";
+
+		ref.fc32_mag_squared(&buf.a[0], &m1[0], num_samps);
+		k.fc32_mag_squared(&buf.a[0], &m2[0], num_samps);
+		if(memcmp(&m1[0], &m2[0], (num_samps + 1) * sizeof(float)) != 0)
+			failed = "fc32_mag_squared";
+
+		// The sum of the magnitudes bounds the rounding error of the dot product
+		sample_fc32 d1 = ref.fc32_dot(&buf.a[0], &buf.b[0], num_samps);
+		sample_fc32 d2 = k.fc32_dot(&buf.a[0], &buf.b[0], num_samps);
+		double bound = 1e-5 * (num_samps + 1);
+		if(std::abs(d1 - d2) > bound)
+			failed = "fc32_dot";
+
+		// Scaled beyond full scale to saturate some samples
+		std::vector<sample_sc16> s1(num_samps + 1), s2(num_samps + 1);
+		ref.fc32_to_sc16(&buf.a[0], &s1[0], num_samps, 40000.0f);
+		k.fc32_to_sc16(&buf.a[0], &s2[0], num_samps, 40000.0f);
+		if(memcmp(&s1[0], &s2[0], (num_samps + 1) * sizeof(sample_sc16)) != 0)
+			failed = "fc32_to_sc16";
+
+		// num_samps phases with a stride larger than the number of phases
+		size_t num_taps = num_samps < max_samps ? INTERP_TAPS : 1;
+		size_t stride = num_samps < max_samps ? num_samps + 3 : max_samps;
+		if(num_taps <= max_samps)
+		{
+			ref.fc32_interpolate(&buf.a[0], &buf.taps[0], num_taps, stride, &f1[0], num_samps);
+			k.fc32_interpolate(&buf.a[0], &buf.taps[0], num_taps, stride, &f2[0], num_samps);
+			if(memcmp(&f1[0], &f2[0], (num_samps + 1) * sizeof(sample_fc32)) != 0)
+				failed = "fc32_interpolate";
+
+			ref.fc32_interpolate_real(&buf.a[0], &buf.taps_real[0], num_taps, stride, &f1[0], num_samps);
+			k.fc32_interpolate_real(&buf.a[0], &buf.taps_real[0], num_taps, stride, &f2[0], num_samps);
+			if(memcmp(&f1[0], &f2[0], (num_samps + 1) * sizeof(sample_fc32)) != 0)
+				failed = "fc32_interpolate_real";
+		}
+
+		if(failed)
+		{
+			std::cout << k.name << ": " << failed << " does not match the scalar reference for " << num_samps << " samples" << std::endl;
+			errors++;
+			failed = NULL;
+		}
+	}
+	return errors;
+}
+
+
+/***********************************************************************//**
+Calls one kernel repeatedly for the given time
+
+@return Throughput in millions of samples per second
+
+***************************************************************************/
+
+static double bench_kernel(const dsp_kernel_table & k, int kernel, bench_buffers & buf, double seconds)
+{
+	size_t num_samps = buf.sc16.size();
+	uint64_t calls = 0;
+	uint64_t start = monotonic_ns();
+	uint64_t end = start + uint64_t(seconds * 1e9);
+	uint64_t now = start;
+	while(now < end)
+	{
+		for(int repeat = 0; repeat < 16; repeat++)
+		{
+			switch(kernel)
+			{
+			case 0: k.sc16_to_fc32(&buf.sc16[0], &buf.out[0], num_samps, 1.0f / 32768); break;
+			case 1: k.sc16_mag_squared(&buf.sc16[0], &buf.mag16[0], num_samps); break;
+			case 2: k.fc32_scale(&buf.a[0], &buf.out[0], num_samps, 0.7f); break;
+			case 3: k.fc32_multiply(&buf.a[0], &buf.b[0], &buf.out[0], num_samps); break;
+			case 4: k.fc32_mag_squared(&buf.a[0], &buf.mag[0], num_samps); break;
+			case 5: bench_sink = k.fc32_dot(&buf.a[0], &buf.b[0], num_samps).real(); break;
+			case 6: k.fc32_to_sc16(&buf.a[0], &buf.out16[0], num_samps, 32767.0f); break;
+			case 7:
+				for(size_t symbol = 0; symbol + INTERP_TAPS <= num_samps / INTERP_PHASES; symbol++)
+					k.fc32_interpolate(&buf.a[symbol], &buf.taps[0], INTERP_TAPS, INTERP_PHASES,
+						&buf.out[symbol * INTERP_PHASES], INTERP_PHASES);
+				break;
+			case 8:
+				for(size_t symbol = 0; symbol + INTERP_TAPS <= num_samps / INTERP_PHASES; symbol++)
+					k.fc32_interpolate_real(&buf.a[symbol], &buf.taps_real[0], INTERP_TAPS, INTERP_PHASES,
+						&buf.out[symbol * INTERP_PHASES], INTERP_PHASES);
+				break;
+			}
+		}
+		calls += 16;
+		now = monotonic_ns();
+	}
+	bench_sink = buf.out[0].real() + buf.mag[0] + buf.mag16[0] + buf.out16[0].real();
+	if(kernel >= 7)
+	{
+		// Output samples of the interpolation
+		size_t symbols = num_samps / INTERP_PHASES;
+		num_samps = symbols >= INTERP_TAPS ? (symbols - INTERP_TAPS + 1) * INTERP_PHASES : 0;
+	}
+	return calls * num_samps / ((now - start) * 1e-9) * 1e-6;
+}
+
+
+int main(int argc, char ** argv)
+{
+	size_t num_samps = 4096;
+	bench_context bench("dsp_bench.json", 0.2);
+	for(int index = 1; index < argc; index++)
+	{
+		if(strcmp(argv[index], "-n") == 0 && index + 1 < argc)
+			num_samps = strtoul(argv[++index], NULL, 10);
+		else if(bench.parse_option(argc, argv, index))
+		{
+			std::cout << "Usage: dspbench [-n samples] [-t seconds] [-l label] [-j file]" << std::endl;
+			return 1;
+		}
+	}
+	if(num_samps == 0)
+		num_samps = 1;
+
+	bench_buffers buf;
+	fill_buffers(buf, num_samps);
+
+	std::vector<const dsp_kernel_table *> tables;
+	dsp_available_kernels(tables);
+	for(size_t t = 1; t < tables.size(); t++)
+		bench.errors += check_table(*tables[t], buf);
+	std::cout << "Kernels available:";
+	for(size_t t = 0; t < tables.size(); t++)
+		std::cout << " " << tables[t]->name;
+	std::cout << " (selected: " << dsp_kernels().name << ")  " << (bench.errors ? "MISMATCH" : "all match the scalar reference") << std::endl;
+
+	if(bench.open())
+		return 1;
+
+	const char * kernels[] = {"sc16_to_fc32", "sc16_mag_squared", "fc32_scale", "fc32_multiply", "fc32_mag_squared", "fc32_dot",
+		"fc32_to_sc16", "fc32_interpolate", "fc32_interpolate_real"};
+	const int num_kernels = sizeof(kernels) / sizeof(kernels[0]);
+	printf("%-22s", "MS/s");
+	for(size_t t = 0; t < tables.size(); t++)
+		printf(" %10s", tables[t]->name);
+	printf("   speedup\n");
+	for(int kernel = 0; kernel < num_kernels; kernel++)
+	{
+		printf("%-22s", kernels[kernel]);
+		double scalar = 0, best = 0;
+		for(size_t t = 0; t < tables.size(); t++)
+		{
+			double msps = bench_kernel(*tables[t], kernel, buf, bench.seconds);
+			if(t == 0)
+				scalar = msps;
+			if(msps > best)
+				best = msps;
+			printf(" %10.1f", msps);
+			fprintf(bench.record("dsp_kernel"), "\"kernel\":\"%s\",\"isa\":\"%s\",\"samples\":%zu,\"msps\":%.2f}\n",
+				kernels[kernel], tables[t]->name, num_samps, msps);
+		}
+		printf("   %5.1fx\n", scalar > 0 ? best / scalar : 0);
+	}
+	return bench.finish("Every kernel matches the scalar reference");
+}
@@ -0,0 +1,217 @@
+#include "dsp_kernels.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+
+/***********************************************************************//**
+Scalar versions of the kernels. They define the exact result expected
+from the SIMD versions: the products and sums are done in the same order,
+one float operation at a time.
+
+***************************************************************************/
+
+static void scalar_sc16_to_fc32(const sample_sc16 * in, sample_fc32 * out, size_t num_samps, float scale)
+{
+	const int16_t * src = reinterpret_cast<const int16_t *>(in);
+	float * dst = reinterpret_cast<float *>(out);
+	for(size_t index = 0; index < 2 * num_samps; index++)
+		dst[index] = float(src[index]) * scale;
+}
+
+
+static void scalar_sc16_mag_squared(const sample_sc16 * in, uint32_t * out, size_t num_samps)
+{
+	const int16_t * src = reinterpret_cast<const int16_t *>(in);
+	for(size_t index = 0; index < num_samps; index++)
+	{
+		int32_t i = src[2 * index];
+		int32_t q = src[2 * index + 1];
+		out[index] = uint32_t(i * i) + uint32_t(q * q);
+	}
+}
+
+
+static void scalar_fc32_scale(const sample_fc32 * in, sample_fc32 * out, size_t num_samps, float gain)
+{
+	const float * src = reinterpret_cast<const float *>(in);
+	float * dst = reinterpret_cast<float *>(out);
+	for(size_t index = 0; index < 2 * num_samps; index++)
+		dst[index] = src[index] * gain;
+}
+
+
+static void scalar_fc32_multiply(const sample_fc32 * a, const sample_fc32 * b, sample_fc32 * out, size_t num_samps)
+{
+	const float * x = reinterpret_cast<const float *>(a);
+	const float * y = reinterpret_cast<const float *>(b);
+	float * dst = reinterpret_cast<float *>(out);
+	for(size_t index = 0; index < num_samps; index++)
+	{
+		float xr = x[2 * index], xi = x[2 * index + 1];
+		float yr = y[2 * index], yi = y[2 * index + 1];
+		float rr = xr * yr;
+		float ii = xi * yi;
+		float ir = xi * yr;
+		float ri = xr * yi;
+		dst[2 * index] = rr - ii;
+		dst[2 * index + 1] = ir + ri;
+	}
+}
+
+
+static void scalar_fc32_mag_squared(const sample_fc32 * in, float * out, size_t num_samps)
+{
+	const float * src = reinterpret_cast<const float *>(in);
+	for(size_t index = 0; index < num_samps; index++)
+	{
+		float rr = src[2 * index] * src[2 * index];
+		float ii = src[2 * index + 1] * src[2 * index + 1];
+		out[index] = rr + ii;
+	}
+}
+
+
+static sample_fc32 scalar_fc32_dot(const sample_fc32 * a, const sample_fc32 * b, size_t num_samps)
+{
+	const float * x = reinterpret_cast<const float *>(a);
+	const float * y = reinterpret_cast<const float *>(b);
+	float sum_r = 0, sum_i = 0;
+	for(size_t index = 0; index < num_samps; index++)
+	{
+		float xr = x[2 * index], xi = x[2 * index + 1];
+		float yr = y[2 * index], yi = y[2 * index + 1];
+		sum_r += xr * yr - xi * yi;
+		sum_i += xi * yr + xr * yi;
+	}
+	return sample_fc32(sum_r, sum_i);
+}
+
+
+static void scalar_fc32_to_sc16(const sample_fc32 * in, sample_sc16 * out, size_t num_samps, float scale)
+{
+	const float * src = reinterpret_cast<const float *>(in);
+	int16_t * dst = reinterpret_cast<int16_t *>(out);
+	for(size_t index = 0; index < 2 * num_samps; index++)
+	{
+		// Saturate, then round by adding half with the sign of the value and truncating
+		float value = src[index] * scale;
+		value = value > 32767.0f ? 32767.0f : (value < -32768.0f ? -32768.0f : value);
+		dst[index] = int16_t(value + (value < 0 ? -0.5f : 0.5f));
+	}
+}
+
+
+static void scalar_fc32_interpolate(const sample_fc32 * hist, const sample_fc32 * taps, size_t num_taps, size_t stride,
+	sample_fc32 * out, size_t num_phases)
+{
+	const float * x = reinterpret_cast<const float *>(hist);
+	float * dst = reinterpret_cast<float *>(out);
+	for(size_t phase = 0; phase < num_phases; phase++)
+	{
+		const float * y = reinterpret_cast<const float *>(taps + phase);
+		float sum_r = 0, sum_i = 0;
+		for(size_t k = 0; k < num_taps; k++)
+		{
+			float xr = x[2 * k], xi = x[2 * k + 1];
+			float yr = y[2 * k * stride], yi = y[2 * k * stride + 1];
+			sum_r += xr * yr - xi * yi;
+			sum_i += xi * yr + xr * yi;
+		}
+		dst[2 * phase] = sum_r;
+		dst[2 * phase + 1] = sum_i;
+	}
+}
+
+
+static void scalar_fc32_interpolate_real(const sample_fc32 * hist, const float * taps, size_t num_taps, size_t stride,
+	sample_fc32 * out, size_t num_phases)
+{
+	const float * x = reinterpret_cast<const float *>(hist);
+	float * dst = reinterpret_cast<float *>(out);
+	for(size_t phase = 0; phase < num_phases; phase++)
+	{
+		float sum_r = 0, sum_i = 0;
+		for(size_t k = 0; k < num_taps; k++)
+		{
+			float t = taps[k * stride + phase];
+			sum_r += x[2 * k] * t;
+			sum_i += x[2 * k + 1] * t;
+		}
+		dst[2 * phase] = sum_r;
+		dst[2 * phase + 1] = sum_i;
+	}
+}
+
+
+static const dsp_kernel_table scalar_table =
+{
+	"scalar",
+	scalar_sc16_to_fc32,
+	scalar_sc16_mag_squared,
+	scalar_fc32_scale,
+	scalar_fc32_multiply,
+	scalar_fc32_mag_squared,
+	scalar_fc32_dot,
+	scalar_fc32_to_sc16,
+	scalar_fc32_interpolate,
+	scalar_fc32_interpolate_real
+};
+
+
+const dsp_kernel_table & dsp_scalar_kernels()
+{
+	return scalar_table;
+}
+
+
+/***********************************************************************//**
+Returns every table usable on this machine, the scalar table first and
+the fastest last
+
+***************************************************************************/
+
+void dsp_available_kernels(std::vector<const dsp_kernel_table *> & tables)
+{
+	tables.clear();
+	tables.push_back(&scalar_table);
+	if(dsp_neon_kernels())
+		tables.push_back(dsp_neon_kernels());
+	if(dsp_sse2_kernels())
+		tables.push_back(dsp_sse2_kernels());
+	if(dsp_avx2_kernels())
+		tables.push_back(dsp_avx2_kernels());
+}
+
+
+/***********************************************************************//**
+Selects the fastest table the first time it is called
+
+The environment variable DSP_KERNELS ("scalar", "sse2", ...) forces the
+choice of a table, to compare the versions on the target.
+
+@return Table of the kernels used by the dsp_xxx() shortcuts
+
+***************************************************************************/
+
+static const dsp_kernel_table * select_kernels()
+{
+	std::vector<const dsp_kernel_table *> tables;
+	dsp_available_kernels(tables);
+	const char * forced = getenv("DSP_KERNELS");
+	if(forced != NULL)
+	{
+		for(size_t index = 0; index < tables.size(); index++)
+			if(strcmp(tables[index]->name, forced) == 0)
+				return tables[index];
+		std::cout << "DSP_KERNELS=" << forced << " is not available, using " << tables.back()->name << std::endl;
+	}
+	return tables.back();
+}
+
+
+const dsp_kernel_table & dsp_kernels()
+{
+	static const dsp_kernel_table * selected = select_kernels();
+	return *selected;
+}
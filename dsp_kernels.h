@@ -0,0 +1,144 @@
+/***********************************************************************//**
+@file
+
+Vectorised kernels working on blocks of complex samples
+
+Every kernel exists in a scalar version, which is the reference, and in
+SIMD versions for the targets of the modem:
+- NEON for the Cortex-A8 of the E100 (selected at compile time, the
+  compiler must be given -mfpu=neon)
+- SSE2 and AVX2 for the x86 development machines (selected at run time
+  from the features of the CPU)
+
+dsp_kernels() returns the fastest table of the machine. The element-wise
+kernels and the interpolation (whose sums run over the taps in the order
+of the scalar version, one output per lane) give results identical to
+the scalar version bit for bit. The dot product adds the terms in a
+different order and only matches the scalar version within the rounding
+error of the sum.
+
+The buffers do not need to be aligned. The sample types are the ones of
+sample_format.h, which are stored as interleaved I and Q.
+
+***************************************************************************/
+
+#ifndef DSP_KERNELS_H
+#define DSP_KERNELS_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+#include "sample_format.h"
+#include "block_pool.h"
+
+
+/// Table of the kernels of one instruction set
+struct dsp_kernel_table
+{
+	const char * name;		/// Instruction set ("scalar", "sse2", "avx2", "neon")
+
+	/// out[n] = in[n] * scale, converted to float
+	void (*sc16_to_fc32)(const sample_sc16 * in, sample_fc32 * out, size_t num_samps, float scale);
+	/// out[n] = I*I + Q*Q, exact
+	void (*sc16_mag_squared)(const sample_sc16 * in, uint32_t * out, size_t num_samps);
+	/// out[n] = in[n] * gain. in and out may be the same buffer
+	void (*fc32_scale)(const sample_fc32 * in, sample_fc32 * out, size_t num_samps, float gain);
+	/// out[n] = a[n] * b[n] (complex product). out may be a or b
+	void (*fc32_multiply)(const sample_fc32 * a, const sample_fc32 * b, sample_fc32 * out, size_t num_samps);
+	/// out[n] = |in[n]|^2
+	void (*fc32_mag_squared)(const sample_fc32 * in, float * out, size_t num_samps);
+	/// Returns the sum of a[n] * b[n] (without conjugation)
+	sample_fc32 (*fc32_dot)(const sample_fc32 * a, const sample_fc32 * b, size_t num_samps);
+	/// out[n] = in[n] * scale rounded to the nearest integer (halves away from zero), saturated to int16
+	void (*fc32_to_sc16)(const sample_fc32 * in, sample_sc16 * out, size_t num_samps, float scale);
+	/// out[p] = sum for k < num_taps of hist[k] * taps[k * stride + p], p < num_phases (polyphase interpolation)
+	void (*fc32_interpolate)(const sample_fc32 * hist, const sample_fc32 * taps, size_t num_taps, size_t stride,
+		sample_fc32 * out, size_t num_phases);
+	/// Same as fc32_interpolate with real taps
+	void (*fc32_interpolate_real)(const sample_fc32 * hist, const float * taps, size_t num_taps, size_t stride,
+		sample_fc32 * out, size_t num_phases);
+};
+
+
+const dsp_kernel_table & dsp_kernels();
+const dsp_kernel_table & dsp_scalar_kernels();
+void dsp_available_kernels(std::vector<const dsp_kernel_table *> & tables);
+
+// Tables of the SIMD versions. NULL when not supported by the build or the CPU
+const dsp_kernel_table * dsp_sse2_kernels();
+const dsp_kernel_table * dsp_avx2_kernels();
+const dsp_kernel_table * dsp_neon_kernels();
+
+
+// Shortcuts to the kernels of the best table
+
+inline void dsp_sc16_to_fc32(const sample_sc16 * in, sample_fc32 * out, size_t num_samps, float scale = 1.0f / 32768)
+{
+	dsp_kernels().sc16_to_fc32(in, out, num_samps, scale);
+}
+
+inline void dsp_sc16_mag_squared(const sample_sc16 * in, uint32_t * out, size_t num_samps)
+{
+	dsp_kernels().sc16_mag_squared(in, out, num_samps);
+}
+
+inline void dsp_fc32_scale(const sample_fc32 * in, sample_fc32 * out, size_t num_samps, float gain)
+{
+	dsp_kernels().fc32_scale(in, out, num_samps, gain);
+}
+
+inline void dsp_fc32_multiply(const sample_fc32 * a, const sample_fc32 * b, sample_fc32 * out, size_t num_samps)
+{
+	dsp_kernels().fc32_multiply(a, b, out, num_samps);
+}
+
+inline void dsp_fc32_mag_squared(const sample_fc32 * in, float * out, size_t num_samps)
+{
+	dsp_kernels().fc32_mag_squared(in, out, num_samps);
+}
+
+inline sample_fc32 dsp_fc32_dot(const sample_fc32 * a, const sample_fc32 * b, size_t num_samps)
+{
+	return dsp_kernels().fc32_dot(a, b, num_samps);
+}
+
+inline void dsp_fc32_to_sc16(const sample_fc32 * in, sample_sc16 * out, size_t num_samps, float scale = 32767.0f)
+{
+	dsp_kernels().fc32_to_sc16(in, out, num_samps, scale);
+}
+
+
+/***********************************************************************//**
+Float view of a block in any host format, relative to full scale
+
+The integer samples are converted into buffer (resized as needed), the
+float samples are returned as they are.
+
+@return Pointer to num_samps float samples
+
+***************************************************************************/
+
+inline const sample_fc32 * dsp_as_fc32(const sample_sc16 * in, size_t num_samps, fc32_buffer & buffer)
+{
+	if(buffer.size() < num_samps)
+		buffer.resize(num_samps);
+	dsp_sc16_to_fc32(in, buffer.empty() ? NULL : &buffer[0], num_samps);
+	return buffer.empty() ? NULL : &buffer[0];
+}
+
+inline const sample_fc32 * dsp_as_fc32(const sample_sc8 * in, size_t num_samps, fc32_buffer & buffer)
+{
+	if(buffer.size() < num_samps)
+		buffer.resize(num_samps);
+	for(size_t n = 0; n < num_samps; n++)
+		buffer[n] = sample_fc32(in[n].real() * (1.0f / 128), in[n].imag() * (1.0f / 128));
+	return buffer.empty() ? NULL : &buffer[0];
+}
+
+inline const sample_fc32 * dsp_as_fc32(const sample_fc32 * in, size_t, fc32_buffer &)
+{
+	return in;
+}
+
+
+#endif
@@ -0,0 +1,240 @@
+/***********************************************************************//**
+@file
+
+NEON versions of the DSP kernels for the Cortex-A8 of the E100
+
+NEON is selected at compile time: the file is only compiled to kernels
+when the compiler targets NEON (-mfpu=neon on ARMv7, always on AArch64).
+The structure loads (vld2) separate I and Q, which keeps the complex
+arithmetic free of shuffles. The multiply and add are separate
+instructions, never fused, so that the results are those of the scalar
+reference.
+
+***************************************************************************/
+
+#include "dsp_kernels.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+
+
+static void neon_sc16_to_fc32(const sample_sc16 * in, sample_fc32 * out, size_t num_samps, float scale)
+{
+	const int16_t * src = reinterpret_cast<const int16_t *>(in);
+	float * dst = reinterpret_cast<float *>(out);
+	size_t count = 2 * num_samps;
+	size_t index = 0;
+	for(; index + 8 <= count; index += 8)
+	{
+		int16x8_t v = vld1q_s16(src + index);
+		float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v)));
+		float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(v)));
+		vst1q_f32(dst + index, vmulq_n_f32(lo, scale));
+		vst1q_f32(dst + index + 4, vmulq_n_f32(hi, scale));
+	}
+	for(; index < count; index++)
+		dst[index] = float(src[index]) * scale;
+}
+
+
+static void neon_sc16_mag_squared(const sample_sc16 * in, uint32_t * out, size_t num_samps)
+{
+	const int16_t * src = reinterpret_cast<const int16_t *>(in);
+	size_t index = 0;
+	for(; index + 4 <= num_samps; index += 4)
+	{
+		// The sum wraps modulo 2^32 like the scalar code
+		int16x4x2_t v = vld2_s16(src + 2 * index);
+		int32x4_t sum = vmlal_s16(vmull_s16(v.val[0], v.val[0]), v.val[1], v.val[1]);
+		vst1q_u32(out + index, vreinterpretq_u32_s32(sum));
+	}
+	for(; index < num_samps; index++)
+	{
+		int32_t i = src[2 * index];
+		int32_t q = src[2 * index + 1];
+		out[index] = uint32_t(i * i) + uint32_t(q * q);
+	}
+}
+
+
+static void neon_fc32_scale(const sample_fc32 * in, sample_fc32 * out, size_t num_samps, float gain)
+{
+	const float * src = reinterpret_cast<const float *>(in);
+	float * dst = reinterpret_cast<float *>(out);
+	size_t count = 2 * num_samps;
+	size_t index = 0;
+	for(; index + 4 <= count; index += 4)
+		vst1q_f32(dst + index, vmulq_n_f32(vld1q_f32(src + index), gain));
+	for(; index < count; index++)
+		dst[index] = src[index] * gain;
+}
+
+
+/// Complex product of 4 samples held as separate I and Q vectors
+static inline float32x4x2_t neon_cmul(float32x4x2_t x, float32x4x2_t y)
+{
+	float32x4x2_t r;
+	r.val[0] = vsubq_f32(vmulq_f32(x.val[0], y.val[0]), vmulq_f32(x.val[1], y.val[1]));
+	r.val[1] = vaddq_f32(vmulq_f32(x.val[1], y.val[0]), vmulq_f32(x.val[0], y.val[1]));
+	return r;
+}
+
+
+static void neon_fc32_multiply(const sample_fc32 * a, const sample_fc32 * b, sample_fc32 * out, size_t num_samps)
+{
+	const float * x = reinterpret_cast<const float *>(a);
+	const float * y = reinterpret_cast<const float *>(b);
+	float * dst = reinterpret_cast<float *>(out);
+	size_t index = 0;
+	for(; index + 4 <= num_samps; index += 4)
+		vst2q_f32(dst + 2 * index, neon_cmul(vld2q_f32(x + 2 * index), vld2q_f32(y + 2 * index)));
+	if(index < num_samps)
+		dsp_scalar_kernels().fc32_multiply(a + index, b + index, out + index, num_samps - index);
+}
+
+
+static void neon_fc32_mag_squared(const sample_fc32 * in, float * out, size_t num_samps)
+{
+	const float * src = reinterpret_cast<const float *>(in);
+	size_t index = 0;
+	for(; index + 4 <= num_samps; index += 4)
+	{
+		float32x4x2_t v = vld2q_f32(src + 2 * index);
+		vst1q_f32(out + index, vaddq_f32(vmulq_f32(v.val[0], v.val[0]), vmulq_f32(v.val[1], v.val[1])));
+	}
+	if(index < num_samps)
+		dsp_scalar_kernels().fc32_mag_squared(in + index, out + index, num_samps - index);
+}
+
+
+static sample_fc32 neon_fc32_dot(const sample_fc32 * a, const sample_fc32 * b, size_t num_samps)
+{
+	const float * x = reinterpret_cast<const float *>(a);
+	const float * y = reinterpret_cast<const float *>(b);
+	float32x4_t acc_r = vdupq_n_f32(0);
+	float32x4_t acc_i = vdupq_n_f32(0);
+	size_t index = 0;
+	for(; index + 4 <= num_samps; index += 4)
+	{
+		float32x4x2_t p = neon_cmul(vld2q_f32(x + 2 * index), vld2q_f32(y + 2 * index));
+		acc_r = vaddq_f32(acc_r, p.val[0]);
+		acc_i = vaddq_f32(acc_i, p.val[1]);
+	}
+	float sum_r[4], sum_i[4];
+	vst1q_f32(sum_r, acc_r);
+	vst1q_f32(sum_i, acc_i);
+	sample_fc32 result((sum_r[0] + sum_r[1]) + (sum_r[2] + sum_r[3]), (sum_i[0] + sum_i[1]) + (sum_i[2] + sum_i[3]));
+	if(index < num_samps)
+		result += dsp_scalar_kernels().fc32_dot(a + index, b + index, num_samps - index);
+	return result;
+}
+
+
+/// Scales 4 floats, saturates them to int16 and rounds them half away from zero like the scalar code
+static inline int32x4_t neon_round_sc16(float32x4_t v, float scale)
+{
+	const uint32x4_t sign = vdupq_n_u32(0x80000000);
+	v = vminq_f32(vmaxq_f32(vmulq_n_f32(v, scale), vdupq_n_f32(-32768.0f)), vdupq_n_f32(32767.0f));
+	uint32x4_t half = vorrq_u32(vreinterpretq_u32_f32(vdupq_n_f32(0.5f)), vandq_u32(vreinterpretq_u32_f32(v), sign));
+	return vcvtq_s32_f32(vaddq_f32(v, vreinterpretq_f32_u32(half)));
+}
+
+
+static void neon_fc32_to_sc16(const sample_fc32 * in, sample_sc16 * out, size_t num_samps, float scale)
+{
+	const float * src = reinterpret_cast<const float *>(in);
+	int16_t * dst = reinterpret_cast<int16_t *>(out);
+	size_t index = 0;
+	for(; index + 4 <= num_samps; index += 4)
+	{
+		int16x4_t lo = vqmovn_s32(neon_round_sc16(vld1q_f32(src + 2 * index), scale));
+		int16x4_t hi = vqmovn_s32(neon_round_sc16(vld1q_f32(src + 2 * index + 4), scale));
+		vst1q_s16(dst + 2 * index, vcombine_s16(lo, hi));
+	}
+	if(index < num_samps)
+		dsp_scalar_kernels().fc32_to_sc16(in + index, out + index, num_samps - index, scale);
+}
+
+
+static void neon_fc32_interpolate(const sample_fc32 * hist, const sample_fc32 * taps, size_t num_taps, size_t stride,
+	sample_fc32 * out, size_t num_phases)
+{
+	const float * x = reinterpret_cast<const float *>(hist);
+	const float * y = reinterpret_cast<const float *>(taps);
+	float * dst = reinterpret_cast<float *>(out);
+	size_t phase = 0;
+	for(; phase + 4 <= num_phases; phase += 4)
+	{
+		float32x4x2_t acc;
+		acc.val[0] = vdupq_n_f32(0);
+		acc.val[1] = vdupq_n_f32(0);
+		for(size_t k = 0; k < num_taps; k++)
+		{
+			float32x4x2_t xk;
+			xk.val[0] = vdupq_n_f32(x[2 * k]);
+			xk.val[1] = vdupq_n_f32(x[2 * k + 1]);
+			float32x4x2_t p = neon_cmul(xk, vld2q_f32(y + 2 * (k * stride + phase)));
+			acc.val[0] = vaddq_f32(acc.val[0], p.val[0]);
+			acc.val[1] = vaddq_f32(acc.val[1], p.val[1]);
+		}
+		vst2q_f32(dst + 2 * phase, acc);
+	}
+	if(phase < num_phases)
+		dsp_scalar_kernels().fc32_interpolate(hist, taps + phase, num_taps, stride, out + phase, num_phases - phase);
+}
+
+
+static void neon_fc32_interpolate_real(const sample_fc32 * hist, const float * taps, size_t num_taps, size_t stride,
+	sample_fc32 * out, size_t num_phases)
+{
+	const float * x = reinterpret_cast<const float *>(hist);
+	float * dst = reinterpret_cast<float *>(out);
+	size_t phase = 0;
+	for(; phase + 4 <= num_phases; phase += 4)
+	{
+		float32x4x2_t acc;
+		acc.val[0] = vdupq_n_f32(0);
+		acc.val[1] = vdupq_n_f32(0);
+		for(size_t k = 0; k < num_taps; k++)
+		{
+			float32x4_t t = vld1q_f32(taps + k * stride + phase);
+			acc.val[0] = vaddq_f32(acc.val[0], vmulq_n_f32(t, x[2 * k]));
+			acc.val[1] = vaddq_f32(acc.val[1], vmulq_n_f32(t, x[2 * k + 1]));
+		}
+		vst2q_f32(dst + 2 * phase, acc);
+	}
+	if(phase < num_phases)
+		dsp_scalar_kernels().fc32_interpolate_real(hist, taps + phase, num_taps, stride, out + phase, num_phases - phase);
+}
+
+
+static const dsp_kernel_table neon_table =
+{
+	"neon",
+	neon_sc16_to_fc32,
+	neon_sc16_mag_squared,
+	neon_fc32_scale,
+	neon_fc32_multiply,
+	neon_fc32_mag_squared,
+	neon_fc32_dot,
+	neon_fc32_to_sc16,
+	neon_fc32_interpolate,
+	neon_fc32_interpolate_real
+};
+
+
+const dsp_kernel_table * dsp_neon_kernels()
+{
+	return &neon_table;
+}
+
+
+#else
+
+const dsp_kernel_table * dsp_neon_kernels()
+{
+	return NULL;
+}
+
+#endif
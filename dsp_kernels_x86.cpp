@@ -0,0 +1,477 @@
+/***********************************************************************//**
+@file
+
+SSE2 and AVX2 versions of the DSP kernels
+
+The functions are compiled with the target attribute of their
+instruction set, so that the file does not need any special compiler
+flag and the AVX2 version is only called when the CPU supports it.
+Each function handles the samples which do not fill a whole vector with
+the scalar code of the reference.
+
+***************************************************************************/
+
+#include "dsp_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#define DSP_SSE2 __attribute__((target("sse2")))
+#define DSP_AVX2 __attribute__((target("avx2")))
+
+
+//-----------------------------------------------------------------------
+// SSE2: 4 floats or 8 int16 per register
+//-----------------------------------------------------------------------
+
+DSP_SSE2 static void sse2_sc16_to_fc32(const sample_sc16 * in, sample_fc32 * out, size_t num_samps, float scale)
+{
+	const int16_t * src = reinterpret_cast<const int16_t *>(in);
+	float * dst = reinterpret_cast<float *>(out);
+	size_t count = 2 * num_samps;
+	size_t index = 0;
+	__m128 k = _mm_set1_ps(scale);
+	for(; index + 8 <= count; index += 8)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + index));
+		// Sign extension: the int16 goes to the high half, then shifts back
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		_mm_storeu_ps(dst + index, _mm_mul_ps(_mm_cvtepi32_ps(lo), k));
+		_mm_storeu_ps(dst + index + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), k));
+	}
+	for(; index < count; index++)
+		dst[index] = float(src[index]) * scale;
+}
+
+
+DSP_SSE2 static void sse2_sc16_mag_squared(const sample_sc16 * in, uint32_t * out, size_t num_samps)
+{
+	const int16_t * src = reinterpret_cast<const int16_t *>(in);
+	size_t index = 0;
+	for(; index + 4 <= num_samps; index += 4)
+	{
+		// pmaddwd gives I*I + Q*Q of each sample. The only overflow
+		// (-32768, -32768) wraps to 0x80000000, the right unsigned result
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * index));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + index), _mm_madd_epi16(v, v));
+	}
+	for(; index < num_samps; index++)
+	{
+		int32_t i = src[2 * index];
+		int32_t q = src[2 * index + 1];
+		out[index] = uint32_t(i * i) + uint32_t(q * q);
+	}
+}
+
+
+DSP_SSE2 static void sse2_fc32_scale(const sample_fc32 * in, sample_fc32 * out, size_t num_samps, float gain)
+{
+	const float * src = reinterpret_cast<const float *>(in);
+	float * dst = reinterpret_cast<float *>(out);
+	size_t count = 2 * num_samps;
+	size_t index = 0;
+	__m128 k = _mm_set1_ps(gain);
+	for(; index + 4 <= count; index += 4)
+		_mm_storeu_ps(dst + index, _mm_mul_ps(_mm_loadu_ps(src + index), k));
+	for(; index < count; index++)
+		dst[index] = src[index] * gain;
+}
+
+
+/// Complex product of 2 interleaved samples: (xr*yr - xi*yi, xi*yr + xr*yi)
+DSP_SSE2 static inline __m128 sse2_cmul(__m128 x, __m128 y)
+{
+	const __m128 sign = _mm_castsi128_ps(_mm_set_epi32(0, int(0x80000000), 0, int(0x80000000)));
+	__m128 yr = _mm_shuffle_ps(y, y, _MM_SHUFFLE(2, 2, 0, 0));
+	__m128 yi = _mm_shuffle_ps(y, y, _MM_SHUFFLE(3, 3, 1, 1));
+	__m128 xs = _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1));
+	// x*yr = (xr*yr, xi*yr), xs*yi = (xi*yi, xr*yi). Negating the real
+	// part before the addition is exact, as in the scalar subtraction
+	return _mm_add_ps(_mm_mul_ps(x, yr), _mm_xor_ps(_mm_mul_ps(xs, yi), sign));
+}
+
+
+DSP_SSE2 static void sse2_fc32_multiply(const sample_fc32 * a, const sample_fc32 * b, sample_fc32 * out, size_t num_samps)
+{
+	const float * x = reinterpret_cast<const float *>(a);
+	const float * y = reinterpret_cast<const float *>(b);
+	float * dst = reinterpret_cast<float *>(out);
+	size_t index = 0;
+	for(; index + 2 <= num_samps; index += 2)
+		_mm_storeu_ps(dst + 2 * index, sse2_cmul(_mm_loadu_ps(x + 2 * index), _mm_loadu_ps(y + 2 * index)));
+	if(index < num_samps)
+		dsp_scalar_kernels().fc32_multiply(a + index, b + index, out + index, num_samps - index);
+}
+
+
+DSP_SSE2 static void sse2_fc32_mag_squared(const sample_fc32 * in, float * out, size_t num_samps)
+{
+	const float * src = reinterpret_cast<const float *>(in);
+	size_t index = 0;
+	for(; index + 4 <= num_samps; index += 4)
+	{
+		__m128 v0 = _mm_loadu_ps(src + 2 * index);
+		__m128 v1 = _mm_loadu_ps(src + 2 * index + 4);
+		__m128 s0 = _mm_mul_ps(v0, v0);
+		__m128 s1 = _mm_mul_ps(v1, v1);
+		__m128 re = _mm_shuffle_ps(s0, s1, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 im = _mm_shuffle_ps(s0, s1, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm_storeu_ps(out + index, _mm_add_ps(re, im));
+	}
+	if(index < num_samps)
+		dsp_scalar_kernels().fc32_mag_squared(in + index, out + index, num_samps - index);
+}
+
+
+DSP_SSE2 static sample_fc32 sse2_fc32_dot(const sample_fc32 * a, const sample_fc32 * b, size_t num_samps)
+{
+	const float * x = reinterpret_cast<const float *>(a);
+	const float * y = reinterpret_cast<const float *>(b);
+	__m128 acc0 = _mm_setzero_ps();
+	__m128 acc1 = _mm_setzero_ps();
+	size_t index = 0;
+	for(; index + 4 <= num_samps; index += 4)
+	{
+		acc0 = _mm_add_ps(acc0, sse2_cmul(_mm_loadu_ps(x + 2 * index), _mm_loadu_ps(y + 2 * index)));
+		acc1 = _mm_add_ps(acc1, sse2_cmul(_mm_loadu_ps(x + 2 * index + 4), _mm_loadu_ps(y + 2 * index + 4)));
+	}
+	float sum[4];
+	_mm_storeu_ps(sum, _mm_add_ps(acc0, acc1));
+	sample_fc32 result(sum[0] + sum[2], sum[1] + sum[3]);
+	if(index < num_samps)
+		result += dsp_scalar_kernels().fc32_dot(a + index, b + index, num_samps - index);
+	return result;
+}
+
+
+/// Scales 4 floats, saturates them to int16 and rounds them half away from zero like the scalar code
+DSP_SSE2 static inline __m128i sse2_round_sc16(__m128 v, __m128 k)
+{
+	const __m128 sign = _mm_castsi128_ps(_mm_set1_epi32(int(0x80000000)));
+	v = _mm_min_ps(_mm_max_ps(_mm_mul_ps(v, k), _mm_set1_ps(-32768.0f)), _mm_set1_ps(32767.0f));
+	v = _mm_add_ps(v, _mm_or_ps(_mm_set1_ps(0.5f), _mm_and_ps(v, sign)));
+	return _mm_cvttps_epi32(v);
+}
+
+
+DSP_SSE2 static void sse2_fc32_to_sc16(const sample_fc32 * in, sample_sc16 * out, size_t num_samps, float scale)
+{
+	const float * src = reinterpret_cast<const float *>(in);
+	int16_t * dst = reinterpret_cast<int16_t *>(out);
+	__m128 k = _mm_set1_ps(scale);
+	size_t index = 0;
+	for(; index + 4 <= num_samps; index += 4)
+	{
+		__m128i lo = sse2_round_sc16(_mm_loadu_ps(src + 2 * index), k);
+		__m128i hi = sse2_round_sc16(_mm_loadu_ps(src + 2 * index + 4), k);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * index), _mm_packs_epi32(lo, hi));
+	}
+	if(index < num_samps)
+		dsp_scalar_kernels().fc32_to_sc16(in + index, out + index, num_samps - index, scale);
+}
+
+
+DSP_SSE2 static void sse2_fc32_interpolate(const sample_fc32 * hist, const sample_fc32 * taps, size_t num_taps, size_t stride,
+	sample_fc32 * out, size_t num_phases)
+{
+	const float * x = reinterpret_cast<const float *>(hist);
+	const float * y = reinterpret_cast<const float *>(taps);
+	float * dst = reinterpret_cast<float *>(out);
+	// 2 phases per register, the history sample broadcast
+	size_t phase = 0;
+	for(; phase + 2 <= num_phases; phase += 2)
+	{
+		__m128 acc = _mm_setzero_ps();
+		for(size_t k = 0; k < num_taps; k++)
+		{
+			__m128 xk = _mm_castpd_ps(_mm_load1_pd(reinterpret_cast<const double *>(x + 2 * k)));
+			acc = _mm_add_ps(acc, sse2_cmul(xk, _mm_loadu_ps(y + 2 * (k * stride + phase))));
+		}
+		_mm_storeu_ps(dst + 2 * phase, acc);
+	}
+	if(phase < num_phases)
+		dsp_scalar_kernels().fc32_interpolate(hist, taps + phase, num_taps, stride, out + phase, num_phases - phase);
+}
+
+
+DSP_SSE2 static void sse2_fc32_interpolate_real(const sample_fc32 * hist, const float * taps, size_t num_taps, size_t stride,
+	sample_fc32 * out, size_t num_phases)
+{
+	const float * x = reinterpret_cast<const float *>(hist);
+	float * dst = reinterpret_cast<float *>(out);
+	// 4 phases in 2 registers, each tap duplicated for I and Q
+	size_t phase = 0;
+	for(; phase + 4 <= num_phases; phase += 4)
+	{
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		for(size_t k = 0; k < num_taps; k++)
+		{
+			__m128 xk = _mm_castpd_ps(_mm_load1_pd(reinterpret_cast<const double *>(x + 2 * k)));
+			__m128 t = _mm_loadu_ps(taps + k * stride + phase);
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(xk, _mm_unpacklo_ps(t, t)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(xk, _mm_unpackhi_ps(t, t)));
+		}
+		_mm_storeu_ps(dst + 2 * phase, acc0);
+		_mm_storeu_ps(dst + 2 * phase + 4, acc1);
+	}
+	if(phase < num_phases)
+		dsp_scalar_kernels().fc32_interpolate_real(hist, taps + phase, num_taps, stride, out + phase, num_phases - phase);
+}
+
+
+static const dsp_kernel_table sse2_table =
+{
+	"sse2",
+	sse2_sc16_to_fc32,
+	sse2_sc16_mag_squared,
+	sse2_fc32_scale,
+	sse2_fc32_multiply,
+	sse2_fc32_mag_squared,
+	sse2_fc32_dot,
+	sse2_fc32_to_sc16,
+	sse2_fc32_interpolate,
+	sse2_fc32_interpolate_real
+};
+
+
+//-----------------------------------------------------------------------
+// AVX2: 8 floats or 16 int16 per register
+//-----------------------------------------------------------------------
+
+DSP_AVX2 static void avx2_sc16_to_fc32(const sample_sc16 * in, sample_fc32 * out, size_t num_samps, float scale)
+{
+	const int16_t * src = reinterpret_cast<const int16_t *>(in);
+	float * dst = reinterpret_cast<float *>(out);
+	size_t count = 2 * num_samps;
+	size_t index = 0;
+	__m256 k = _mm256_set1_ps(scale);
+	for(; index + 16 <= count; index += 16)
+	{
+		__m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + index)));
+		__m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + index + 8)));
+		_mm256_storeu_ps(dst + index, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), k));
+		_mm256_storeu_ps(dst + index + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), k));
+	}
+	for(; index < count; index++)
+		dst[index] = float(src[index]) * scale;
+}
+
+
+DSP_AVX2 static void avx2_sc16_mag_squared(const sample_sc16 * in, uint32_t * out, size_t num_samps)
+{
+	const int16_t * src = reinterpret_cast<const int16_t *>(in);
+	size_t index = 0;
+	for(; index + 8 <= num_samps; index += 8)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 2 * index));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + index), _mm256_madd_epi16(v, v));
+	}
+	if(index < num_samps)
+		sse2_sc16_mag_squared(in + index, out + index, num_samps - index);
+}
+
+
+DSP_AVX2 static void avx2_fc32_scale(const sample_fc32 * in, sample_fc32 * out, size_t num_samps, float gain)
+{
+	const float * src = reinterpret_cast<const float *>(in);
+	float * dst = reinterpret_cast<float *>(out);
+	size_t count = 2 * num_samps;
+	size_t index = 0;
+	__m256 k = _mm256_set1_ps(gain);
+	for(; index + 8 <= count; index += 8)
+		_mm256_storeu_ps(dst + index, _mm256_mul_ps(_mm256_loadu_ps(src + index), k));
+	for(; index < count; index++)
+		dst[index] = src[index] * gain;
+}
+
+
+/// Complex product of 4 interleaved samples. addsub is exact like the scalar code
+DSP_AVX2 static inline __m256 avx2_cmul(__m256 x, __m256 y)
+{
+	__m256 yr = _mm256_moveldup_ps(y);
+	__m256 yi = _mm256_movehdup_ps(y);
+	__m256 xs = _mm256_permute_ps(x, _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm256_addsub_ps(_mm256_mul_ps(x, yr), _mm256_mul_ps(xs, yi));
+}
+
+
+DSP_AVX2 static void avx2_fc32_multiply(const sample_fc32 * a, const sample_fc32 * b, sample_fc32 * out, size_t num_samps)
+{
+	const float * x = reinterpret_cast<const float *>(a);
+	const float * y = reinterpret_cast<const float *>(b);
+	float * dst = reinterpret_cast<float *>(out);
+	size_t index = 0;
+	for(; index + 4 <= num_samps; index += 4)
+		_mm256_storeu_ps(dst + 2 * index, avx2_cmul(_mm256_loadu_ps(x + 2 * index), _mm256_loadu_ps(y + 2 * index)));
+	if(index < num_samps)
+		dsp_scalar_kernels().fc32_multiply(a + index, b + index, out + index, num_samps - index);
+}
+
+
+DSP_AVX2 static void avx2_fc32_mag_squared(const sample_fc32 * in, float * out, size_t num_samps)
+{
+	const float * src = reinterpret_cast<const float *>(in);
+	size_t index = 0;
+	for(; index + 8 <= num_samps; index += 8)
+	{
+		__m256 v0 = _mm256_loadu_ps(src + 2 * index);
+		__m256 v1 = _mm256_loadu_ps(src + 2 * index + 8);
+		__m256 s0 = _mm256_mul_ps(v0, v0);
+		__m256 s1 = _mm256_mul_ps(v1, v1);
+		// The shuffles work inside each 128 bits lane: samples 0 1 4 5 2 3 6 7
+		__m256 re = _mm256_shuffle_ps(s0, s1, _MM_SHUFFLE(2, 0, 2, 0));
+		__m256 im = _mm256_shuffle_ps(s0, s1, _MM_SHUFFLE(3, 1, 3, 1));
+		__m256 sum = _mm256_add_ps(re, im);
+		sum = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(sum), _MM_SHUFFLE(3, 1, 2, 0)));
+		_mm256_storeu_ps(out + index, sum);
+	}
+	if(index < num_samps)
+		dsp_scalar_kernels().fc32_mag_squared(in + index, out + index, num_samps - index);
+}
+
+
+DSP_AVX2 static sample_fc32 avx2_fc32_dot(const sample_fc32 * a, const sample_fc32 * b, size_t num_samps)
+{
+	const float * x = reinterpret_cast<const float *>(a);
+	const float * y = reinterpret_cast<const float *>(b);
+	__m256 acc0 = _mm256_setzero_ps();
+	__m256 acc1 = _mm256_setzero_ps();
+	size_t index = 0;
+	for(; index + 8 <= num_samps; index += 8)
+	{
+		acc0 = _mm256_add_ps(acc0, avx2_cmul(_mm256_loadu_ps(x + 2 * index), _mm256_loadu_ps(y + 2 * index)));
+		acc1 = _mm256_add_ps(acc1, avx2_cmul(_mm256_loadu_ps(x + 2 * index + 8), _mm256_loadu_ps(y + 2 * index + 8)));
+	}
+	__m256 acc = _mm256_add_ps(acc0, acc1);
+	__m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+	float sum[4];
+	_mm_storeu_ps(sum, half);
+	sample_fc32 result(sum[0] + sum[2], sum[1] + sum[3]);
+	if(index < num_samps)
+		result += dsp_scalar_kernels().fc32_dot(a + index, b + index, num_samps - index);
+	return result;
+}
+
+
+/// Scales 8 floats, saturates them to int16 and rounds them half away from zero like the scalar code
+DSP_AVX2 static inline __m256i avx2_round_sc16(__m256 v, __m256 k)
+{
+	const __m256 sign = _mm256_castsi256_ps(_mm256_set1_epi32(int(0x80000000)));
+	v = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(v, k), _mm256_set1_ps(-32768.0f)), _mm256_set1_ps(32767.0f));
+	v = _mm256_add_ps(v, _mm256_or_ps(_mm256_set1_ps(0.5f), _mm256_and_ps(v, sign)));
+	return _mm256_cvttps_epi32(v);
+}
+
+
+DSP_AVX2 static void avx2_fc32_to_sc16(const sample_fc32 * in, sample_sc16 * out, size_t num_samps, float scale)
+{
+	const float * src = reinterpret_cast<const float *>(in);
+	int16_t * dst = reinterpret_cast<int16_t *>(out);
+	__m256 k = _mm256_set1_ps(scale);
+	size_t index = 0;
+	for(; index + 8 <= num_samps; index += 8)
+	{
+		__m256i lo = avx2_round_sc16(_mm256_loadu_ps(src + 2 * index), k);
+		__m256i hi = avx2_round_sc16(_mm256_loadu_ps(src + 2 * index + 8), k);
+		// The pack works inside each 128 bits lane: samples 0 1 4 5 2 3 6 7
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 2 * index), packed);
+	}
+	if(index < num_samps)
+		dsp_scalar_kernels().fc32_to_sc16(in + index, out + index, num_samps - index, scale);
+}
+
+
+DSP_AVX2 static void avx2_fc32_interpolate(const sample_fc32 * hist, const sample_fc32 * taps, size_t num_taps, size_t stride,
+	sample_fc32 * out, size_t num_phases)
+{
+	const float * x = reinterpret_cast<const float *>(hist);
+	const float * y = reinterpret_cast<const float *>(taps);
+	float * dst = reinterpret_cast<float *>(out);
+	size_t phase = 0;
+	for(; phase + 4 <= num_phases; phase += 4)
+	{
+		__m256 acc = _mm256_setzero_ps();
+		for(size_t k = 0; k < num_taps; k++)
+		{
+			__m256 xk = _mm256_castpd_ps(_mm256_broadcast_sd(reinterpret_cast<const double *>(x + 2 * k)));
+			acc = _mm256_add_ps(acc, avx2_cmul(xk, _mm256_loadu_ps(y + 2 * (k * stride + phase))));
+		}
+		_mm256_storeu_ps(dst + 2 * phase, acc);
+	}
+	if(phase < num_phases)
+		dsp_scalar_kernels().fc32_interpolate(hist, taps + phase, num_taps, stride, out + phase, num_phases - phase);
+}
+
+
+DSP_AVX2 static void avx2_fc32_interpolate_real(const sample_fc32 * hist, const float * taps, size_t num_taps, size_t stride,
+	sample_fc32 * out, size_t num_phases)
+{
+	const float * x = reinterpret_cast<const float *>(hist);
+	float * dst = reinterpret_cast<float *>(out);
+	const __m256i dup_lo = _mm256_set_epi32(3, 3, 2, 2, 1, 1, 0, 0);
+	const __m256i dup_hi = _mm256_set_epi32(7, 7, 6, 6, 5, 5, 4, 4);
+	size_t phase = 0;
+	for(; phase + 8 <= num_phases; phase += 8)
+	{
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		for(size_t k = 0; k < num_taps; k++)
+		{
+			__m256 xk = _mm256_castpd_ps(_mm256_broadcast_sd(reinterpret_cast<const double *>(x + 2 * k)));
+			__m256 t = _mm256_loadu_ps(taps + k * stride + phase);
+			acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(xk, _mm256_permutevar8x32_ps(t, dup_lo)));
+			acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(xk, _mm256_permutevar8x32_ps(t, dup_hi)));
+		}
+		_mm256_storeu_ps(dst + 2 * phase, acc0);
+		_mm256_storeu_ps(dst + 2 * phase + 8, acc1);
+	}
+	if(phase < num_phases)
+		dsp_scalar_kernels().fc32_interpolate_real(hist, taps + phase, num_taps, stride, out + phase, num_phases - phase);
+}
+
+
+static const dsp_kernel_table avx2_table =
+{
+	"avx2",
+	avx2_sc16_to_fc32,
+	avx2_sc16_mag_squared,
+	avx2_fc32_scale,
+	avx2_fc32_multiply,
+	avx2_fc32_mag_squared,
+	avx2_fc32_dot,
+	avx2_fc32_to_sc16,
+	avx2_fc32_interpolate,
+	avx2_fc32_interpolate_real
+};
+
+
+const dsp_kernel_table * dsp_sse2_kernels()
+{
+	return __builtin_cpu_supports("sse2") ? &sse2_table : NULL;
+}
+
+
+const dsp_kernel_table * dsp_avx2_kernels()
+{
+	return __builtin_cpu_supports("avx2") ? &avx2_table : NULL;
+}
+
+
+#else
+
+const dsp_kernel_table * dsp_sse2_kernels()
+{
+	return NULL;
+}
+
+
+const dsp_kernel_table * dsp_avx2_kernels()
+{
+	return NULL;
+}
+
+#endif
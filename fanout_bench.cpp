@@ -0,0 +1,220 @@
+/***********************************************************************//**
+@file
+
+Publishes sample blocks through a block_fanout (block_fanout.h) to three
+subscribers running in their own threads, with each policy for the slow
+one, and checks the zero-copy hand-off
+
+The subscribers are: a fast reader (demodulator), a writer with a deep
+queue and a monitor which sleeps after each block. The producer fills each
+block once with a stamp of its sequence number and publishes it as fast
+as the pool allows.
+
+The program checks that every subscriber reads intact blocks in order,
+that the subscribers of a block all read it at the same address (no
+copy), that delivered plus dropped blocks account for every published
+block, that a FANOUT_BLOCK subscriber never misses a block, and that every
+block is back in the pool at the end. It prints the counters of each
+subscriber and the publication rate.
+
+Usage: fanoutbench [-n blocks] [-l label] [-j file]
+
+-n number of blocks published in each run (default 50000)
+-l label stored in the results (e.g. the release)
+-j file receiving the results, one JSON object per line (default fanout_bench.json)
+
+The exit code is 1 if a check fails.
+
+***************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <pthread.h>
+#include <unistd.h>
+#include "block_fanout.h"
+#include "sample_format.h"
+#include "bench_common.h"
+
+
+#define BLOCK_SAMPS 4096
+#define POOL_BLOCKS 16			/// Enlarged by reset() after the queues of the subscribers
+#define MONITOR_SLEEP_US 50		/// Work of the slow subscriber on each block
+#define NUM_SUBSCRIBERS 3
+
+typedef block_fanout<sample_sc16> bench_fanout;
+
+
+/// Stamp written in the first and last samples of a block
+static sample_sc16 stamp(uint64_t sequence)
+{
+	return sample_sc16(short(sequence & 0x7fff), short((sequence >> 15) & 0x7fff));
+}
+
+
+/// One subscriber and what its thread has read
+struct bench_reader
+{
+	bench_fanout::subscriber_t * subscriber;
+	int sleep_us;						/// Time spent on each block
+	std::vector<const sample_sc16 *> seen;	/// Address of each block read, by sequence number
+	uint64_t received;
+	uint64_t errors;					/// Blocks out of order or with a wrong stamp
+	pthread_t thread_id;
+};
+
+
+static void * reader_thread(void * arg)
+{
+	bench_reader & reader = *static_cast<bench_reader*>(arg);
+	uint64_t next = 0;
+	const bench_fanout::block_t * block;
+	while((block = reader.subscriber->wait_read()) != NULL)
+	{
+		if(block->sequence < next || block->sequence >= reader.seen.size() || block->num_samps != BLOCK_SAMPS
+			|| block->samples[0] != stamp(block->sequence) || block->samples[BLOCK_SAMPS - 1] != stamp(block->sequence))
+			reader.errors++;
+		else
+		{
+			reader.seen[block->sequence] = block->samples;
+			next = block->sequence + 1;
+		}
+		reader.received++;
+		if(reader.sleep_us)
+			usleep(reader.sleep_us);
+		reader.subscriber->release();
+	}
+	return NULL;
+}
+
+
+/***********************************************************************//**
+Runs the producer and the subscribers with the given policy for the
+monitor, then checks the results
+
+@return Number of failed checks
+
+***************************************************************************/
+static int run_policy(fanout_policy policy, uint64_t num_blocks, bench_context & bench)
+{
+	bench_fanout fanout(POOL_BLOCKS, BLOCK_SAMPS);
+	bench_reader readers[NUM_SUBSCRIBERS];
+	readers[0].subscriber = &fanout.subscribe("demod", 8);
+	readers[0].sleep_us = 0;
+	readers[1].subscriber = &fanout.subscribe("writer", 32);
+	readers[1].sleep_us = 0;
+	readers[2].subscriber = &fanout.subscribe("monitor", 4, policy);
+	readers[2].sleep_us = MONITOR_SLEEP_US;
+	fanout.reset();
+
+	for(int index = 0; index < NUM_SUBSCRIBERS; index++)
+	{
+		readers[index].seen.assign(num_blocks, NULL);
+		readers[index].received = 0;
+		readers[index].errors = 0;
+		pthread_create(&readers[index].thread_id, NULL, &reader_thread, &readers[index]);
+	}
+
+	uint64_t start = monotonic_ns();
+	for(uint64_t sequence = 0; sequence < num_blocks; sequence++)
+	{
+		bench_fanout::block_t * block = fanout.acquire_write();
+		for(size_t index = 0; index < BLOCK_SAMPS; index++)
+			block->samples[index] = stamp(sequence);
+		block->num_samps = BLOCK_SAMPS;
+		block->first_sample = sequence * BLOCK_SAMPS;
+		block->skipped = 0;
+		fanout.publish();
+	}
+	uint64_t elapsed = monotonic_ns() - start;
+	fanout.close();
+	for(int index = 0; index < NUM_SUBSCRIBERS; index++)
+		pthread_join(readers[index].thread_id, NULL);
+
+	const char * policy_name = policy == FANOUT_BLOCK ? "block" : "drop";
+	printf("\nMonitor policy %s: %.0f blocks/s, %.1f MS/s\n", policy_name, num_blocks * 1e9 / elapsed, num_blocks * BLOCK_SAMPS * 1e3 / elapsed);
+	fanout.print_stats(std::cout);
+
+	// Counters and integrity of each subscriber
+	int errors = 0;
+	uint64_t shared_bytes = 0;
+	for(int index = 0; index < NUM_SUBSCRIBERS; index++)
+	{
+		const bench_reader & reader = readers[index];
+		const bench_fanout::subscriber_t & subscriber = *reader.subscriber;
+		if(reader.errors || reader.received != subscriber.get_delivered()
+			|| subscriber.get_delivered() + subscriber.get_drops() != fanout.get_published())
+		{
+			printf("FAILED: %s read %llu blocks (%llu bad) for %llu delivered and %llu dropped of %llu\n", subscriber.get_name(),
+				(unsigned long long)reader.received, (unsigned long long)reader.errors, (unsigned long long)subscriber.get_delivered(),
+				(unsigned long long)subscriber.get_drops(), (unsigned long long)fanout.get_published());
+			errors++;
+		}
+		if(subscriber.get_policy() == FANOUT_BLOCK && subscriber.get_drops())
+		{
+			printf("FAILED: %s dropped blocks with the block policy\n", subscriber.get_name());
+			errors++;
+		}
+		shared_bytes += subscriber.get_delivered() * BLOCK_SAMPS * sizeof(sample_sc16);
+	}
+
+	// The subscribers of a block read the same samples
+	uint64_t copies = 0;
+	for(uint64_t sequence = 0; sequence < num_blocks; sequence++)
+	{
+		const sample_sc16 * address = NULL;
+		for(int index = 0; index < NUM_SUBSCRIBERS; index++)
+		{
+			const sample_sc16 * seen = readers[index].seen[sequence];
+			if(seen == NULL)
+				continue;
+			if(address && seen != address)
+				copies++;
+			address = seen;
+		}
+	}
+	if(copies)
+	{
+		printf("FAILED: %llu blocks read at different addresses\n", (unsigned long long)copies);
+		errors++;
+	}
+	if(fanout.get_overruns() || fanout.count_free() != fanout.size())
+	{
+		printf("FAILED: %llu overruns, %zu of %zu blocks back in the pool\n", (unsigned long long)fanout.get_overruns(),
+			fanout.count_free(), fanout.size());
+		errors++;
+	}
+
+	const bench_fanout::subscriber_t & monitor = *readers[2].subscriber;
+	fprintf(bench.record("fanout"), "\"policy\":\"%s\",\"blocks\":%llu,\"block_samps\":%d,\"blocks_per_s\":%.0f,\"monitor_drops\":%llu,"
+		"\"monitor_blocked_ms\":%.1f,\"bytes_not_copied\":%llu,\"ok\":%s}\n", policy_name, (unsigned long long)num_blocks, BLOCK_SAMPS, num_blocks * 1e9 / elapsed,
+		(unsigned long long)monitor.get_drops(), monitor.get_blocked_ns() * 1e-6, (unsigned long long)shared_bytes, errors ? "false" : "true");
+	return errors;
+}
+
+
+int main(int argc, char ** argv)
+{
+	uint64_t num_blocks = 50000;
+	bench_context bench("fanout_bench.json");
+	for(int index = 1; index < argc; index++)
+	{
+		if(strcmp(argv[index], "-n") == 0 && index + 1 < argc)
+			num_blocks = strtoull(argv[++index], NULL, 10);
+		else if(bench.parse_option(argc, argv, index))
+		{
+			std::cout << "Usage: fanoutbench [-n blocks] [-l label] [-j file]" << std::endl;
+			return 1;
+		}
+	}
+	if(bench.open())
+		return 1;
+
+	bench.errors += run_policy(FANOUT_DROP, num_blocks, bench);
+	bench.errors += run_policy(FANOUT_BLOCK, num_blocks, bench);
+
+	printf("\n");
+	return bench.finish("Every block shared without copy");
+}
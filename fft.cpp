@@ -0,0 +1,127 @@
+#include "fft.h"
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <pthread.h>
+
+
+/***********************************************************************//**
+Computes the tables of a transform
+
+@param size Number of points, a power of two
+@param inverse_transform True for the inverse transform
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool fft_plan::init(size_t size, bool inverse_transform)
+{
+	if(size == 0 || (size & (size - 1)) != 0)
+	{
+		std::cout << "FFT size " << size << " is not a power of two" << std::endl;
+		return true;
+	}
+	length = size;
+	inverse = inverse_transform;
+
+	int bits = 0;
+	while((size_t(1) << bits) < length)
+		bits++;
+	reversed.resize(length);
+	for(size_t index = 0; index < length; index++)
+	{
+		size_t r = 0;
+		for(int bit = 0; bit < bits; bit++)
+			if(index & (size_t(1) << bit))
+				r |= size_t(1) << (bits - 1 - bit);
+		reversed[index] = r;
+	}
+
+	double sign = inverse ? 1 : -1;
+	twiddles.resize(length / 2);
+	for(size_t k = 0; k < length / 2; k++)
+	{
+		double angle = sign * 2 * M_PI * k / length;
+		twiddles[k] = sample_fc32(float(cos(angle)), float(sin(angle)));
+	}
+	return false;
+}
+
+
+/***********************************************************************//**
+Runs the transform: bit reversal then decimation in time butterflies
+
+***************************************************************************/
+
+void fft_plan::execute(const sample_fc32 * in, sample_fc32 * out) const
+{
+	if(in == out)
+	{
+		for(size_t index = 0; index < length; index++)
+			if(reversed[index] > index)
+				std::swap(out[index], out[reversed[index]]);
+	}
+	else
+	{
+		for(size_t index = 0; index < length; index++)
+			out[reversed[index]] = in[index];
+	}
+
+	for(size_t half = 1; half < length; half *= 2)
+	{
+		size_t stride = length / (2 * half);
+		for(size_t start = 0; start < length; start += 2 * half)
+		{
+			for(size_t k = 0; k < half; k++)
+			{
+				const sample_fc32 & w = twiddles[k * stride];
+				sample_fc32 & a = out[start + k];
+				sample_fc32 & b = out[start + k + half];
+				float br = b.real() * w.real() - b.imag() * w.imag();
+				float bi = b.real() * w.imag() + b.imag() * w.real();
+				b = sample_fc32(a.real() - br, a.imag() - bi);
+				a = sample_fc32(a.real() + br, a.imag() + bi);
+			}
+		}
+	}
+}
+
+
+/// Plans shared by the whole process, by size and direction
+static std::map<std::pair<size_t, bool>, fft_plan *> plan_cache;
+static pthread_mutex_t plan_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/***********************************************************************//**
+Returns the plan of a transform, computing it on the first request
+
+@param size Number of points, a power of two
+@param inverse True for the inverse transform
+
+@return Plan shared by all the callers, NULL if the size is not valid
+
+***************************************************************************/
+
+const fft_plan * fft_get_plan(size_t size, bool inverse)
+{
+	pthread_mutex_lock(&plan_cache_mutex);
+	std::pair<size_t, bool> key(size, inverse);
+	std::map<std::pair<size_t, bool>, fft_plan *>::iterator found = plan_cache.find(key);
+	fft_plan * plan = NULL;
+	if(found != plan_cache.end())
+		plan = found->second;
+	else
+	{
+		plan = new fft_plan;
+		if(plan->init(size, inverse))
+		{
+			delete plan;
+			plan = NULL;
+		}
+		else
+			plan_cache[key] = plan;
+	}
+	pthread_mutex_unlock(&plan_cache_mutex);
+	return plan;
+}
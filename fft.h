@@ -0,0 +1,55 @@
+/***********************************************************************//**
+@file
+
+Small complex FFT for the filter banks and the correlators
+
+Radix-2, sizes which are a power of two. The twiddle factors and the bit
+reversal permutation are computed once by init(), so execute() does no
+allocation and no trigonometry. Neither direction is normalised: an
+inverse transform following a forward one multiplies by the size.
+
+fft_get_plan() keeps one plan of each size and direction for the whole
+process, so that the filters created and destroyed at run time do not
+recompute the tables. A plan is never modified after init() and can be
+executed by several threads at once.
+
+***************************************************************************/
+
+#ifndef FFT_H
+#define FFT_H
+
+#include <vector>
+#include <cstddef>
+#include "sample_format.h"
+#include "block_pool.h"
+
+
+/***********************************************************************//**
+Plan of a transform of one size and one direction
+
+forward: X[k] = sum x[n] exp(-2 pi j k n / N)
+inverse: x[n] = sum X[k] exp(+2 pi j k n / N)
+
+***************************************************************************/
+class fft_plan
+{
+public:
+	fft_plan() : length(0), inverse(false) {}
+	bool init(size_t size, bool inverse_transform);
+	/// out may be in (in place transform)
+	void execute(const sample_fc32 * in, sample_fc32 * out) const;
+	size_t size() const {return length;}
+	bool is_inverse() const {return inverse;}
+
+private:
+	size_t length;					/// Number of points
+	bool inverse;					/// True for the inverse transform
+	fc32_buffer twiddles;	/// exp(-+2 pi j k / N) for k < N/2
+	std::vector<size_t> reversed;	/// Bit reversed index of each input
+};
+
+
+const fft_plan * fft_get_plan(size_t size, bool inverse);
+
+
+#endif
@@ -0,0 +1,214 @@
+#include "file_source.h"
+#include <cstring>
+#include <complex>
+#include <iostream>
+#include <unistd.h>
+
+
+/***********************************************************************//**
+Constructor
+
+@param name Name of the capture file
+@param pace true to deliver the samples at the sample rate of the capture
+@param repeat true to restart at the beginning when the end of the file is reached
+
+***************************************************************************/
+
+file_source::file_source(const char * name, bool pace, bool repeat)
+:filename(name), paced(pace), loop(repeat), opened(false), done(false), position(0), delivered(0), loops(0),
+ next_entry(0), overflow_reported(false)
+{
+}
+
+
+/***********************************************************************//**
+Opens the capture file and checks its format
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool file_source::prepare()
+{
+	if(opened && opened_format == cpu_format)
+		return false;
+	if(reader.open(filename.c_str()))
+		return true;
+	// The samples are copied as they are: no conversion between host formats
+	const capture_header & h = reader.get_header();
+	std::string format(h.cpu_format, strnlen(h.cpu_format, sizeof(h.cpu_format)));
+	if(format != cpu_format || h.sample_size != cpu_format_size(cpu_format))
+	{
+		std::cout << "The capture holds " << format << " samples, " << cpu_format << " requested" << std::endl;
+		reader.close();
+		return true;
+	}
+	opened = true;
+	opened_format = cpu_format;
+	return false;
+}
+
+
+/***********************************************************************//**
+Starts the replay at the beginning of the file
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool file_source::start(size_t)
+{
+	if(prepare())
+		return true;
+	done = reader.get_num_samples() == 0;
+	position = 0;
+	delivered = 0;
+	loops = 0;
+	loop_offset = uhd::time_spec_t(0.0);
+	next_entry = 0;
+	overflow_reported = false;
+	pacer.start(paced ? get_rate() : 0);
+	return false;
+}
+
+
+/***********************************************************************//**
+Time between the first samples of two passes of a loop: the span of the
+capture, gaps and squelched spans included, plus one sample period so
+that the next pass follows the last sample
+
+***************************************************************************/
+
+uhd::time_spec_t file_source::loop_span() const
+{
+	int64_t first_secs, last_secs;
+	double first_frac, last_frac;
+	reader.sample_time(0, first_secs, first_frac);
+	reader.sample_time(reader.get_num_samples() - 1, last_secs, last_frac);
+	return uhd::time_spec_t(time_t(last_secs - first_secs), last_frac - first_frac) + uhd::time_spec_t(1 / reader.get_header().sample_rate);
+}
+
+
+/***********************************************************************//**
+Delivers the next samples of the file
+
+@return Number of samples copied into buf
+
+***************************************************************************/
+
+size_t file_source::recv(void * buf, size_t num_samps, uhd::rx_metadata_t & md, double timeout)
+{
+	md = uhd::rx_metadata_t();
+	md.error_code = uhd::rx_metadata_t::ERROR_CODE_NONE;
+	if(done)
+	{
+		// Behave like a device which stopped streaming
+		usleep(useconds_t(timeout * 1e6));
+		md.error_code = uhd::rx_metadata_t::ERROR_CODE_TIMEOUT;
+		return 0;
+	}
+
+	// Injected overflow: samples are skipped
+	size_t lost = injector.check();
+	if(lost)
+	{
+		if(lost > reader.get_num_samples() - position)
+			lost = reader.get_num_samples() - position - 1;
+		position += lost;
+		delivered += lost;
+		while(next_entry < reader.get_index_size() && reader.get_index_entry(next_entry).sample < position)
+		{
+			next_entry++;
+			overflow_reported = false;
+		}
+		md.error_code = uhd::rx_metadata_t::ERROR_CODE_OVERFLOW;
+		return 0;
+	}
+
+	// Overflow recorded in the capture
+	size_t count = num_samps;
+	if(next_entry < reader.get_index_size())
+	{
+		const capture_index_entry & e = reader.get_index_entry(next_entry);
+		if(e.sample == position && (e.flags & CAPTURE_INDEX_OVERFLOW) && !overflow_reported)
+		{
+			overflow_reported = true;
+			md.error_code = uhd::rx_metadata_t::ERROR_CODE_OVERFLOW;
+			return 0;
+		}
+		// A block must not span the next gap or squelched span
+		for(size_t index = next_entry; index < reader.get_index_size(); index++)
+		{
+			const capture_index_entry & gap = reader.get_index_entry(index);
+			if(gap.sample >= position + count)
+				break;
+			if(gap.sample > position && (gap.flags & (CAPTURE_INDEX_GAP | CAPTURE_INDEX_SQUELCH)))
+			{
+				count = gap.sample - position;
+				break;
+			}
+		}
+	}
+	if(count > reader.get_num_samples() - position)
+		count = reader.get_num_samples() - position;
+
+	const void * samples = reader.get_samples(position, count);
+	if(samples == NULL)
+	{
+		done = true;
+		md.error_code = uhd::rx_metadata_t::ERROR_CODE_BAD_PACKET;
+		return 0;
+	}
+	memcpy(buf, samples, count * reader.get_header().sample_size);
+
+	int64_t full_secs;
+	double frac_secs;
+	reader.sample_time(position, full_secs, frac_secs);
+	md.has_time_spec = true;
+	md.time_spec = uhd::time_spec_t(time_t(full_secs), frac_secs);
+	if(loops)
+		md.time_spec = md.time_spec + loop_offset;
+
+	position += count;
+	delivered += count;
+	while(next_entry < reader.get_index_size() && reader.get_index_entry(next_entry).sample < position)
+	{
+		next_entry++;
+		overflow_reported = false;
+	}
+	if(position == reader.get_num_samples())
+	{
+		if(loop)
+		{
+			position = 0;
+			next_entry = 0;
+			loops++;
+			loop_offset = loop_offset + loop_span();
+		}
+		else
+			done = true;
+	}
+
+	pacer.wait(delivered);
+	return count;
+}
+
+
+/***********************************************************************//**
+Describes the replayed capture: the header of the original capture is
+reused with the current host time
+
+***************************************************************************/
+
+void file_source::describe(capture_header & header, std::string & snapshot)
+{
+	header = reader.get_header();
+	header.complete = 0;
+	header.host_start_time = time(NULL);
+	header.num_samples = 0;
+	header.index_offset = 0;
+	header.index_count = 0;
+	header.num_gaps = 0;
+	header.num_squelched = 0;
+	snapshot = "Replay of " + filename + "\n" + reader.get_snapshot();
+}
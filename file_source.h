@@ -0,0 +1,66 @@
+/***********************************************************************//**
+@file
+
+Declaration of the sample source replaying a capture file
+
+
+***************************************************************************/
+
+#ifndef FILE_SOURCE_H
+#define FILE_SOURCE_H
+
+#include "sample_source.h"
+
+
+/***********************************************************************//**
+Sample source replaying a capture file written by the capture_writer
+
+The samples are delivered with the time stamps of the capture. The gaps
+of the capture are reproduced: a block never spans a gap and an overflow
+recorded in the index is reported before the first block following it.
+The replay can be paced at the sample rate of the capture or run as fast
+as possible, and additional overflows can be injected. In loop mode each
+pass is stamped after the last sample of the previous one, so the time
+keeps increasing. The host format
+requested with set_format() must be the format of the capture: the
+samples are copied without conversion.
+
+***************************************************************************/
+class file_source : public sample_source
+{
+public:
+	file_source(const char * filename, bool paced = true, bool loop = false);
+
+	bool prepare();
+	bool start(size_t samps_per_buf);
+	size_t recv(void * buf, size_t num_samps, uhd::rx_metadata_t & md, double timeout);
+	void stop() {}
+	bool is_done() const {return done;}
+	double get_rate() {return reader.get_header().sample_rate;}
+	void describe(capture_header & header, std::string & snapshot);
+
+	/// Injects an overflow every num_blocks recv() calls, losing num_samps samples
+	void set_overflow_injection(size_t num_blocks, size_t num_samps) {injector.configure(num_blocks, num_samps);}
+
+private:
+	uhd::time_spec_t loop_span() const;
+
+	capture_reader reader;		/// Access to the capture file
+	std::string filename;		/// Name of the capture file
+	bool paced;					/// True to deliver the samples at the sample rate
+	bool loop;					/// True to restart at the beginning at the end of the file
+	bool opened;				/// True once the file has been opened and checked
+	std::string opened_format;	/// Host format checked when the file was opened
+	bool done;					/// True once the end of the file has been reached
+	uint64_t position;			/// Next sample of the file to deliver
+	uint64_t delivered;			/// Number of samples delivered or skipped since start()
+	uint64_t loops;				/// Number of times the end of the file was reached
+	uhd::time_spec_t loop_offset;	/// Time added to the stamps of the current pass: loops times the span of the capture
+	size_t next_entry;			/// First index entry at or after position
+	bool overflow_reported;		/// True once the overflow of next_entry has been reported
+	source_pacer pacer;			/// Paces the replay
+	overflow_injector injector;	/// Injects additional overflows
+};
+
+
+#endif
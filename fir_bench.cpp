@@ -0,0 +1,209 @@
+/***********************************************************************//**
+@file
+
+Compares the compile-time specialised filters (fir_static.h) with the
+filters of the baseband chains, whose taps and decimation are set at run
+time
+
+For each design the program checks that both filters give the same
+output (bit for bit in Q15, within the rounding of the sums in float)
+and that the coefficients computed by the compiler match
+design_lowpass(). It then measures both on the sizes of the blocks of
+the sampling task: plan_block_size() at 125 kS/s with packets of 362
+samples gives 2172 samples for 20 ms and 9774 for 80 ms.
+
+Usage: firbench [-t seconds] [-l label] [-j file]
+
+-t measuring time of each filter in seconds (default 0.2)
+-l label stored in the results (e.g. the release)
+-j file receiving the results, one JSON object per line (default fir_bench.json)
+
+The exit code is 1 if a filter does not match its runtime version.
+
+***************************************************************************/
+
+#include <cstdio>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "fir_static.h"
+#include "baseband.h"
+#include "dsp_kernels.h"
+#include "sim_source.h"
+#include "latency_stats.h"
+#include "bench_common.h"
+
+
+#define BENCH_RATE 125000.0
+
+
+/// Block sizes of the sampling task (20 ms and 80 ms of latency budget)
+static const size_t block_sizes[] = {2172, 9774};
+
+
+/// Common state of the measurements
+struct fir_bench_context
+{
+	fir_bench_context(bench_context & b) : bench(b) {}
+
+	bench_context & bench;
+	std::vector<sample_sc16> sc16;
+	std::vector<sample_fc32> fc32;
+};
+
+
+/// Runtime filter of the baseband chain of the sample type
+static size_t runtime_filter(baseband_q15 & chain, const sample_sc16 * in, size_t num_samps, sample_sc16 * out)
+{
+	return chain.filter(in, num_samps, out);
+}
+
+static size_t runtime_filter(baseband_fc32 & chain, const sample_fc32 * in, size_t num_samps, sample_fc32 * out)
+{
+	return chain.filter(in, num_samps, out);
+}
+
+
+/***********************************************************************//**
+Throughput of a filter over the input, cut in blocks
+
+@return Millions of input samples per second
+
+***************************************************************************/
+
+template <typename T, typename F>
+static double bench_filter(F & filter, const std::vector<T> & in, size_t block_samps, double seconds)
+{
+	std::vector<T> out(block_samps + 1);
+	uint64_t samples = 0;
+	uint64_t start = monotonic_ns();
+	uint64_t now = start;
+	while(now < start + uint64_t(seconds * 1e9))
+	{
+		for(size_t offset = 0; offset + block_samps <= in.size(); offset += block_samps)
+		{
+			filter.process(&in[offset], block_samps, &out[0]);
+			samples += block_samps;
+		}
+		now = monotonic_ns();
+	}
+	bench_sink = float(out[0].real());
+	return samples / ((now - start) * 1e-9) * 1e-6;
+}
+
+
+/// Adapter giving the runtime filters the interface of fir_static
+template <typename C>
+struct runtime_adapter
+{
+	C & chain;
+	runtime_adapter(C & c) : chain(c) {}
+	template <typename T>
+	size_t process(const T * in, size_t num_samps, T * out) {return runtime_filter(chain, in, num_samps, out);}
+};
+
+
+/***********************************************************************//**
+Checks and measures one sample type for one design
+
+***************************************************************************/
+
+template <typename T, typename CHAIN, size_t D, typename DESIGN>
+static void run_type(fir_bench_context & ctx, const char * name, const char * type, const std::vector<T> & in)
+{
+	typedef fir_static<T, D, DESIGN> static_fir;
+
+	baseband_config config;
+	config.rate = BENCH_RATE;
+	config.decimation = D;
+	for(size_t k = 0; k < DESIGN::num_taps; k++)
+		config.taps.push_back(DESIGN::tap(k));
+	CHAIN chain;
+	chain.configure(config);
+	static_fir fir;
+
+	// Same output on the whole input, in blocks of an odd size
+	std::vector<T> expected(in.size() / D + 1), actual(in.size() / D + 1);
+	size_t num_expected = runtime_filter(chain, &in[0], in.size(), &expected[0]);
+	size_t num_actual = 0;
+	for(size_t start = 0; start < in.size(); start += 1001)
+		num_actual += fir.process(&in[start], in.size() - start < 1001 ? in.size() - start : 1001, &actual[num_actual]);
+	double max_error = num_actual == num_expected ? 0 : 1;
+	for(size_t n = 0; n < num_expected && n < num_actual; n++)
+	{
+		double error = std::abs(sample_fc32(float(expected[n].real() - actual[n].real()), float(expected[n].imag() - actual[n].imag())));
+		max_error = error > max_error ? error : max_error;
+	}
+	// Q15 must be exact, float within the rounding of the sums
+	double tolerance = sample_traits<T>::full_scale() > 1 ? 0 : 1e-5;
+	bool failed = max_error > tolerance;
+	ctx.bench.errors += failed;
+
+	for(size_t b = 0; b < sizeof(block_sizes) / sizeof(block_sizes[0]); b++)
+	{
+		runtime_adapter<CHAIN> runtime(chain);
+		double runtime_msps = bench_filter(runtime, in, block_sizes[b], ctx.bench.seconds);
+		double static_msps = bench_filter(fir, in, block_sizes[b], ctx.bench.seconds);
+		printf("%-22s %-5s %6zu %10.2f %10.2f %7.1fx  %s\n", name, type, block_sizes[b], runtime_msps, static_msps,
+			static_msps / runtime_msps, failed ? "MISMATCH" : "match");
+		fprintf(ctx.bench.record("fir_static"), "\"design\":\"%s\",\"type\":\"%s\",\"block\":%zu,\"runtime_msps\":%.2f,"
+			"\"static_msps\":%.2f,\"max_error\":%g}\n", name, type, block_sizes[b], runtime_msps, static_msps, max_error);
+	}
+}
+
+
+template <size_t D, typename DESIGN>
+static void run_design(fir_bench_context & ctx, const char * name)
+{
+	run_type<sample_sc16, baseband_q15, D, DESIGN>(ctx, name, "sc16", ctx.sc16);
+	run_type<sample_fc32, baseband_fc32, D, DESIGN>(ctx, name, "fc32", ctx.fc32);
+}
+
+
+int main(int argc, char ** argv)
+{
+	bench_context bench("fir_bench.json", 0.2);
+	for(int index = 1; index < argc; index++)
+	{
+		if(bench.parse_option(argc, argv, index))
+		{
+			std::cout << "Usage: firbench [-t seconds] [-l label] [-j file]" << std::endl;
+			return 1;
+		}
+	}
+	if(bench.open())
+		return 1;
+	fir_bench_context ctx(bench);
+
+	// A tone and noise, in both formats
+	sim_config sim;
+	sim.rate = BENCH_RATE;
+	sim_tone tone = {3000, 0.3};
+	sim.tones.push_back(tone);
+	sim.noise_rms = 0.1;
+	sim_source source(sim);
+	source.start(0);
+	ctx.sc16.resize(8 * 9774);
+	source.generate(&ctx.sc16[0], ctx.sc16.size());
+	ctx.fc32.resize(ctx.sc16.size());
+	dsp_sc16_to_fc32(&ctx.sc16[0], &ctx.fc32[0], ctx.sc16.size());
+
+	// The coefficients computed by the compiler against design_lowpass()
+	typedef lowpass_design<63, 1, 25> chain_lowpass;
+	std::vector<double> reference = design_lowpass(63, 5000, BENCH_RATE);
+	double max_difference = 0;
+	for(size_t k = 0; k < reference.size(); k++)
+		max_difference = fabs(reference[k] - chain_lowpass::tap(k)) > max_difference ? fabs(reference[k] - chain_lowpass::tap(k)) : max_difference;
+	bool taps_differ = max_difference > 1e-12;
+	bench.errors += taps_differ;
+	printf("Compile-time taps against design_lowpass(): max difference %g%s\n", max_difference, taps_differ ? "  MISMATCH" : "");
+
+	printf("%-22s %-5s %6s %10s %10s %8s\n", "design", "type", "block", "runtime", "static", "speedup");
+	run_design<8, chain_lowpass>(ctx, "lowpass 63 taps / 8");
+	run_design<4, lowpass_design<31, 1, 10> >(ctx, "lowpass 31 taps / 4");
+	run_design<8, raised_cosine_design<65, 8, 35> >(ctx, "raised cos 65 taps / 8");
+	run_design<1, lowpass_design<16, 1, 5> >(ctx, "lowpass 16 taps / 1");
+
+	printf("Throughputs in MS/s of input\n");
+	return bench.finish("All the filters match");
+}
@@ -0,0 +1,333 @@
+/***********************************************************************//**
+@file
+
+FIR filters and decimators specialised at compile time
+
+The number of taps, the decimation factor and the sample type are
+template parameters, and the coefficients are computed by the compiler
+from a design (windowed sinc or raised cosine) into read-only tables.
+The inner loop has a constant trip count, so the compiler unrolls and
+vectorises it, and the taps are not loaded from a vector at run time.
+
+The filters follow the conventions of the baseband chains: output at
+inputs D-1, 2D-1, ..., sc16 samples with Q15 taps, a 64 bits accumulator
+and one rounding per output (bit exact with baseband_q15::filter()),
+fc32 samples with float taps.
+
+	fir_static<sample_sc16, 8, lowpass_design<63, 1, 25> > fir;
+
+is the filter of baseband_q15 for design_lowpass(63, 5000, 125000) and a
+decimation by 8.
+
+Only C++11 is required (-std=c++0x): the constexpr functions are single
+expressions and the tables are expanded from an index list.
+
+***************************************************************************/
+
+#ifndef FIR_STATIC_H
+#define FIR_STATIC_H
+
+#include <cstddef>
+#include <stdint.h>
+#include "sample_format.h"
+#include "fixed_point.h"
+
+
+//---------------------------------------------------------------------------
+// Trigonometry usable in constant expressions
+//---------------------------------------------------------------------------
+
+#define CT_PI 3.14159265358979323846
+
+constexpr double ct_floor(double x)
+{
+	return double(int64_t(x)) > x ? double(int64_t(x)) - 1 : double(int64_t(x));
+}
+
+/// x reduced to -pi .. pi
+constexpr double ct_reduce(double x)
+{
+	return x - 2 * CT_PI * ct_floor((x + CT_PI) / (2 * CT_PI));
+}
+
+/// Taylor series from the given term, until the terms are below the precision of double
+constexpr double ct_series(double x2, double term, int n, double sum)
+{
+	return n > 40 ? sum : ct_series(x2, -term * x2 / ((n + 1) * (n + 2)), n + 2, sum + term);
+}
+
+constexpr double ct_sin_reduced(double r)
+{
+	return ct_series(r * r, r, 1, 0);
+}
+
+constexpr double ct_cos_reduced(double r)
+{
+	return ct_series(r * r, 1, 0, 0);
+}
+
+constexpr double ct_sin(double x)
+{
+	return ct_sin_reduced(ct_reduce(x));
+}
+
+constexpr double ct_cos(double x)
+{
+	return ct_cos_reduced(ct_reduce(x));
+}
+
+
+//---------------------------------------------------------------------------
+// Designs: tap(k) is the coefficient k, normalised to a unit gain at DC
+//---------------------------------------------------------------------------
+
+/// Sum of the raw taps lo .. hi-1 of a design, split in halves to bound the recursion depth
+template <typename D>
+constexpr double ct_sum(size_t lo, size_t hi)
+{
+	return hi - lo == 1 ? D::raw_tap(lo) : ct_sum<D>(lo, lo + (hi - lo) / 2) + ct_sum<D>(lo + (hi - lo) / 2, hi);
+}
+
+/// Gain at DC of a design, computed once for all its taps
+template <typename D>
+struct design_gain
+{
+	static constexpr double value = ct_sum<D>(0, D::num_taps);
+};
+
+template <typename D>
+constexpr double design_gain<D>::value;
+
+
+/***********************************************************************//**
+Low-pass windowed sinc (Hamming window), the design of design_lowpass()
+
+@tparam N Number of taps
+@tparam CUT_NUM, CUT_DEN Cut-off frequency as a fraction of the sample rate
+
+***************************************************************************/
+template <size_t N, size_t CUT_NUM, size_t CUT_DEN>
+struct lowpass_design
+{
+	static const size_t num_taps = N;
+
+	static constexpr double sinc(double t)
+	{
+		return t == 0 ? 2.0 * CUT_NUM / CUT_DEN : ct_sin(2 * CT_PI * CUT_NUM / CUT_DEN * t) / (CT_PI * t);
+	}
+	static constexpr double window(size_t k)
+	{
+		return N > 1 ? 0.54 - 0.46 * ct_cos(2 * CT_PI * k / (N - 1)) : 1;
+	}
+	static constexpr double raw_tap(size_t k)
+	{
+		return sinc(double(k) - (N - 1) / 2.0) * window(k);
+	}
+	static constexpr double tap(size_t k)
+	{
+		return raw_tap(k) / design_gain<lowpass_design>::value;
+	}
+};
+
+
+/***********************************************************************//**
+Raised cosine pulse
+
+@tparam N Number of taps
+@tparam SPS Samples per symbol
+@tparam BETA_PERCENT Roll-off factor in percent (1 .. 100)
+
+***************************************************************************/
+template <size_t N, size_t SPS, size_t BETA_PERCENT>
+struct raised_cosine_design
+{
+	static const size_t num_taps = N;
+
+	static constexpr double sinc(double x)
+	{
+		return x == 0 ? 1 : ct_sin(CT_PI * x) / (CT_PI * x);
+	}
+	/// t in symbols. At t = +-1/(2 beta) the limit pi/4 sinc(1/(2 beta)) is used
+	static constexpr double pulse(double t, double beta)
+	{
+		return (2 * beta * t) * (2 * beta * t) > 1 - 1e-9 && (2 * beta * t) * (2 * beta * t) < 1 + 1e-9 ?
+			CT_PI / 4 * sinc(1 / (2 * beta)) :
+			sinc(t) * ct_cos(CT_PI * beta * t) / (1 - (2 * beta * t) * (2 * beta * t));
+	}
+	static constexpr double raw_tap(size_t k)
+	{
+		return pulse((double(k) - (N - 1) / 2.0) / SPS, BETA_PERCENT / 100.0);
+	}
+	static constexpr double tap(size_t k)
+	{
+		return raw_tap(k) / design_gain<raised_cosine_design>::value;
+	}
+};
+
+
+//---------------------------------------------------------------------------
+// Tables of the coefficients, in reverse order (oldest sample first)
+//---------------------------------------------------------------------------
+
+template <size_t... I>
+struct index_list {};
+
+template <size_t N, size_t... I>
+struct make_index_list : make_index_list<N - 1, N - 1, I...> {};
+
+template <size_t... I>
+struct make_index_list<0, I...>
+{
+	typedef index_list<I...> type;
+};
+
+
+/// Rounds and saturates a coefficient to Q15, like q15_from_double()
+constexpr int16_t ct_q15(double value)
+{
+	return value * Q15_ONE >= Q15_MAX ? Q15_MAX : (value * Q15_ONE <= Q15_MIN ? Q15_MIN :
+		int16_t(ct_floor(value * Q15_ONE + 0.5)));
+}
+
+
+template <typename D, typename L = typename make_index_list<D::num_taps>::type>
+struct tap_table;
+
+template <typename D, size_t... I>
+struct tap_table<D, index_list<I...> >
+{
+	static constexpr float fc32[sizeof...(I)] = {float(D::tap(D::num_taps - 1 - I))...};
+	static constexpr int16_t q15[sizeof...(I)] = {ct_q15(D::tap(D::num_taps - 1 - I))...};
+};
+
+template <typename D, size_t... I>
+constexpr float tap_table<D, index_list<I...> >::fc32[sizeof...(I)];
+
+template <typename D, size_t... I>
+constexpr int16_t tap_table<D, index_list<I...> >::q15[sizeof...(I)];
+
+
+//---------------------------------------------------------------------------
+// Dot products of the delay line with the taps, one per sample type
+//---------------------------------------------------------------------------
+
+template <typename T, size_t N>
+struct fir_static_kernel;
+
+/// Q15: exact 64 bits sums, rounded once
+template <size_t N>
+struct fir_static_kernel<sample_sc16, N>
+{
+	typedef int16_t tap_type;
+	static const int16_t * taps(const int16_t * q15, const float *) {return q15;}
+
+	static sample_sc16 dot(const sample_sc16 * window, const int16_t * taps)
+	{
+		const int16_t * w = reinterpret_cast<const int16_t *>(window);
+		int64_t acc_i = 0, acc_q = 0;
+		for(size_t k = 0; k < N; k++)
+		{
+			acc_i += int32_t(w[2 * k]) * taps[k];
+			acc_q += int32_t(w[2 * k + 1]) * taps[k];
+		}
+		return sample_sc16(q15_from_q30(acc_i), q15_from_q30(acc_q));
+	}
+};
+
+/// Float: four partial sums per component, so that the additions can be vectorised
+template <size_t N>
+struct fir_static_kernel<sample_fc32, N>
+{
+	typedef float tap_type;
+	static const float * taps(const int16_t *, const float * fc32) {return fc32;}
+
+	static sample_fc32 dot(const sample_fc32 * window, const float * taps)
+	{
+		const float * w = reinterpret_cast<const float *>(window);
+		const size_t body = N - N % 4;
+		float acc[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+		for(size_t k = 0; k < body; k += 4)
+		{
+			for(size_t lane = 0; lane < 4; lane++)
+			{
+				acc[2 * lane] += w[2 * (k + lane)] * taps[k + lane];
+				acc[2 * lane + 1] += w[2 * (k + lane) + 1] * taps[k + lane];
+			}
+		}
+		for(size_t k = body; k < N; k++)
+		{
+			acc[0] += w[2 * k] * taps[k];
+			acc[1] += w[2 * k + 1] * taps[k];
+		}
+		return sample_fc32((acc[0] + acc[2]) + (acc[4] + acc[6]), (acc[1] + acc[3]) + (acc[5] + acc[7]));
+	}
+};
+
+
+/***********************************************************************//**
+FIR filter and decimator with everything fixed at compile time
+
+@tparam T sample_sc16 or sample_fc32
+@tparam D Decimation factor
+@tparam DESIGN Design of the coefficients (lowpass_design, raised_cosine_design)
+
+The delay line is a member array written twice, so the object needs no
+allocation and the window is always contiguous.
+
+***************************************************************************/
+template <typename T, size_t D, typename DESIGN>
+class fir_static
+{
+public:
+	static const size_t num_taps = DESIGN::num_taps;
+	static const size_t decimation = D;
+	typedef T output_type;
+	typedef fir_static_kernel<T, num_taps> kernel;
+
+	fir_static() {reset();}
+
+	void reset()
+	{
+		for(size_t k = 0; k < 2 * num_taps; k++)
+			delay[k] = T(0, 0);
+		delay_pos = 0;
+		decim_phase = 0;
+	}
+
+	size_t max_output(size_t num_samps) const {return num_samps / D + 1;}
+
+	/// Coefficients in reverse order, in read-only data
+	static const typename kernel::tap_type * taps() {return kernel::taps(tap_table<DESIGN>::q15, tap_table<DESIGN>::fc32);}
+
+	/***********************************************************************//**
+	Filters and decimates one block
+
+	@return Number of output samples
+
+	***************************************************************************/
+	size_t process(const T * in, size_t num_samps, T * out)
+	{
+		const typename kernel::tap_type * coeffs = taps();
+		size_t count = 0;
+		for(size_t n = 0; n < num_samps; n++)
+		{
+			delay[delay_pos] = in[n];
+			delay[delay_pos + num_taps] = in[n];
+			if(++delay_pos == num_taps)
+				delay_pos = 0;
+			if(++decim_phase < D)
+				continue;
+			decim_phase = 0;
+			out[count++] = kernel::dot(&delay[delay_pos], coeffs);
+		}
+		return count;
+	}
+
+private:
+	T delay[2 * num_taps];		/// Delay line, written twice
+	size_t delay_pos;			/// Position of the next input in the delay line
+	size_t decim_phase;			/// Number of inputs since the last output
+};
+
+
+#endif
@@ -0,0 +1,115 @@
+/***********************************************************************//**
+@file
+
+Saturating Q15 and Q31 arithmetic
+
+A Q15 value is an int16_t holding a fraction of 32768 (-1.0 .. 1-2^-15),
+which is the natural scale of the sc16 samples. A Q31 value is an
+int32_t holding a fraction of 2^31. The operations round to nearest and
+saturate instead of wrapping, as the DSP instructions of ARMv6 and later
+(QADD, SSAT, SMLAL) do.
+
+***************************************************************************/
+
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#include <stdint.h>
+#include <cmath>
+
+typedef int16_t q15_t;
+typedef int32_t q31_t;
+
+#define Q15_ONE 32768
+#define Q15_MAX 32767
+#define Q15_MIN (-32768)
+#define Q31_MAX 2147483647
+#define Q31_MIN (-2147483647 - 1)
+
+
+/// Saturates a 32 bits value to Q15
+inline q15_t q15_sat(int32_t value)
+{
+	return q15_t(value > Q15_MAX ? Q15_MAX : (value < Q15_MIN ? Q15_MIN : value));
+}
+
+/// Saturates a 64 bits value to Q31
+inline q31_t q31_sat(int64_t value)
+{
+	return q31_t(value > Q31_MAX ? Q31_MAX : (value < Q31_MIN ? Q31_MIN : value));
+}
+
+/// Saturating addition
+inline q15_t q15_add(q15_t a, q15_t b)
+{
+	return q15_sat(int32_t(a) + b);
+}
+
+/// Saturating subtraction
+inline q15_t q15_sub(q15_t a, q15_t b)
+{
+	return q15_sat(int32_t(a) - b);
+}
+
+/// Product rounded to Q15. Only -1 * -1 saturates
+inline q15_t q15_mul(q15_t a, q15_t b)
+{
+	return q15_sat((int32_t(a) * b + (1 << 14)) >> 15);
+}
+
+/// Rounds a Q30 product or sum of products (64 bits accumulator) to Q15
+inline q15_t q15_from_q30(int64_t acc)
+{
+	int64_t value = (acc + (1 << 14)) >> 15;
+	return q15_t(value > Q15_MAX ? Q15_MAX : (value < Q15_MIN ? Q15_MIN : value));
+}
+
+/// Saturating addition
+inline q31_t q31_add(q31_t a, q31_t b)
+{
+	return q31_sat(int64_t(a) + b);
+}
+
+/// Product rounded to Q31. Only -1 * -1 saturates
+inline q31_t q31_mul(q31_t a, q31_t b)
+{
+	return q31_sat((int64_t(a) * b + (int64_t(1) << 30)) >> 31);
+}
+
+/// Converts a value in -1.0 .. 1.0 to Q15 with rounding and saturation
+inline q15_t q15_from_double(double value)
+{
+	long rounded = lrint(value * Q15_ONE);
+	return q15_t(rounded > Q15_MAX ? Q15_MAX : (rounded < Q15_MIN ? Q15_MIN : rounded));
+}
+
+/// Converts a value in -1.0 .. 1.0 to Q31 with rounding and saturation
+inline q31_t q31_from_double(double value)
+{
+	double scaled = floor(value * 2147483648.0 + 0.5);
+	return q31_t(scaled > Q31_MAX ? Q31_MAX : (scaled < Q31_MIN ? Q31_MIN : scaled));
+}
+
+/// Integer square root, rounded down
+inline uint32_t isqrt32(uint32_t value)
+{
+	uint32_t root = 0;
+	uint32_t bit = uint32_t(1) << 30;
+	while(bit > value)
+		bit >>= 2;
+	while(bit)
+	{
+		if(value >= root + bit)
+		{
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+			root >>= 1;
+		bit >>= 2;
+	}
+	return root;
+}
+
+
+#endif
@@ -0,0 +1,476 @@
+/***********************************************************************//**
+@file
+
+Runs a multi-channel receiver on the flowgraph runtime (flowgraph.h) with
+each scheduling mode and compares it with the same stages called one
+after the other in a single thread
+
+The graph is: signal source -> polyphase channelizer -> one QPSK
+demodulator and one Viterbi decoder per channel -> one sink per channel
+counting and hashing the decoded bits. The signal is a simulated burst
+in channel 1 and noise in the other channels, replayed from memory as
+fast as the graph takes it.
+
+The program checks that every mode gives the bits of the single thread
+reference in every channel, and that the CPU time charged to the blocks
+accounts for most of the CPU time of the process. It prints the load of
+each block and the throughput in input MS/s.
+
+Usage: flowbench [-n samples] [-c channels] [-l label] [-j file]
+
+-n number of input samples of each run (default 4000000)
+-c number of channels (default 8)
+-l label stored in the results (e.g. the release)
+-j file receiving the results, one JSON object per line (default flow_bench.json)
+
+The exit code is 1 if a check fails.
+
+***************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "flowgraph.h"
+#include "polyphase.h"
+#include "demodulator.h"
+#include "viterbi.h"
+#include "baseband.h"
+#include "sim_source.h"
+#include "frame_sync.h"
+#include "latency_stats.h"
+#include "bench_common.h"
+
+
+#define BENCH_CHANNEL_RATE 125000.0	/// Rate of each channel, that of the demodulator
+#define BENCH_SIGNAL_SAMPLES 1000000	/// Samples generated, then replayed in a loop
+#define BLOCK_SAMPS 4096
+#define BURST_CHANNEL 1
+#define MIN_ACCOUNTED 0.5		/// Smallest share of the process CPU time charged to the blocks
+
+
+/// Decoded bits of one channel
+struct channel_result
+{
+	channel_result() : bits(0), hash(2166136261u) {}
+	uint64_t bits;
+	uint32_t hash;				/// FNV-1a of the bits
+	void add(const uint8_t * data, size_t count)
+	{
+		for(size_t i = 0; i < count; i++)
+			hash = (hash ^ data[i]) * 16777619u;
+		bits += count;
+	}
+	bool operator!=(const channel_result & other) const {return bits != other.bits || hash != other.hash;}
+};
+
+
+/// Replays the signal from memory
+class signal_source : public flow_block
+{
+public:
+	signal_source(const std::vector<sample_sc16> & signal, uint64_t total)
+	:flow_block("source"), out(this, "out", BLOCK_SAMPS), signal(signal), total(total), position(0) {}
+
+	flow_output<sample_sc16> out;
+
+	flow_status work()
+	{
+		if(position >= total || stop_requested())
+			return FLOW_FINISHED;
+		sample_block<sample_sc16> * block = out.acquire();
+		if(block == NULL)
+			return FLOW_IDLE;
+		size_t offset = position % signal.size();
+		size_t count = signal.size() - offset < BLOCK_SAMPS ? signal.size() - offset : BLOCK_SAMPS;
+		if(count > total - position)
+			count = total - position;
+		memcpy(block->samples, &signal[offset], count * sizeof(sample_sc16));
+		block->num_samps = count;
+		block->first_sample = position;
+		block->md = uhd::rx_metadata_t();
+		block->skipped = 0;
+		position += count;
+		out.publish();
+		return FLOW_WORKED;
+	}
+
+private:
+	const std::vector<sample_sc16> & signal;
+	uint64_t total;
+	uint64_t position;
+};
+
+
+/// Channelizer with one output per channel
+class channelizer_block : public flow_block
+{
+public:
+	channelizer_block(pfb_channelizer & channelizer)
+	:flow_block("channelizer"), in(this, "in"), channelizer(channelizer), pointers(channelizer.get_channels()),
+	 acquired(channelizer.get_channels())
+	{
+		names.reserve(channelizer.get_channels());
+		for(size_t c = 0; c < channelizer.get_channels(); c++)
+		{
+			char name[24];
+			snprintf(name, sizeof(name), "ch%zu", c);
+			names.push_back(name);
+			outs.push_back(new flow_output<sample_fc32>(this, names.back().c_str(), channelizer.max_output(BLOCK_SAMPS)));
+		}
+	}
+	~channelizer_block()
+	{
+		for(size_t c = 0; c < outs.size(); c++)
+			delete outs[c];
+	}
+
+	flow_input<sample_sc16> in;
+	std::vector<flow_output<sample_fc32> *> outs;
+
+	flow_status work()
+	{
+		const sample_block<sample_sc16> * block = in.peek();
+		if(block == NULL)
+			return in.is_finished() ? FLOW_FINISHED : FLOW_IDLE;
+		for(size_t c = 0; c < outs.size(); c++)
+		{
+			acquired[c] = outs[c]->acquire();
+			if(acquired[c] == NULL)
+				return FLOW_IDLE;
+			pointers[c] = acquired[c]->samples;
+		}
+		size_t count = channelizer.process(block->samples, block->num_samps, &pointers[0]);
+		if(count)
+		{
+			for(size_t c = 0; c < outs.size(); c++)
+			{
+				acquired[c]->num_samps = count;
+				acquired[c]->md = block->md;
+				outs[c]->publish();
+			}
+		}
+		in.release();
+		return FLOW_WORKED;
+	}
+
+private:
+	pfb_channelizer & channelizer;
+	std::vector<std::string> names;
+	std::vector<sample_fc32 *> pointers;
+	std::vector<sample_block<sample_fc32> *> acquired;
+};
+
+
+/// Demodulator giving the soft bits of its channel
+class demod_block : public flow_block
+{
+public:
+	demod_block(const char * name, qpsk_demodulator & demod, size_t input_samps)
+	:flow_block(name), in(this, "in"), out(this, "soft", 2 * demod.max_output(input_samps)), demod(demod),
+	 symbols(demod.max_output(input_samps)) {}
+
+	flow_input<sample_fc32> in;
+	flow_output<int8_t> out;
+
+	flow_status work()
+	{
+		const sample_block<sample_fc32> * block = in.peek();
+		if(block == NULL)
+			return in.is_finished() ? FLOW_FINISHED : FLOW_IDLE;
+		sample_block<int8_t> * soft = out.acquire();
+		if(soft == NULL)
+			return FLOW_IDLE;
+		size_t count = demod.process(block->samples, block->num_samps, &symbols[0], soft->samples);
+		if(count)
+		{
+			soft->num_samps = 2 * count;
+			soft->md = block->md;
+			out.publish();
+		}
+		in.release();
+		return FLOW_WORKED;
+	}
+
+private:
+	qpsk_demodulator & demod;
+	std::vector<sample_fc32> symbols;
+};
+
+
+/// Counts and hashes the decoded bits
+class bits_sink : public flow_block
+{
+public:
+	bits_sink(const char * name, channel_result & result) : flow_block(name), in(this, "in"), result(result) {}
+
+	flow_input<uint8_t> in;
+
+	flow_status work()
+	{
+		const sample_block<uint8_t> * block = in.peek();
+		if(block == NULL)
+			return in.is_finished() ? FLOW_FINISHED : FLOW_IDLE;
+		result.add(block->samples, block->num_samps);
+		in.release();
+		return FLOW_WORKED;
+	}
+
+private:
+	channel_result & result;
+};
+
+
+/***********************************************************************//**
+Stages of the receiver, configured identically for every run
+
+***************************************************************************/
+
+struct modem_stages
+{
+	modem_stages(size_t num_channels) : demods(num_channels), decoders(num_channels)
+	{
+		double rate = BENCH_CHANNEL_RATE * num_channels;
+		channelizer.configure(rate, num_channels, design_lowpass(8 * num_channels, 0.5 * rate / num_channels, rate));
+		demod_config config;
+		config.rate = BENCH_CHANNEL_RATE;
+		config.symbol_rate = 12500;
+		viterbi_config fec;
+		for(size_t c = 0; c < num_channels; c++)
+		{
+			demods[c] = new qpsk_demodulator;
+			demods[c]->configure(config);
+			decoders[c].configure(fec);
+		}
+	}
+	~modem_stages()
+	{
+		for(size_t c = 0; c < demods.size(); c++)
+			delete demods[c];
+	}
+
+	pfb_channelizer channelizer;
+	std::vector<qpsk_demodulator *> demods;
+	std::vector<viterbi_decoder> decoders;
+};
+
+
+/***********************************************************************//**
+Reference: the stages one after the other on each block
+
+***************************************************************************/
+
+static double run_inline(const std::vector<sample_sc16> & signal, uint64_t total, size_t num_channels,
+	std::vector<channel_result> & results)
+{
+	modem_stages stages(num_channels);
+	results.assign(num_channels, channel_result());
+	size_t chan_samps = stages.channelizer.max_output(BLOCK_SAMPS);
+	std::vector<std::vector<sample_fc32> > channels(num_channels, std::vector<sample_fc32>(chan_samps));
+	std::vector<sample_fc32 *> pointers(num_channels);
+	for(size_t c = 0; c < num_channels; c++)
+		pointers[c] = &channels[c][0];
+	std::vector<sample_fc32> symbols(stages.demods[0]->max_output(chan_samps));
+	std::vector<int8_t> soft(2 * symbols.size());
+	std::vector<uint8_t> bits(stages.decoders[0].max_output(soft.size()) + stages.decoders[0].max_flush());
+
+	uint64_t start = monotonic_ns();
+	for(uint64_t position = 0; position < total; )
+	{
+		size_t offset = position % signal.size();
+		size_t count = signal.size() - offset < BLOCK_SAMPS ? signal.size() - offset : BLOCK_SAMPS;
+		if(count > total - position)
+			count = total - position;
+		size_t outputs = stages.channelizer.process(&signal[offset], count, &pointers[0]);
+		for(size_t c = 0; outputs && c < num_channels; c++)
+		{
+			size_t num_symbols = stages.demods[c]->process(pointers[c], outputs, &symbols[0], &soft[0]);
+			if(num_symbols)
+				results[c].add(&bits[0], stages.decoders[c].process(&soft[0], 2 * num_symbols, &bits[0]));
+		}
+		position += count;
+	}
+	return total / ((monotonic_ns() - start) * 1e-9) * 1e-6;
+}
+
+
+/***********************************************************************//**
+Runs the receiver as a flowgraph
+
+@return Input MS/s
+
+***************************************************************************/
+
+static double run_graph(const std::vector<sample_sc16> & signal, uint64_t total, size_t num_channels, const flow_config & config,
+	std::vector<channel_result> & results, double & accounted)
+{
+	modem_stages stages(num_channels);
+	results.assign(num_channels, channel_result());
+	size_t chan_samps = stages.channelizer.max_output(BLOCK_SAMPS);
+
+	flowgraph graph;
+	signal_source source(signal, total);
+	channelizer_block channelizer(stages.channelizer);
+	graph.add(source);
+	graph.add(channelizer);
+	graph.connect(source.out, channelizer.in);
+
+	std::vector<std::string> names;
+	names.reserve(3 * num_channels);
+	std::vector<demod_block *> demods;
+	std::vector<flow_stage<viterbi_decoder, int8_t> *> decoders;
+	std::vector<bits_sink *> sinks;
+	for(size_t c = 0; c < num_channels; c++)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "demod%zu", c);
+		names.push_back(name);
+		demods.push_back(new demod_block(names.back().c_str(), *stages.demods[c], chan_samps));
+		snprintf(name, sizeof(name), "viterbi%zu", c);
+		names.push_back(name);
+		decoders.push_back(new flow_stage<viterbi_decoder, int8_t>(names.back().c_str(), stages.decoders[c], 2 * stages.demods[c]->max_output(chan_samps)));
+		snprintf(name, sizeof(name), "sink%zu", c);
+		names.push_back(name);
+		sinks.push_back(new bits_sink(names.back().c_str(), results[c]));
+		graph.add(*demods[c]);
+		graph.add(*decoders[c]);
+		graph.add(*sinks[c]);
+		graph.connect(*channelizer.outs[c], demods[c]->in);
+		graph.connect(demods[c]->out, decoders[c]->input);
+		graph.connect(decoders[c]->output, sinks[c]->in);
+	}
+
+	struct timespec cpu_start, cpu_end;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+	double msps = 0;
+	if(!graph.start(config))
+	{
+		graph.wait();
+		msps = total / (graph.get_elapsed_ns() * 1e-9) * 1e-6;
+	}
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+	double process_ns = (cpu_end.tv_sec - cpu_start.tv_sec) * 1e9 + (cpu_end.tv_nsec - cpu_start.tv_nsec);
+	uint64_t blocks_ns = 0;
+	for(size_t b = 0; b < graph.get_num_blocks(); b++)
+		blocks_ns += graph.get_block(b).get_cpu_ns();
+	accounted = process_ns > 0 ? blocks_ns / process_ns : 0;
+	graph.print_stats();
+
+	for(size_t c = 0; c < num_channels; c++)
+	{
+		delete demods[c];
+		delete decoders[c];
+		delete sinks[c];
+	}
+	return msps;
+}
+
+
+int main(int argc, char ** argv)
+{
+	uint64_t total = 4000000;
+	size_t num_channels = 8;
+	bench_context bench("flow_bench.json");
+	for(int index = 1; index < argc; index++)
+	{
+		if(strcmp(argv[index], "-n") == 0 && index + 1 < argc)
+			total = strtoull(argv[++index], NULL, 10);
+		else if(strcmp(argv[index], "-c") == 0 && index + 1 < argc)
+			num_channels = atoi(argv[++index]);
+		else if(bench.parse_option(argc, argv, index))
+		{
+			std::cout << "Usage: flowbench [-n samples] [-c channels] [-l label] [-j file]" << std::endl;
+			return 1;
+		}
+	}
+	if(num_channels < 2 || BURST_CHANNEL >= num_channels)
+	{
+		std::cout << "At least 2 channels" << std::endl;
+		return 1;
+	}
+	if(bench.open())
+		return 1;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	// Burst at the centre of one channel, noise everywhere
+	sim_config sim;
+	sim.rate = BENCH_CHANNEL_RATE * num_channels;
+	sim.noise_rms = 0.05;
+	sim.burst_amplitude = 0.5;
+	sim.burst_freq = BURST_CHANNEL * BENCH_CHANNEL_RATE;
+	sim.symbol_rate = 12500;
+	sim.burst_symbols = 256;
+	sim.burst_period = 0.1;
+	sim.preamble = frame_sync_default_preamble();
+	sim_source generator(sim);
+	generator.start(0);
+	std::vector<sample_sc16> signal(BENCH_SIGNAL_SAMPLES);
+	generator.generate(&signal[0], signal.size());
+	printf("%zu channels of %.0f samples/s, %llu input samples, %ld CPUs\n", num_channels, BENCH_CHANNEL_RATE,
+		(unsigned long long)total, cpus);
+
+	std::vector<channel_result> reference;
+	double inline_msps = run_inline(signal, total, num_channels, reference);
+	printf("Single thread: %.2f MS/s, %llu bits in channel %d\n\n", inline_msps, (unsigned long long)reference[BURST_CHANNEL].bits,
+		BURST_CHANNEL);
+	fprintf(bench.record("flow"), "\"cpus\":%ld,\"channels\":%zu,\"mode\":\"inline\",\"workers\":0,\"msps\":%.3f,\"errors\":0}\n",
+		cpus, num_channels, inline_msps);
+
+	// Thread per block, then pools of 1, 2, 4 workers and one per CPU
+	std::vector<flow_config> configs(1);
+	const size_t pools[] = {1, 2, 4, size_t(cpus > 0 ? cpus : 1)};
+	for(size_t p = 0; p < sizeof(pools) / sizeof(pools[0]); p++)
+	{
+		if(p == 3 && (pools[3] == 1 || pools[3] == 2 || pools[3] == 4))
+			break;
+		flow_config config;
+		config.mode = FLOW_POOL;
+		config.num_workers = pools[p];
+		configs.push_back(config);
+	}
+
+	std::vector<std::string> lines;
+	for(size_t r = 0; r < configs.size(); r++)
+	{
+		const flow_config & config = configs[r];
+		char mode[32];
+		if(config.mode == FLOW_POOL)
+			snprintf(mode, sizeof(mode), "pool of %zu", config.num_workers);
+		else
+			snprintf(mode, sizeof(mode), "thread per block");
+		printf("--- %s\n", mode);
+		std::vector<channel_result> results;
+		double accounted;
+		double msps = run_graph(signal, total, num_channels, config, results, accounted);
+		int run_errors = 0;
+		for(size_t c = 0; c < num_channels; c++)
+			if(results[c] != reference[c])
+			{
+				run_errors++;
+				printf("  channel %zu: %llu bits, hash %08x instead of %llu bits, hash %08x\n", c, (unsigned long long)results[c].bits,
+					results[c].hash, (unsigned long long)reference[c].bits, reference[c].hash);
+			}
+		if(accounted < MIN_ACCOUNTED || accounted > 1.02)
+		{
+			run_errors++;
+			printf("  %.0f %% of the CPU time of the process charged to the blocks\n", 100 * accounted);
+		}
+		bench.errors += run_errors;
+		char line[160];
+		snprintf(line, sizeof(line), "%-17s %8.2f MS/s %6.2fx %5.0f%% accounted %8s", mode, msps, msps / inline_msps, 100 * accounted,
+			run_errors ? "FAILED" : "ok");
+		lines.push_back(line);
+		fprintf(bench.record("flow"), "\"cpus\":%ld,\"channels\":%zu,\"mode\":\"%s\",\"workers\":%zu,\"msps\":%.3f,\"accounted\":%.3f,"
+			"\"errors\":%d}\n", cpus, num_channels,
+			config.mode == FLOW_POOL ? "pool" : "thread", config.mode == FLOW_POOL ? config.num_workers : 0, msps, accounted, run_errors);
+		printf("\n");
+	}
+
+	printf("%-17s %8.2f MS/s\n", "single thread", inline_msps);
+	for(size_t l = 0; l < lines.size(); l++)
+		printf("%s\n", lines[l].c_str());
+	return bench.finish("Every mode gives the bits of the single thread");
+}
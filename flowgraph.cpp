@@ -0,0 +1,624 @@
+#include "flowgraph.h"
+#include <cstdio>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// Scheduling state of a block in FLOW_POOL mode. A block is in at most one
+// queue: notify() only queues it when it was idle. Every notification is a
+// read-modify-write of the state, so the worker which then runs the block
+// sees the blocks published before the notification.
+#define FLOW_STATE_IDLE 0u
+#define FLOW_STATE_NOTIFIED 1u		/// Queued, or notified while running
+#define FLOW_STATE_RUNNING 2u
+#define FLOW_STATE_DONE 4u
+
+// Values of flowgraph::launch
+#define FLOW_LAUNCH_WAIT 0
+#define FLOW_LAUNCH_RUN 1
+#define FLOW_LAUNCH_ABORT 2
+
+// Sleep of a thread whose outputs are full (thread per block mode)
+#define FLOW_FULL_WAIT_US 100
+
+
+/// Worker of FLOW_POOL: its queue of runnable blocks
+struct flow_worker
+{
+	flowgraph * graph;
+	size_t index;
+	pthread_mutex_t lock;		/// Protects the queue, taken by the owner and by the thieves
+	std::vector<flow_block *> queue;	/// Circular, one slot per block of the graph
+	size_t first;				/// Oldest queued block
+	uint64_t next_poll;			/// monotonic_ns() of the next poll of the blocks
+	std::atomic<size_t> count;	/// Number of queued blocks, read without the lock
+};
+
+
+/***********************************************************************//**
+Constructor: registers the port in its block
+
+***************************************************************************/
+
+flow_port::flow_port(flow_block * block, const char * port_name, bool is_input)
+:owner(block), name(port_name), input(is_input), peer(NULL)
+{
+	if(input)
+		owner->inputs.push_back(this);
+	else
+		owner->outputs.push_back(this);
+}
+
+
+flow_block::flow_block(const char * block_name)
+:name(block_name), graph(NULL), has_rt_config(false), state(FLOW_STATE_IDLE), cpu_ns(0), calls(0), idle_calls(0)
+{
+}
+
+
+bool flow_block::stop_requested() const
+{
+	return graph && graph->is_stopping();
+}
+
+
+bool flow_block::inputs_finished() const
+{
+	for(size_t index = 0; index < inputs.size(); index++)
+		if(!inputs[index]->is_finished())
+			return false;
+	return true;
+}
+
+
+flowgraph::flowgraph()
+:running(false), launch(FLOW_LAUNCH_WAIT), num_finished(0), stopping(false), start_time(0), end_time(0), num_sleeping(0)
+{
+	pthread_mutex_init(&idle_mutex, NULL);
+	pthread_cond_init(&idle_cond, NULL);
+}
+
+
+flowgraph::~flowgraph()
+{
+	if(running)
+	{
+		stop();
+		wait();
+	}
+	pthread_cond_destroy(&idle_cond);
+	pthread_mutex_destroy(&idle_mutex);
+}
+
+
+/***********************************************************************//**
+Adds a block to the graph. The block must live until the graph is
+destroyed.
+
+***************************************************************************/
+
+void flowgraph::add(flow_block & block)
+{
+	block.graph = this;
+	blocks.push_back(&block);
+}
+
+
+/***********************************************************************//**
+Creates the threads and runs the blocks
+
+Every port of every block must be connected. The threads are all created
+before the first work() call: if one cannot be created, none runs.
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool flowgraph::start(const flow_config & settings)
+{
+	if(running || blocks.empty())
+	{
+		std::cout << "Flowgraph: " << (running ? "already running" : "no block") << std::endl;
+		return true;
+	}
+	for(size_t b = 0; b < blocks.size(); b++)
+	{
+		flow_block & block = *blocks[b];
+		for(size_t p = 0; p < block.inputs.size() + block.outputs.size(); p++)
+		{
+			flow_port & port = p < block.inputs.size() ? *block.inputs[p] : *block.outputs[p - block.inputs.size()];
+			if(!port.is_connected())
+			{
+				std::cout << "Flowgraph: " << block.name << "." << port.name << " is not connected" << std::endl;
+				return true;
+			}
+			if(port.peer && port.peer->owner->graph != this)
+			{
+				std::cout << "Flowgraph: " << block.name << "." << port.name << " is connected to a block out of the graph" << std::endl;
+				return true;
+			}
+		}
+	}
+
+	config = settings;
+	if(config.batch == 0)
+		config.batch = 1;
+	if(config.idle_wait_ms <= 0)
+		config.idle_wait_ms = 1;
+	if(config.mode == FLOW_POOL && config.num_workers == 0)
+	{
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		config.num_workers = cpus > 0 ? size_t(cpus) : 1;
+	}
+	num_finished.store(0);
+	stopping.store(false);
+	end_time.store(0);
+	launch = FLOW_LAUNCH_WAIT;
+	start_time = monotonic_ns();
+
+	bool error = false;
+	if(config.mode == FLOW_POOL)
+	{
+		// Every block starts runnable, spread over the queues
+		for(size_t w = 0; w < config.num_workers; w++)
+		{
+			flow_worker * worker = new flow_worker;
+			worker->graph = this;
+			worker->index = w;
+			pthread_mutex_init(&worker->lock, NULL);
+			worker->queue.assign(blocks.size(), NULL);
+			worker->first = 0;
+			worker->next_poll = 0;
+			worker->count.store(0);
+			workers.push_back(worker);
+		}
+		for(size_t b = 0; b < blocks.size(); b++)
+		{
+			flow_worker & worker = *workers[b % workers.size()];
+			blocks[b]->state.store(FLOW_STATE_NOTIFIED);
+			worker.queue[worker.count.load()] = blocks[b];
+			worker.count.fetch_add(1);
+		}
+		for(size_t w = 0; w < workers.size() && !error; w++)
+		{
+			thread_rt_config rt = config.rt;
+			if(rt.cpu >= 0)
+				rt.cpu += int(w);
+			pthread_t thread;
+			error = create_rt_thread(&thread, rt, &flowgraph::worker_helper, workers[w], "flow_worker");
+			if(!error)
+				threads.push_back(thread);
+		}
+	}
+	else
+	{
+		for(size_t b = 0; b < blocks.size() && !error; b++)
+		{
+			flow_block & block = *blocks[b];
+			pthread_t thread;
+			error = create_rt_thread(&thread, block.has_rt_config ? block.rt_config : config.rt, &flowgraph::block_helper, &block,
+				block.name);
+			if(!error)
+				threads.push_back(thread);
+		}
+	}
+
+	pthread_mutex_lock(&idle_mutex);
+	launch = error ? FLOW_LAUNCH_ABORT : FLOW_LAUNCH_RUN;
+	pthread_cond_broadcast(&idle_cond);
+	pthread_mutex_unlock(&idle_mutex);
+	running = true;
+	if(error)
+	{
+		wait();
+		return true;
+	}
+	return false;
+}
+
+
+/***********************************************************************//**
+Asks the sources to finish. The blocks already produced still go through
+the graph: wait() returns once they have been processed.
+
+***************************************************************************/
+
+void flowgraph::stop()
+{
+	stopping.store(true);
+	if(config.mode == FLOW_POOL && !workers.empty())
+	{
+		// Run every block once so that the sources see the request
+		for(size_t b = 0; b < blocks.size(); b++)
+			notify(*blocks[b], *workers[0]);
+		pthread_mutex_lock(&idle_mutex);
+		pthread_cond_broadcast(&idle_cond);
+		pthread_mutex_unlock(&idle_mutex);
+	}
+}
+
+
+/***********************************************************************//**
+Waits for the end of every block and of the threads
+
+***************************************************************************/
+
+void flowgraph::wait()
+{
+	if(!running)
+		return;
+	for(size_t t = 0; t < threads.size(); t++)
+		pthread_join(threads[t], NULL);
+	threads.clear();
+	for(size_t w = 0; w < workers.size(); w++)
+	{
+		pthread_mutex_destroy(&workers[w]->lock);
+		delete workers[w];
+	}
+	workers.clear();
+	if(end_time.load() == 0)
+		end_time.store(monotonic_ns());
+	running = false;
+}
+
+
+uint64_t flowgraph::get_elapsed_ns() const
+{
+	uint64_t end = end_time.load();
+	return (end ? end : monotonic_ns()) - start_time;
+}
+
+
+void * flowgraph::block_helper(void * arg)
+{
+	flow_block * block = static_cast<flow_block *>(arg);
+	block->graph->run_block(*block);
+	return NULL;
+}
+
+
+void * flowgraph::worker_helper(void * arg)
+{
+	flow_worker * worker = static_cast<flow_worker *>(arg);
+	worker->graph->run_worker(*worker);
+	return NULL;
+}
+
+
+/***********************************************************************//**
+Holds a new thread until every thread has been created
+
+@return true to run, false if start() failed
+
+***************************************************************************/
+
+bool flowgraph::wait_launch()
+{
+	pthread_mutex_lock(&idle_mutex);
+	while(launch == FLOW_LAUNCH_WAIT)
+		pthread_cond_wait(&idle_cond, &idle_mutex);
+	bool run = launch == FLOW_LAUNCH_RUN;
+	pthread_mutex_unlock(&idle_mutex);
+	return run;
+}
+
+
+/***********************************************************************//**
+Calls work() and charges its CPU time to the block
+
+***************************************************************************/
+
+flow_status flowgraph::call_work(flow_block & block)
+{
+	uint64_t cpu_start = thread_cpu_ns();
+	flow_status status = block.work();
+	uint64_t cost = thread_cpu_ns() - cpu_start;
+	block.calls++;
+	block.cpu_ns += cost;
+	if(status == FLOW_IDLE)
+		block.idle_calls++;
+	else if(status == FLOW_WORKED)
+		block.work_cost.record(cost);
+	return status;
+}
+
+
+/***********************************************************************//**
+Ends a block: closes its outputs so that the blocks downstream finish in
+turn
+
+@param worker Worker running the block in FLOW_POOL mode, NULL otherwise
+
+***************************************************************************/
+
+void flowgraph::finish(flow_block & block, flow_worker * worker)
+{
+	for(size_t o = 0; o < block.outputs.size(); o++)
+		block.outputs[o]->close();
+	block.state.exchange(FLOW_STATE_DONE);
+	if(worker)
+		for(size_t o = 0; o < block.outputs.size(); o++)
+			if(block.outputs[o]->peer)
+				notify(*block.outputs[o]->peer->owner, *worker);
+	if(num_finished.fetch_add(1) + 1 == blocks.size())
+	{
+		end_time.store(monotonic_ns());
+		pthread_mutex_lock(&idle_mutex);
+		pthread_cond_broadcast(&idle_cond);
+		pthread_mutex_unlock(&idle_mutex);
+	}
+}
+
+
+/***********************************************************************//**
+Thread of a block in FLOW_THREAD_PER_BLOCK mode
+
+An idle block sleeps on its first empty input until a block is published
+on it. When its inputs are not empty, an output is full: it polls every
+FLOW_FULL_WAIT_US until the consumer has released a slot.
+
+***************************************************************************/
+
+void flowgraph::run_block(flow_block & block)
+{
+	const thread_rt_config & rt = block.has_rt_config ? block.rt_config : config.rt;
+	prefault_stack(rt.prefault_stack);
+	if(!wait_launch())
+		return;
+
+	while(true)
+	{
+		flow_status status = call_work(block);
+		if(status == FLOW_FINISHED)
+			break;
+		if(status == FLOW_WORKED)
+			continue;
+		flow_port * empty = NULL;
+		for(size_t i = 0; i < block.inputs.size() && empty == NULL; i++)
+			if(block.inputs[i]->is_blocked() && !block.inputs[i]->is_finished())
+				empty = block.inputs[i];
+		if(empty)
+			empty->wait(config.idle_wait_ms);
+		else
+			usleep(FLOW_FULL_WAIT_US);
+	}
+	finish(block, NULL);
+}
+
+
+/***********************************************************************//**
+Worker thread of FLOW_POOL mode
+
+The worker takes the last block of its own queue, or the oldest block of
+another queue, and calls its work() up to batch times while it does
+something. The block goes back to the queue if it can do more, and its
+neighbours are made runnable when it consumed or produced blocks. The
+blocks are also polled every idle_wait_ms for the rings fed from outside
+the graph, whose producer does not notify the scheduler.
+
+***************************************************************************/
+
+void flowgraph::run_worker(flow_worker & worker)
+{
+	thread_rt_config rt = config.rt;
+	prefault_stack(rt.prefault_stack);
+	if(!wait_launch())
+		return;
+
+	worker.next_poll = monotonic_ns() + uint64_t(config.idle_wait_ms) * 1000000ULL;
+	while(!is_finished())
+	{
+		uint64_t now = monotonic_ns();
+		if(now >= worker.next_poll)
+		{
+			worker.next_poll = now + uint64_t(config.idle_wait_ms) * 1000000ULL;
+			poll(worker);
+		}
+
+		flow_block * block = pop(worker);
+		if(block == NULL)
+		{
+			if(sleep())
+				poll(worker);
+			continue;
+		}
+
+		block->state.exchange(FLOW_STATE_RUNNING);
+		flow_status status;
+		bool worked = false;
+		size_t count = 0;
+		do
+		{
+			status = call_work(*block);
+			worked |= status == FLOW_WORKED;
+		}
+		while(status == FLOW_WORKED && ++count < config.batch);
+
+		if(status == FLOW_FINISHED)
+		{
+			if(worked)
+				notify_neighbours(*block, worker);
+			finish(*block, &worker);
+			continue;
+		}
+		if(status == FLOW_WORKED)
+		{
+			block->state.exchange(FLOW_STATE_NOTIFIED);
+			push(worker, *block);
+		}
+		else
+		{
+			// Idle, unless it was notified while running
+			unsigned expected = FLOW_STATE_RUNNING;
+			if(!block->state.compare_exchange_strong(expected, FLOW_STATE_IDLE))
+			{
+				block->state.exchange(FLOW_STATE_NOTIFIED);
+				push(worker, *block);
+			}
+		}
+		// Pushed last, the neighbours run next on this worker
+		if(worked)
+			notify_neighbours(*block, worker);
+	}
+}
+
+
+/***********************************************************************//**
+Makes a block runnable, on the queue of the given worker if it was idle
+
+***************************************************************************/
+
+void flowgraph::notify(flow_block & block, flow_worker & worker)
+{
+	if(block.state.fetch_or(FLOW_STATE_NOTIFIED) == FLOW_STATE_IDLE)
+		push(worker, block);
+}
+
+
+/// Notifies the consumers of the outputs and the producers of the inputs of a block
+void flowgraph::notify_neighbours(flow_block & block, flow_worker & worker)
+{
+	for(size_t o = 0; o < block.outputs.size(); o++)
+		if(block.outputs[o]->peer)
+			notify(*block.outputs[o]->peer->owner, worker);
+	for(size_t i = 0; i < block.inputs.size(); i++)
+		if(block.inputs[i]->peer)
+			notify(*block.inputs[i]->peer->owner, worker);
+}
+
+
+/// Notifies every block which has not finished
+void flowgraph::poll(flow_worker & worker)
+{
+	for(size_t b = 0; b < blocks.size(); b++)
+		notify(*blocks[b], worker);
+}
+
+
+void flowgraph::push(flow_worker & worker, flow_block & block)
+{
+	pthread_mutex_lock(&worker.lock);
+	worker.queue[(worker.first + worker.count.load()) % worker.queue.size()] = &block;
+	worker.count.fetch_add(1);
+	pthread_mutex_unlock(&worker.lock);
+
+	// Pairs with the increment of num_sleeping in sleep(): either the
+	// sleeper sees the block or the block is seen sleeping
+	if(num_sleeping.load())
+	{
+		pthread_mutex_lock(&idle_mutex);
+		pthread_cond_signal(&idle_cond);
+		pthread_mutex_unlock(&idle_mutex);
+	}
+}
+
+
+/***********************************************************************//**
+Takes the newest block of the queue of the worker, or else the oldest
+block of another queue
+
+@return The block or NULL if every queue is empty
+
+***************************************************************************/
+
+flow_block * flowgraph::pop(flow_worker & worker)
+{
+	flow_block * block = NULL;
+	if(worker.count.load())
+	{
+		pthread_mutex_lock(&worker.lock);
+		size_t count = worker.count.load();
+		if(count)
+		{
+			block = worker.queue[(worker.first + count - 1) % worker.queue.size()];
+			worker.count.fetch_sub(1);
+		}
+		pthread_mutex_unlock(&worker.lock);
+		if(block)
+			return block;
+	}
+	for(size_t w = 1; w < workers.size(); w++)
+	{
+		flow_worker & victim = *workers[(worker.index + w) % workers.size()];
+		if(victim.count.load() == 0)
+			continue;
+		pthread_mutex_lock(&victim.lock);
+		if(victim.count.load())
+		{
+			block = victim.queue[victim.first];
+			victim.first = (victim.first + 1) % victim.queue.size();
+			victim.count.fetch_sub(1);
+		}
+		pthread_mutex_unlock(&victim.lock);
+		if(block)
+			return block;
+	}
+	return NULL;
+}
+
+
+/***********************************************************************//**
+Sleeps until a block is pushed, the graph has finished or idle_wait_ms
+
+@return true if the sleep timed out
+
+***************************************************************************/
+
+bool flowgraph::sleep()
+{
+	bool timed_out = false;
+	pthread_mutex_lock(&idle_mutex);
+	num_sleeping.fetch_add(1);
+	bool pending = is_finished();
+	for(size_t w = 0; w < workers.size() && !pending; w++)
+		pending = workers[w]->count.load() != 0;
+	if(!pending)
+	{
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += long(config.idle_wait_ms) * 1000000L;
+		deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+		deadline.tv_nsec %= 1000000000L;
+		timed_out = pthread_cond_timedwait(&idle_cond, &idle_mutex, &deadline) == ETIMEDOUT;
+	}
+	num_sleeping.fetch_sub(1);
+	pthread_mutex_unlock(&idle_mutex);
+	return timed_out;
+}
+
+
+/***********************************************************************//**
+Displays the load of each block: work() calls, share of idle calls, CPU
+time, CPU time relative to the run time of the graph (1 core = 100 %),
+percentiles of the CPU time of the calls which did something, and the
+blocks published on each output
+
+***************************************************************************/
+
+void flowgraph::print_stats(std::ostream & os) const
+{
+	double elapsed = get_elapsed_ns() * 1e-9;
+	char line[256];
+	snprintf(line, sizeof(line), "%-16s %9s %6s %9s %6s %9s %9s %9s", "block", "calls", "idle", "CPU ms", "load",
+		"p50 us", "p99 us", "max us");
+	os << line << std::endl;
+	uint64_t total = 0;
+	for(size_t b = 0; b < blocks.size(); b++)
+	{
+		const flow_block & block = *blocks[b];
+		const latency_histogram & cost = block.get_work_cost();
+		total += block.get_cpu_ns();
+		snprintf(line, sizeof(line), "%-16s %9llu %5.1f%% %9.1f %5.1f%% %9.1f %9.1f %9.1f", block.get_name(),
+			(unsigned long long)block.get_calls(), block.get_calls() ? 100.0 * block.get_idle_calls() / block.get_calls() : 0.0,
+			block.get_cpu_ns() * 1e-6, elapsed > 0 ? block.get_cpu_ns() * 1e-7 / elapsed : 0.0,
+			cost.percentile(50) * 1e-3, cost.percentile(99) * 1e-3, cost.get_max() * 1e-3);
+		os << line;
+		for(size_t o = 0; o < block.get_num_outputs(); o++)
+			os << (o ? ", " : "  -> ") << block.get_output(o).get_name() << " " << block.get_output(o).get_published();
+		os << std::endl;
+	}
+	snprintf(line, sizeof(line), "%zu blocks in %.3f s, %.1f ms of CPU in work() (%.2f cores)", blocks.size(), elapsed, total * 1e-6,
+		elapsed > 0 ? total * 1e-9 / elapsed : 0.0);
+	os << line << std::endl;
+}
@@ -0,0 +1,442 @@
+/***********************************************************************//**
+@file
+
+Dataflow runtime: blocks with typed ports connected by lock-free rings,
+run by a scheduler across the cores
+
+A block derives from flow_block, declares its ports as members
+(flow_input<T>, flow_output<T>) and implements work(): read what is
+available on the inputs, fill what is free on the outputs, and tell the
+scheduler whether something was done. Each connection is a sample_ring
+of blocks of T (single producer, single consumer), so the ports of two
+blocks only connect when they carry the same type, and a full ring holds
+its producer back instead of dropping blocks.
+
+The scheduler runs the blocks in one of two modes:
+
+- FLOW_THREAD_PER_BLOCK: each block has its own thread (rt_thread.h
+  settings), which sleeps on its input ring when it has nothing to do
+- FLOW_POOL: a fixed number of worker threads, each with its own queue
+  of runnable blocks. A block which produced something makes its
+  neighbours runnable on the same worker (the data is still in its
+  cache); an idle worker steals the oldest runnable block of another
+  worker
+
+The CPU time of every work() call (CLOCK_THREAD_CPUTIME_ID) is added to
+the block it ran, whatever the thread, so the load of each stage is known
+in both modes.
+
+A block ends when work() returns FLOW_FINISHED: a source when it has no
+more samples or when stop_requested() is true, the other blocks once
+their inputs are finished (closed and empty). Its output rings are then
+closed, so the end of the stream flows down the graph and every block
+sent before the end is processed.
+
+***************************************************************************/
+
+#ifndef FLOWGRAPH_H
+#define FLOWGRAPH_H
+
+#include <vector>
+#include <atomic>
+#include <ostream>
+#include <iostream>
+#include <cstddef>
+#include <stdint.h>
+#include <pthread.h>
+#include "sample_ring.h"
+#include "rt_thread.h"
+#include "latency_stats.h"
+
+
+/// Default number of blocks in the ring of a connection
+#define FLOW_RING_SLOTS 4
+
+
+/// Result of flow_block::work()
+enum flow_status
+{
+	FLOW_WORKED,		/// Something was consumed or produced: work() is called again
+	FLOW_IDLE,			/// Nothing to read or no room to write
+	FLOW_FINISHED		/// The block will not produce anything more
+};
+
+
+/// Scheduling mode of a flowgraph
+enum flow_mode
+{
+	FLOW_THREAD_PER_BLOCK,	/// One thread per block
+	FLOW_POOL				/// Worker threads sharing the blocks by work stealing
+};
+
+
+/// Settings of the scheduler
+struct flow_config
+{
+	flow_config() : mode(FLOW_THREAD_PER_BLOCK), num_workers(0), batch(16), idle_wait_ms(1) {}
+
+	flow_mode mode;
+	size_t num_workers;			/// Worker threads of FLOW_POOL. 0 for one per online CPU
+	size_t batch;				/// Consecutive work() calls of a block before the worker takes the next one (FLOW_POOL)
+	int idle_wait_ms;			/// Longest sleep of an idle thread before the blocks are polled again
+	thread_rt_config rt;		/// Settings of the threads. In FLOW_POOL a CPU >= 0 pins worker i to CPU cpu + i
+};
+
+
+class flow_block;
+class flowgraph;
+
+
+/***********************************************************************//**
+Untyped part of a port, seen by the scheduler
+
+***************************************************************************/
+class flow_port
+{
+public:
+	flow_port(flow_block * owner, const char * name, bool input);
+	virtual ~flow_port() {}
+
+	const char * get_name() const {return name;}
+	flow_block * get_owner() const {return owner;}
+	bool is_input() const {return input;}
+	/// Port at the other end of the connection. NULL if not connected or fed by a ring outside the graph
+	flow_port * get_peer() const {return peer;}
+	virtual bool is_connected() const = 0;
+	/// Input: no block to read. Output: no free slot
+	virtual bool is_blocked() const = 0;
+	/// Input: the producer has finished and every block has been read. Output: always false
+	virtual bool is_finished() const = 0;
+	/// Number of blocks published on the ring of an output port
+	virtual uint64_t get_published() const = 0;
+
+protected:
+	friend class flowgraph;
+	/// Input: sleeps until a block is published or the ring is closed (thread per block mode only)
+	virtual void wait(int timeout_ms) = 0;
+	/// Output: closes the ring once the owner has finished
+	virtual void close() = 0;
+
+	flow_block * owner;
+	const char * name;
+	bool input;
+	flow_port * peer;
+};
+
+
+/***********************************************************************//**
+Input port: consumer side of a ring of sample_block<T>
+
+***************************************************************************/
+template <typename T>
+class flow_input : public flow_port
+{
+public:
+	typedef sample_block<T> block_t;
+
+	flow_input(flow_block * owner, const char * name) : flow_port(owner, name, true), ring(NULL) {}
+
+	/// Oldest published block, NULL if there is none. Stays valid until release()
+	const block_t * peek() {return ring->try_read();}
+	/// Gives the block returned by peek() back to the producer
+	void release() {ring->release();}
+	/// True once the producer has finished and every block has been read
+	bool is_finished() const {return ring->is_closed() && ring->depth() == 0;}
+	/// Number of samples in the blocks of the producer
+	size_t block_size() const {return ring->block_size();}
+
+	bool is_connected() const {return ring != NULL;}
+	bool is_blocked() const {return ring->depth() == 0;}
+	uint64_t get_published() const {return ring->get_published();}
+
+protected:
+	void wait(int timeout_ms) {ring->wait_read(timeout_ms);}
+	void close() {}
+
+private:
+	friend class flowgraph;
+	sample_ring<T> * ring;		/// Ring of the producer, not owned
+};
+
+
+/***********************************************************************//**
+Output port: producer side of a ring of sample_block<T>. The ring is
+created by flowgraph::connect() and owned by the port.
+
+***************************************************************************/
+template <typename T>
+class flow_output : public flow_port
+{
+public:
+	typedef sample_block<T> block_t;
+
+	flow_output(flow_block * owner, const char * name, size_t samps)
+	:flow_port(owner, name, false), ring(NULL), samps_per_block(samps) {}
+	~flow_output()
+	{
+		if(ring)
+		{
+			ring->~sample_ring<T>();
+			free(ring);
+		}
+	}
+
+	/***********************************************************************
+	Next block to fill, NULL while the ring is full. Nothing is reserved
+	before publish(): a block which found another output full can return
+	FLOW_IDLE and get the same block from acquire() next time.
+	***********************************************************************/
+	block_t * acquire() {return ring->depth() >= ring->size() ? NULL : ring->acquire_write();}
+	/// Hands the block returned by acquire() to the consumer
+	void publish() {ring->publish();}
+	/// Capacity of the blocks in samples
+	size_t block_size() const {return samps_per_block;}
+
+	bool is_connected() const {return ring != NULL;}
+	bool is_blocked() const {return ring->depth() >= ring->size();}
+	bool is_finished() const {return false;}
+	uint64_t get_published() const {return ring->get_published();}
+
+protected:
+	void wait(int) {}
+	void close() {ring->close();}
+
+private:
+	friend class flowgraph;
+	flow_output(const flow_output &);
+	flow_output & operator=(const flow_output &);
+
+	sample_ring<T> * ring;
+	size_t samps_per_block;
+};
+
+
+/***********************************************************************//**
+Processing block of a flowgraph
+
+work() is only ever called by one thread at a time, so a block keeps its
+state in plain members. The accounting counters are written by the
+scheduler and are valid once flowgraph::wait() has returned.
+
+***************************************************************************/
+class flow_block
+{
+public:
+	flow_block(const char * name);
+	virtual ~flow_block() {}
+
+	virtual flow_status work() = 0;
+
+	const char * get_name() const {return name;}
+	size_t get_num_inputs() const {return inputs.size();}
+	size_t get_num_outputs() const {return outputs.size();}
+	flow_port & get_input(size_t index) const {return *inputs[index];}
+	flow_port & get_output(size_t index) const {return *outputs[index];}
+	/// Settings of the thread of the block in FLOW_THREAD_PER_BLOCK mode (default: those of the flow_config)
+	void set_rt_config(const thread_rt_config & config) {rt_config = config; has_rt_config = true;}
+
+	/// CPU time spent in work() in ns
+	uint64_t get_cpu_ns() const {return cpu_ns;}
+	/// Number of work() calls
+	uint64_t get_calls() const {return calls;}
+	/// Number of work() calls which returned FLOW_IDLE
+	uint64_t get_idle_calls() const {return idle_calls;}
+	/// CPU time of the work() calls which did something
+	const latency_histogram & get_work_cost() const {return work_cost;}
+
+protected:
+	/// True once flowgraph::stop() has been called: a source returns FLOW_FINISHED
+	bool stop_requested() const;
+	/// True when every input is finished: the block returns FLOW_FINISHED once it has flushed its state
+	bool inputs_finished() const;
+
+private:
+	friend class flow_port;
+	friend class flowgraph;
+	flow_block(const flow_block &);
+	flow_block & operator=(const flow_block &);
+
+	const char * name;
+	std::vector<flow_port *> inputs;
+	std::vector<flow_port *> outputs;
+	flowgraph * graph;			/// Graph the block was added to
+	thread_rt_config rt_config;
+	bool has_rt_config;
+	std::atomic<unsigned> state;	/// Scheduling state in FLOW_POOL mode (see flowgraph.cpp)
+	uint64_t cpu_ns;
+	uint64_t calls;
+	uint64_t idle_calls;
+	latency_histogram work_cost;
+};
+
+
+/***********************************************************************//**
+Block running a stage of the modem (the process() / max_output() /
+output_type interface of ddc_stage, pfb_decimator, viterbi_decoder, ...)
+on each input block
+
+The output blocks hold max_output() of the largest input block. Their
+first_sample counts the output samples, their metadata is the one of
+the input block.
+
+***************************************************************************/
+template <typename Stage, typename In>
+class flow_stage : public flow_block
+{
+public:
+	typedef typename Stage::output_type output_type;
+
+	/***********************************************************************
+	@param stage Configured stage, used by the thread running the block only
+	@param input_samps Size of the blocks of the producer
+	***********************************************************************/
+	flow_stage(const char * name, Stage & stage, size_t input_samps)
+	:flow_block(name), input(this, "in"), output(this, "out", stage.max_output(input_samps)), stage(stage), produced(0) {}
+
+	flow_input<In> input;
+	flow_output<output_type> output;
+
+	flow_status work()
+	{
+		const sample_block<In> * in = input.peek();
+		if(in == NULL)
+			return input.is_finished() ? FLOW_FINISHED : FLOW_IDLE;
+		sample_block<output_type> * out = output.acquire();
+		if(out == NULL)
+			return FLOW_IDLE;
+		size_t count = stage.process(in->samples, in->num_samps, out->samples);
+		if(count)
+		{
+			out->num_samps = count;
+			out->first_sample = produced;
+			out->md = in->md;
+			out->skipped = 0;
+			produced += count;
+			output.publish();
+		}
+		input.release();
+		return FLOW_WORKED;
+	}
+
+private:
+	Stage & stage;
+	uint64_t produced;			/// Output samples published
+};
+
+
+struct flow_worker;
+
+
+/***********************************************************************//**
+Graph of blocks and its scheduler
+
+The blocks are added and connected, then start() creates the threads and
+wait() returns once every block has finished. A graph runs once: the
+blocks and the graph are destroyed after wait().
+
+***************************************************************************/
+class flowgraph
+{
+public:
+	flowgraph();
+	~flowgraph();
+
+	void add(flow_block & block);
+
+	/***********************************************************************
+	Connects an output to an input through a ring of num_slots blocks
+
+	@return true if an error occurred, false otherwise
+	***********************************************************************/
+	template <typename T>
+	bool connect(flow_output<T> & out, flow_input<T> & in, size_t num_slots = FLOW_RING_SLOTS)
+	{
+		if(out.ring || in.ring)
+		{
+			std::cout << "Flowgraph: " << out.owner->get_name() << "." << out.name << " or " << in.owner->get_name() << "." << in.name
+				<< " is already connected" << std::endl;
+			return true;
+		}
+		// The indexes of the ring are on their own cache lines
+		void * mem = NULL;
+		if(posix_memalign(&mem, CACHE_LINE_SIZE, sizeof(sample_ring<T>)))
+			throw std::bad_alloc();
+		out.ring = new(mem) sample_ring<T>(num_slots, out.block_size());
+		in.ring = out.ring;
+		out.peer = &in;
+		in.peer = &out;
+		return false;
+	}
+
+	/***********************************************************************
+	Feeds an input from a ring filled outside the graph, e.g. by a source
+	thread. The input is finished when the ring is closed. In
+	FLOW_POOL mode the consumer is not woken up by the producer: it sees
+	the new blocks within idle_wait_ms.
+
+	@return true if an error occurred, false otherwise
+	***********************************************************************/
+	template <typename T>
+	bool connect(sample_ring<T> & ring, flow_input<T> & in)
+	{
+		if(in.ring)
+		{
+			std::cout << "Flowgraph: " << in.owner->get_name() << "." << in.name << " is already connected" << std::endl;
+			return true;
+		}
+		in.ring = &ring;
+		return false;
+	}
+
+	bool start(const flow_config & config);
+	void stop();
+	void wait();
+	/// True once every block has finished
+	bool is_finished() const {return num_finished.load(std::memory_order_acquire) == blocks.size();}
+	/// True once stop() has been called
+	bool is_stopping() const {return stopping.load(std::memory_order_relaxed);}
+
+	size_t get_num_blocks() const {return blocks.size();}
+	flow_block & get_block(size_t index) const {return *blocks[index];}
+	/// Time between start() and the end of the last block in ns
+	uint64_t get_elapsed_ns() const;
+	void print_stats(std::ostream & os = std::cout) const;
+
+private:
+	friend struct flow_worker;
+	flowgraph(const flowgraph &);
+	flowgraph & operator=(const flowgraph &);
+
+	static void * block_helper(void * arg);
+	static void * worker_helper(void * arg);
+	void run_block(flow_block & block);
+	void run_worker(flow_worker & worker);
+	flow_status call_work(flow_block & block);
+	void finish(flow_block & block, flow_worker * worker);
+	void notify(flow_block & block, flow_worker & worker);
+	void notify_neighbours(flow_block & block, flow_worker & worker);
+	void poll(flow_worker & worker);
+	void push(flow_worker & worker, flow_block & block);
+	flow_block * pop(flow_worker & worker);
+	bool sleep();
+	bool wait_launch();
+
+	flow_config config;
+	std::vector<flow_block *> blocks;
+	std::vector<flow_worker *> workers;
+	std::vector<pthread_t> threads;	/// Threads of the blocks or of the workers
+	bool running;				/// True between start() and wait()
+	int launch;					/// The threads wait for 1 (run) or 2 (abort), protected by idle_mutex
+	std::atomic<size_t> num_finished;
+	std::atomic<bool> stopping;
+	uint64_t start_time;
+	std::atomic<uint64_t> end_time;
+
+	// Idle workers of FLOW_POOL
+	std::atomic<size_t> num_sleeping;
+	pthread_mutex_t idle_mutex;
+	pthread_cond_t idle_cond;
+};
+
+
+#endif
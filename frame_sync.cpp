@@ -0,0 +1,383 @@
+#include "frame_sync.h"
+#include "dsp_kernels.h"
+#include <cmath>
+#include <complex>
+#include <iostream>
+
+
+/// Largest transform considered by choose_fft_size()
+#define MAX_FFT_SIZE 65536
+
+
+/***********************************************************************//**
+Preamble of the frames sent by the modem
+
+32 symbols from the 7 bits m-sequence x^7 + x^6 + 1 started at 84, two
+bits per symbol: the highest autocorrelation sidelobe is 0.16 of the peak.
+
+***************************************************************************/
+
+const std::vector<uint8_t> & frame_sync_default_preamble()
+{
+	static const uint8_t symbols[] = {3, 3, 1, 1, 0, 2, 3, 0, 2, 0, 1, 2, 1, 3, 2, 2, 1, 3, 3, 2, 1, 0, 3, 2, 0, 1, 3, 1, 3, 1, 2, 1};
+	static const std::vector<uint8_t> preamble(symbols, symbols + sizeof(symbols));
+	return preamble;
+}
+
+
+frame_sync::frame_sync()
+:forward(NULL), inverse(NULL), reference_energy(0), preamble_samps(0)
+{
+	reset();
+}
+
+
+/***********************************************************************//**
+Frequency hypotheses for one transform size
+
+The hypotheses are spaced by rate / (2L) at most, rounded down to a whole
+number of bins: half way between two of them the correlation of the
+preamble has lost 10%.
+
+@param fft_size Size of the transforms
+@param bins Receives the spectrum shift of each hypothesis
+
+***************************************************************************/
+
+void frame_sync::plan_hypotheses(size_t fft_size, std::vector<int> & bins) const
+{
+	int bins_per_step = int(fft_size / (2 * preamble_samps));
+	if(bins_per_step == 0)
+		bins_per_step = 1;
+	double spacing = bins_per_step * config.rate / fft_size;
+	int half = int(ceil(config.max_freq_offset / spacing));
+	bins.clear();
+	for(int h = -half; h <= half; h++)
+		bins.push_back(h * bins_per_step);
+}
+
+
+/***********************************************************************//**
+Chooses the transform size with the lowest cost per correlation
+
+Each frame costs a forward transform, and an inverse transform and N
+products per hypothesis. It gives N - L + 1 correlations.
+
+@return FFT size, 0 if the preamble is too long
+
+***************************************************************************/
+
+size_t frame_sync::choose_fft_size() const
+{
+	size_t best = 0;
+	double best_cost = 0;
+	std::vector<int> bins;
+	for(size_t size = 2; size <= MAX_FFT_SIZE; size *= 2)
+	{
+		if(size < 2 * preamble_samps)
+			continue;
+		plan_hypotheses(size, bins);
+		double cost = ((1 + bins.size()) * size * log2(double(size)) + bins.size() * size) / double(size - preamble_samps + 1);
+		if(best == 0 || cost < best_cost)
+		{
+			best = size;
+			best_cost = cost;
+		}
+	}
+	return best;
+}
+
+
+/***********************************************************************//**
+Builds the preamble and its spectrum
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool frame_sync::configure(const frame_sync_config & cfg)
+{
+	config = cfg;
+	if(config.preamble.empty())
+		config.preamble = frame_sync_default_preamble();
+	if(config.symbol_rate <= 0 || config.rate < config.symbol_rate)
+	{
+		std::cout << "Frame sync needs one sample per symbol at least" << std::endl;
+		return true;
+	}
+
+	// Rectangular pulses, like the simulated bursts, at the expected frequency
+	double sps = config.rate / config.symbol_rate;
+	preamble_samps = size_t(floor(config.preamble.size() * sps + 0.5));
+	reference.resize(preamble_samps);
+	reference_energy = 0;
+	for(size_t k = 0; k < preamble_samps; k++)
+	{
+		uint8_t bits = config.preamble[size_t(k / sps)];
+		std::complex<double> symbol((bits & 1) ? M_SQRT1_2 : -M_SQRT1_2, (bits & 2) ? M_SQRT1_2 : -M_SQRT1_2);
+		std::complex<double> value = symbol * std::polar(1.0, 2 * M_PI * config.center_freq * k / config.rate);
+		reference[k] = sample_fc32(float(value.real()), float(value.imag()));
+		reference_energy += std::norm(reference[k]);
+	}
+
+	size_t size = config.fft_size ? config.fft_size : choose_fft_size();
+	if(size < preamble_samps)
+	{
+		std::cout << "FFT size " << size << " too small for a preamble of " << preamble_samps << " samples" << std::endl;
+		return true;
+	}
+	forward = fft_get_plan(size, false);
+	inverse = fft_get_plan(size, true);
+	if(forward == NULL || inverse == NULL)
+		return true;
+	plan_hypotheses(size, shifts);
+
+	// Matched filter h[k] = conj(r[L-1-k]): output n correlates frame[n-L+1 .. n]
+	spectrum.assign(size, sample_fc32(0, 0));
+	for(size_t k = 0; k < preamble_samps; k++)
+		spectrum[k] = std::conj(reference[preamble_samps - 1 - k]) / float(size);
+	forward->execute(&spectrum[0], &spectrum[0]);
+	transform.resize(size);
+	work.resize(size);
+	best_power.resize(size);
+	best_shift.resize(size);
+	power.resize(size);
+	energy.resize(size + 1);
+	reset();
+	return false;
+}
+
+
+void frame_sync::reset()
+{
+	running = false;
+	next_sample = 0;
+	has_time = false;
+	time_sample = 0;
+	restart(0);
+}
+
+
+/// Forgets the past inputs and the peak being searched; the stream continues at first_sample
+void frame_sync::restart(uint64_t first_sample)
+{
+	size_t overlap = preamble_samps ? preamble_samps - 1 : 0;
+	frame.assign(spectrum.size(), sample_fc32(0, 0));
+	fill = overlap;
+	frame_start = first_sample - overlap;
+	valid_from = first_sample;
+	has_candidate = false;
+}
+
+
+/***********************************************************************//**
+Correlates the frame with the preamble for every frequency hypothesis and
+keeps the strongest one at each output
+
+***************************************************************************/
+
+void frame_sync::correlate_frame()
+{
+	const size_t size = spectrum.size();
+	forward->execute(&frame[0], &transform[0]);
+
+	energy[0] = 0;
+	for(size_t n = 0; n < size; n++)
+		energy[n + 1] = energy[n] + std::norm(frame[n]);
+
+	std::fill(best_power.begin(), best_power.end(), 0.0f);
+	for(size_t h = 0; h < shifts.size(); h++)
+	{
+		// X[k + b]: the frame moved down by b bins
+		size_t shift = size_t((shifts[h] % int(size) + int(size)) % int(size));
+		dsp_fc32_multiply(transform.data() + shift, spectrum.data(), work.data(), size - shift);
+		dsp_fc32_multiply(transform.data(), spectrum.data() + size - shift, work.data() + size - shift, shift);
+		inverse->execute(&work[0], &work[0]);
+		dsp_fc32_mag_squared(&work[0], &power[0], size);
+		for(size_t n = preamble_samps - 1; n < size; n++)
+		{
+			if(power[n] > best_power[n])
+			{
+				best_power[n] = power[n];
+				best_shift[n] = shifts[h];
+			}
+		}
+	}
+}
+
+
+/***********************************************************************//**
+Refines the frequency of a peak
+
+The frame is brought to the frequency of the hypothesis and correlated
+with each half of the preamble: the phase between the two correlations
+is the residual offset times the duration of a half.
+
+@param end Index in the frame of the last sample of the preamble
+@param coarse_freq Frequency of the hypothesis, offset from center_freq
+
+@return Frequency offset from center_freq in Hz
+
+***************************************************************************/
+
+double frame_sync::refine(size_t end, double coarse_freq) const
+{
+	const sample_fc32 * x = &frame[end + 1 - preamble_samps];
+	size_t half = preamble_samps / 2;
+	std::complex<double> step = std::polar(1.0, -2 * M_PI * coarse_freq / config.rate);
+	std::complex<double> phasor(1, 0);
+	std::complex<double> first(0, 0), second(0, 0);
+	for(size_t k = 0; k < 2 * half; k++)
+	{
+		std::complex<double> z = std::complex<double>(x[k] * std::conj(reference[k])) * phasor;
+		if(k < half)
+			first += z;
+		else
+			second += z;
+		phasor *= step;
+	}
+	return coarse_freq + std::arg(second * std::conj(first)) * config.rate / (2 * M_PI * half);
+}
+
+
+/// Completes the candidate with its time and hands it over
+void frame_sync::report(frame_detection & detection)
+{
+	candidate.has_time_spec = has_time;
+	if(has_time)
+		candidate.time_spec = time_ref + uhd::time_spec_t::from_ticks(int64_t(candidate.sample - time_sample), config.rate);
+	detection = candidate;
+	has_candidate = false;
+}
+
+
+/***********************************************************************//**
+Correlates the frame and searches its outputs for peaks
+
+@param valid_end Number of samples of the frame received from the stream,
+the others are padding
+@param detections Receives the peaks which became final
+
+@return Number of detections
+
+***************************************************************************/
+
+size_t frame_sync::scan_frame(size_t valid_end, frame_detection * detections)
+{
+	const size_t size = spectrum.size();
+	const size_t overlap = preamble_samps - 1;
+	size_t count = 0;
+	correlate_frame();
+	for(size_t end = overlap; end < valid_end; end++)
+	{
+		uint64_t start = frame_start + end - overlap;
+		if(int64_t(start - valid_from) < 0)
+			continue;
+		// The peak is final once the correlator has moved a preamble past it
+		if(has_candidate && start >= candidate.sample + preamble_samps)
+			report(detections[count++]);
+		double window_energy = energy[end + 1] - energy[end + 1 - preamble_samps];
+		double metric = window_energy > 0 ? best_power[end] / (reference_energy * window_energy) : 0;
+		if(metric >= config.threshold && (!has_candidate || metric > candidate.metric))
+		{
+			has_candidate = true;
+			candidate.sample = start;
+			candidate.metric = float(metric);
+			candidate.coarse_freq = best_shift[end] * config.rate / size;
+			candidate.freq_offset = refine(end, candidate.coarse_freq);
+		}
+	}
+	return count;
+}
+
+
+/***********************************************************************//**
+Searches the samples of the partial frame, at the end of the stream or
+before a jump. The frame is padded with zeros and only the windows made
+of received samples are considered. The peak being searched becomes
+final. The next block restarts the correlation.
+
+@param detections Receives max_output(get_step()) detections at most
+
+@return Number of detections
+
+***************************************************************************/
+
+size_t frame_sync::flush(frame_detection * detections)
+{
+	size_t count = 0;
+	if(fill > preamble_samps - 1)
+	{
+		std::fill(frame.begin() + fill, frame.end(), sample_fc32(0, 0));
+		count = scan_frame(fill, detections);
+	}
+	if(has_candidate)
+		report(detections[count++]);
+	running = false;
+	return count;
+}
+
+
+/***********************************************************************//**
+Searches one block for preambles
+
+@param in Input samples, in any host format of the sampling task
+@param num_samps Number of input samples
+@param first_sample Number of in[0] since the start of the stream (the
+first_sample of the sampling task block)
+@param md Metadata of the block
+@param detections Receives max_output(num_samps) detections at most
+
+@return Number of detections. A preamble is reported once L samples
+after its start have been correlated, possibly in a later block, or at
+the next jump of the stream
+
+***************************************************************************/
+
+template <typename T>
+size_t frame_sync::process(const T * in, size_t num_samps, uint64_t first_sample, const uhd::rx_metadata_t & md,
+	frame_detection * detections)
+{
+	size_t count = 0;
+	if(running && first_sample != next_sample)
+		count = flush(detections);
+	if(!running)
+		restart(first_sample);
+	running = true;
+	next_sample = first_sample + num_samps;
+	if(md.has_time_spec)
+	{
+		has_time = true;
+		time_sample = first_sample;
+		time_ref = md.time_spec;
+	}
+
+	const sample_fc32 * data = dsp_as_fc32(in, num_samps, converted);
+	const size_t size = spectrum.size();
+	const size_t overlap = preamble_samps - 1;
+	size_t pos = 0;
+	while(pos < num_samps)
+	{
+		size_t n = size - fill < num_samps - pos ? size - fill : num_samps - pos;
+		std::copy(data + pos, data + pos + n, frame.begin() + fill);
+		fill += n;
+		pos += n;
+		if(fill < size)
+			break;
+
+		count += scan_frame(size, detections + count);
+
+		std::copy(frame.end() - overlap, frame.end(), frame.begin());
+		fill = overlap;
+		frame_start += size - overlap;
+	}
+	return count;
+}
+
+
+template size_t frame_sync::process(const sample_sc8 * in, size_t num_samps, uint64_t first_sample,
+	const uhd::rx_metadata_t & md, frame_detection * detections);
+template size_t frame_sync::process(const sample_sc16 * in, size_t num_samps, uint64_t first_sample,
+	const uhd::rx_metadata_t & md, frame_detection * detections);
+template size_t frame_sync::process(const sample_fc32 * in, size_t num_samps, uint64_t first_sample,
+	const uhd::rx_metadata_t & md, frame_detection * detections);
@@ -0,0 +1,146 @@
+/***********************************************************************//**
+@file
+
+Frame acquisition: FFT correlator looking for a known QPSK preamble in the
+blocks of the sampling task
+
+A sliding correlation in the time domain costs L complex products per
+sample and per frequency hypothesis, L being the length of the preamble
+in samples. The correlator works on FFT frames instead (overlap-save, as
+overlap_save_filter): one forward transform per frame, then for each
+frequency hypothesis a product with the spectrum of the preamble and an
+inverse transform. A frequency hypothesis is a circular shift of the
+spectrum of the frame, so it costs no extra forward transform.
+
+The correlation is normalised by the energy of the preamble and by the
+energy of the input under it: the metric is between 0 and 1 (1 for the
+preamble alone, S / (S + N) with noise) whatever the level of the input,
+so the threshold needs no AGC.
+
+The frames overlap by L - 1 samples and the state of the peak search is
+kept between blocks, so a preamble across two blocks is found like any
+other, once.
+
+***************************************************************************/
+
+#ifndef FRAME_SYNC_H
+#define FRAME_SYNC_H
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+#include "/usr/include/uhd/usrp/multi_usrp.hpp"
+#include "sample_format.h"
+#include "block_pool.h"
+#include "fft.h"
+
+
+/// Preamble of the frames: 32 QPSK symbols (bit 0: I > 0, bit 1: Q > 0)
+const std::vector<uint8_t> & frame_sync_default_preamble();
+
+
+/// Configuration of the correlator
+struct frame_sync_config
+{
+	frame_sync_config() : rate(125000), center_freq(0), symbol_rate(12500), threshold(0.4), max_freq_offset(1000), fft_size(0) {}
+
+	double rate;				/// Input sample rate in samples/s
+	double center_freq;			/// Expected frequency of the bursts in the input in Hz
+	double symbol_rate;			/// Symbol rate in symbols/s (rectangular pulses)
+	std::vector<uint8_t> preamble;	/// Preamble symbols. Empty for frame_sync_default_preamble()
+	double threshold;			/// Normalised correlation above which a preamble is detected (0 .. 1)
+	double max_freq_offset;		/// Largest offset from center_freq searched in Hz
+	size_t fft_size;			/// Size of the transforms. 0 to choose the cheapest
+};
+
+
+/// One detected preamble
+struct frame_detection
+{
+	uint64_t sample;			/// Number of the first sample of the preamble since the start of the stream
+	bool has_time_spec;			/// True if time_spec is valid
+	uhd::time_spec_t time_spec;	/// Time of the first sample of the preamble, from the rx metadata
+	float metric;				/// Normalised correlation (0 .. 1)
+	double coarse_freq;			/// Frequency hypothesis of the peak, offset from center_freq in Hz
+	double freq_offset;			/// Offset from center_freq refined from the phase of the two halves of the preamble
+};
+
+
+/***********************************************************************//**
+FFT preamble correlator
+
+process() receives the blocks with their first_sample and metadata: the
+time of a detection is the time_spec of the last block with one, moved by
+the number of samples between them, so it is exact to the sample even
+when the preamble started in an earlier block. A jump of first_sample
+(samples missing from the stream, or left out by the squelch) restarts
+the correlation: the samples received before the jump are searched
+first, so that a short burst forwarded alone is not lost in a partial
+frame.
+
+***************************************************************************/
+class frame_sync
+{
+public:
+	typedef frame_detection output_type;
+
+	frame_sync();
+	bool configure(const frame_sync_config & config);
+	void reset();
+
+	/// Maximum number of detections from num_samps inputs
+	size_t max_output(size_t num_samps) const {return (num_samps + get_step()) / preamble_samps + 2;}
+	size_t get_fft_size() const {return spectrum.size();}
+	/// Number of correlations computed by each frame
+	size_t get_step() const {return spectrum.size() - preamble_samps + 1;}
+	size_t get_num_hypotheses() const {return shifts.size();}
+	size_t get_preamble_samps() const {return preamble_samps;}
+
+	template <typename T>
+	size_t process(const T * in, size_t num_samps, uint64_t first_sample, const uhd::rx_metadata_t & md,
+		frame_detection * detections);
+	size_t flush(frame_detection * detections);
+
+private:
+	void plan_hypotheses(size_t fft_size, std::vector<int> & bins) const;
+	size_t choose_fft_size() const;
+	void restart(uint64_t first_sample);
+	void correlate_frame();
+	size_t scan_frame(size_t valid_end, frame_detection * detections);
+	void report(frame_detection & detection);
+	double refine(size_t end, double coarse_freq) const;
+
+	frame_sync_config config;
+	const fft_plan * forward;	/// Cached plans, see fft_get_plan()
+	const fft_plan * inverse;
+	fc32_buffer reference;	/// Preamble at center_freq
+	double reference_energy;
+	size_t preamble_samps;		/// L
+	fc32_buffer spectrum;	/// Spectrum of the matched filter, divided by N
+	std::vector<int> shifts;	/// Spectrum shift of each frequency hypothesis in bins
+
+	fc32_buffer frame;	/// L - 1 past inputs followed by the new ones
+	size_t fill;				/// Number of samples in frame
+	uint64_t frame_start;		/// Number of the sample frame[0]
+	fc32_buffer transform;	/// Spectrum of the frame
+	fc32_buffer work;	/// Product and correlation of one hypothesis
+	float_buffer best_power;	/// Highest |correlation|^2 at each output of the frame
+	pool_vector<int>::type best_shift;	/// Hypothesis giving it
+	float_buffer power;	/// |correlation|^2 of one hypothesis
+	pool_vector<double>::type energy;	/// Cumulated energy of the frame, energy[n] for frame[0 .. n-1]
+	uint64_t valid_from;		/// First sample of the stream since the last restart
+
+	// Peak search, across frames and blocks
+	bool has_candidate;
+	frame_detection candidate;	/// Best peak above the threshold not reported yet
+
+	bool running;				/// False until the first block after reset()
+	uint64_t next_sample;		/// Expected first_sample of the next block
+	bool has_time;				/// True if a block with a time_spec was received
+	uint64_t time_sample;		/// Number of the first sample of that block
+	uhd::time_spec_t time_ref;	/// Its time_spec
+	fc32_buffer converted;	/// Integer input converted to float
+};
+
+
+#endif
@@ -0,0 +1,67 @@
+#include "latency_stats.h"
+#include <cstring>
+
+
+/***********************************************************************//**
+Removes all the recorded durations
+
+***************************************************************************/
+
+void latency_histogram::reset()
+{
+	memset(buckets, 0, sizeof(buckets));
+	count = 0;
+	sum = 0;
+	min_value = ~uint64_t(0);
+	max_value = 0;
+}
+
+
+/***********************************************************************//**
+Returns the highest value of a bucket
+
+***************************************************************************/
+
+uint64_t latency_histogram::bucket_value(size_t index)
+{
+	if(index < LATENCY_SUB_BUCKETS)
+		return index;
+	int shift = int(index / LATENCY_SUB_BUCKETS) - 1;
+	uint64_t sub = index % LATENCY_SUB_BUCKETS;
+	return ((uint64_t(LATENCY_SUB_BUCKETS + sub + 1)) << shift) - 1;
+}
+
+
+/***********************************************************************//**
+Returns a percentile of the recorded durations
+
+The value returned is the upper bound of the bucket holding the
+percentile, limited to the longest recorded duration.
+
+@param p Percentile between 0 and 100 (e.g. 99.9)
+
+@return Duration in ns. 0 if nothing has been recorded
+
+***************************************************************************/
+
+uint64_t latency_histogram::percentile(double p) const
+{
+	if(count == 0)
+		return 0;
+	uint64_t rank = uint64_t(p / 100.0 * count + 0.5);
+	if(rank < 1)
+		rank = 1;
+	if(rank > count)
+		rank = count;
+	uint64_t seen = 0;
+	for(size_t index = 0; index < LATENCY_NUM_BUCKETS; index++)
+	{
+		seen += buckets[index];
+		if(seen >= rank)
+		{
+			uint64_t value = bucket_value(index);
+			return value < max_value ? value : max_value;
+		}
+	}
+	return max_value;
+}
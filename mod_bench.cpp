@@ -0,0 +1,332 @@
+/***********************************************************************//**
+@file
+
+Checks the PSK modulator (modulator.h) and measures its throughput
+
+For BPSK, QPSK and 8PSK, with and without frequency shift, and with the
+kernels of every instruction set, the program checks that:
+- the sc16 samples are those of a double precision reference (direct
+  form filter on the zero-stuffed symbols, then the mixer) within 1 LSB
+- the samples do not depend on how the bits are cut into blocks, nor on
+  the instruction set (bit for bit)
+
+A QPSK burst is then modulated at the rates of the modem and fed to
+qpsk_demodulator, with the same root raised cosine as matched filter:
+the demodulator must lock and give back the symbols sent (up to the
+phase ambiguity of QPSK and the delay of the filters).
+
+The throughput is measured by modulating random bits into blocks of
+MOD_BLOCK_SAMPS samples, as the producer of the transmit task does.
+
+Usage: modbench [-t seconds] [-l label] [-j file]
+
+-t measuring time of each case in seconds (default 0.2)
+-l label stored in the results (e.g. the release)
+-j file receiving the results, one JSON object per line (default mod_bench.json)
+
+The exit code is 1 if a check fails.
+
+***************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <complex>
+#include <iostream>
+#include <vector>
+#include "modulator.h"
+#include "demodulator.h"
+#include "baseband.h"
+#include "latency_stats.h"
+#include "bench_common.h"
+
+
+#define BENCH_RATE 125000.0
+#define BENCH_SYMBOL_RATE 12500.0	/// 10 samples per symbol
+#define BENCH_CENTER -20000.0		/// Shift of the shifted cases, as the carrier of receiver_test --sim
+#define CHECK_SYMBOLS 1500			/// Symbols of each reference check
+#define ODD_BLOCK_BITS 97			/// Block size which is not a multiple of anything
+#define LOOPBACK_SYMBOLS 20000		/// 1.6 s of QPSK for the demodulator
+#define MIN_LOOPBACK_MER 25.0		/// Lowest modulation error ratio accepted in the loopback, in dB
+#define MOD_BLOCK_SAMPS 2000		/// Samples of each block of the throughput measure
+
+
+static std::vector<uint8_t> random_bits(size_t num_bits)
+{
+	std::vector<uint8_t> bits(num_bits);
+	for(size_t index = 0; index < num_bits; index++)
+		bits[index] = uint8_t(bench_random() >> 31);
+	return bits;
+}
+
+
+/// Constellation point of the bits of one symbol, from the description of the mapping
+static std::complex<double> reference_point(const std::string & scheme, const uint8_t * bits)
+{
+	if(scheme == "bpsk")
+		return std::complex<double>(bits[0] ? -1 : 1, 0);
+	if(scheme == "qpsk")
+		return std::complex<double>(bits[0] ? -M_SQRT1_2 : M_SQRT1_2, bits[1] ? -M_SQRT1_2 : M_SQRT1_2);
+	unsigned value = bits[0] << 2 | bits[1] << 1 | bits[2];
+	unsigned k = 0;
+	while((k ^ (k >> 1)) != value)
+		k++;
+	return std::polar(1.0, M_PI * k / 4);
+}
+
+
+/***********************************************************************//**
+Modulates the bits in blocks of block_bits with the kernels of a table,
+then flushes the modulator
+
+***************************************************************************/
+
+template <typename T>
+static std::vector<T> modulate(const mod_config & config, const dsp_kernel_table * table, const std::vector<uint8_t> & bits,
+	size_t block_bits)
+{
+	modulator mod;
+	std::vector<T> out;
+	if(mod.configure(config))
+		return out;
+	mod.set_kernels(table);
+	out.resize(mod.max_output(bits.size()) + bits.size() / block_bits * mod.get_sps() + mod.max_flush());
+	size_t count = 0;
+	for(size_t start = 0; start < bits.size(); start += block_bits)
+	{
+		size_t n = bits.size() - start < block_bits ? bits.size() - start : block_bits;
+		count += mod.process(&bits[start], n, &out[count]);
+	}
+	count += mod.flush(&out[count]);
+	out.resize(count);
+	return out;
+}
+
+
+/***********************************************************************//**
+Compares the modulator with the double precision reference
+
+@return Number of failed checks
+
+***************************************************************************/
+
+static int check_scheme(const mod_config & config, const std::vector<const dsp_kernel_table *> & tables, bench_context & bench)
+{
+	modulator mod;
+	if(mod.configure(config))
+		return 1;
+	size_t sps = mod.get_sps();
+	size_t bps = mod.get_bits_per_symbol();
+	std::vector<uint8_t> bits = random_bits(CHECK_SYMBOLS * bps);
+
+	// Zero-stuffed symbols through the whole pulse, then the mixer
+	std::vector<double> pulse = design_rrc(sps * config.span, double(sps), config.rolloff);
+	double energy = 0;
+	for(size_t index = 0; index < pulse.size(); index++)
+		energy += pulse[index] * pulse[index];
+	double gain = config.level * sqrt(sps / energy);
+	size_t num_samps = (CHECK_SYMBOLS + config.span - 1) * sps;
+	std::vector<std::complex<double> > reference(num_samps);
+	for(size_t m = 0; m < CHECK_SYMBOLS; m++)
+	{
+		std::complex<double> point = reference_point(config.scheme, &bits[m * bps]);
+		for(size_t index = 0; index < pulse.size(); index++)
+			reference[m * sps + index] += point * pulse[index] * gain;
+	}
+	double w = 2 * M_PI * config.center_freq / config.rate;
+	for(size_t n = 0; n < num_samps; n++)
+		reference[n] *= std::polar(32767.0, w * n);
+
+	// The first table is the scalar one, the others must match it bit for bit
+	int errors = 0;
+	std::vector<sample_sc16> scalar_out;
+	for(size_t t = 0; t < tables.size(); t++)
+	{
+		std::vector<sample_sc16> whole = modulate<sample_sc16>(config, tables[t], bits, bits.size());
+		std::vector<sample_sc16> odd = modulate<sample_sc16>(config, tables[t], bits, ODD_BLOCK_BITS);
+		double max_error = 0;
+		for(size_t n = 0; n < whole.size() && n < num_samps; n++)
+		{
+			double error = std::max(fabs(whole[n].real() - reference[n].real()), fabs(whole[n].imag() - reference[n].imag()));
+			max_error = std::max(max_error, error);
+		}
+		bool accurate = whole.size() == num_samps && max_error <= 1.0;
+		bool same = odd.size() == whole.size() && memcmp(&odd[0], &whole[0], whole.size() * sizeof(sample_sc16)) == 0;
+		if(t == 0)
+			scalar_out = whole;
+		else
+			same = same && whole.size() == scalar_out.size() &&
+				memcmp(&whole[0], &scalar_out[0], whole.size() * sizeof(sample_sc16)) == 0;
+		errors += !accurate + !same;
+		printf("%-6s %9.0f %-8s %9zu %11.2f %8s\n", config.scheme.c_str(), config.center_freq, tables[t]->name, whole.size(),
+			max_error, same ? "same" : "DIFFER");
+		fprintf(bench.record("mod_check"), "\"scheme\":\"%s\",\"shift\":%.1f,\"isa\":\"%s\",\"samples\":%zu,\"max_error_lsb\":%.3f,"
+			"\"identical\":%s}\n", config.scheme.c_str(), config.center_freq, tables[t]->name, whole.size(), max_error,
+			same ? "true" : "false");
+	}
+	return errors;
+}
+
+
+/***********************************************************************//**
+Modulates a QPSK burst and demodulates it
+
+@return Number of failed checks
+
+***************************************************************************/
+
+static int check_loopback(bench_context & bench)
+{
+	mod_config config;
+	config.rate = BENCH_RATE;
+	config.symbol_rate = BENCH_SYMBOL_RATE;
+	config.center_freq = BENCH_CENTER;
+	std::vector<uint8_t> bits = random_bits(2 * LOOPBACK_SYMBOLS);
+	std::vector<sample_sc16> signal = modulate<sample_sc16>(config, NULL, bits, bits.size());
+
+	// The matched filter runs at the output of the DDC, about 4 samples per symbol
+	demod_config demod_cfg;
+	demod_cfg.rate = BENCH_RATE;
+	demod_cfg.center_freq = BENCH_CENTER;
+	demod_cfg.symbol_rate = BENCH_SYMBOL_RATE;
+	size_t decimation = size_t(BENCH_RATE / BENCH_SYMBOL_RATE / 4);
+	double demod_sps = BENCH_RATE / decimation / BENCH_SYMBOL_RATE;
+	demod_cfg.matched_taps = design_rrc(size_t(config.span * demod_sps) + 1, demod_sps, config.rolloff);
+	qpsk_demodulator demod;
+	if(demod.configure(demod_cfg))
+		return 1;
+	std::vector<sample_fc32> symbols(demod.max_output(signal.size()));
+	std::vector<int8_t> soft(2 * symbols.size());
+	size_t count = demod.process(&signal[0], signal.size(), &symbols[0], &soft[0]);
+	double mer = demod.get_mer();
+
+	// Best match of the decisions of the second half, the tail of the burst
+	// excluded, over the 4 rotations and the delays
+	size_t end = count > 4 * config.span ? count - 4 * config.span : 0;
+	size_t best = 0;
+	for(size_t delay = 0; delay < 4 * config.span && delay < count; delay++)
+		for(int rotation = 0; rotation < 4; rotation++)
+		{
+			std::complex<float> turn = std::pow(std::complex<float>(0, 1), rotation);
+			size_t matches = 0;
+			for(size_t n = count / 2; n < end && n - delay < LOOPBACK_SYMBOLS; n++)
+			{
+				sample_fc32 z = symbols[n] * turn;
+				const uint8_t * sent = &bits[2 * (n - delay)];
+				matches += (z.real() < 0) == (sent[0] != 0) && (z.imag() < 0) == (sent[1] != 0);
+			}
+			best = std::max(best, matches);
+		}
+	size_t compared = end > count / 2 ? end - count / 2 : 0;
+	bool ok = mer >= MIN_LOOPBACK_MER && count + 4 * config.span >= LOOPBACK_SYMBOLS && compared && best == compared;
+	printf("Loopback into the demodulator: %zu symbols of %d, MER %.1f dB, %zu of %zu symbols of the second half found%s\n",
+		count, LOOPBACK_SYMBOLS, mer, best, compared, ok ? "" : "  FAILED");
+	fprintf(bench.record("mod_loopback"), "\"symbols\":%zu,\"mer\":%.2f,\"matched\":%zu,\"compared\":%zu,\"ok\":%s}\n",
+		count, mer, best, compared, ok ? "true" : "false");
+	return ok ? 0 : 1;
+}
+
+
+/***********************************************************************//**
+Modulates random bits into blocks for the given time
+
+@return Throughput in millions of output samples per second
+
+***************************************************************************/
+
+template <typename T>
+static double bench_modulator(const mod_config & config, const dsp_kernel_table * table, double seconds)
+{
+	modulator mod;
+	if(mod.configure(config))
+		return 0;
+	mod.set_kernels(table);
+	size_t block_bits = MOD_BLOCK_SAMPS / mod.get_sps() * mod.get_bits_per_symbol();
+	std::vector<uint8_t> bits = random_bits(16 * block_bits);
+	std::vector<T, pool_allocator<T> > block(mod.max_output(block_bits));
+	uint64_t samples = 0;
+	uint64_t start = monotonic_ns();
+	uint64_t end = start + uint64_t(seconds * 1e9);
+	uint64_t now = start;
+	while(now < end)
+	{
+		for(size_t index = 0; index < 16; index++)
+			samples += mod.process(&bits[index * block_bits], block_bits, &block[0]);
+		now = monotonic_ns();
+	}
+	return samples / ((now - start) * 1e-9) * 1e-6;
+}
+
+
+int main(int argc, char ** argv)
+{
+	bench_context bench("mod_bench.json", 0.2);
+	for(int index = 1; index < argc; index++)
+	{
+		if(bench.parse_option(argc, argv, index))
+		{
+			std::cout << "Usage: modbench [-t seconds] [-l label] [-j file]" << std::endl;
+			return 1;
+		}
+	}
+	if(bench.open())
+		return 1;
+
+	std::vector<const dsp_kernel_table *> tables;
+	dsp_available_kernels(tables);
+	const char * schemes[] = {"bpsk", "qpsk", "8psk"};
+	const double shifts[] = {0, BENCH_CENTER};
+
+	//------------------------------------------------
+	// Reference, block size and instruction set
+	//------------------------------------------------
+	printf("%-6s %9s %-8s %9s %11s %8s\n", "scheme", "shift Hz", "kernels", "samples", "error LSB", "blocks");
+	for(size_t s = 0; s < 3; s++)
+		for(size_t f = 0; f < 2; f++)
+		{
+			mod_config config;
+			config.rate = BENCH_RATE;
+			config.symbol_rate = BENCH_SYMBOL_RATE;
+			config.scheme = schemes[s];
+			config.center_freq = shifts[f];
+			bench.errors += check_scheme(config, tables, bench);
+		}
+	bench.errors += check_loopback(bench);
+
+	//------------------------------------------------
+	// Throughput
+	//------------------------------------------------
+	printf("\nMS/s, %d samples per block, %.0f samples per symbol, span of 8 symbols\n", MOD_BLOCK_SAMPS, BENCH_RATE / BENCH_SYMBOL_RATE);
+	printf("%-6s %9s %-6s", "scheme", "shift Hz", "format");
+	for(size_t t = 0; t < tables.size(); t++)
+		printf(" %10s", tables[t]->name);
+	printf("   speedup\n");
+	for(size_t s = 0; s < 3; s++)
+		for(size_t f = 0; f < 2; f++)
+			for(int format = 0; format < 2; format++)
+			{
+				mod_config config;
+				config.rate = BENCH_RATE;
+				config.symbol_rate = BENCH_SYMBOL_RATE;
+				config.scheme = schemes[s];
+				config.center_freq = shifts[f];
+				const char * format_name = format ? "fc32" : "sc16";
+				printf("%-6s %9.0f %-6s", schemes[s], shifts[f], format_name);
+				double scalar = 0, best = 0;
+				for(size_t t = 0; t < tables.size(); t++)
+				{
+					double msps = format ? bench_modulator<sample_fc32>(config, tables[t], bench.seconds)
+						: bench_modulator<sample_sc16>(config, tables[t], bench.seconds);
+					if(t == 0)
+						scalar = msps;
+					if(msps > best)
+						best = msps;
+					printf(" %10.1f", msps);
+					fprintf(bench.record("mod"), "\"scheme\":\"%s\",\"shift\":%.1f,\"format\":\"%s\",\"isa\":\"%s\",\"sps\":%.0f,\"msps\":%.2f}\n",
+						schemes[s], shifts[f], format_name, tables[t]->name, BENCH_RATE / BENCH_SYMBOL_RATE, msps);
+				}
+				printf("   %5.1fx\n", scalar > 0 ? best / scalar : 0);
+			}
+
+	return bench.finish("Modulator matches the reference");
+}
@@ -0,0 +1,252 @@
+#include "modulator.h"
+#include "baseband.h"
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+
+/// The fc32 samples are written directly to the output
+static inline sample_fc32 * pass_output(sample_fc32 * out, fc32_buffer &)
+{
+	return out;
+}
+
+/// The integer samples are computed in the work buffer, then converted
+template <typename T>
+static inline sample_fc32 * pass_output(T *, fc32_buffer & work)
+{
+	return &work[0];
+}
+
+
+static inline void store_pass(const sample_fc32 *, size_t, sample_fc32 *, const dsp_kernel_table &)
+{
+}
+
+static inline void store_pass(const sample_fc32 * in, size_t num_samps, sample_sc16 * out, const dsp_kernel_table & k)
+{
+	k.fc32_to_sc16(in, out, num_samps, float(sample_traits<sample_sc16>::full_scale()));
+}
+
+static inline void store_pass(const sample_fc32 * in, size_t num_samps, sample_sc8 * out, const dsp_kernel_table &)
+{
+	for(size_t index = 0; index < num_samps; index++)
+		store_sample(out[index], in[index].real(), in[index].imag());
+}
+
+
+modulator::modulator()
+:kernels(&dsp_kernels()), sps(1), span(1), bits_per_symbol(1), shifted(false), phasor(1, 0), phasor_step(1, 0),
+ pending(0), pending_bits(0), num_symbols(0), num_samples(0)
+{
+}
+
+
+/***********************************************************************//**
+Builds the constellation and the polyphase filter
+
+The taps are scaled so that random symbols give the RMS level requested:
+the output power is the energy of the pulse divided by L.
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool modulator::configure(const mod_config & cfg)
+{
+	double ratio = cfg.symbol_rate > 0 ? cfg.rate / cfg.symbol_rate : 0;
+	if(ratio < 2 || fabs(ratio - floor(ratio + 0.5)) > 1e-9)
+	{
+		std::cout << "The sample rate must be a multiple of the symbol rate, at least 2 samples per symbol" << std::endl;
+		return true;
+	}
+	if(cfg.span == 0 || cfg.rolloff <= 0 || cfg.rolloff > 1 || fabs(cfg.center_freq) >= cfg.rate / 2 || cfg.level <= 0)
+	{
+		std::cout << "Invalid modulator settings" << std::endl;
+		return true;
+	}
+	if(cfg.scheme == "bpsk")
+	{
+		bits_per_symbol = 1;
+		constellation[0] = sample_fc32(1, 0);
+		constellation[1] = sample_fc32(-1, 0);
+	}
+	else if(cfg.scheme == "qpsk")
+	{
+		bits_per_symbol = 2;
+		for(unsigned value = 0; value < 4; value++)
+			constellation[value] = sample_fc32(value & 2 ? -M_SQRT1_2 : M_SQRT1_2, value & 1 ? -M_SQRT1_2 : M_SQRT1_2);
+	}
+	else if(cfg.scheme == "8psk")
+	{
+		// Point k carries the Gray code of k
+		bits_per_symbol = 3;
+		for(unsigned k = 0; k < 8; k++)
+			constellation[k ^ (k >> 1)] = sample_fc32(float(cos(M_PI * k / 4)), float(sin(M_PI * k / 4)));
+	}
+	else
+	{
+		std::cout << "Unsupported modulation " << cfg.scheme << std::endl;
+		return true;
+	}
+	config = cfg;
+	sps = size_t(floor(ratio + 0.5));
+	span = config.span;
+
+	// Polyphase taps, the oldest symbol first so that the history is read forwards
+	size_t num_taps = sps * span;
+	std::vector<double> pulse = design_rrc(num_taps, double(sps), config.rolloff);
+	double energy = 0;
+	for(size_t index = 0; index < num_taps; index++)
+		energy += pulse[index] * pulse[index];
+	double gain = config.level * sqrt(sps / energy);
+	double w = 2 * M_PI * config.center_freq / config.rate;
+	shifted = config.center_freq != 0;
+	real_taps.assign(num_taps, 0);
+	complex_taps.assign(shifted ? num_taps : 0, sample_fc32(0, 0));
+	for(size_t k = 0; k < span; k++)
+		for(size_t p = 0; p < sps; p++)
+		{
+			size_t n = (span - 1 - k) * sps + p;
+			real_taps[k * sps + p] = float(pulse[n] * gain);
+			if(shifted)
+				complex_taps[k * sps + p] = sample_fc32(std::polar(pulse[n] * gain, w * n));
+		}
+	phasor_step = std::polar(1.0, w * sps);
+
+	symbols.resize(span - 1 + MOD_CHUNK);
+	work.resize(MOD_CHUNK * sps);
+	reset();
+	return false;
+}
+
+
+void modulator::set_kernels(const dsp_kernel_table * table)
+{
+	kernels = table ? table : &dsp_kernels();
+}
+
+
+/// Forgets the past symbols and the pending bits, restarts the frequency shift at phase 0
+void modulator::reset()
+{
+	std::fill(symbols.begin(), symbols.end(), sample_fc32(0, 0));
+	phasor = std::complex<double>(1, 0);
+	pending = 0;
+	pending_bits = 0;
+	num_symbols = 0;
+	num_samples = 0;
+}
+
+
+/***********************************************************************//**
+Filters the symbols of one pass, which follow the history, and keeps the
+last K - 1 symbols for the next pass
+
+@param count Number of new symbols
+@param out Receives count * L samples
+
+@return Number of samples
+
+***************************************************************************/
+
+template <typename T>
+size_t modulator::filter(size_t count, T * out)
+{
+	sample_fc32 * dst = pass_output(out, work);
+	for(size_t m = 0; m < count; m++)
+	{
+		if(shifted)
+			kernels->fc32_interpolate(&symbols[m], &complex_taps[0], span, sps, dst + m * sps, sps);
+		else
+			kernels->fc32_interpolate_real(&symbols[m], &real_taps[0], span, sps, dst + m * sps, sps);
+	}
+	store_pass(dst, count * sps, out, *kernels);
+	std::copy(symbols.begin() + count, symbols.begin() + count + span - 1, symbols.begin());
+
+	// exp(jwmL) is renormalised once per pass so that its error does not grow
+	phasor /= std::abs(phasor);
+	num_symbols += count;
+	num_samples += count * sps;
+	return count * sps;
+}
+
+
+/***********************************************************************//**
+Modulates bits
+
+@param bits Input bits, one per byte (bit 0)
+@param num_bits Number of bits
+@param out Receives max_output(num_bits) samples at most
+
+@return Number of samples, L per complete symbol
+
+***************************************************************************/
+
+template <typename T>
+size_t modulator::process(const uint8_t * bits, size_t num_bits, T * out)
+{
+	size_t produced = 0;
+	size_t index = 0;
+	while(index < num_bits)
+	{
+		sample_fc32 * next = &symbols[span - 1];
+		size_t count = 0;
+		for(; index < num_bits && count < MOD_CHUNK; index++)
+		{
+			pending = (pending << 1) | (bits[index] & 1);
+			if(++pending_bits < bits_per_symbol)
+				continue;
+			std::complex<double> point(constellation[pending]);
+			next[count++] = sample_fc32(shifted ? point * phasor : point);
+			phasor *= phasor_step;
+			pending = 0;
+			pending_bits = 0;
+		}
+		produced += filter(count, out + produced);
+	}
+	return produced;
+}
+
+
+/***********************************************************************//**
+Ends a burst: completes the last symbol with zero bits, then outputs the
+K - 1 symbol periods of the tail of the filter. The modulator is ready for
+the next burst, the frequency shift keeps its phase
+
+@param out Receives max_flush() samples at most
+
+@return Number of samples
+
+***************************************************************************/
+
+template <typename T>
+size_t modulator::flush(T * out)
+{
+	size_t produced = 0;
+	if(pending_bits)
+	{
+		const uint8_t zeros[3] = {0, 0, 0};
+		produced = process(zeros, bits_per_symbol - pending_bits, out);
+	}
+	size_t tail = span - 1;
+	while(tail)
+	{
+		// Zero symbols, the shift advancing with the time
+		size_t count = std::min(tail, size_t(MOD_CHUNK));
+		std::fill(symbols.begin() + span - 1, symbols.begin() + span - 1 + count, sample_fc32(0, 0));
+		for(size_t m = 0; m < count; m++)
+			phasor *= phasor_step;
+		produced += filter(count, out + produced);
+		tail -= count;
+	}
+	return produced;
+}
+
+
+template size_t modulator::process(const uint8_t * bits, size_t num_bits, sample_sc8 * out);
+template size_t modulator::process(const uint8_t * bits, size_t num_bits, sample_sc16 * out);
+template size_t modulator::process(const uint8_t * bits, size_t num_bits, sample_fc32 * out);
+template size_t modulator::flush(sample_sc8 * out);
+template size_t modulator::flush(sample_sc16 * out);
+template size_t modulator::flush(sample_fc32 * out);
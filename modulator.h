@@ -0,0 +1,126 @@
+/***********************************************************************//**
+@file
+
+Streaming PSK modulator writing the samples of the transmitter
+
+The bits are mapped to BPSK, QPSK or 8PSK symbols, interpolated by a
+root raised cosine filter in polyphase form and optionally shifted in
+frequency. The prototype h of L * K taps (L samples per symbol, a span
+of K symbols) is split into the L phases e_p[k] = h[kL + p]: the L
+samples of symbol m are
+
+y[mL + p] = sum_k s[m - k] h[kL + p]
+
+so each output sample costs K multiplications instead of the L * K of
+a filter run on the zero-stuffed symbols. The frequency shift is moved
+onto the filter like the frequency-translating FIR of the DDC: with the
+taps h[n] exp(jwn) and the symbol m multiplied by exp(jwmL), the filter
+output is the shifted signal, and the shift costs one complex
+multiplication per symbol instead of one per sample.
+
+***************************************************************************/
+
+#ifndef MODULATOR_H
+#define MODULATOR_H
+
+#include <complex>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+#include "sample_format.h"
+#include "block_pool.h"
+#include "dsp_kernels.h"
+
+/// Symbols mapped and filtered per pass: bounds the work buffer of the integer outputs
+#define MOD_CHUNK 64
+
+
+/// Configuration of the modulator
+struct mod_config
+{
+	mod_config() : rate(125000), symbol_rate(12500), scheme("qpsk"), rolloff(0.35), span(8), center_freq(0), level(0.25) {}
+
+	double rate;				/// Output sample rate in samples/s, an integer multiple of symbol_rate
+	double symbol_rate;			/// Symbol rate in symbols/s
+	std::string scheme;			/// "bpsk", "qpsk" or "8psk"
+	double rolloff;				/// Excess bandwidth of the root raised cosine pulse
+	size_t span;				/// Length of the pulse in symbols
+	double center_freq;			/// Frequency of the signal in the output in Hz
+	double level;				/// RMS level of the output (fraction of full scale)
+};
+
+
+/***********************************************************************//**
+PSK modulator
+
+The bits are one per byte (the output of conv_encoder), the first bit of
+a symbol being its most significant one. The mapping is the one of
+qpsk_demodulator: for QPSK the first bit gives the sign of I and the
+second the sign of Q, a 1 being negative; BPSK is the I component alone;
+8PSK is Gray coded, the neighbouring points differing by one bit.
+
+process() accepts any number of bits and keeps the bits of an
+incomplete symbol and the last K - 1 symbols for the next call, so the
+samples do not depend on how the bits are cut into blocks. The samples
+are written directly to the output, typically a block of the transmit
+task: fc32 without any copy, sc16 and sc8 through a work buffer of
+MOD_CHUNK symbols which stays in the cache. sc16 is also the sample of
+input_buf_t, so the blocks can be fed to the receive stages for a
+loopback. flush() ends a burst: it pads the last symbol with zero bits
+and lets the filter ring down.
+
+The modulator does not allocate once configured.
+
+***************************************************************************/
+class modulator
+{
+public:
+	modulator();
+	bool configure(const mod_config & config);
+	/// Uses the kernels of another table (benchmarks). NULL for dsp_kernels()
+	void set_kernels(const dsp_kernel_table * table);
+	void reset();
+
+	/// Samples per symbol
+	size_t get_sps() const {return sps;}
+	size_t get_bits_per_symbol() const {return bits_per_symbol;}
+	/// Maximum number of samples produced from num_bits bits
+	size_t max_output(size_t num_bits) const {return (num_bits / bits_per_symbol + 1) * sps;}
+	/// Maximum number of samples produced by flush()
+	size_t max_flush() const {return span * sps;}
+
+	template <typename T>
+	size_t process(const uint8_t * bits, size_t num_bits, T * out);
+	template <typename T>
+	size_t flush(T * out);
+
+	uint64_t get_num_symbols() const {return num_symbols;}
+	uint64_t get_num_samples() const {return num_samples;}
+	const char * get_kernel_name() const {return kernels->name;}
+
+private:
+	template <typename T>
+	size_t filter(size_t count, T * out);
+
+	mod_config config;
+	const dsp_kernel_table * kernels;
+	size_t sps;					/// L
+	size_t span;				/// K
+	size_t bits_per_symbol;
+	sample_fc32 constellation[8];	/// Point of each value of the bits of a symbol
+	bool shifted;				/// Complex taps for a frequency shift, real ones otherwise
+	float_buffer real_taps;		/// real_taps[k * L + p] = h[(K - 1 - k) * L + p], scaled to the level
+	fc32_buffer complex_taps;	/// Same rotated by exp(jwn)
+	std::complex<double> phasor;	/// exp(jwmL) of the next symbol
+	std::complex<double> phasor_step;	/// exp(jwL)
+	fc32_buffer symbols;		/// Last K - 1 symbols, followed by those of the pass
+	fc32_buffer work;			/// Float samples of one pass for the integer outputs
+	unsigned pending;			/// Bits of the incomplete symbol, the first one highest
+	size_t pending_bits;		/// Number of bits in pending
+	uint64_t num_symbols;
+	uint64_t num_samples;
+};
+
+
+#endif
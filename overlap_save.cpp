@@ -0,0 +1,145 @@
+#include "overlap_save.h"
+#include "dsp_kernels.h"
+#include <cmath>
+#include <iostream>
+
+
+/// Largest transform considered by choose_fft_size()
+#define MAX_FFT_SIZE 65536
+
+
+/***********************************************************************//**
+Chooses the transform size with the lowest cost per output sample
+
+Each frame costs two transforms of N log2(N) butterflies plus N complex
+products, and gives N - L + 1 outputs. The minimum is usually between 4L
+and 8L.
+
+@param num_taps Length of the filter
+
+@return FFT size, 0 if the filter is too long
+
+***************************************************************************/
+
+size_t overlap_save_filter::choose_fft_size(size_t num_taps)
+{
+	size_t best = 0;
+	double best_cost = 0;
+	for(size_t size = 2; size <= MAX_FFT_SIZE; size *= 2)
+	{
+		if(size < num_taps)
+			continue;
+		double cost = (2 * size * log2(double(size)) + size) / double(size - num_taps + 1);
+		if(best == 0 || cost < best_cost)
+		{
+			best = size;
+			best_cost = cost;
+		}
+	}
+	return best;
+}
+
+
+/***********************************************************************//**
+Computes the spectrum of the filter
+
+@param taps Coefficients of the filter, h[0] first
+@param fft_size Size of the transforms, a power of two larger than the
+filter. 0 to choose it with choose_fft_size()
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool overlap_save_filter::configure(const std::vector<sample_fc32> & taps, size_t fft_size)
+{
+	if(taps.empty())
+	{
+		std::cout << "Overlap-save filter without taps" << std::endl;
+		return true;
+	}
+	size_t size = fft_size ? fft_size : choose_fft_size(taps.size());
+	if(size < taps.size())
+	{
+		std::cout << "FFT size " << size << " too small for " << taps.size() << " taps" << std::endl;
+		return true;
+	}
+	forward = fft_get_plan(size, false);
+	inverse = fft_get_plan(size, true);
+	if(forward == NULL || inverse == NULL)
+		return true;
+
+	num_taps = taps.size();
+	spectrum.assign(size, sample_fc32(0, 0));
+	for(size_t k = 0; k < num_taps; k++)
+		spectrum[k] = taps[k] / float(size);
+	forward->execute(&spectrum[0], &spectrum[0]);
+	work.resize(size);
+	reset();
+	return false;
+}
+
+
+bool overlap_save_filter::configure(const std::vector<double> & taps, size_t fft_size)
+{
+	std::vector<sample_fc32> complex_taps(taps.size());
+	for(size_t k = 0; k < taps.size(); k++)
+		complex_taps[k] = sample_fc32(float(taps[k]), 0);
+	return configure(complex_taps, fft_size);
+}
+
+
+/// Forgets the past inputs
+void overlap_save_filter::reset()
+{
+	frame.assign(spectrum.size(), sample_fc32(0, 0));
+	fill = num_taps - 1;
+}
+
+
+/***********************************************************************//**
+Filters one block
+
+@param in Input samples, in any host format of the sampling task
+@param num_samps Number of input samples
+@param out Receives max_output(num_samps) samples at most
+
+@return Number of output samples, the outputs of the frames completed by
+this block
+
+***************************************************************************/
+
+template <typename T>
+size_t overlap_save_filter::process(const T * in, size_t num_samps, sample_fc32 * out)
+{
+	const sample_fc32 * data = dsp_as_fc32(in, num_samps, converted);
+	const size_t size = spectrum.size();
+	const size_t overlap = num_taps - 1;
+	size_t count = 0;
+	size_t pos = 0;
+	while(pos < num_samps)
+	{
+		size_t n = size - fill < num_samps - pos ? size - fill : num_samps - pos;
+		std::copy(data + pos, data + pos + n, frame.begin() + fill);
+		fill += n;
+		pos += n;
+		if(fill < size)
+			break;
+
+		forward->execute(&frame[0], &work[0]);
+		dsp_fc32_multiply(&work[0], &spectrum[0], &work[0], size);
+		inverse->execute(&work[0], &work[0]);
+		// The first L - 1 outputs are circular wrap-around, the others are valid
+		std::copy(work.begin() + overlap, work.end(), out + count);
+		count += size - overlap;
+
+		std::copy(frame.end() - overlap, frame.end(), frame.begin());
+		fill = overlap;
+	}
+	return count;
+}
+
+
+template size_t overlap_save_filter::process(const sample_sc8 * in, size_t num_samps, sample_fc32 * out);
+template size_t overlap_save_filter::process(const sample_sc16 * in, size_t num_samps, sample_fc32 * out);
+template size_t overlap_save_filter::process(const sample_fc32 * in, size_t num_samps, sample_fc32 * out);
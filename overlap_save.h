@@ -0,0 +1,61 @@
+/***********************************************************************//**
+@file
+
+Overlap-save fast convolution for the long filters (matched filters,
+band-limiting filters)
+
+The input is cut into FFT frames of N samples overlapping by L - 1, the
+length of the filter. Each frame is transformed, multiplied by the
+spectrum of the filter and transformed back; the last N - L + 1 samples
+are the filter outputs. Above about 64 taps this costs far less per
+sample than the direct form.
+
+The outputs are those of the direct form y[n] = sum h[k] x[n - k] with
+a zero history, but they are delivered one frame at a time: the delay
+between an input and its output is at most N - L samples.
+
+***************************************************************************/
+
+#ifndef OVERLAP_SAVE_H
+#define OVERLAP_SAVE_H
+
+#include <vector>
+#include <cstddef>
+#include "sample_format.h"
+#include "block_pool.h"
+#include "fft.h"
+
+
+class overlap_save_filter
+{
+public:
+	typedef sample_fc32 output_type;
+
+	overlap_save_filter() : forward(NULL), inverse(NULL), num_taps(0), fill(0) {}
+	bool configure(const std::vector<sample_fc32> & taps, size_t fft_size = 0);
+	bool configure(const std::vector<double> & taps, size_t fft_size = 0);
+	void reset();
+	/// Maximum number of outputs produced from num_samps inputs
+	size_t max_output(size_t num_samps) const {return num_samps + get_step();}
+	size_t get_fft_size() const {return spectrum.size();}
+	/// Number of outputs of each frame
+	size_t get_step() const {return spectrum.size() - num_taps + 1;}
+
+	static size_t choose_fft_size(size_t num_taps);
+
+	template <typename T>
+	size_t process(const T * in, size_t num_samps, sample_fc32 * out);
+
+private:
+	const fft_plan * forward;	/// Cached plans, see fft_get_plan()
+	const fft_plan * inverse;
+	size_t num_taps;			/// L
+	fc32_buffer spectrum;	/// Spectrum of the filter, divided by N
+	fc32_buffer frame;	/// L - 1 past inputs followed by the new ones
+	size_t fill;				/// Number of samples in frame
+	fc32_buffer work;	/// Transform of the frame
+	fc32_buffer converted;	/// Integer input converted to float
+};
+
+
+#endif
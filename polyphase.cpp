@@ -0,0 +1,196 @@
+#include "polyphase.h"
+#include "dsp_kernels.h"
+#include <iostream>
+
+
+/***********************************************************************//**
+Splits the prototype filter into the branches
+
+@param branches Number of branches M (decimation factor)
+@param taps Prototype low-pass filter, designed at the input rate
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool polyphase_bank::configure(size_t branches, const std::vector<double> & taps)
+{
+	if(branches == 0 || taps.empty())
+	{
+		std::cout << "Polyphase filter needs at least one branch and one tap" << std::endl;
+		return true;
+	}
+	num_branches = branches;
+	taps_per_branch = (taps.size() + branches - 1) / branches;
+	coeffs.assign(taps_per_branch * num_branches, 0.0f);
+	for(size_t n = 0; n < taps.size(); n++)
+		coeffs[n] = float(taps[n]);
+	branch_out.resize(num_branches);
+	reset();
+	return false;
+}
+
+
+void polyphase_bank::reset()
+{
+	frames.assign(taps_per_branch * num_branches, sample_fc32(0, 0));
+	newest = 0;
+	frame_pos = 0;
+}
+
+
+/***********************************************************************//**
+Deals the samples to the branches until a frame is complete
+
+Sample j of frame m (input mM + j) goes to branch M-1-j, so that branch p
+holds x[mM + M-1 - p].
+
+@param in Input samples
+@param num_samps Number of input samples
+@param consumed Receives the number of input samples used
+
+@return Outputs of the M branches when a frame was completed, NULL
+otherwise. Valid until the next call
+
+***************************************************************************/
+
+const sample_fc32 * polyphase_bank::push(const sample_fc32 * in, size_t num_samps, size_t & consumed)
+{
+	const size_t M = num_branches;
+	const size_t K = taps_per_branch;
+	sample_fc32 * frame = &frames[newest * M];
+	size_t count = M - frame_pos < num_samps ? M - frame_pos : num_samps;
+	for(size_t n = 0; n < count; n++)
+		frame[M - 1 - frame_pos - n] = in[n];
+	frame_pos += count;
+	consumed = count;
+	if(frame_pos < M)
+		return NULL;
+
+	// Branch p: sum over k of e_p[k] times its sample k frames ago
+	sample_fc32 * v = &branch_out[0];
+	for(size_t p = 0; p < M; p++)
+		v[p] = sample_fc32(0, 0);
+	for(size_t k = 0; k < K; k++)
+	{
+		const sample_fc32 * past = &frames[((newest + K - k) % K) * M];
+		const float * e = &coeffs[k * M];
+		for(size_t p = 0; p < M; p++)
+			v[p] += past[p] * e[p];
+	}
+	newest = (newest + 1) % K;
+	frame_pos = 0;
+	return v;
+}
+
+
+/***********************************************************************//**
+Filters and decimates one block
+
+@param in Input samples, in any host format of the sampling task
+@param num_samps Number of input samples
+@param out Receives max_output(num_samps) samples at most
+
+@return Number of output samples
+
+***************************************************************************/
+
+template <typename T>
+size_t pfb_decimator::process(const T * in, size_t num_samps, sample_fc32 * out)
+{
+	const sample_fc32 * data = dsp_as_fc32(in, num_samps, converted);
+	size_t branches = bank.get_branches();
+	size_t count = 0;
+	size_t pos = 0;
+	while(pos < num_samps)
+	{
+		size_t consumed;
+		const sample_fc32 * v = bank.push(data + pos, num_samps - pos, consumed);
+		pos += consumed;
+		if(v == NULL)
+			continue;
+		sample_fc32 sum(0, 0);
+		for(size_t p = 0; p < branches; p++)
+			sum += v[p];
+		out[count++] = sum;
+	}
+	return count;
+}
+
+
+/***********************************************************************//**
+Prepares the channelizer
+
+@param input_rate Sample rate of the input in samples/s
+@param num_channels Number of channels M, a power of two
+@param taps Prototype low-pass filter at the input rate, normally cut at
+rate / (2M)
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool pfb_channelizer::configure(double input_rate, size_t num_channels, const std::vector<double> & taps)
+{
+	ifft = fft_get_plan(num_channels, true);
+	if(ifft == NULL || bank.configure(num_channels, taps))
+		return true;
+	rate = input_rate;
+	spectrum.resize(num_channels);
+	return false;
+}
+
+
+double pfb_channelizer::get_channel_freq(size_t channel) const
+{
+	size_t M = bank.get_branches();
+	double freq = double(channel % M) * rate / M;
+	return freq >= rate / 2 ? freq - rate : freq;
+}
+
+
+/***********************************************************************//**
+Splits one block into the channels
+
+@param in Input samples, in any host format of the sampling task
+@param num_samps Number of input samples
+@param out One buffer per channel, each receiving max_output(num_samps)
+samples at most
+
+@return Number of output samples in each channel
+
+***************************************************************************/
+
+template <typename T>
+size_t pfb_channelizer::process(const T * in, size_t num_samps, sample_fc32 * const * out)
+{
+	const sample_fc32 * data = dsp_as_fc32(in, num_samps, converted);
+	size_t M = bank.get_branches();
+	size_t count = 0;
+	size_t pos = 0;
+	while(pos < num_samps)
+	{
+		size_t consumed;
+		const sample_fc32 * v = bank.push(data + pos, num_samps - pos, consumed);
+		pos += consumed;
+		if(v == NULL)
+			continue;
+		// Branch p is delayed by p + 1 samples from the end of the frame:
+		// moving it to bin p + 1 turns the inverse FFT into the channel mixers
+		for(size_t p = 0; p < M; p++)
+			spectrum[(p + 1) % M] = v[p];
+		ifft->execute(&spectrum[0], &spectrum[0]);
+		for(size_t c = 0; c < M; c++)
+			out[c][count] = spectrum[c];
+		count++;
+	}
+	return count;
+}
+
+
+template size_t pfb_decimator::process(const sample_sc8 * in, size_t num_samps, sample_fc32 * out);
+template size_t pfb_decimator::process(const sample_sc16 * in, size_t num_samps, sample_fc32 * out);
+template size_t pfb_decimator::process(const sample_fc32 * in, size_t num_samps, sample_fc32 * out);
+template size_t pfb_channelizer::process(const sample_sc8 * in, size_t num_samps, sample_fc32 * const * out);
+template size_t pfb_channelizer::process(const sample_sc16 * in, size_t num_samps, sample_fc32 * const * out);
+template size_t pfb_channelizer::process(const sample_fc32 * in, size_t num_samps, sample_fc32 * const * out);
@@ -0,0 +1,119 @@
+/***********************************************************************//**
+@file
+
+Polyphase decimating FIR and polyphase FFT channelizer
+
+The prototype low-pass filter h of a decimation by M is split into M
+branches e_p[k] = h[kM + p]. The input is dealt to the branches by a
+commutator, one frame of M samples per output, and every branch runs at
+the output rate. Summing the branches gives the decimating FIR; an
+inverse FFT over the branches instead gives the M channels centred on
+c * rate / M, all from the same branch outputs:
+
+y_c[m] = sum_n h[n] x[mM + M-1 - n] exp(-2 pi j c (mM + M-1 - n) / M)
+
+which is the output of a mixer at -c * rate / M followed by the FIR and
+the decimation, at the instants used by the baseband chains. One input
+sample costs h.size() / M multiplications plus log2(M) for the FFT,
+instead of M mixers and filters.
+
+The channelizer is critically sampled: the channels are adjacent and a
+signal in the transition band of the prototype appears in both
+neighbouring channels.
+
+***************************************************************************/
+
+#ifndef POLYPHASE_H
+#define POLYPHASE_H
+
+#include <vector>
+#include <cstddef>
+#include "sample_format.h"
+#include "block_pool.h"
+#include "fft.h"
+
+
+/***********************************************************************//**
+Commutator and branch filters shared by the decimator and the channelizer
+
+***************************************************************************/
+class polyphase_bank
+{
+public:
+	polyphase_bank() : num_branches(0), taps_per_branch(0), newest(0), frame_pos(0) {}
+	bool configure(size_t branches, const std::vector<double> & taps);
+	void reset();
+	const sample_fc32 * push(const sample_fc32 * in, size_t num_samps, size_t & consumed);
+	size_t get_branches() const {return num_branches;}
+
+private:
+	size_t num_branches;		/// M, also the decimation
+	size_t taps_per_branch;		/// K, the prototype is padded with zeros to K * M taps
+	float_buffer coeffs;	/// coeffs[k * M + p] = h[k * M + p]
+	fc32_buffer frames;	/// Last K frames, frame f at f * M
+	size_t newest;				/// Frame being filled
+	size_t frame_pos;			/// Number of samples already in this frame
+	fc32_buffer branch_out;	/// Output of the branches for the last frame
+};
+
+
+/***********************************************************************//**
+Decimating FIR in polyphase form
+
+Same output as the filter of the baseband chains (FIR then keep one
+sample out of M), with the arithmetic of a filter at the output rate.
+
+***************************************************************************/
+class pfb_decimator
+{
+public:
+	typedef sample_fc32 output_type;
+
+	bool configure(size_t decimation, const std::vector<double> & taps) {return bank.configure(decimation, taps);}
+	void reset() {bank.reset();}
+	size_t max_output(size_t num_samps) const {return num_samps / bank.get_branches() + 1;}
+
+	template <typename T>
+	size_t process(const T * in, size_t num_samps, sample_fc32 * out);
+
+private:
+	polyphase_bank bank;
+	fc32_buffer converted;	/// Integer input converted to float
+};
+
+
+/***********************************************************************//**
+Polyphase FFT channelizer: splits one stream into M channels, each
+decimated by M
+
+Channel c is centred on c * rate / M (the channels above M / 2 are the
+negative frequencies). Each output buffer receives the samples of one
+channel, to be handed to its own demodulator.
+
+***************************************************************************/
+class pfb_channelizer
+{
+public:
+	pfb_channelizer() : rate(0), ifft(NULL) {}
+	bool configure(double input_rate, size_t num_channels, const std::vector<double> & taps);
+	void reset() {bank.reset();}
+	size_t get_channels() const {return bank.get_branches();}
+	/// Centre frequency of a channel in Hz, between -rate / 2 and rate / 2
+	double get_channel_freq(size_t channel) const;
+	double get_output_rate() const {return rate / bank.get_branches();}
+	/// Maximum number of outputs per channel produced from num_samps inputs
+	size_t max_output(size_t num_samps) const {return num_samps / bank.get_branches() + 1;}
+
+	template <typename T>
+	size_t process(const T * in, size_t num_samps, sample_fc32 * const * out);
+
+private:
+	double rate;				/// Input sample rate
+	polyphase_bank bank;
+	const fft_plan * ifft;		/// Inverse transform over the branches (cached plan)
+	fc32_buffer spectrum;	/// Input then output of the transform
+	fc32_buffer converted;
+};
+
+
+#endif
@@ -8,9 +8,24 @@
 #include <csignal>
 #include <fstream>
 #include <cmath>
+#include <cstring>
+#include <cstdlib>
 #include "uhd_utilities.h"
 #include <pthread.h>
 #include "task_sampling.h"
+#include "task_transmit.h"
+#include "uhd_source.h"
+#include "file_source.h"
+#include "sim_source.h"
+#include "uhd_sink.h"
+#include "sim_sink.h"
+#include "ddc.h"
+#include "demodulator.h"
+#include "frame_sync.h"
+#include "viterbi.h"
+#include "polyphase.h"
+#include "baseband.h"
+#include "modulator.h"
 
 bool stop_signal_called = false;
 
@@ -21,6 +36,426 @@ void sig_int_handler(int) {stop_signal_called = true;}
 #define MAIN_ERROR_SAMPLING_TASK_NOT_CREATED 1 ;
 
 
+/// Options of the command line
+struct test_options
+{
+	test_options() : mlock(false), consumer_policy(FANOUT_DROP), pool_mb(0), replay_file(NULL), simulate(false), paced(true),
+		inject_blocks(0), inject_samps(0), cpu_format("sc16"), otw_format("sc16"), latency_ms(80), spp(0), frame_size(NULL),
+		ddc_freq(0), ddc_decim(0), num_channels(0), demod_freq(0), symbol_rate(0), fec_rate(NULL), sync_freq(0), sync_symbol_rate(0),
+		transmit(false), tx_tone(0), tx_symbol_rate(12500) {}
+
+	thread_rt_config rx_rt;		/// Real-time settings of the sampling thread
+	thread_rt_config writer_rt;	/// Real-time settings of the capture writer thread
+	thread_rt_config tx_rt;		/// Real-time settings of the transmit thread
+	bool mlock;					/// True to lock the memory of the process
+	fanout_policy consumer_policy;	/// Policy of the sampling task when this program is late
+	block_pool_config pool_config;	/// Pool of the blocks and the DSP buffers
+	size_t pool_mb;				/// Size of the pool in MB, 0 for no pool
+	const char * replay_file;	/// Capture file replayed instead of the USRP, or NULL
+	bool simulate;				/// True for the synthetic signal instead of the USRP
+	bool paced;					/// False to run the replay or the simulation as fast as possible
+	size_t inject_blocks;		/// Blocks between two injected overflows, 0 for none
+	size_t inject_samps;		/// Samples lost by each injected overflow
+	const char * cpu_format;	/// Host format: "sc8", "sc16" or "fc32"
+	const char * otw_format;	/// Over the wire format: "sc8" or "sc16"
+	double latency_ms;			/// Latency budget of one block in ms
+	size_t spp;					/// Samples per transport packet, 0 for the default of the device
+	const char * frame_size;	/// Size in bytes of the receive frames of the transport, or NULL
+	double ddc_freq;			/// Shift of the host DDC in Hz
+	size_t ddc_decim;			/// Decimation of the host DDC, 0 for no DDC
+	size_t num_channels;		/// Channels of the channelizer, 0 for no channelizer
+	double demod_freq;			/// Frequency of the demodulated QPSK signal in Hz
+	double symbol_rate;			/// Symbol rate of the demodulator, 0 for no demodulator
+	const char * fec_rate;		/// Code rate of the Viterbi decoder, or NULL for no decoder
+	double sync_freq;			/// Frequency of the bursts searched by the frame sync in Hz
+	double sync_symbol_rate;	/// Symbol rate of the bursts, 0 for no frame sync
+	squelch_config squelch;		/// Squelch of the sampling task
+	bool transmit;				/// True to transmit while receiving
+	double tx_tone;				/// Frequency of the tone or of the modulated signal in Hz
+	std::string tx_scheme;		/// Modulation of the transmitted PRBS, empty for a tone
+	double tx_symbol_rate;		/// Symbol rate of the transmitted PRBS
+};
+
+
+/// Displays the preambles found by the frame sync
+static void print_frames(const frame_detection * detections, size_t count)
+{
+	for(size_t d = 0; d < count; d++)
+		printf("Frame at sample %llu, %.6f s, %.1f Hz, metric %.2f\n", (unsigned long long)detections[d].sample,
+			detections[d].time_spec.get_real_secs(), detections[d].freq_offset, detections[d].metric);
+}
+
+
+/// Queues blocks of a tone at half of full scale until the transmit ring is full
+template <typename T>
+static void top_up_tone(task_transmit_t<T> & tx, std::complex<double> & phasor, const std::complex<double> & step)
+{
+	typename task_transmit_t<T>::block_t * block;
+	while((block = tx.acquire_block(0)) != NULL)
+	{
+		for(size_t index = 0; index < block->capacity; index++)
+		{
+			store_sample(block->samples[index], 0.5 * phasor.real(), 0.5 * phasor.imag());
+			phasor *= step;
+		}
+		phasor /= std::abs(phasor);
+		block->num_samps = block->capacity;
+		tx.publish_block();
+	}
+}
+
+
+/// Queues blocks of modulated PRBS15 bits until the transmit ring is full.
+/// The modulator writes the whole symbols which fit in each block
+template <typename T>
+static void top_up_modulated(task_transmit_t<T> & tx, modulator & mod, std::vector<uint8_t> & bits, unsigned & prbs)
+{
+	typename task_transmit_t<T>::block_t * block;
+	while((block = tx.acquire_block(0)) != NULL)
+	{
+		for(size_t index = 0; index < bits.size(); index++)
+		{
+			unsigned bit = ((prbs >> 14) ^ (prbs >> 13)) & 1;
+			prbs = ((prbs << 1) | bit) & 0x7fff;
+			bits[index] = uint8_t(bit);
+		}
+		block->num_samps = mod.process(&bits[0], bits.size(), block->samples);
+		tx.publish_block();
+	}
+}
+
+
+/***********************************************************************//**
+Runs the sampling task in the host format T until CTRL+C is pressed or
+the source ends, then displays the statistics of the stream
+
+The processing is selected by the fields of options. When ddc_decim is
+not 0 the blocks are down-converted in the host by ddc_freq Hz and
+decimated by ddc_decim. When num_channels is not 0 they
+are split into num_channels channels by the polyphase channelizer. When
+symbol_rate is not 0 the QPSK signal at demod_freq Hz is demodulated, and
+its soft bits are decoded when fec_rate is not NULL. When
+sync_symbol_rate is not 0 the preambles of the bursts at sync_freq Hz are
+searched. When the squelch is enabled only the blocks of the bursts reach
+this processing and the capture file. With consumer_policy FANOUT_BLOCK
+the sampling task waits for this loop instead of dropping blocks. When
+tx_sink is not NULL a tone at tx_tone Hz, or a PRBS modulated in
+tx_scheme at tx_symbol_rate centred on tx_tone Hz, is transmitted at the
+same time (full duplex): this loop tops up the ring of the transmit task
+after each received block.
+
+@return 0 or MAIN_ERROR_xxx
+
+***************************************************************************/
+template <typename T>
+int run_sampling(sample_source & source, size_t samps_per_buf, size_t num_bufs, sample_sink * tx_sink, const test_options & options)
+{
+	//-----------------------------------------------
+	// Start the rx sampling task
+	//-----------------------------------------------
+	task_sampling_t<T> rx_task(source, samps_per_buf, num_bufs);
+	if(rx_task.set_otw_format(options.otw_format))
+		return MAIN_ERROR_SAMPLING_TASK_NOT_CREATED;
+	rx_task.set_rt_config(options.rx_rt);
+	rx_task.set_writer_rt_config(options.writer_rt);
+	rx_task.set_consumer_policy(options.consumer_policy);
+	rx_task.set_squelch_config(options.squelch);
+	if(rx_task.start())
+	{
+		// An error occurred
+		std::cout << "Rx sampling task could not be created" << std::endl;
+		return MAIN_ERROR_SAMPLING_TASK_NOT_CREATED;
+	}
+
+	// Transmit task, prefilled with half of its ring before it starts
+	task_transmit_t<T> * tx_task = NULL;
+	std::complex<double> tx_phasor(1, 0);
+	std::complex<double> tx_step(1, 0);
+	modulator * tx_mod = NULL;
+	std::vector<uint8_t> tx_bits;
+	unsigned tx_prbs = 1;
+	if(tx_sink && !options.tx_scheme.empty())
+	{
+		mod_config mod_cfg;
+		mod_cfg.rate = tx_sink->get_rate();
+		mod_cfg.symbol_rate = options.tx_symbol_rate;
+		mod_cfg.scheme = options.tx_scheme;
+		mod_cfg.center_freq = options.tx_tone;
+		tx_mod = new modulator;
+		if(tx_mod->configure(mod_cfg))
+		{
+			// Nothing to transmit
+			delete tx_mod;
+			tx_mod = NULL;
+			tx_sink = NULL;
+		}
+		else
+			tx_bits.resize(samps_per_buf / tx_mod->get_sps() * tx_mod->get_bits_per_symbol());
+	}
+	if(tx_sink)
+	{
+		tx_task = new task_transmit_t<T>(*tx_sink, samps_per_buf, num_bufs, num_bufs / 2);
+		tx_task->set_rt_config(options.tx_rt);
+		if(tx_task->set_otw_format(options.otw_format) || tx_sink->prepare())
+		{
+			delete tx_task;
+			tx_task = NULL;
+		}
+		else
+		{
+			tx_step = std::polar(1.0, 2 * M_PI * options.tx_tone / tx_sink->get_rate());
+			if(tx_mod)
+				top_up_modulated(*tx_task, *tx_mod, tx_bits, tx_prbs);
+			else
+				top_up_tone(*tx_task, tx_phasor, tx_step);
+			if(tx_task->start())
+			{
+				std::cout << "Tx task could not be created" << std::endl;
+				delete tx_task;
+				tx_task = NULL;
+			}
+			else if(tx_mod)
+				std::cout << "Transmitter: " << options.tx_scheme << " at " << options.tx_tone << " Hz, " << options.tx_symbol_rate << " symbols/s, "
+					<< tx_sink->get_rate() << " samples/s, " << tx_mod->get_kernel_name() << " kernels" << std::endl;
+			else
+				std::cout << "Transmitter: tone at " << options.tx_tone << " Hz, " << tx_sink->get_rate() << " samples/s" << std::endl;
+		}
+	}
+
+	// Host DDC: 8 taps per output sample, pass band of 80% of the output rate
+	ddc_stage * ddc = NULL;
+	fc32_buffer ddc_out;
+	uint64_t ddc_samples = 0;
+	if(options.ddc_decim)
+	{
+		double rate = source.get_rate();
+		ddc = new ddc_stage(rate, options.ddc_decim, design_lowpass(8 * options.ddc_decim + 1, 0.4 * rate / options.ddc_decim, rate));
+		ddc->set_frequency(options.ddc_freq);
+		ddc_out.resize(ddc->max_output(samps_per_buf));
+		std::cout << "Host DDC: " << options.ddc_freq << " Hz, " << ddc->get_output_rate() << " samples/s" << std::endl;
+	}
+
+	// Channelizer: one output buffer per channel, each for its own demodulator
+	pfb_channelizer * channelizer = NULL;
+	std::vector<fc32_buffer> channels;
+	std::vector<sample_fc32 *> channel_out;
+	uint64_t channel_samples = 0;
+	if(options.num_channels)
+	{
+		double rate = source.get_rate();
+		channelizer = new pfb_channelizer;
+		if(channelizer->configure(rate, options.num_channels, design_lowpass(8 * options.num_channels, 0.5 * rate / options.num_channels, rate)))
+		{
+			delete channelizer;
+			channelizer = NULL;
+		}
+		else
+		{
+			channels.assign(options.num_channels, fc32_buffer(channelizer->max_output(samps_per_buf)));
+			for(size_t c = 0; c < options.num_channels; c++)
+				channel_out.push_back(&channels[c][0]);
+			std::cout << "Channelizer: " << options.num_channels << " channels of " << channelizer->get_output_rate() << " samples/s" << std::endl;
+		}
+	}
+
+	// Demodulator: symbols and soft bits of each block
+	qpsk_demodulator * demod = NULL;
+	fc32_buffer symbols;
+	pool_vector<int8_t>::type soft_bits;
+	if(options.symbol_rate > 0)
+	{
+		demod_config config;
+		config.rate = source.get_rate();
+		config.center_freq = options.demod_freq;
+		config.symbol_rate = options.symbol_rate;
+		demod = new qpsk_demodulator;
+		if(demod->configure(config))
+		{
+			delete demod;
+			demod = NULL;
+		}
+		else
+		{
+			symbols.resize(demod->max_output(samps_per_buf));
+			soft_bits.resize(2 * symbols.size());
+			std::cout << "Demodulator: QPSK at " << options.demod_freq << " Hz, " << options.symbol_rate << " symbols/s" << std::endl;
+		}
+	}
+
+	// Viterbi decoder of the soft bits of the demodulator
+	viterbi_decoder * fec = NULL;
+	pool_vector<uint8_t>::type decoded;
+	uint64_t fec_ns = 0;
+	if(demod && options.fec_rate != NULL)
+	{
+		viterbi_config config;
+		config.rate = options.fec_rate;
+		fec = new viterbi_decoder;
+		if(fec->configure(config))
+		{
+			delete fec;
+			fec = NULL;
+		}
+		else
+		{
+			decoded.resize(fec->max_output(soft_bits.size()));
+			std::cout << "FEC: K=7 rate " << options.fec_rate << ", " << fec->get_kernel_name() << " kernels" << std::endl;
+		}
+	}
+
+	// Frame sync: preambles found in each block
+	frame_sync * sync = NULL;
+	pool_vector<frame_detection>::type detections;
+	uint64_t num_frames = 0;
+	if(options.sync_symbol_rate > 0)
+	{
+		frame_sync_config config;
+		config.rate = source.get_rate();
+		config.center_freq = options.sync_freq;
+		config.symbol_rate = options.sync_symbol_rate;
+		sync = new frame_sync;
+		if(sync->configure(config))
+		{
+			delete sync;
+			sync = NULL;
+		}
+		else
+		{
+			detections.resize(sync->max_output(samps_per_buf));
+			std::cout << "Frame sync: preamble of " << sync->get_preamble_samps() << " samples at " << options.sync_freq << " Hz, FFT of "
+				<< sync->get_fft_size() << " points, " << sync->get_num_hypotheses() << " frequency hypotheses" << std::endl;
+		}
+	}
+	
+	//------------------------------------------------
+	//  Consume the blocks until CTRL+C is pressed or the source ends
+	//------------------------------------------------
+	while(!stop_signal_called)
+	{
+		const typename task_sampling_t<T>::block_t * block = rx_task.wait_buffer(1000);
+		if(tx_task && tx_mod)
+			top_up_modulated(*tx_task, *tx_mod, tx_bits, tx_prbs);
+		else if(tx_task)
+			top_up_tone(*tx_task, tx_phasor, tx_step);
+		if(block == NULL)
+		{
+			if(rx_task.get_fanout().is_closed())
+				break;
+			continue;
+		}
+		// Processing of block->samples[0 .. block->num_samps-1] goes here
+		if(ddc)
+			ddc_samples += ddc->process(block->samples, block->num_samps, &ddc_out[0]);
+		if(channelizer)
+			channel_samples += channelizer->process(block->samples, block->num_samps, &channel_out[0]);
+		if(demod)
+		{
+			size_t count = demod->process(block->samples, block->num_samps, &symbols[0], &soft_bits[0]);
+			if(fec)
+			{
+				uint64_t start = thread_cpu_ns();
+				fec->process(&soft_bits[0], 2 * count, &decoded[0]);
+				fec_ns += thread_cpu_ns() - start;
+			}
+		}
+		if(sync)
+		{
+			size_t count = sync->process(block->samples, block->num_samps, block->first_sample, block->md, &detections[0]);
+			print_frames(&detections[0], count);
+			num_frames += count;
+		}
+		rx_task.release_buffer();
+	}
+	rx_task.stop();
+	if(tx_task)
+		tx_task->finish();
+
+	//------------------------------------------------
+	//  Wait for thread completion
+	//------------------------------------------------
+	void * exit_status;
+	int res = pthread_join(rx_task.get_tid(), & exit_status); // Exit status in *status_ptr
+	if(tx_task)
+	{
+		pthread_join(tx_task->get_tid(), & exit_status);
+		tx_task->print_stats(std::cout);
+		delete tx_task;
+	}
+	if(tx_mod)
+	{
+		std::cout << "Modulator: " << tx_mod->get_num_symbols() << " symbols, " << tx_mod->get_num_samples() << " samples" << std::endl;
+		delete tx_mod;
+	}
+
+	std::cout << "Blocks lost by the consumer: " << rx_task.get_overruns() << std::endl;
+	rx_task.get_fanout().print_stats(std::cout);
+	const capture_writer & writer = rx_task.get_writer();
+	std::cout << "Capture writer: " << writer.get_bytes_written() << " bytes written, "
+		<< writer.get_drops() << " blocks dropped, max queue depth " << writer.get_max_queue_depth()
+		<< ", " << writer.get_num_gaps() << " gaps"
+		<< (writer.is_direct() ? " (O_DIRECT)" : "") << std::endl;
+	if(options.squelch.enable)
+	{
+		// The consumer and the writer only saw the forwarded samples
+		const squelch_gate & gate = rx_task.get_squelch();
+		uint64_t total = gate.get_forwarded() + gate.get_skipped();
+		std::cout << "Squelch: opened " << gate.get_openings() << " times, " << gate.get_forwarded() << " samples forwarded, "
+			<< gate.get_skipped() << " skipped (" << (total ? 100.0 * gate.get_forwarded() / total : 0) << "% occupancy), "
+			<< writer.get_num_squelched() << " samples not stored" << std::endl;
+	}
+	const rx_continuity & continuity = rx_task.get_continuity();
+	std::cout << "Stream: " << continuity.get_samples() << " samples received, " << continuity.get_dropped()
+		<< " samples lost in " << continuity.get_num_gaps() << " gaps, " << continuity.get_time_errors() << " time errors" << std::endl;
+	for(int code = RX_ERROR_TIMEOUT; code < RX_ERROR_COUNT; code++)
+		if(continuity.get_errors(rx_error_index(code)))
+			std::cout << "\t" << rx_continuity::error_name(rx_error_index(code)) << ": " << continuity.get_errors(rx_error_index(code)) << std::endl;
+	if(ddc)
+	{
+		std::cout << "Host DDC: " << ddc_samples << " samples" << std::endl;
+		delete ddc;
+	}
+	if(channelizer)
+	{
+		std::cout << "Channelizer: " << channel_samples << " samples per channel" << std::endl;
+		delete channelizer;
+	}
+	if(demod)
+	{
+		// CPU time of a block against its duration at the sample rate
+		const latency_histogram & cost = demod->get_block_cost();
+		double block_ns = double(samps_per_buf) / source.get_rate() * 1e9;
+		std::cout << "Demodulator: " << demod->get_num_symbols() << " symbols, carrier offset " << demod->get_freq_offset()
+			<< " Hz, symbol period " << demod->get_symbol_period() << " samples, MER " << demod->get_mer() << " dB" << std::endl;
+		std::cout << "Demodulator CPU per block: mean " << cost.get_mean() * 1e-3 << " us, p99 " << cost.percentile(99) * 1e-3
+			<< " us, max " << cost.get_max() * 1e-3 << " us, " << 100 * cost.get_mean() / block_ns << "% of real time" << std::endl;
+		delete demod;
+	}
+	if(fec)
+	{
+		double seconds = continuity.get_samples() / source.get_rate();
+		std::cout << "FEC: " << fec->get_num_bits() << " bits decoded, CPU " << fec_ns * 1e-6 << " ms, "
+			<< (seconds > 0 ? 100 * fec_ns * 1e-9 / seconds : 0) << "% of real time" << std::endl;
+		delete fec;
+	}
+	if(sync)
+	{
+		// Preambles in the last partial frame
+		size_t count = sync->flush(&detections[0]);
+		print_frames(&detections[0], count);
+		num_frames += count;
+		std::cout << "Frame sync: " << num_frames << " frames" << std::endl;
+		delete sync;
+	}
+	if(get_block_pool())
+	{
+		get_block_pool()->print_stats(std::cout);
+		std::cout << "Buffers allocated outside the pool: " << get_heap_allocations() << std::endl;
+	}
+
+	return 0;
+}
+
+
 int main(int argc, char ** argv)
 {
 	namespace radio = uhd::usrp;
@@ -32,56 +467,260 @@ int main(int argc, char ** argv)
 
 	// Set up the signal handler for CTRL+C
 	std::signal(SIGINT, &sig_int_handler);
-	
+
 	//-----------------------------------------------
-	// Create the USRP Hardware object
+	// Real-time options
+	//   --prio N        SCHED_FIFO priority of the sampling thread
+	//   --cpu N         CPU of the sampling thread
+	//   --writer-cpu N  CPU of the capture writer thread
+	//   --mlock         lock the memory of the process
+	//   --block         the sampling task waits for the consumer instead of dropping blocks
+	//   --pool MB[,A]   allocate the blocks and the DSP buffers from a pool of MB MB, aligned on A bytes
+	//                   (64 by default, or the page size); locked with --mlock
+	//   --hugepages     map the pool on huge pages
+	// Source options (default: the USRP)
+	//   --replay FILE   replay a capture file instead of the USRP
+	//   --sim           synthetic signal instead of the USRP
+	//   --fast          do not pace the replay or the simulation
+	//   --inject N,S    inject an overflow losing S samples every N blocks
+	// Sample formats
+	//   --format F      host format: sc8, sc16 (default) or fc32
+	//   --otw F         over the wire format: sc8 or sc16 (default)
+	// Block size
+	//   --latency MS    latency budget of one block in ms (default 80)
+	//   --spp N         samples per transport packet requested from the device
+	//   --frame-size B  size in bytes of the receive frames of the transport
+	// Host processing
+	//   --ddc HZ[,D]    shift the blocks by HZ and decimate them by D in the host
+	//   --channels M    split the blocks into M channels (power of two)
+	//   --demod HZ[,R]  demodulate the QPSK signal at HZ, R symbols/s (default 12500)
+	//   --fec RATE      decode the soft bits of --demod, K=7 code of rate 1/2, 2/3, 3/4, 5/6 or 7/8
+	//   --sync HZ[,R]   search the preambles of the bursts at HZ, R symbols/s (default 12500)
+	// Full duplex
+	//   --tx-tone HZ    transmit a tone at HZ while receiving (simulated transmitter with --sim or --replay)
+	//   --tx-mod S[,R]  transmit a PRBS modulated in S (bpsk, qpsk or 8psk), R symbols/s (default 12500),
+	//                   root raised cosine pulses, at the frequency of --tx-tone (default 0)
+	//   --tx-cpu N      CPU of the transmit thread, which has the priority of the sampling thread
+	//   --squelch DB[,PRE,POST]  forward the blocks above DB dBFS only, with PRE blocks
+	//                   before and POST blocks after each burst (default 1,1)
 	//-----------------------------------------------
-	size_t mboard = 0;
+	test_options options;
+	for(int index = 1; index < argc; index++)
+	{
+		if(strcmp(argv[index], "--prio") == 0 && index + 1 < argc)
+		{
+			options.rx_rt.priority = atoi(argv[++index]);
+			options.tx_rt.priority = options.rx_rt.priority;
+			// The writer runs just below the sampling thread
+			options.writer_rt.priority = options.rx_rt.priority > 1 ? options.rx_rt.priority - 1 : 0;
+		}
+		else if(strcmp(argv[index], "--cpu") == 0 && index + 1 < argc)
+			options.rx_rt.cpu = atoi(argv[++index]);
+		else if(strcmp(argv[index], "--writer-cpu") == 0 && index + 1 < argc)
+			options.writer_rt.cpu = atoi(argv[++index]);
+		else if(strcmp(argv[index], "--tx-cpu") == 0 && index + 1 < argc)
+			options.tx_rt.cpu = atoi(argv[++index]);
+		else if(strcmp(argv[index], "--tx-tone") == 0 && index + 1 < argc)
+		{
+			options.transmit = true;
+			options.tx_tone = atof(argv[++index]);
+		}
+		else if(strcmp(argv[index], "--tx-mod") == 0 && index + 1 < argc)
+		{
+			char scheme[16] = "";
+			options.transmit = true;
+			if(sscanf(argv[++index], "%15[^,],%lf", scheme, &options.tx_symbol_rate) < 1)
+				strcpy(scheme, "qpsk");
+			options.tx_scheme = scheme;
+		}
+		else if(strcmp(argv[index], "--mlock") == 0)
+			options.mlock = true;
+		else if(strcmp(argv[index], "--block") == 0)
+			options.consumer_policy = FANOUT_BLOCK;
+		else if(strcmp(argv[index], "--pool") == 0 && index + 1 < argc)
+			sscanf(argv[++index], "%zu,%zu", &options.pool_mb, &options.pool_config.alignment);
+		else if(strcmp(argv[index], "--hugepages") == 0)
+			options.pool_config.hugepages = true;
+		else if(strcmp(argv[index], "--replay") == 0 && index + 1 < argc)
+			options.replay_file = argv[++index];
+		else if(strcmp(argv[index], "--sim") == 0)
+			options.simulate = true;
+		else if(strcmp(argv[index], "--fast") == 0)
+			options.paced = false;
+		else if(strcmp(argv[index], "--inject") == 0 && index + 1 < argc)
+			sscanf(argv[++index], "%zu,%zu", &options.inject_blocks, &options.inject_samps);
+		else if(strcmp(argv[index], "--format") == 0 && index + 1 < argc)
+			options.cpu_format = argv[++index];
+		else if(strcmp(argv[index], "--otw") == 0 && index + 1 < argc)
+			options.otw_format = argv[++index];
+		else if(strcmp(argv[index], "--latency") == 0 && index + 1 < argc)
+			options.latency_ms = atof(argv[++index]);
+		else if(strcmp(argv[index], "--spp") == 0 && index + 1 < argc)
+			options.spp = strtoul(argv[++index], NULL, 10);
+		else if(strcmp(argv[index], "--frame-size") == 0 && index + 1 < argc)
+			options.frame_size = argv[++index];
+		else if(strcmp(argv[index], "--ddc") == 0 && index + 1 < argc)
+		{
+			// Without a decimation factor the DDC only shifts
+			if(sscanf(argv[++index], "%lf,%zu", &options.ddc_freq, &options.ddc_decim) == 1)
+				options.ddc_decim = 1;
+		}
+		else if(strcmp(argv[index], "--channels") == 0 && index + 1 < argc)
+			options.num_channels = strtoul(argv[++index], NULL, 10);
+		else if(strcmp(argv[index], "--demod") == 0 && index + 1 < argc)
+		{
+			// Symbol rate of the simulated bursts by default
+			if(sscanf(argv[++index], "%lf,%lf", &options.demod_freq, &options.symbol_rate) == 1)
+				options.symbol_rate = 12500;
+		}
+		else if(strcmp(argv[index], "--fec") == 0 && index + 1 < argc)
+			options.fec_rate = argv[++index];
+		else if(strcmp(argv[index], "--sync") == 0 && index + 1 < argc)
+		{
+			if(sscanf(argv[++index], "%lf,%lf", &options.sync_freq, &options.sync_symbol_rate) == 1)
+				options.sync_symbol_rate = 12500;
+		}
+		else if(strcmp(argv[index], "--squelch") == 0 && index + 1 < argc)
+		{
+			// The gate closes 3 dB below the opening level
+			options.squelch.enable = true;
+			sscanf(argv[++index], "%lf,%zu,%zu", &options.squelch.open_level, &options.squelch.pre_blocks, &options.squelch.post_blocks);
+			options.squelch.close_level = options.squelch.open_level - 3;
+		}
+	}
+	options.rx_rt.prefault_stack = 64 * 1024;
+	options.writer_rt.prefault_stack = 64 * 1024;
+	options.tx_rt.prefault_stack = 64 * 1024;
+	if(cpu_format_size(options.cpu_format) == 0)
+	{
+		std::cout << "Unsupported host format " << options.cpu_format << std::endl;
+		return 1;
+	}
+	if(options.mlock && lock_memory())
+		std::cout << "Continuing without locked memory" << std::endl;
 
-	uhd::device_addr_t args;
-	std::cout << std::endl << "-----> Creating device" << std::endl;
-	radio::multi_usrp::sptr usrp = radio::multi_usrp::make(args);
-	
-	// Configure the board as desired
-	// Sample rate
-	usrp->set_rx_rate(125000);
-	std::cout << "Rx Sample rate: "  << usrp->get_rx_rate() << std::endl;
-	// Initial receive frequency
-	tune_request_t tune_request(135e6, 55e3);
-	tune_result_t tune_result = usrp->set_rx_freq(tune_request);
-	std::cout << "Target RF frequency: " << tune_result.target_rf_freq << std::endl;
-	std::cout << "Actual RF frequency: " << tune_result.actual_rf_freq << std::endl;
-	std::cout << "Target DSP frequency: " << tune_result.target_dsp_freq << std::endl;
-	std::cout << "Actual DSP frequency: " << tune_result.actual_dsp_freq << std::endl;
-	// Display the board configuration
-	get_rx_parameters(usrp, 0, std::cout);	
+	// The pool must exist before the sampling task and the stages allocate their buffers
+	block_pool pool;
+	if(options.pool_mb)
+	{
+		options.pool_config.bytes = options.pool_mb << 20;
+		options.pool_config.lock = options.mlock;
+		if(pool.create(options.pool_config))
+			return 1;
+		set_block_pool(&pool);
+	}
 	
 	//-----------------------------------------------
-	// Initialize sample buffers
+	// Create the source of the samples
 	//-----------------------------------------------
-	const int samps_per_buf = 10000;
-	g_inbuf[0].assign(samps_per_buf, 0);
-	g_inbuf[1].assign(samps_per_buf, 0);
+	const int num_bufs = 8;
+	radio::multi_usrp::sptr usrp;
+	sample_source * source;
+	if(options.replay_file != NULL)
+	{
+		std::cout << std::endl << "-----> Replaying " << options.replay_file << std::endl;
+		file_source * replay = new file_source(options.replay_file, options.paced);
+		replay->set_overflow_injection(options.inject_blocks, options.inject_samps);
+		source = replay;
+	}
+	else if(options.simulate)
+	{
+		std::cout << std::endl << "-----> Simulated source" << std::endl;
+		sim_config config;
+		config.paced = options.paced;
+		sim_tone tone = {10e3, 0.25};
+		config.tones.push_back(tone);
+		config.burst_amplitude = 0.5;
+		config.burst_freq = -20e3;
+		config.symbol_rate = 12500;
+		config.burst_symbols = 256;
+		config.burst_period = 0.5;
+		config.preamble = frame_sync_default_preamble();
+		sim_source * sim = new sim_source(config);
+		sim->set_overflow_injection(options.inject_blocks, options.inject_samps);
+		source = sim;
+	}
+	else
+	{
+		//-----------------------------------------------
+		// Create the USRP Hardware object
+		//-----------------------------------------------
+		size_t mboard = 0;
+
+		// The size of the receive frames is a parameter of the transport
+		uhd::device_addr_t args;
+		if(options.frame_size != NULL)
+			args["recv_frame_size"] = options.frame_size;
+		std::cout << std::endl << "-----> Creating device" << std::endl;
+		usrp = radio::multi_usrp::make(args);
+		
+		// Configure the board as desired
+		// Sample rate
+		usrp->set_rx_rate(125000);
+		std::cout << "Rx Sample rate: "  << usrp->get_rx_rate() << std::endl;
+		// Initial receive frequency
+		tune_request_t tune_request(135e6, 55e3);
+		tune_result_t tune_result = usrp->set_rx_freq(tune_request);
+		std::cout << "Target RF frequency: " << tune_result.target_rf_freq << std::endl;
+		std::cout << "Actual RF frequency: " << tune_result.actual_rf_freq << std::endl;
+		std::cout << "Target DSP frequency: " << tune_result.target_dsp_freq << std::endl;
+		std::cout << "Actual DSP frequency: " << tune_result.actual_dsp_freq << std::endl;
+		// Display the board configuration
+		get_rx_parameters(usrp, 0, std::cout);	
+		if(options.transmit)
+		{
+			// Same rate and frequency as the receiver
+			usrp->set_tx_rate(125000);
+			usrp->set_tx_freq(tune_request_t(135e6));
+			std::cout << "Tx Sample rate: "  << usrp->get_tx_rate() << std::endl;
+		}
+		
+		uhd_source * hardware = new uhd_source(usrp);
+		hardware->set_tune_result(tune_result);
+		source = hardware;
+	}
 
 	//-----------------------------------------------
-	// Start the rx sampling task
+	// Size the blocks from the latency budget and the transport packets
 	//-----------------------------------------------
-	task_sampling rx_task(usrp);
-	if(rx_task.start())
+	source->set_format(options.cpu_format, options.otw_format);
+	source->set_spp(options.spp);
+	size_t samps_per_buf = plan_block_size(*source, options.latency_ms * 1e-3);
+	if(samps_per_buf == 0)
 	{
-		// An error occurred
-		std::cout << "Rx sampling task could not be created" << std::endl;
+		std::cout << "Sample source could not be opened" << std::endl;
+		delete source;
 		return MAIN_ERROR_SAMPLING_TASK_NOT_CREATED;
 	}
-	
-	//------------------------------------------------
-	//  Wait for thread completion
-	//------------------------------------------------
-	void * exit_status;
-	int res = pthread_join(rx_task.get_tid(), & exit_status); // Exit status in *status_ptr
 
-	
-	return 0;
+	// Transmitter of the full duplex test
+	sample_sink * tx_sink = NULL;
+	if(options.transmit && usrp)
+		tx_sink = new uhd_sink(usrp);
+	else if(options.transmit)
+	{
+		sim_sink_config config;
+		config.rate = source->get_rate();
+		config.paced = options.paced;
+		tx_sink = new sim_sink(config);
+	}
+	if(tx_sink)
+	{
+		tx_sink->set_format(options.cpu_format, options.otw_format);
+		tx_sink->set_spp(options.spp);
+	}
+
+	int result;
+	if(strcmp(options.cpu_format, "sc8") == 0)
+		result = run_sampling<sample_sc8>(*source, samps_per_buf, num_bufs, tx_sink, options);
+	else if(strcmp(options.cpu_format, "fc32") == 0)
+		result = run_sampling<sample_fc32>(*source, samps_per_buf, num_bufs, tx_sink, options);
+	else
+		result = run_sampling<sample_sc16>(*source, samps_per_buf, num_bufs, tx_sink, options);
+
+	delete tx_sink;
+	delete source;
+	return result;
 	
 }
 
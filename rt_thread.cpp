@@ -0,0 +1,166 @@
+#include "rt_thread.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <errno.h>
+#include <alloca.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+/*************************************************************************//**
+@brief Creates a thread with the requested real-time settings
+
+If the thread cannot be created with SCHED_FIFO (no CAP_SYS_NICE or
+RLIMIT_RTPRIO too low), a message is displayed and the thread is created
+with the default scheduler so that the program can still run.
+
+@param thread Receives the identifier of the thread
+@param config Real-time settings
+@param routine Function executed by the thread
+@param arg Argument of the function
+@param name Name of the thread used in the messages
+
+@return true if an error occurred, false otherwise
+
+*****************************************************************************/
+
+bool create_rt_thread(pthread_t * thread, const thread_rt_config & config, void * (*routine)(void *), void * arg, const char * name)
+{
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+
+	if(config.stack_size)
+		pthread_attr_setstacksize(&attr, config.stack_size);
+	size_t stack_size;
+	pthread_attr_getstacksize(&attr, &stack_size);
+	std::cout << name << " stack size: " << stack_size << std::endl;
+
+	if(config.cpu >= 0)
+	{
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(config.cpu, &cpus);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+	}
+
+	if(config.priority > 0)
+	{
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = config.priority;
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		pthread_attr_setschedparam(&attr, &param);
+	}
+
+	int res = pthread_create(thread, &attr, routine, arg);
+	if(res == EPERM && config.priority > 0)
+	{
+		std::cout << name << ": not allowed to use SCHED_FIFO, using the default scheduler" << std::endl;
+		pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+		res = pthread_create(thread, &attr, routine, arg);
+	}
+	pthread_attr_destroy(&attr);
+	if(res)
+	{
+		std::cout << "Thread for " << name << " could not be created" << std::endl;
+		return true;
+	}
+	return false;
+}
+
+
+/*************************************************************************//**
+@brief Touches the stack of the calling thread so that its pages are
+mapped before the time critical loop starts
+
+@param bytes Number of bytes of stack to touch
+
+*****************************************************************************/
+
+void prefault_stack(size_t bytes)
+{
+	if(bytes == 0)
+		return;
+	volatile char * stack = static_cast<volatile char *>(alloca(bytes));
+	size_t page = sysconf(_SC_PAGESIZE);
+	for(size_t index = 0; index < bytes; index += page)
+		stack[index] = 0;
+}
+
+
+/*************************************************************************//**
+@brief Touches every page of a buffer so that it is mapped
+
+@param addr Start of the buffer
+@param bytes Size of the buffer
+
+*****************************************************************************/
+
+void prefault_memory(void * addr, size_t bytes)
+{
+	volatile char * mem = static_cast<volatile char *>(addr);
+	size_t page = sysconf(_SC_PAGESIZE);
+	for(size_t index = 0; index < bytes; index += page)
+		mem[index] = mem[index];
+}
+
+
+/*************************************************************************//**
+@brief Locks all the current and future memory of the process in RAM
+
+@return true if an error occurred, false otherwise
+
+*****************************************************************************/
+
+bool lock_memory()
+{
+	if(mlockall(MCL_CURRENT | MCL_FUTURE))
+	{
+		std::cout << "Memory could not be locked: " << strerror(errno) << std::endl;
+		return true;
+	}
+	return false;
+}
+
+
+/*************************************************************************//**
+@brief Checks and displays the real-time settings of the calling thread
+
+@param config Settings which were requested
+@param name Name of the thread used in the messages
+@param os output stream when the data is displayed. std::cout is the default value
+
+@return true if the settings of the thread differ from the requested ones
+
+*****************************************************************************/
+
+bool verify_rt_thread(const thread_rt_config & config, const char * name, std::ostream & os)
+{
+	bool mismatch = false;
+	int policy;
+	struct sched_param param;
+	pthread_getschedparam(pthread_self(), &policy, &param);
+	os << name << ": policy " << (policy == SCHED_FIFO ? "SCHED_FIFO" : policy == SCHED_RR ? "SCHED_RR" : "SCHED_OTHER")
+		<< " priority " << param.sched_priority;
+	if(config.priority > 0 && (policy != SCHED_FIFO || param.sched_priority != config.priority))
+		mismatch = true;
+
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	os << " CPUs";
+	for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		if(CPU_ISSET(cpu, &cpus))
+			os << " " << cpu;
+	if(config.cpu >= 0 && (CPU_COUNT(&cpus) != 1 || !CPU_ISSET(config.cpu, &cpus)))
+		mismatch = true;
+
+	os << " running on CPU " << sched_getcpu();
+	if(mismatch)
+		os << " (requested settings not applied)";
+	os << std::endl;
+	return mismatch;
+}
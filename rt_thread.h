@@ -0,0 +1,44 @@
+/***********************************************************************//**
+@file
+
+Helpers to create real-time threads: scheduling policy, CPU affinity,
+memory locking and pre-faulting of the stack and buffers
+
+
+***************************************************************************/
+
+#ifndef RT_THREAD_H
+#define RT_THREAD_H
+
+#include <pthread.h>
+#include <cstddef>
+#include <ostream>
+#include <iostream>
+
+
+/***********************************************************************//**
+Real-time settings of a thread
+
+The default values give a normal (SCHED_OTHER) thread with the default
+stack, which is what pthread_create() does without attributes.
+
+***************************************************************************/
+struct thread_rt_config
+{
+	thread_rt_config() : priority(0), cpu(-1), stack_size(0), prefault_stack(0) {}
+
+	int priority;			/// SCHED_FIFO priority (1-99). 0 keeps the default scheduler
+	int cpu;				/// CPU the thread is pinned to. -1 lets it run on any CPU
+	size_t stack_size;		/// Stack size in bytes. 0 keeps the default size
+	size_t prefault_stack;	/// Number of bytes of stack touched when the thread starts
+};
+
+
+bool create_rt_thread(pthread_t * thread, const thread_rt_config & config, void * (*routine)(void *), void * arg, const char * name);
+void prefault_stack(size_t bytes);
+void prefault_memory(void * addr, size_t bytes);
+bool lock_memory();
+bool verify_rt_thread(const thread_rt_config & config, const char * name, std::ostream & os = std::cout);
+
+
+#endif
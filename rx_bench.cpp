@@ -0,0 +1,349 @@
+/***********************************************************************//**
+@file
+
+Microbenchmark of the receive loop of the sampling task
+
+The loop of task_sampling::run() is driven by an unpaced sim_source for
+every combination of block size and ring depth. For each combination the
+benchmark measures:
+- the throughput of the loop in millions of samples per second, and the
+  number of blocks lost because the consumer did not keep up
+- the percentiles of the duration of one iteration of the loop
+- the percentiles of the handoff latency, from the publication of a block
+  by the sampling thread to its reception by the consumer
+
+Without pacing the loop runs as fast as it can: the consumer may not keep
+up and the handoff latency then mostly measures the wake up of the
+consumer. With -R the source delivers the samples at a fixed rate, as a
+device would.
+
+Before the measurements, a run with injected overflows, zero fill and the
+capture writer checks that the capture file holds exactly the samples
+delivered by the source: the zeros of the gaps are only for the consumer.
+
+Usage: rxbench [-n samples] [-s sizes] [-d depths] [-r runs] [-R rate] [-t]
+               [-w] [-c] [-p prio] [-a cpu] [-l label] [-j file]
+
+-n number of samples per run (default 20000000)
+-s comma separated list of samps_per_buf (default 1000,2500,10000,40000)
+-d comma separated list of ring depths (default 2,4,8,32)
+-r number of runs of each combination, the best throughput is kept (default 1)
+-R paces the source at the given rate in samples/s (default: unpaced)
+-t the source generates a tone. By default it delivers zeros, so that
+   the cost of the loop itself is measured
+-w the consumer reads every sample of the blocks
+-c the samples are also written to bench.cap by the capture writer
+-p SCHED_FIFO priority of the sampling thread
+-a CPU of the sampling thread
+-l label stored in the results (e.g. the release)
+-j file receiving the results, one JSON object per line (default rx_bench.json)
+
+***************************************************************************/
+
+#define DEFINE_GLOBALS
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <unistd.h>
+#include "task_sampling.h"
+#include "sim_source.h"
+#include "capture_file.h"
+#include "latency_stats.h"
+#include "bench_common.h"
+
+#define CHECK_SAMPLES 1000000	/// Samples of the zero fill and capture check
+#define CHECK_SAMPS_PER_BUF 1000
+#define CHECK_OVERFLOW_EVERY 7	/// An overflow every 7 recv() calls of the check
+#define CHECK_OVERFLOW_SAMPS 1234	/// Samples lost at each overflow
+
+
+/// Results of one run of the benchmark
+struct bench_result
+{
+	size_t samps_per_buf;
+	size_t depth;
+	uint64_t samples;		/// Samples received by the loop
+	uint64_t delivered;		/// Samples received by the consumer
+	double seconds;			/// Duration of the run
+	uint64_t overruns;		/// Blocks lost because the consumer did not keep up
+	latency_histogram loop;		/// Duration of the iterations of the receive loop
+	latency_histogram handoff;	/// Time between publish and reception by the consumer
+};
+
+
+/***********************************************************************//**
+Parses a comma separated list of sizes
+
+***************************************************************************/
+
+static std::vector<size_t> parse_list(const char * text)
+{
+	std::vector<size_t> values;
+	while(*text)
+	{
+		char * end;
+		unsigned long value = strtoul(text, &end, 10);
+		if(end == text)
+			break;
+		if(value)
+			values.push_back(value);
+		text = *end == ',' ? end + 1 : end;
+	}
+	return values;
+}
+
+
+/***********************************************************************//**
+Runs the sampling task on a simulated source and consumes every block
+
+@return true if the task could not be started
+
+***************************************************************************/
+
+static bool run_bench(bench_result & result, uint64_t num_samples, double rate, bool tone, bool touch, bool capture, const thread_rt_config & rt)
+{
+	sim_config config;
+	if(rate > 0)
+	{
+		config.rate = rate;
+		config.paced = true;
+	}
+	else
+		config.paced = false;
+	config.noise_rms = 0;
+	if(tone)
+	{
+		sim_tone t = {10e3, 0.5};
+		config.tones.push_back(t);
+	}
+	config.num_samples = num_samples;
+	sim_source source(config);
+
+	task_sampling rx_task(source, result.samps_per_buf, result.depth, capture ? "bench.cap" : NULL);
+	rx_task.set_rt_config(rt);
+	rx_task.set_loop_histogram(&result.loop);
+	result.loop.reset();
+	result.handoff.reset();
+	result.delivered = 0;
+
+	uint64_t start = monotonic_ns();
+	if(rx_task.start())
+		return true;
+
+	long sum = 0;
+	for(;;)
+	{
+		const input_block_t * block = rx_task.wait_buffer(1000);
+		if(block == NULL)
+		{
+			if(rx_task.get_fanout().is_closed())
+				break;
+			continue;
+		}
+		result.handoff.record(monotonic_ns() - block->publish_time);
+		if(touch)
+			for(size_t index = 0; index < block->num_samps; index++)
+				sum += block->samples[index].real();
+		result.delivered += block->num_samps;
+		rx_task.release_buffer();
+	}
+	pthread_join(rx_task.get_tid(), NULL);
+	result.seconds = (monotonic_ns() - start) * 1e-9;
+	result.overruns = rx_task.get_overruns();
+	result.samples = rx_task.get_continuity().get_samples();
+
+	// Keeps the reading loop from being optimised away
+	if(sum == 1)
+		std::cout << " ";
+	return false;
+}
+
+
+/***********************************************************************//**
+Runs the sampling task with zero fill and capture on a source losing
+samples, then compares the capture file with the samples of an identical
+source read without the task
+
+@return Number of errors
+
+***************************************************************************/
+
+static int check_zero_fill_capture(bench_context & bench)
+{
+	sim_config config;
+	config.rate = 5e6;
+	config.paced = true;
+	config.noise_rms = 0.2;
+	sim_tone t = {10e3, 0.5};
+	config.tones.push_back(t);
+	config.num_samples = CHECK_SAMPLES;
+
+	uint64_t delivered = 0, received = 0, lost = 0, drops = 0;
+	size_t block_size;
+	{
+		sim_source source(config);
+		source.set_overflow_injection(CHECK_OVERFLOW_EVERY, CHECK_OVERFLOW_SAMPS);
+		task_sampling rx_task(source, CHECK_SAMPS_PER_BUF, 32, "bench.cap");
+		rx_task.set_zero_fill(true);
+		block_size = rx_task.get_fanout().block_size();
+		if(rx_task.start())
+			return 1;
+		for(;;)
+		{
+			const input_block_t * block = rx_task.wait_buffer(1000);
+			if(block == NULL)
+			{
+				if(rx_task.get_fanout().is_closed())
+					break;
+				continue;
+			}
+			delivered += block->num_samps;
+			rx_task.release_buffer();
+		}
+		pthread_join(rx_task.get_tid(), NULL);
+		received = rx_task.get_continuity().get_samples();
+		lost = rx_task.get_continuity().get_dropped();
+		drops = rx_task.get_writer().get_drops();
+		// The capture file is completed when the task is destroyed
+	}
+
+	// The same signal and the same overflows, in blocks of the same size
+	config.paced = false;
+	sim_source reference(config);
+	reference.set_overflow_injection(CHECK_OVERFLOW_EVERY, CHECK_OVERFLOW_SAMPS);
+	reference.set_format(sample_traits<sample_sc16>::cpu_format(), "sc16");
+	reference.start(block_size);
+	std::vector<sample_sc16> expected;
+	std::vector<sample_sc16> buffer(block_size);
+	while(!reference.is_done())
+	{
+		uhd::rx_metadata_t md;
+		size_t n = reference.recv(&buffer[0], block_size, md, 1);
+		expected.insert(expected.end(), buffer.begin(), buffer.begin() + n);
+	}
+
+	capture_reader reader;
+	bool identical = false;
+	if(reader.open("bench.cap") == false && reader.get_num_samples() == expected.size())
+	{
+		const void * samples = reader.get_samples(0, expected.size());
+		identical = samples && memcmp(samples, &expected[0], expected.size() * sizeof(sample_sc16)) == 0;
+	}
+	reader.close();
+	unlink("bench.cap");
+
+	// The consumer got the zeros, the file only the received samples
+	int errors = !identical || drops || received != expected.size() || delivered != received + lost;
+	printf("Zero fill and capture: %llu samples received, %llu lost, %llu delivered, capture %s the source %s\n",
+		(unsigned long long)received, (unsigned long long)lost, (unsigned long long)delivered,
+		identical ? "identical to" : "different from", errors ? "FAILED" : "ok");
+	fprintf(bench.record("rx_capture_check"), "\"received\":%llu,\"lost\":%llu,\"delivered\":%llu,\"writer_drops\":%llu,"
+		"\"identical\":%s,\"ok\":%s}\n", (unsigned long long)received, (unsigned long long)lost, (unsigned long long)delivered,
+		(unsigned long long)drops, identical ? "true" : "false", errors ? "false" : "true");
+	return errors;
+}
+
+
+/***********************************************************************//**
+Writes one result as a JSON object on a single line
+
+***************************************************************************/
+
+static void write_json(bench_context & bench, const bench_result & r, double rate, bool tone, bool touch, bool capture)
+{
+	fprintf(bench.record("rx_loop"), "\"samps_per_buf\":%zu,\"depth\":%zu,\"paced_rate\":%.0f,\"tone\":%s,\"consumer_reads\":%s,\"capture\":%s,"
+		"\"samples\":%llu,\"delivered\":%llu,\"seconds\":%.6f,\"msps\":%.3f,\"overruns\":%llu,",
+		r.samps_per_buf, r.depth, rate, tone ? "true" : "false", touch ? "true" : "false", capture ? "true" : "false",
+		(unsigned long long)r.samples, (unsigned long long)r.delivered, r.seconds, r.samples / r.seconds * 1e-6, (unsigned long long)r.overruns);
+	const latency_histogram * hists[2] = {&r.loop, &r.handoff};
+	const char * names[2] = {"loop_ns", "handoff_ns"};
+	for(int h = 0; h < 2; h++)
+		fprintf(bench.json, "\"%s\":{\"count\":%llu,\"mean\":%.1f,\"min\":%llu,\"p50\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu}%s",
+			names[h], (unsigned long long)hists[h]->get_count(), hists[h]->get_mean(),
+			(unsigned long long)hists[h]->get_min(), (unsigned long long)hists[h]->percentile(50),
+			(unsigned long long)hists[h]->percentile(99), (unsigned long long)hists[h]->percentile(99.9),
+			(unsigned long long)hists[h]->get_max(), h == 0 ? "," : "}\n");
+}
+
+
+int main(int argc, char ** argv)
+{
+	uint64_t num_samples = 20000000;
+	std::vector<size_t> sizes = parse_list("1000,2500,10000,40000");
+	std::vector<size_t> depths = parse_list("2,4,8,32");
+	int runs = 1;
+	double rate = 0;
+	bool tone = false;
+	bool touch = false;
+	bool capture = false;
+	bench_context bench("rx_bench.json");
+	thread_rt_config rt;
+	for(int index = 1; index < argc; index++)
+	{
+		if(strcmp(argv[index], "-n") == 0 && index + 1 < argc)
+			num_samples = strtoull(argv[++index], NULL, 10);
+		else if(strcmp(argv[index], "-s") == 0 && index + 1 < argc)
+			sizes = parse_list(argv[++index]);
+		else if(strcmp(argv[index], "-d") == 0 && index + 1 < argc)
+			depths = parse_list(argv[++index]);
+		else if(strcmp(argv[index], "-r") == 0 && index + 1 < argc)
+			runs = atoi(argv[++index]);
+		else if(strcmp(argv[index], "-R") == 0 && index + 1 < argc)
+			rate = atof(argv[++index]);
+		else if(strcmp(argv[index], "-t") == 0)
+			tone = true;
+		else if(strcmp(argv[index], "-w") == 0)
+			touch = true;
+		else if(strcmp(argv[index], "-c") == 0)
+			capture = true;
+		else if(strcmp(argv[index], "-p") == 0 && index + 1 < argc)
+			rt.priority = atoi(argv[++index]);
+		else if(strcmp(argv[index], "-a") == 0 && index + 1 < argc)
+			rt.cpu = atoi(argv[++index]);
+		else if(bench.parse_option(argc, argv, index))
+		{
+			std::cout << "Usage: rxbench [-n samples] [-s sizes] [-d depths] [-r runs] [-R rate] [-t] [-w] [-c] [-p prio] [-a cpu] [-l label] [-j file]" << std::endl;
+			return 1;
+		}
+	}
+	if(runs < 1)
+		runs = 1;
+
+	if(bench.open())
+		return 1;
+
+	bench.errors += check_zero_fill_capture(bench);
+
+	printf("%10s %6s %9s %9s %9s %9s %9s %9s %9s %9s\n", "spb", "depth", "MS/s", "overruns",
+		"loop p50", "p99", "p999", "handoff50", "p99", "p999");
+	for(size_t s = 0; s < sizes.size(); s++)
+		for(size_t d = 0; d < depths.size(); d++)
+		{
+			bench_result best, current;
+			best.seconds = 0;
+			for(int run = 0; run < runs; run++)
+			{
+				current.samps_per_buf = sizes[s];
+				current.depth = depths[d];
+				if(run_bench(current, num_samples, rate, tone, touch, capture, rt))
+				{
+					std::cout << "The sampling task could not be started" << std::endl;
+					return 1;
+				}
+				if(best.seconds == 0 || current.seconds < best.seconds)
+					best = current;
+			}
+			// The ring rounds the depth up to a power of two
+			printf("%10zu %6zu %9.2f %9llu %9llu %9llu %9llu %9llu %9llu %9llu\n", best.samps_per_buf, best.depth,
+				best.samples / best.seconds * 1e-6, (unsigned long long)best.overruns,
+				(unsigned long long)best.loop.percentile(50), (unsigned long long)best.loop.percentile(99),
+				(unsigned long long)best.loop.percentile(99.9), (unsigned long long)best.handoff.percentile(50),
+				(unsigned long long)best.handoff.percentile(99), (unsigned long long)best.handoff.percentile(99.9));
+			write_json(bench, best, rate, tone, touch, capture);
+		}
+	printf("Times in ns\n");
+	return bench.finish("Capture identical to the source");
+}
@@ -0,0 +1,183 @@
+#include "rx_continuity.h"
+
+
+/***********************************************************************//**
+Constructor
+
+***************************************************************************/
+
+rx_continuity::rx_continuity()
+{
+	reset(0);
+}
+
+
+/***********************************************************************//**
+Clears all the counters. Must not be called while update() is running
+
+@param sample_rate Sample rate of the stream in samples/s
+
+***************************************************************************/
+
+void rx_continuity::reset(double sample_rate)
+{
+	rate = sample_rate;
+	has_reference = false;
+	expected_ticks = 0;
+	blocks.store(0);
+	samples.store(0);
+	dropped.store(0);
+	num_gaps.store(0);
+	time_errors.store(0);
+	next_sample.store(0);
+	for(int index = 0; index < RX_ERROR_COUNT; index++)
+		errors[index].store(0);
+	for(int index = 0; index < RX_GAP_HISTORY; index++)
+	{
+		history[index].seq.store(0);
+		history[index].sample.store(0);
+		history[index].size.store(0);
+	}
+}
+
+
+/***********************************************************************//**
+Checks one block returned by recv()
+
+The time stamp of the block is compared with the time of the previous
+block plus its number of samples. A later time means that samples were
+lost: the gap is counted and recorded in the history. An earlier time is
+counted as a time error.
+
+@param md Metadata returned by recv()
+@param num_samps Number of samples returned by recv()
+
+@return Number of samples missing just before this block
+
+***************************************************************************/
+
+uint64_t rx_continuity::update(const uhd::rx_metadata_t & md, size_t num_samps)
+{
+	blocks.fetch_add(1, std::memory_order_relaxed);
+	errors[error_index(md.error_code)].fetch_add(1, std::memory_order_relaxed);
+	if(num_samps == 0)
+		return 0;
+
+	uint64_t gap = 0;
+	uint64_t position = next_sample.load(std::memory_order_relaxed);
+	if(md.has_time_spec && rate > 0)
+	{
+		long long ticks = md.time_spec.to_ticks(rate);
+		if(has_reference)
+		{
+			if(ticks > expected_ticks)
+			{
+				gap = ticks - expected_ticks;
+				record_gap(position, gap);
+				position += gap;
+			}
+			else if(ticks < expected_ticks)
+				time_errors.fetch_add(1, std::memory_order_relaxed);
+		}
+		has_reference = true;
+		expected_ticks = ticks + num_samps;
+	}
+	else
+		expected_ticks += num_samps;
+
+	samples.fetch_add(num_samps, std::memory_order_relaxed);
+	next_sample.store(position + num_samps, std::memory_order_relaxed);
+	return gap;
+}
+
+
+/***********************************************************************//**
+Returns one of the last gaps
+
+@param age 0 for the most recent gap, 1 for the previous one...
+@param gap Filled with the description of the gap
+
+@return true if the gap does not exist (or is no longer in the history)
+
+***************************************************************************/
+
+bool rx_continuity::get_gap(size_t age, rx_gap & gap) const
+{
+	uint64_t count = num_gaps.load(std::memory_order_acquire);
+	if(age >= RX_GAP_HISTORY || age >= count)
+		return true;
+	const gap_slot & slot = history[(count - 1 - age) % RX_GAP_HISTORY];
+	uint32_t seq;
+	do
+	{
+		seq = slot.seq.load(std::memory_order_acquire);
+		gap.sample = slot.sample.load(std::memory_order_relaxed);
+		gap.size = slot.size.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while((seq & 1) || seq != slot.seq.load(std::memory_order_relaxed));
+	return false;
+}
+
+
+/***********************************************************************//**
+Adds a gap to the counters and to the history
+
+***************************************************************************/
+
+void rx_continuity::record_gap(uint64_t sample, uint64_t size)
+{
+	uint64_t count = num_gaps.load(std::memory_order_relaxed);
+	gap_slot & slot = history[count % RX_GAP_HISTORY];
+	uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+	slot.seq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.sample.store(sample, std::memory_order_relaxed);
+	slot.size.store(size, std::memory_order_relaxed);
+	slot.seq.store(seq + 2, std::memory_order_release);
+	dropped.fetch_add(size, std::memory_order_relaxed);
+	num_gaps.store(count + 1, std::memory_order_release);
+}
+
+
+/***********************************************************************//**
+Converts an UHD error code to the index of its counter
+
+***************************************************************************/
+
+rx_error_index rx_continuity::error_index(uhd::rx_metadata_t::error_code_t code)
+{
+	using namespace uhd;
+	switch(code)
+	{
+	case rx_metadata_t::ERROR_CODE_NONE:
+		return RX_ERROR_NONE;
+	case rx_metadata_t::ERROR_CODE_TIMEOUT:
+		return RX_ERROR_TIMEOUT;
+	case rx_metadata_t::ERROR_CODE_LATE_COMMAND:
+		return RX_ERROR_LATE_COMMAND;
+	case rx_metadata_t::ERROR_CODE_BROKEN_CHAIN:
+		return RX_ERROR_BROKEN_CHAIN;
+	case rx_metadata_t::ERROR_CODE_OVERFLOW:
+		return RX_ERROR_OVERFLOW;
+	case rx_metadata_t::ERROR_CODE_ALIGNMENT:
+		return RX_ERROR_ALIGNMENT;
+	case rx_metadata_t::ERROR_CODE_BAD_PACKET:
+		return RX_ERROR_BAD_PACKET;
+	}
+	return RX_ERROR_UNKNOWN;
+}
+
+
+/***********************************************************************//**
+Returns the name of an error counter, as displayed by display_rx_metadata()
+
+***************************************************************************/
+
+const char * rx_continuity::error_name(rx_error_index code)
+{
+	static const char * names[RX_ERROR_COUNT] =
+	{
+		"None", "Timeout", "Late Command", "Broken Chain", "Overflow", "Alignment", "Bad Packet", "Unknown"
+	};
+	return names[code];
+}
@@ -0,0 +1,105 @@
+/***********************************************************************//**
+@file
+
+Declaration of the sample continuity checker used by the sampling task
+
+
+***************************************************************************/
+
+#ifndef RX_CONTINUITY_H
+#define RX_CONTINUITY_H
+
+#include <atomic>
+#include <stdint.h>
+#include "/usr/include/uhd/usrp/multi_usrp.hpp"
+
+// Number of gaps kept in the history
+#define RX_GAP_HISTORY 16
+
+/// Index of the error counters. One per uhd::rx_metadata_t::error_code_t value
+enum rx_error_index
+{
+	RX_ERROR_NONE = 0,
+	RX_ERROR_TIMEOUT,
+	RX_ERROR_LATE_COMMAND,
+	RX_ERROR_BROKEN_CHAIN,
+	RX_ERROR_OVERFLOW,
+	RX_ERROR_ALIGNMENT,
+	RX_ERROR_BAD_PACKET,
+	RX_ERROR_UNKNOWN,
+	RX_ERROR_COUNT
+};
+
+
+/// Description of a gap
+struct rx_gap
+{
+	uint64_t sample;	/// Sample number (since the start of the stream) of the first missing sample
+	uint64_t size;		/// Number of missing samples
+};
+
+
+/***********************************************************************//**
+This class checks that consecutive blocks returned by recv() are
+contiguous in time and counts the error codes reported in the metadata
+
+update() is called by the sampling task only. All the counters are atomics
+so that any thread can read them while the stream is running.
+
+***************************************************************************/
+class rx_continuity
+{
+public:
+	rx_continuity();
+
+	void reset(double rate);
+	uint64_t update(const uhd::rx_metadata_t & md, size_t num_samps);
+
+	/// Number of recv() calls checked
+	uint64_t get_blocks() const {return blocks.load(std::memory_order_relaxed);}
+	/// Number of samples received
+	uint64_t get_samples() const {return samples.load(std::memory_order_relaxed);}
+	/// Number of samples missing between the blocks
+	uint64_t get_dropped() const {return dropped.load(std::memory_order_relaxed);}
+	/// Number of discontinuities
+	uint64_t get_num_gaps() const {return num_gaps.load(std::memory_order_relaxed);}
+	/// Number of blocks whose time was earlier than expected
+	uint64_t get_time_errors() const {return time_errors.load(std::memory_order_relaxed);}
+	/// Number of recv() calls which returned the error code
+	uint64_t get_errors(rx_error_index code) const {return errors[code].load(std::memory_order_relaxed);}
+	/// Sample number of the next expected sample, gaps included
+	uint64_t get_next_sample() const {return next_sample.load(std::memory_order_relaxed);}
+
+	bool get_gap(size_t age, rx_gap & gap) const;
+
+	static rx_error_index error_index(uhd::rx_metadata_t::error_code_t code);
+	static const char * error_name(rx_error_index code);
+
+private:
+	void record_gap(uint64_t sample, uint64_t size);
+
+	double rate;			/// Sample rate used to convert times to samples
+	bool has_reference;		/// True once a block with a time stamp has been seen
+	long long expected_ticks;	/// Time, in samples, expected for the next block
+
+	std::atomic<uint64_t> blocks;
+	std::atomic<uint64_t> samples;
+	std::atomic<uint64_t> dropped;
+	std::atomic<uint64_t> num_gaps;
+	std::atomic<uint64_t> time_errors;
+	std::atomic<uint64_t> next_sample;
+	std::atomic<uint64_t> errors[RX_ERROR_COUNT];
+
+	// History of the last gaps. Each entry is protected by a sequence
+	// number which is odd while the entry is being written
+	struct gap_slot
+	{
+		std::atomic<uint32_t> seq;
+		std::atomic<uint64_t> sample;
+		std::atomic<uint64_t> size;
+	};
+	gap_slot history[RX_GAP_HISTORY];
+};
+
+
+#endif
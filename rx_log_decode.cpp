@@ -0,0 +1,72 @@
+/***********************************************************************//**
+@file
+
+Offline decoder of the binary receive metadata log
+
+Usage: rxlogdecode [-o] rx_log.bin
+
+Prints every record in the same format as the text log. With -o the byte
+offset of the block in the sample file is printed as well.
+
+***************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include "rx_log_format.h"
+
+#define DECODE_BATCH 256
+
+
+int main(int argc, char ** argv)
+{
+	bool show_offset = false;
+	const char * filename = NULL;
+	for(int index = 1; index < argc; index++)
+	{
+		if(strcmp(argv[index], "-o") == 0)
+			show_offset = true;
+		else
+			filename = argv[index];
+	}
+	if(filename == NULL)
+	{
+		std::cout << "Usage: " << argv[0] << " [-o] rx_log.bin" << std::endl;
+		return 1;
+	}
+
+	std::ifstream log(filename, std::ifstream::in | std::ifstream::binary);
+	if(log.fail())
+	{
+		std::cout << "Log file could not be opened" << std::endl;
+		return 2;
+	}
+
+	rx_log_header header;
+	log.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if(!log || header.magic != RX_LOG_MAGIC)
+	{
+		std::cout << "Not a binary rx log (or written with a different byte order)" << std::endl;
+		return 3;
+	}
+	if(header.version != RX_LOG_VERSION || header.record_size != sizeof(rx_log_record))
+	{
+		std::cout << "Unsupported log version " << header.version << std::endl;
+		return 4;
+	}
+
+	rx_log_record records[DECODE_BATCH];
+	while(log)
+	{
+		log.read(reinterpret_cast<char*>(records), sizeof(records));
+		size_t count = log.gcount() / sizeof(rx_log_record);
+		for(size_t index = 0; index < count; index++)
+		{
+			display_rx_log_record(records[index], std::cout);
+			if(show_offset)
+				std::cout << "File Offset: " << records[index].file_offset << std::endl;
+		}
+	}
+	return 0;
+}
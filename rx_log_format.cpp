@@ -0,0 +1,50 @@
+#include "rx_log_format.h"
+
+
+/*************************************************************************//**
+@brief Display a binary log record
+
+The output is identical to the text log written with display_rx_metadata()
+
+@param rec record to display
+@param os output stream when the data is displayed
+
+*****************************************************************************/
+
+void display_rx_log_record(const rx_log_record & rec, std::ostream & os)
+{
+	os << std::endl;
+	os << "Samples Received: " << rec.num_samps << std::endl;
+	bool has_time_spec = (rec.flags & RX_LOG_FLAG_HAS_TIME_SPEC) != 0;
+	os << "Has time spec? " << has_time_spec << std::endl;
+	if(has_time_spec)
+		os << "\tSeconds " << rec.full_secs + rec.frac_secs << std::endl;
+	os << "More fragments? " << ((rec.flags & RX_LOG_FLAG_MORE_FRAGMENTS) != 0) << std::endl;
+	os << "Fragment Offset: " << rec.fragment_offset << std::endl;
+	os << "Start of Burst? " << ((rec.flags & RX_LOG_FLAG_START_OF_BURST) != 0) << std::endl;
+	os << "End of Burst? " << ((rec.flags & RX_LOG_FLAG_END_OF_BURST) != 0) << std::endl;
+	switch(rec.error_code)
+	{
+	case RX_LOG_ERROR_NONE:
+		os << "Error : " << "None" << std::endl;
+		break;
+	case RX_LOG_ERROR_TIMEOUT:
+		os << "Error : " << "Timeout" << std::endl;
+		break;
+	case RX_LOG_ERROR_LATE_COMMAND:
+		os << "Error : " << "Late Command" << std::endl;
+		break;
+	case RX_LOG_ERROR_BROKEN_CHAIN:
+		os << "Error : " << "Broken Chain" << std::endl;
+		break;
+	case RX_LOG_ERROR_OVERFLOW:
+		os << "Error : " << "Overflow" << std::endl;
+		break;
+	case RX_LOG_ERROR_ALIGNMENT:
+		os << "Error : " << "Alignment" << std::endl;
+		break;
+	case RX_LOG_ERROR_BAD_PACKET:
+		os << "Error : " << "Bad Packet" << std::endl;
+		break;
+	}
+}
@@ -0,0 +1,70 @@
+/***********************************************************************//**
+@file
+
+Binary format of the receive metadata log
+
+The log starts with an rx_log_header followed by one fixed size
+rx_log_record per recv() call. All the fields are stored in the native
+byte order of the machine which wrote the log; the magic number allows the
+decoder to detect a byte order mismatch.
+
+This file does not depend on UHD so that the offline decoder can be built
+on a machine without the driver.
+
+***************************************************************************/
+
+#ifndef RX_LOG_FORMAT_H
+#define RX_LOG_FORMAT_H
+
+#include <stdint.h>
+#include <ostream>
+
+#define RX_LOG_MAGIC 0x474c5852	// "RXLG"
+#define RX_LOG_VERSION 2
+
+// Bits of rx_log_record::flags
+#define RX_LOG_FLAG_HAS_TIME_SPEC	0x01
+#define RX_LOG_FLAG_MORE_FRAGMENTS	0x02
+#define RX_LOG_FLAG_START_OF_BURST	0x04
+#define RX_LOG_FLAG_END_OF_BURST	0x08
+
+// Values of rx_log_record::error_code. Identical to uhd::rx_metadata_t::error_code_t
+#define RX_LOG_ERROR_NONE			0x0
+#define RX_LOG_ERROR_TIMEOUT		0x1
+#define RX_LOG_ERROR_LATE_COMMAND	0x2
+#define RX_LOG_ERROR_BROKEN_CHAIN	0x4
+#define RX_LOG_ERROR_OVERFLOW		0x8
+#define RX_LOG_ERROR_ALIGNMENT		0xc
+#define RX_LOG_ERROR_BAD_PACKET		0xf
+
+
+/// Header written once at the start of the log
+struct rx_log_header
+{
+	uint32_t magic;			/// RX_LOG_MAGIC
+	uint16_t version;		/// RX_LOG_VERSION
+	uint16_t record_size;	/// sizeof(rx_log_record)
+	uint32_t sample_size;	/// Size in bytes of one complex sample in the data file
+	uint32_t reserved;
+};
+
+
+/// One record per recv() call. 40 bytes
+struct rx_log_record
+{
+	int64_t full_secs;		/// Integer part of md.time_spec
+	double frac_secs;		/// Fractional part of md.time_spec
+	uint64_t file_offset;	/// Byte offset of the first sample of the block in the data file
+	uint32_t num_samps;		/// Number of samples returned by recv()
+	uint32_t fragment_offset;	/// md.fragment_offset, in samples like num_samps
+	uint8_t error_code;		/// md.error_code
+	uint8_t flags;			/// RX_LOG_FLAG_xxx
+	uint16_t reserved;		/// Zero
+	uint32_t reserved2;		/// Zero
+};
+
+
+void display_rx_log_record(const rx_log_record & rec, std::ostream & os);
+
+
+#endif
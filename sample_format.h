@@ -0,0 +1,108 @@
+/***********************************************************************//**
+@file
+
+Host sample formats supported by the sampling task
+
+The host (cpu) format is a compile time parameter of the sampling task,
+of its ring and of the consumers, so that each format is handled without
+any run time conversion. The over the wire format is a run time choice:
+sc8 halves the bandwidth of the bus between the FPGA and the host at the
+cost of 8 bits of dynamic range, the conversion to the host format being
+done by UHD while it copies the packets.
+
+| cpu format | C++ type              | full scale |
+|------------|-----------------------|------------|
+| sc8        | std::complex<int8_t>  | 127        |
+| sc16       | std::complex<short>   | 32767      |
+| fc32       | std::complex<float>   | 1.0        |
+
+***************************************************************************/
+
+#ifndef SAMPLE_FORMAT_H
+#define SAMPLE_FORMAT_H
+
+#include <complex>
+#include <string>
+#include <cmath>
+#include <stdint.h>
+
+typedef std::complex<int8_t> sample_sc8;
+typedef std::complex<short> sample_sc16;
+typedef std::complex<float> sample_fc32;
+
+
+/// Properties of a host sample type
+template <typename T>
+struct sample_traits;
+
+template <>
+struct sample_traits<sample_sc8>
+{
+	static const char * cpu_format() {return "sc8";}
+	static double full_scale() {return 127.0;}
+};
+
+template <>
+struct sample_traits<sample_sc16>
+{
+	static const char * cpu_format() {return "sc16";}
+	static double full_scale() {return 32767.0;}
+};
+
+template <>
+struct sample_traits<sample_fc32>
+{
+	static const char * cpu_format() {return "fc32";}
+	static double full_scale() {return 1.0;}
+};
+
+
+/// Size in bytes of one complex sample of a cpu format. 0 if the format is not supported
+inline size_t cpu_format_size(const std::string & format)
+{
+	if(format == "sc8")
+		return sizeof(sample_sc8);
+	if(format == "sc16")
+		return sizeof(sample_sc16);
+	if(format == "fc32")
+		return sizeof(sample_fc32);
+	return 0;
+}
+
+
+/// True if the over the wire format is supported by the E100
+inline bool is_otw_format(const std::string & format)
+{
+	return format == "sc8" || format == "sc16";
+}
+
+
+/***********************************************************************//**
+Stores a value relative to full scale (-1.0 .. 1.0) in a sample,
+saturating the integer formats
+
+***************************************************************************/
+
+inline int saturate_int(double value, int limit)
+{
+	long rounded = lrint(value);
+	return rounded > limit ? limit : (rounded < -limit - 1 ? -limit - 1 : int(rounded));
+}
+
+inline void store_sample(sample_sc8 & out, double i, double q)
+{
+	out = sample_sc8(int8_t(saturate_int(i * 127.0, 127)), int8_t(saturate_int(q * 127.0, 127)));
+}
+
+inline void store_sample(sample_sc16 & out, double i, double q)
+{
+	out = sample_sc16(short(saturate_int(i * 32767.0, 32767)), short(saturate_int(q * 32767.0, 32767)));
+}
+
+inline void store_sample(sample_fc32 & out, double i, double q)
+{
+	out = sample_fc32(float(i), float(q));
+}
+
+
+#endif
@@ -0,0 +1,427 @@
+/***********************************************************************//**
+@file
+
+Lock-free single producer / single consumer ring of sample blocks
+
+The producer (normally the sampling task) fills the blocks and publishes
+them with release semantics. The consumer acquires them, processes the
+samples and releases the slot. If the consumer falls behind and the ring
+is full, the producer receives into a spill block which is never
+published and the overrun counter is incremented, so that no published
+block is ever overwritten while it is being read.
+
+***************************************************************************/
+
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <atomic>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <stdint.h>
+#include "/usr/include/uhd/usrp/multi_usrp.hpp"
+#include "latency_stats.h"
+#include "block_pool.h"
+
+
+/***********************************************************************//**
+One block of samples together with the metadata returned by recv()
+
+***************************************************************************/
+template <typename T>
+struct sample_block
+{
+	T * samples;			/// Sample storage, aligned on a cache line (or page, see block_pool)
+	size_t capacity;		/// Number of samples which can be stored
+	size_t num_samps;		/// Number of valid samples in the block
+	uint64_t sequence;		/// Sequence number of the block since the start of the ring
+	uint64_t first_sample;	/// Number of the first sample since the start of the stream, gaps included
+	uhd::rx_metadata_t md;	/// Metadata of the recv() call which filled the block
+	uint64_t skipped;		/// Samples left out by the squelch just before this block (see squelch.h)
+	uint64_t publish_time;	/// monotonic_ns() when the block was published, to measure the handoff latency
+};
+
+
+/***********************************************************************//**
+One block of samples to transmit together with the metadata given to
+send(): start and end of burst, and the time of the first sample
+
+***************************************************************************/
+template <typename T>
+struct tx_block
+{
+	T * samples;			/// Sample storage, aligned on a cache line (or page, see block_pool)
+	size_t capacity;		/// Number of samples which can be stored
+	size_t num_samps;		/// Number of valid samples in the block
+	uint64_t sequence;		/// Sequence number of the block since the start of the ring
+	uhd::tx_metadata_t md;	/// Metadata of the send() call of the block
+	uint64_t publish_time;	/// monotonic_ns() when the block was published
+};
+
+
+/***********************************************************************//**
+Lock-free SPSC ring of sample blocks
+
+The number of slots is rounded up to a power of two. Exactly one thread
+may call the producer functions (acquire_write, publish) and exactly one
+thread may call the consumer functions (try_read, wait_read, release).
+The counters can be read from any thread.
+
+The blocks are sample_block (received samples) by default, or tx_block
+for the transmit path. publish_zeros_before() only exists for the former.
+
+***************************************************************************/
+template <typename T, typename B = sample_block<T> >
+class sample_ring
+{
+public:
+	typedef T value_type;
+	typedef B block_t;
+
+	sample_ring(size_t num_slots, size_t samps_per_block);
+	~sample_ring();
+
+	// Producer side
+	block_t * acquire_write();
+	void publish();
+	size_t publish_zeros_before(size_t count, double rate);
+
+	// Consumer side
+	const block_t * try_read();
+	const block_t * wait_read(int timeout_ms = -1);
+	void release();
+
+	/// Wakes up the consumer and makes wait_read() return NULL once the ring is empty
+	void close();
+	/// Re-opens the ring after a close(). Must be called while neither side is active
+	void reset();
+
+	/// True once close() has been called
+	bool is_closed() const {return closed.load(std::memory_order_acquire);}
+	/// Number of slots in the ring
+	size_t size() const {return num_slots;}
+	/// Number of samples in each block
+	size_t block_size() const {return samps_per_block;}
+	/// Number of blocks published and not yet released by the consumer
+	size_t depth() const {return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);}
+	/// Number of blocks published since the creation of the ring
+	uint64_t get_published() const {return published.load(std::memory_order_relaxed);}
+	/// Number of blocks lost because the ring was full
+	uint64_t get_overruns() const {return overruns.load(std::memory_order_relaxed);}
+
+private:
+	sample_ring(const sample_ring &);
+	sample_ring & operator=(const sample_ring &);
+
+	block_t * slot(size_t index) {return &blocks[index & mask];}
+	void notify_consumer();
+
+	size_t num_slots;		/// Number of slots (power of two)
+	size_t mask;			/// num_slots - 1
+	size_t samps_per_block;	/// Capacity of each block in samples
+	block_t * blocks;		/// Array of num_slots blocks
+	block_t spill;			/// Block used by the producer when the ring is full
+	T * storage;			/// Single allocation holding the samples of all the blocks
+	size_t storage_bytes;	/// Size of the allocation
+	bool writing_spill;		/// True if the block handed out by acquire_write() is the spill block
+
+	// Producer and consumer indexes are kept on separate cache lines
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> head;	/// Count of published blocks (written by producer)
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail;	/// Count of released blocks (written by consumer)
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> published;
+	std::atomic<uint64_t> overruns;
+	std::atomic<bool> closed;
+	std::atomic<bool> consumer_waiting;
+
+	pthread_mutex_t wait_mutex;	/// Only used to put the consumer to sleep
+	pthread_cond_t wait_cond;
+};
+
+
+/***********************************************************************//**
+Constructor: Allocates all the blocks of the ring
+
+@param num_slots Number of blocks in the ring. Rounded up to a power of two (minimum 2)
+@param samps_per_block Number of samples in each block
+
+***************************************************************************/
+template <typename T, typename B>
+sample_ring<T, B>::sample_ring(size_t slots, size_t samps)
+:num_slots(2), samps_per_block(samps), blocks(NULL), spill(), storage(NULL), storage_bytes(0), writing_spill(false),
+ head(0), tail(0), published(0), overruns(0), closed(false), consumer_waiting(false)
+{
+	while(num_slots < slots)
+		num_slots <<= 1;
+	mask = num_slots - 1;
+
+	// Round the size of each block to a whole number of cache lines (or
+	// pages) so that every block starts on an aligned boundary
+	size_t align = pool_alignment();
+	size_t block_bytes = samps_per_block * sizeof(T);
+	block_bytes = (block_bytes + align - 1) & ~(align - 1);
+	size_t stride = block_bytes / sizeof(T);
+
+	storage_bytes = block_bytes * (num_slots + 1);
+	storage = static_cast<T*>(pool_alloc(storage_bytes));
+	for(size_t index = 0; index < stride * (num_slots + 1); index++)
+		new (&storage[index]) T();
+
+	// The other fields of the blocks start at zero
+	blocks = new block_t[num_slots]();
+	for(size_t index = 0; index < num_slots; index++)
+	{
+		blocks[index].samples = storage + index * stride;
+		blocks[index].capacity = samps_per_block;
+	}
+	spill.samples = storage + num_slots * stride;
+	spill.capacity = samps_per_block;
+
+	pthread_mutex_init(&wait_mutex, NULL);
+	pthread_cond_init(&wait_cond, NULL);
+}
+
+
+/***********************************************************************//**
+Destructor: Deallocates the blocks
+
+***************************************************************************/
+template <typename T, typename B>
+sample_ring<T, B>::~sample_ring()
+{
+	delete [] blocks;
+	pool_free(storage, storage_bytes);
+	pthread_cond_destroy(&wait_cond);
+	pthread_mutex_destroy(&wait_mutex);
+}
+
+
+/***********************************************************************//**
+Producer: Returns the block to fill next
+
+If the consumer has not released enough slots, the spill block is
+returned instead and the overrun counter is incremented. The samples
+written to the spill block are never delivered.
+
+@return Pointer to the block to fill. Never NULL
+
+***************************************************************************/
+template <typename T, typename B>
+typename sample_ring<T, B>::block_t * sample_ring<T, B>::acquire_write()
+{
+	size_t h = head.load(std::memory_order_relaxed);
+	if(h - tail.load(std::memory_order_acquire) >= num_slots)
+	{
+		overruns.fetch_add(1, std::memory_order_relaxed);
+		writing_spill = true;
+		return &spill;
+	}
+	writing_spill = false;
+	block_t * b = slot(h);
+	b->sequence = h;
+	return b;
+}
+
+
+/***********************************************************************//**
+Producer: Makes the block returned by the last acquire_write() visible to
+the consumer
+
+***************************************************************************/
+template <typename T, typename B>
+void sample_ring<T, B>::publish()
+{
+	if(writing_spill)
+		return;
+	slot(head.load(std::memory_order_relaxed))->publish_time = monotonic_ns();
+	head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	published.fetch_add(1, std::memory_order_relaxed);
+	notify_consumer();
+}
+
+
+/***********************************************************************//**
+Producer: Publishes blocks of zero samples ahead of the block being
+written, to fill a gap in the stream
+
+The block returned by the last acquire_write() must already contain its
+samples, first_sample and metadata. Its sample storage is exchanged with
+the storage of the following free slot, so that the zeros can be written
+in the slot which comes first without copying the received samples. The
+zero blocks get the metadata of the received block with their time moved
+back by the length of the gap.
+
+@param count Number of zero samples to insert
+@param rate Sample rate, used to compute the time of the zero blocks
+
+@return Number of zero samples inserted. Less than count if the ring
+became full
+
+***************************************************************************/
+template <typename T, typename B>
+size_t sample_ring<T, B>::publish_zeros_before(size_t count, double rate)
+{
+	if(writing_spill)
+		return 0;
+	size_t inserted = 0;
+	while(inserted < count)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if(h + 1 - tail.load(std::memory_order_acquire) >= num_slots)
+			break;
+		block_t * zero = slot(h);
+		block_t * next = slot(h + 1);
+
+		// Move the received samples to the next slot
+		T * samples = next->samples;
+		next->samples = zero->samples;
+		zero->samples = samples;
+		next->num_samps = zero->num_samps;
+		next->md = zero->md;
+		next->first_sample = zero->first_sample;
+		next->skipped = zero->skipped;
+		next->sequence = h + 1;
+
+		// The zeros cover the beginning of the part of the gap still to be filled
+		size_t n = count - inserted;
+		if(n > samps_per_block)
+			n = samps_per_block;
+		for(size_t index = 0; index < n; index++)
+			zero->samples[index] = T();
+		zero->num_samps = n;
+		zero->first_sample = next->first_sample - (count - inserted);
+		zero->md.has_time_spec = next->md.has_time_spec;
+		zero->md.time_spec = next->md.time_spec - uhd::time_spec_t::from_ticks(count - inserted, rate);
+		zero->md.error_code = uhd::rx_metadata_t::ERROR_CODE_NONE;
+		zero->skipped = 0;
+		zero->publish_time = monotonic_ns();
+		inserted += n;
+
+		head.store(h + 1, std::memory_order_release);
+		published.fetch_add(1, std::memory_order_relaxed);
+	}
+	if(inserted)
+		notify_consumer();
+	return inserted;
+}
+
+
+/***********************************************************************//**
+Consumer: Returns the oldest published block without blocking
+
+@return Pointer to the block or NULL if no block is available
+
+***************************************************************************/
+template <typename T, typename B>
+const typename sample_ring<T, B>::block_t * sample_ring<T, B>::try_read()
+{
+	size_t t = tail.load(std::memory_order_relaxed);
+	if(head.load(std::memory_order_acquire) == t)
+		return NULL;
+	return slot(t);
+}
+
+
+/***********************************************************************//**
+Consumer: Waits for the next published block
+
+@param timeout_ms Maximum time to wait in milliseconds. A negative value waits forever
+
+@return Pointer to the block or NULL on timeout or when the ring has been closed
+
+***************************************************************************/
+template <typename T, typename B>
+const typename sample_ring<T, B>::block_t * sample_ring<T, B>::wait_read(int timeout_ms)
+{
+	const block_t * b = try_read();
+	if(b)
+		return b;
+
+	struct timespec deadline;
+	if(timeout_ms >= 0)
+	{
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += timeout_ms / 1000;
+		deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+		if(deadline.tv_nsec >= 1000000000L)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+	}
+
+	pthread_mutex_lock(&wait_mutex);
+	consumer_waiting.store(true, std::memory_order_seq_cst);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	while((b = try_read()) == NULL && !closed.load(std::memory_order_acquire))
+	{
+		int res;
+		if(timeout_ms >= 0)
+			res = pthread_cond_timedwait(&wait_cond, &wait_mutex, &deadline);
+		else
+			res = pthread_cond_wait(&wait_cond, &wait_mutex);
+		if(res == ETIMEDOUT)
+		{
+			b = try_read();
+			break;
+		}
+	}
+	consumer_waiting.store(false, std::memory_order_relaxed);
+	pthread_mutex_unlock(&wait_mutex);
+	return b;
+}
+
+
+/***********************************************************************//**
+Consumer: Returns the block obtained with try_read() or wait_read() to
+the producer
+
+***************************************************************************/
+template <typename T, typename B>
+void sample_ring<T, B>::release()
+{
+	tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+
+template <typename T, typename B>
+void sample_ring<T, B>::close()
+{
+	closed.store(true, std::memory_order_release);
+	pthread_mutex_lock(&wait_mutex);
+	pthread_cond_broadcast(&wait_cond);
+	pthread_mutex_unlock(&wait_mutex);
+}
+
+
+template <typename T, typename B>
+void sample_ring<T, B>::reset()
+{
+	head.store(0);
+	tail.store(0);
+	closed.store(false);
+}
+
+
+/***********************************************************************//**
+Wakes up the consumer if it is sleeping in wait_read(). The mutex is only
+taken when the consumer is actually waiting so that the common path of
+the producer stays lock-free.
+
+***************************************************************************/
+template <typename T, typename B>
+void sample_ring<T, B>::notify_consumer()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(!consumer_waiting.load(std::memory_order_seq_cst))
+		return;
+	pthread_mutex_lock(&wait_mutex);
+	pthread_cond_signal(&wait_cond);
+	pthread_mutex_unlock(&wait_mutex);
+}
+
+
+#endif
@@ -0,0 +1,71 @@
+/***********************************************************************//**
+@file
+
+Interface of the sinks of samples used by the transmit task
+
+The transmit task does not talk to the hardware directly: it sends the
+samples to a sample_sink, the counterpart of sample_source. Two
+implementations exist:
+- uhd_sink: the USRP through UHD
+- sim_sink: software device playing the samples at the sample rate
+
+***************************************************************************/
+
+#ifndef SAMPLE_SINK_H
+#define SAMPLE_SINK_H
+
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+#include "/usr/include/uhd/usrp/multi_usrp.hpp"
+#include "sample_format.h"
+
+
+/***********************************************************************//**
+Abstract sink of samples
+
+start() is called by task_transmit::start(), send(), recv_async_msg()
+and stop() from the transmit thread. send() and recv_async_msg() have
+the semantics of uhd::tx_streamer::send() and recv_async_msg(): the
+samples are in the cpu format given to set_format(), and the device
+reports underflows, late bursts and the end of the bursts as async
+messages. get_rate() and get_packet_samps() are valid after prepare(),
+which start() calls if it has not been done.
+
+***************************************************************************/
+class sample_sink
+{
+public:
+	sample_sink() : cpu_format("sc16"), otw_format("sc16"), hint_spp(0) {}
+	virtual ~sample_sink() {}
+
+	/// Host and over the wire formats of the samples, used by the next prepare()
+	void set_format(const std::string & cpu, const std::string & otw) {cpu_format = cpu; otw_format = otw;}
+	/// Number of samples per transport packet requested from the device. 0 keeps its default
+	void set_spp(size_t spp) {hint_spp = spp;}
+
+	/// Opens the stream without starting it. Returns true if an error occurred
+	virtual bool prepare() {return false;}
+	/// Number of samples in one transport packet, 0 if the sink has no packets
+	virtual size_t get_packet_samps() {return 0;}
+	/// Starts the stream. Returns true if an error occurred
+	virtual bool start() = 0;
+	/// Sends num_samps samples. Returns the number of samples accepted before the timeout
+	virtual size_t send(const void * buf, size_t num_samps, const uhd::tx_metadata_t & md, double timeout) = 0;
+	/// Reads the next async message of the device. Returns false if none arrived before the timeout
+	virtual bool recv_async_msg(uhd::async_metadata_t & md, double timeout) = 0;
+	/// Stops the stream
+	virtual void stop() = 0;
+	/// Sample rate of the stream in samples/s
+	virtual double get_rate() = 0;
+	/// Current time of the device, the reference of the time_spec of the bursts
+	virtual uhd::time_spec_t get_time_now() = 0;
+
+protected:
+	std::string cpu_format;		/// Host format of the samples ("sc8", "sc16" or "fc32")
+	std::string otw_format;		/// Over the wire format of the samples
+	size_t hint_spp;			/// Requested samples per packet, 0 for the default of the device
+};
+
+
+#endif
@@ -0,0 +1,86 @@
+#include "sample_source.h"
+#include <errno.h>
+#include <iostream>
+
+
+/***********************************************************************//**
+Computes the number of samples of the blocks of the sampling task from
+a latency budget
+
+A block is handed to the consumer only once it is full, so the block
+duration is the part of the latency added by the sampling task. The
+block holds the largest whole number of transport packets which fits in
+the budget, with at least one packet. Each recv() then moves whole
+packets and the transport never has to keep a partial packet for the
+next call.
+
+@param source Source of the samples, with its format already set. Its
+prepare() is called to know the rate and the packet size
+@param latency_budget Maximum duration of a block in seconds
+
+@return Number of samples per block. 0 if the source could not be prepared
+
+***************************************************************************/
+
+size_t plan_block_size(sample_source & source, double latency_budget)
+{
+	if(source.prepare())
+		return 0;
+	double rate = source.get_rate();
+	size_t packet = source.get_packet_samps();
+	size_t samps = size_t(rate * latency_budget);
+	if(packet)
+	{
+		samps -= samps % packet;
+		if(samps < packet)
+			samps = packet;
+	}
+	else if(samps == 0)
+		samps = 1;
+	std::cout << "Block size: " << samps << " samples (" << samps / rate * 1e3 << " ms";
+	if(packet)
+		std::cout << ", " << samps / packet << " packets of " << packet;
+	std::cout << ")" << std::endl;
+	return samps;
+}
+
+
+/***********************************************************************//**
+Starts pacing: the first sample is due now
+
+@param sample_rate Sample rate in samples/s. 0 disables the pacing
+
+***************************************************************************/
+
+void source_pacer::start(double sample_rate)
+{
+	rate = sample_rate;
+	clock_gettime(CLOCK_MONOTONIC, &origin);
+}
+
+
+/***********************************************************************//**
+Sleeps until the given number of samples would have been received by
+a real device
+
+@param samples Number of samples delivered since start()
+
+***************************************************************************/
+
+void source_pacer::wait(uint64_t samples)
+{
+	if(rate <= 0)
+		return;
+	double elapsed = samples / rate;
+	struct timespec due = origin;
+	time_t secs = time_t(elapsed);
+	due.tv_sec += secs;
+	due.tv_nsec += long((elapsed - secs) * 1e9);
+	if(due.tv_nsec >= 1000000000L)
+	{
+		due.tv_sec++;
+		due.tv_nsec -= 1000000000L;
+	}
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR)
+		;
+}
@@ -0,0 +1,114 @@
+/***********************************************************************//**
+@file
+
+Interface of the sources of samples used by the sampling task
+
+The sampling task does not talk to the hardware directly: it receives the
+samples from a sample_source. Three implementations exist:
+- uhd_source: the USRP through UHD
+- file_source: replay of a capture file
+- sim_source: synthetic signal generator
+
+***************************************************************************/
+
+#ifndef SAMPLE_SOURCE_H
+#define SAMPLE_SOURCE_H
+
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+#include <time.h>
+#include "/usr/include/uhd/usrp/multi_usrp.hpp"
+#include "capture_file.h"
+#include "sample_format.h"
+
+
+/***********************************************************************//**
+Abstract source of samples
+
+start() is called by task_sampling::start(), recv() and stop() from the
+sampling thread. recv() has the semantics of
+uhd::rx_streamer::recv(): it fills the buffer with samples in the cpu
+format given to set_format() and the metadata of the first sample.
+describe() is valid after start(). get_rate() and get_packet_samps() are
+valid after prepare(), which start() calls if it has not been done.
+
+***************************************************************************/
+class sample_source
+{
+public:
+	sample_source() : cpu_format("sc16"), otw_format("sc16"), hint_spp(0) {}
+	virtual ~sample_source() {}
+
+	/// Host and over the wire formats of the samples, used by the next prepare()
+	void set_format(const std::string & cpu, const std::string & otw) {cpu_format = cpu; otw_format = otw;}
+	/// Number of samples per transport packet requested from the device. 0 keeps its default
+	void set_spp(size_t spp) {hint_spp = spp;}
+
+	/// Opens the stream without starting it. Returns true if an error occurred
+	virtual bool prepare() {return false;}
+	/// Number of samples in one transport packet, 0 if the source has no packets
+	virtual size_t get_packet_samps() {return 0;}
+	/// Starts the stream. Returns true if an error occurred
+	virtual bool start(size_t samps_per_buf) = 0;
+	/// Receives up to num_samps samples. Returns the number of samples received
+	virtual size_t recv(void * buf, size_t num_samps, uhd::rx_metadata_t & md, double timeout) = 0;
+	/// Stops the stream
+	virtual void stop() = 0;
+	/// True once the source has no more samples to deliver (end of a replay)
+	virtual bool is_done() const {return false;}
+	/// Sample rate of the stream in samples/s
+	virtual double get_rate() = 0;
+	/// Fills the header of a capture file and the text stored after it
+	virtual void describe(capture_header & header, std::string & snapshot) = 0;
+
+protected:
+	std::string cpu_format;		/// Host format of the samples ("sc8", "sc16" or "fc32")
+	std::string otw_format;		/// Over the wire format of the samples
+	size_t hint_spp;			/// Requested samples per packet, 0 for the default of the device
+};
+
+
+size_t plan_block_size(sample_source & source, double latency_budget);
+
+
+/***********************************************************************//**
+Paces a software source at the real sample rate
+
+***************************************************************************/
+class source_pacer
+{
+public:
+	source_pacer() : rate(0) {}
+	void start(double rate);
+	void wait(uint64_t samples);
+
+private:
+	double rate;			/// Sample rate in samples/s
+	struct timespec origin;	/// Time at which the first sample was delivered
+};
+
+
+/***********************************************************************//**
+Injects overflows in a software source: every N blocks, recv() returns
+an ERROR_CODE_OVERFLOW without samples and some samples are skipped, as
+the USRP does when the host does not read fast enough
+
+***************************************************************************/
+class overflow_injector
+{
+public:
+	overflow_injector() : every(0), lost(0), count(0) {}
+	/// Injects an overflow every num_blocks calls, losing num_samps samples
+	void configure(size_t num_blocks, size_t num_samps) {every = num_blocks; lost = num_samps; count = 0;}
+	/// Returns the number of samples to skip if an overflow must be reported now, 0 otherwise
+	size_t check() {return (every && ++count % every == 0) ? lost : 0;}
+
+private:
+	size_t every;		/// Number of blocks between overflows. 0 disables the injection
+	size_t lost;		/// Number of samples lost at each overflow
+	uint64_t count;		/// Number of calls to check()
+};
+
+
+#endif
@@ -0,0 +1,219 @@
+#include "sim_sink.h"
+#include <ctime>
+#include <iostream>
+#include "latency_stats.h"
+
+
+/// Suspends the thread for the given time in seconds
+static void sleep_seconds(double seconds)
+{
+	if(seconds <= 0)
+		return;
+	struct timespec delay;
+	delay.tv_sec = time_t(seconds);
+	delay.tv_nsec = long((seconds - delay.tv_sec) * 1e9);
+	nanosleep(&delay, NULL);
+}
+
+
+/***********************************************************************//**
+Constructor
+
+@param cfg Description of the device
+
+***************************************************************************/
+
+sim_sink::sim_sink(const sim_sink_config & cfg)
+:config(cfg), sample_size(0), origin(0), play_end(0), in_burst(false), dropping(false), underflowed(false),
+ samples(0), dropped(0), bursts(0), underflows(0), late(0), lost_events(0), checksum(SIM_CHECKSUM_INIT),
+ event_head(0), event_tail(0)
+{
+}
+
+
+/***********************************************************************//**
+Checks the formats of the stream
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool sim_sink::prepare()
+{
+	sample_size = cpu_format_size(cpu_format);
+	if(config.rate <= 0 || sample_size == 0 || !is_otw_format(otw_format))
+	{
+		std::cout << "Unsupported sample format " << cpu_format << "/" << otw_format << std::endl;
+		return true;
+	}
+	if(hint_spp)
+		config.packet_samps = hint_spp;
+	return false;
+}
+
+
+/***********************************************************************//**
+Resets the device: clock at 0, no burst, empty message queue
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool sim_sink::start()
+{
+	if(prepare())
+		return true;
+	origin = monotonic_ns();
+	play_end = 0;
+	in_burst = false;
+	dropping = false;
+	underflowed = false;
+	samples = 0;
+	dropped = 0;
+	bursts = 0;
+	underflows = 0;
+	late = 0;
+	lost_events = 0;
+	checksum = SIM_CHECKSUM_INIT;
+	event_head = 0;
+	event_tail = 0;
+	return false;
+}
+
+
+/// Current device time in seconds
+double sim_sink::device_time()
+{
+	if(!config.paced)
+		return play_end;
+	return (monotonic_ns() - origin) * 1e-9;
+}
+
+
+/***********************************************************************//**
+Plays the samples of one send() call
+
+The samples are accepted as long as they fit in the buffer of the device
+before the timeout, as UHD does.
+
+@return Number of samples accepted
+
+***************************************************************************/
+
+size_t sim_sink::send(const void * buf, size_t num_samps, const uhd::tx_metadata_t & md, double timeout)
+{
+	double now = device_time();
+	check_underflow(now);
+	if(!in_burst || md.start_of_burst)
+	{
+		// A new burst, or the continuous stream, starts after the samples queued
+		in_burst = true;
+		dropping = false;
+		underflowed = false;
+		bursts++;
+		double start = play_end > now ? play_end : now;
+		if(md.has_time_spec)
+		{
+			if(md.time_spec.get_real_secs() < start)
+			{
+				late++;
+				push_event(uhd::async_metadata_t::EVENT_CODE_TIME_ERROR, now);
+				dropping = true;
+			}
+			else
+				start = md.time_spec.get_real_secs();
+		}
+		if(!dropping)
+			play_end = start;
+	}
+	else if(underflowed)
+	{
+		// The burst resumes with a gap
+		play_end = now;
+		underflowed = false;
+	}
+
+	if(dropping)
+	{
+		dropped += num_samps;
+		if(md.end_of_burst)
+			in_burst = false;
+		return num_samps;
+	}
+
+	// Flow control: wait until the buffer of the device has room
+	size_t accepted = num_samps;
+	if(config.paced)
+	{
+		double buffer_time = config.buffer_samps / config.rate;
+		double wait = play_end + num_samps / config.rate - buffer_time - now;
+		if(wait > timeout)
+		{
+			double room = (now + timeout + buffer_time - play_end) * config.rate;
+			accepted = room <= 0 ? 0 : (room < num_samps ? size_t(room) : num_samps);
+			wait = timeout;
+		}
+		sleep_seconds(wait);
+	}
+	checksum = sim_checksum(checksum, buf, accepted * sample_size);
+	play_end += accepted / config.rate;
+	samples += accepted;
+
+	if(md.end_of_burst && accepted == num_samps)
+	{
+		push_event(uhd::async_metadata_t::EVENT_CODE_BURST_ACK, play_end);
+		in_burst = false;
+	}
+	return accepted;
+}
+
+
+/***********************************************************************//**
+Returns the next async message of the device
+
+@return false if no message arrived before the timeout
+
+***************************************************************************/
+
+bool sim_sink::recv_async_msg(uhd::async_metadata_t & md, double timeout)
+{
+	check_underflow(device_time());
+	if(event_head == event_tail && config.paced && timeout > 0)
+	{
+		sleep_seconds(timeout);
+		check_underflow(device_time());
+	}
+	if(event_head == event_tail)
+		return false;
+	md = events[event_tail & (SIM_SINK_EVENTS - 1)];
+	event_tail++;
+	return true;
+}
+
+
+/// Reports an underflow if the open burst has run out of samples
+void sim_sink::check_underflow(double now)
+{
+	if(!in_burst || dropping || underflowed || now <= play_end)
+		return;
+	underflowed = true;
+	underflows++;
+	push_event(uhd::async_metadata_t::EVENT_CODE_UNDERFLOW, play_end);
+}
+
+
+/// Queues an async message. The message is lost if the queue is full
+void sim_sink::push_event(uhd::async_metadata_t::event_code_t code, double time)
+{
+	if(event_head - event_tail >= SIM_SINK_EVENTS)
+	{
+		lost_events++;
+		return;
+	}
+	uhd::async_metadata_t & md = events[event_head & (SIM_SINK_EVENTS - 1)];
+	md.channel = 0;
+	md.has_time_spec = true;
+	md.time_spec = uhd::time_spec_t(time);
+	md.event_code = code;
+	event_head++;
+}
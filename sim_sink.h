@@ -0,0 +1,123 @@
+/***********************************************************************//**
+@file
+
+Declaration of the simulated transmitter
+
+
+***************************************************************************/
+
+#ifndef SIM_SINK_H
+#define SIM_SINK_H
+
+#include <cstddef>
+#include <stdint.h>
+#include "sample_sink.h"
+
+// Number of async messages queued by the simulated device (power of two)
+#define SIM_SINK_EVENTS 64
+
+
+/// Description of the simulated transmitter
+struct sim_sink_config
+{
+	sim_sink_config() : rate(125000), buffer_samps(16384), packet_samps(362), paced(true) {}
+
+	double rate;			/// Sample rate in samples/s
+	size_t buffer_samps;	/// Samples the device buffers ahead of the output
+	size_t packet_samps;	/// Samples per transport packet
+	bool paced;				/// true to play the samples at the sample rate
+};
+
+
+/***********************************************************************//**
+Sample sink playing the samples like a transmitter
+
+The device clock starts at 0 with start(). When paced, the device holds
+up to buffer_samps samples not played yet: send() waits for room like
+the flow control of UHD, and a burst (or the continuous stream) which is
+not ended by end_of_burst and runs out of samples reports an underflow.
+A burst whose time_spec is already past reports a time error and its
+samples are dropped until its end_of_burst. The end of each burst played
+is acknowledged with a burst ack.
+
+When not paced the samples are played as soon as they are sent: the
+device clock is the end of the last sample, so that the results do not
+depend on the load of the machine. Underflows never occur.
+
+send() and recv_async_msg() must be called from the same thread.
+The counters are valid once the transmit task is stopped.
+
+***************************************************************************/
+class sim_sink : public sample_sink
+{
+public:
+	sim_sink(const sim_sink_config & config);
+
+	bool prepare();
+	size_t get_packet_samps() {return config.packet_samps;}
+	bool start();
+	size_t send(const void * buf, size_t num_samps, const uhd::tx_metadata_t & md, double timeout);
+	bool recv_async_msg(uhd::async_metadata_t & md, double timeout);
+	void stop() {}
+	double get_rate() {return config.rate;}
+	uhd::time_spec_t get_time_now() {return uhd::time_spec_t(device_time());}
+
+	/// Samples played, the dropped ones excluded
+	uint64_t get_samples() const {return samples;}
+	/// Samples of the late bursts, never played
+	uint64_t get_dropped() const {return dropped;}
+	/// Bursts started, the continuous stream counting as one
+	uint64_t get_bursts() const {return bursts;}
+	/// Underflows reported
+	uint64_t get_underflows() const {return underflows;}
+	/// Late bursts reported
+	uint64_t get_late() const {return late;}
+	/// Async messages lost because the application did not read them
+	uint64_t get_lost_events() const {return lost_events;}
+	/// Checksum of the samples played, see sim_checksum()
+	uint64_t get_checksum() const {return checksum;}
+
+private:
+	double device_time();
+	void check_underflow(double now);
+	void push_event(uhd::async_metadata_t::event_code_t code, double time);
+
+	sim_sink_config config;		/// Description of the device
+	size_t sample_size;			/// Size of one sample of the cpu format
+	uint64_t origin;			/// monotonic_ns() of the device time 0
+	double play_end;			/// Device time at which the samples sent so far are played
+	bool in_burst;				/// True from the first send() of a burst until its end_of_burst
+	bool dropping;				/// True while the samples of a late burst are dropped
+	bool underflowed;			/// True if the current burst ran out of samples
+	uint64_t samples;			/// Samples played
+	uint64_t dropped;			/// Samples of the late bursts
+	uint64_t bursts;			/// Bursts started
+	uint64_t underflows;		/// Underflows reported
+	uint64_t late;				/// Time errors reported
+	uint64_t lost_events;		/// Events lost with a full queue
+	uint64_t checksum;			/// Checksum of the samples played
+	uhd::async_metadata_t events[SIM_SINK_EVENTS];	/// Async messages not read yet
+	size_t event_head;			/// Count of messages queued
+	size_t event_tail;			/// Count of messages read
+};
+
+
+/***********************************************************************//**
+Updates a FNV-1a checksum with the bytes of some samples. The producers
+of the benchmarks compute the same value to check that every sample was
+played once and in order
+
+***************************************************************************/
+inline uint64_t sim_checksum(uint64_t hash, const void * data, size_t bytes)
+{
+	const uint8_t * p = static_cast<const uint8_t*>(data);
+	for(size_t index = 0; index < bytes; index++)
+		hash = (hash ^ p[index]) * 1099511628211ULL;
+	return hash;
+}
+
+/// Initial value of sim_checksum()
+#define SIM_CHECKSUM_INIT 14695981039346656037ULL
+
+
+#endif
@@ -0,0 +1,250 @@
+#include "sim_source.h"
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <iostream>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+/***********************************************************************//**
+Constructor
+
+@param cfg Description of the signal to generate
+
+***************************************************************************/
+
+sim_source::sim_source(const sim_config & cfg)
+:config(cfg), quantize_sc8(false), position(0), rng_state(cfg.seed ? cfg.seed : 1), has_spare(false), spare(0),
+ samps_per_symbol(1), burst_period_samps(0)
+{
+}
+
+
+/***********************************************************************//**
+Resets the generator to the first sample
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool sim_source::start(size_t)
+{
+	if(config.rate <= 0)
+		return true;
+	if(cpu_format_size(cpu_format) == 0 || !is_otw_format(otw_format))
+	{
+		std::cout << "Unsupported sample format " << cpu_format << "/" << otw_format << std::endl;
+		return true;
+	}
+	// The 8 bits of the wire are simulated for the wider host formats
+	quantize_sc8 = otw_format == "sc8" && cpu_format != "sc8";
+	position = 0;
+	rng_state = config.seed ? config.seed : 1;
+	has_spare = false;
+
+	phasors.assign(config.tones.size(), std::complex<double>(1, 0));
+	steps.clear();
+	for(size_t index = 0; index < config.tones.size(); index++)
+		steps.push_back(std::polar(1.0, 2 * M_PI * config.tones[index].freq / config.rate));
+
+	burst_phasor = std::complex<double>(1, 0);
+	burst_step = std::polar(1.0, 2 * M_PI * config.burst_freq / config.rate);
+	symbol = std::complex<double>(0, 0);
+	samps_per_symbol = config.symbol_rate > 0 ? config.rate / config.symbol_rate : 1;
+	burst_period_samps = uint64_t(config.burst_period * config.rate);
+
+	pacer.start(config.paced ? config.rate : 0);
+	return false;
+}
+
+
+/***********************************************************************//**
+Generates the next samples
+
+@return Number of samples written into buf
+
+***************************************************************************/
+
+size_t sim_source::recv(void * buf, size_t num_samps, uhd::rx_metadata_t & md, double)
+{
+	md = uhd::rx_metadata_t();
+	md.error_code = uhd::rx_metadata_t::ERROR_CODE_NONE;
+	if(is_done())
+	{
+		md.error_code = uhd::rx_metadata_t::ERROR_CODE_TIMEOUT;
+		return 0;
+	}
+
+	size_t lost = injector.check();
+	if(lost)
+	{
+		skip(lost);
+		md.error_code = uhd::rx_metadata_t::ERROR_CODE_OVERFLOW;
+		return 0;
+	}
+
+	if(config.num_samples && num_samps > config.num_samples - position)
+		num_samps = config.num_samples - position;
+	md.has_time_spec = true;
+	md.time_spec = uhd::time_spec_t::from_ticks(position, config.rate);
+	if(cpu_format == "sc8")
+		generate(static_cast<sample_sc8 *>(buf), num_samps);
+	else if(cpu_format == "fc32")
+		generate(static_cast<sample_fc32 *>(buf), num_samps);
+	else
+		generate(static_cast<sample_sc16 *>(buf), num_samps);
+	pacer.wait(position);
+	return num_samps;
+}
+
+
+/***********************************************************************//**
+Computes the next samples of the signal
+
+Can also be used directly, without the sampling task, to feed the DSP
+stages with a known signal.
+
+The samples are stored in the type of out (sample_sc8, sample_sc16 or
+sample_fc32), relative to the full scale of this type.
+
+@param out Receives the samples
+@param num_samps Number of samples to generate
+
+***************************************************************************/
+
+template <typename T>
+void sim_source::generate(T * out, size_t num_samps)
+{
+	const double noise_scale = config.noise_rms / sqrt(2.0);
+	size_t num_tones = phasors.size();
+	uint64_t burst_len = uint64_t(config.burst_symbols * samps_per_symbol);
+
+	// Without any signal the source only costs a memset (loop benchmarks)
+	if(num_tones == 0 && config.noise_rms <= 0 && (config.burst_amplitude <= 0 || burst_period_samps == 0))
+	{
+		memset(static_cast<void *>(out), 0, num_samps * sizeof(*out));
+		position += num_samps;
+		return;
+	}
+
+	for(size_t n = 0; n < num_samps; n++, position++)
+	{
+		std::complex<double> value(0, 0);
+
+		for(size_t t = 0; t < num_tones; t++)
+		{
+			value += config.tones[t].amplitude * phasors[t];
+			phasors[t] *= steps[t];
+		}
+
+		if(config.burst_amplitude > 0 && burst_period_samps)
+		{
+			uint64_t offset = position % burst_period_samps;
+			if(offset < burst_len)
+			{
+				// New QPSK symbol at each symbol boundary: the preamble, then random ones
+				uint64_t index = uint64_t(offset / samps_per_symbol);
+				if(offset == 0 || index != uint64_t((offset - 1) / samps_per_symbol))
+				{
+					uint32_t bits = index < config.preamble.size() ? config.preamble[index] : random();
+					symbol = std::complex<double>((bits & 1) ? M_SQRT1_2 : -M_SQRT1_2, (bits & 2) ? M_SQRT1_2 : -M_SQRT1_2);
+				}
+				value += config.burst_amplitude * symbol * burst_phasor;
+			}
+			burst_phasor *= burst_step;
+		}
+
+		if(config.noise_rms > 0)
+			value += std::complex<double>(gaussian() * noise_scale, gaussian() * noise_scale);
+
+		if(quantize_sc8)
+			value = std::complex<double>(saturate_int(value.real() * 127.0, 127), saturate_int(value.imag() * 127.0, 127)) / 127.0;
+		store_sample(out[n], value.real(), value.imag());
+	}
+
+	// The recursive phasors slowly drift away from the unit circle
+	for(size_t t = 0; t < num_tones; t++)
+		phasors[t] /= std::abs(phasors[t]);
+	burst_phasor /= std::abs(burst_phasor);
+}
+
+
+template void sim_source::generate(sample_sc8 * out, size_t num_samps);
+template void sim_source::generate(sample_sc16 * out, size_t num_samps);
+template void sim_source::generate(sample_fc32 * out, size_t num_samps);
+
+
+/***********************************************************************//**
+Advances the signal without generating the samples (injected overflow)
+
+***************************************************************************/
+
+void sim_source::skip(uint64_t num_samps)
+{
+	for(size_t t = 0; t < phasors.size(); t++)
+		phasors[t] *= std::pow(steps[t], double(num_samps));
+	burst_phasor *= std::pow(burst_step, double(num_samps));
+	position += num_samps;
+}
+
+
+/// xorshift32 generator
+uint32_t sim_source::random()
+{
+	uint32_t x = rng_state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	rng_state = x;
+	return x;
+}
+
+
+/// Gaussian value of unit variance (Box-Muller)
+double sim_source::gaussian()
+{
+	if(has_spare)
+	{
+		has_spare = false;
+		return spare;
+	}
+	double u1 = (random() + 1.0) / 4294967297.0;
+	double u2 = random() / 4294967296.0;
+	double r = sqrt(-2.0 * log(u1));
+	spare = r * sin(2 * M_PI * u2);
+	has_spare = true;
+	return r * cos(2 * M_PI * u2);
+}
+
+
+/***********************************************************************//**
+Describes the simulated signal in the header of a capture file
+
+***************************************************************************/
+
+void sim_source::describe(capture_header & header, std::string & snapshot)
+{
+	init_capture_header(header);
+	strncpy(header.cpu_format, cpu_format.c_str(), sizeof(header.cpu_format) - 1);
+	strncpy(header.otw_format, otw_format.c_str(), sizeof(header.otw_format) - 1);
+	strncpy(header.antenna, "SIM", sizeof(header.antenna));
+	header.host_start_time = time(NULL);
+	header.sample_rate = config.rate;
+
+	std::ostringstream text;
+	text << "Simulated source" << std::endl;
+	text << "Rate: " << config.rate << std::endl;
+	for(size_t index = 0; index < config.tones.size(); index++)
+		text << "Tone: " << config.tones[index].freq << " Hz  Amplitude: " << config.tones[index].amplitude << std::endl;
+	text << "Noise RMS: " << config.noise_rms << std::endl;
+	if(config.burst_amplitude > 0)
+		text << "QPSK bursts: " << config.burst_symbols << " symbols at " << config.symbol_rate << " symbols/s every "
+			<< config.burst_period << " s, " << config.burst_freq << " Hz, amplitude " << config.burst_amplitude
+			<< ", preamble of " << config.preamble.size() << " symbols" << std::endl;
+	text << "Seed: " << config.seed << std::endl;
+	snapshot = text.str();
+}
@@ -0,0 +1,102 @@
+/***********************************************************************//**
+@file
+
+Declaration of the synthetic sample source
+
+
+***************************************************************************/
+
+#ifndef SIM_SOURCE_H
+#define SIM_SOURCE_H
+
+#include <vector>
+#include <complex>
+#include <stdint.h>
+#include "sample_source.h"
+
+
+/// One continuous tone of the simulated signal
+struct sim_tone
+{
+	double freq;		/// Frequency offset in Hz
+	double amplitude;	/// Amplitude relative to full scale (1.0)
+};
+
+
+/***********************************************************************//**
+Description of the simulated signal
+
+The signal is the sum of tones, of QPSK bursts and of complex white
+gaussian noise. All the amplitudes are relative to the full scale of the
+host format of the samples.
+
+***************************************************************************/
+struct sim_config
+{
+	sim_config() : rate(125000), noise_rms(0.01), burst_amplitude(0), burst_freq(0), symbol_rate(0),
+		burst_symbols(0), burst_period(0), paced(false), num_samples(0), seed(1) {}
+
+	double rate;				/// Sample rate in samples/s
+	std::vector<sim_tone> tones;	/// Continuous tones
+	double noise_rms;			/// RMS amplitude of the noise (I and Q together)
+	double burst_amplitude;		/// Amplitude of the bursts. 0 disables the bursts
+	double burst_freq;			/// Frequency offset of the bursts in Hz
+	double symbol_rate;			/// Symbol rate of the bursts in symbols/s
+	size_t burst_symbols;		/// Number of QPSK symbols in each burst
+	std::vector<uint8_t> preamble;	/// First symbols of each burst (bit 0: I > 0, bit 1: Q > 0), then random ones
+	double burst_period;		/// Time between the start of two bursts in s
+	bool paced;					/// true to deliver the samples at the sample rate
+	uint64_t num_samples;		/// Number of samples generated before the end. 0 for no end
+	unsigned seed;				/// Seed of the random generators
+};
+
+
+/***********************************************************************//**
+Sample source generating a synthetic signal
+
+The time stamps start at 0 and advance exactly with the number of samples,
+except when overflows are injected.
+
+***************************************************************************/
+class sim_source : public sample_source
+{
+public:
+	sim_source(const sim_config & config);
+
+	bool start(size_t samps_per_buf);
+	size_t recv(void * buf, size_t num_samps, uhd::rx_metadata_t & md, double timeout);
+	void stop() {}
+	bool is_done() const {return config.num_samples && position >= config.num_samples;}
+	double get_rate() {return config.rate;}
+	void describe(capture_header & header, std::string & snapshot);
+
+	/// Injects an overflow every num_blocks recv() calls, losing num_samps samples
+	void set_overflow_injection(size_t num_blocks, size_t num_samps) {injector.configure(num_blocks, num_samps);}
+
+	template <typename T>
+	void generate(T * out, size_t num_samps);
+
+private:
+	uint32_t random();
+	double gaussian();
+	void skip(uint64_t num_samps);
+
+	sim_config config;			/// Description of the signal
+	bool quantize_sc8;			/// True to reduce the samples to 8 bits (sc8 over the wire)
+	uint64_t position;			/// Number of the next sample
+	uint32_t rng_state;			/// State of the xorshift generator
+	bool has_spare;				/// True if spare holds the second output of Box-Muller
+	double spare;				/// Second gaussian value of the last Box-Muller transform
+	std::vector<std::complex<double> > phasors;	/// Current phase of each tone
+	std::vector<std::complex<double> > steps;	/// Phase increment of each tone per sample
+	std::complex<double> burst_phasor;	/// Current phase of the burst carrier
+	std::complex<double> burst_step;	/// Phase increment of the burst carrier
+	std::complex<double> symbol;	/// Current QPSK symbol
+	double samps_per_symbol;	/// Number of samples per symbol
+	uint64_t burst_period_samps;	/// Number of samples between two burst starts
+	source_pacer pacer;			/// Paces the generation
+	overflow_injector injector;	/// Injects overflows
+};
+
+
+#endif
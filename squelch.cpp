@@ -0,0 +1,235 @@
+#include "squelch.h"
+#include "dsp_kernels.h"
+#include <cmath>
+#include <cstring>
+
+
+/***********************************************************************//**
+Constructor: allocates the history and the power buffers for blocks of
+samps_per_block samples at most
+
+@param sample_size Size in bytes of one complex sample of the ring
+@param samps_per_block Capacity of the blocks of the ring
+
+***************************************************************************/
+
+squelch_gate::squelch_gate(size_t size, size_t samps)
+:sample_size(size), samps_per_block(samps), power_sc16(samps), power_fc32(samps)
+{
+	configure(squelch_config());
+}
+
+
+/***********************************************************************//**
+Sets the levels and windows of the squelch and closes the gate
+
+Allocates the history ring: call it before the sampling task starts.
+
+***************************************************************************/
+
+void squelch_gate::configure(const squelch_config & cfg)
+{
+	config = cfg;
+	if(config.close_level > config.open_level)
+		config.close_level = config.open_level;
+	history.resize(config.pre_blocks + 1);
+	storage.resize(history.size() * samps_per_block * sample_size);
+	for(size_t slot = 0; slot < history.size(); slot++)
+		history[slot].samples = &storage[slot * samps_per_block * sample_size];
+	reset();
+}
+
+
+/// Closes the gate, forgets the held blocks and clears the counters
+void squelch_gate::reset()
+{
+	oldest = 0;
+	num_held = 0;
+	open = false;
+	hang = 0;
+	level = -INFINITY;
+	pending_skipped = 0;
+	num_forwarded = 0;
+	num_skipped = 0;
+	num_openings = 0;
+}
+
+
+/// Keeps the highest mean power of the segments
+static inline double max_segment(double best, double sum, size_t count)
+{
+	double mean = sum / count;
+	return mean > best ? mean : best;
+}
+
+
+/***********************************************************************//**
+Level of a block
+
+@return Highest mean power of the segments of SQUELCH_SEGMENT samples in
+dBFS (0 dBFS for a full scale complex sine), -inf for an empty or null
+block
+
+***************************************************************************/
+
+template <>
+float squelch_gate::measure(const sample_sc16 * samples, size_t num_samps)
+{
+	dsp_sc16_mag_squared(samples, &power_sc16[0], num_samps);
+	double best = 0;
+	for(size_t start = 0; start < num_samps; start += SQUELCH_SEGMENT)
+	{
+		size_t end = start + SQUELCH_SEGMENT < num_samps ? start + SQUELCH_SEGMENT : num_samps;
+		uint64_t sum = 0;
+		for(size_t n = start; n < end; n++)
+			sum += power_sc16[n];
+		best = max_segment(best, double(sum), end - start);
+	}
+	return float(10 * log10(best / (32768.0 * 32768.0)));
+}
+
+
+template <>
+float squelch_gate::measure(const sample_fc32 * samples, size_t num_samps)
+{
+	dsp_fc32_mag_squared(samples, &power_fc32[0], num_samps);
+	double best = 0;
+	for(size_t start = 0; start < num_samps; start += SQUELCH_SEGMENT)
+	{
+		size_t end = start + SQUELCH_SEGMENT < num_samps ? start + SQUELCH_SEGMENT : num_samps;
+		float sum = 0;
+		for(size_t n = start; n < end; n++)
+			sum += power_fc32[n];
+		best = max_segment(best, sum, end - start);
+	}
+	return float(10 * log10(best));
+}
+
+
+template <>
+float squelch_gate::measure(const sample_sc8 * samples, size_t num_samps)
+{
+	double best = 0;
+	for(size_t start = 0; start < num_samps; start += SQUELCH_SEGMENT)
+	{
+		size_t end = start + SQUELCH_SEGMENT < num_samps ? start + SQUELCH_SEGMENT : num_samps;
+		uint32_t sum = 0;
+		for(size_t n = start; n < end; n++)
+			sum += samples[n].real() * samples[n].real() + samples[n].imag() * samples[n].imag();
+		best = max_segment(best, double(sum), end - start);
+	}
+	return float(10 * log10(best / (128.0 * 128.0)));
+}
+
+
+/***********************************************************************//**
+Moves the gate with the level of a new block
+
+@param block_level Level of the block given by measure()
+
+@return What to do with the block
+
+***************************************************************************/
+
+squelch_gate::action squelch_gate::update(float block_level)
+{
+	level = block_level;
+	if(!config.enable)
+		return SQUELCH_ACTIVE;
+	if(!open)
+	{
+		if(level < config.open_level)
+			return SQUELCH_IDLE;
+		open = true;
+		hang = config.post_blocks;
+		num_openings++;
+		return SQUELCH_OPEN;
+	}
+	if(level >= config.close_level)
+		hang = config.post_blocks;
+	else if(hang > 0)
+		hang--;
+	else
+	{
+		open = false;
+		return SQUELCH_IDLE;
+	}
+	return SQUELCH_ACTIVE;
+}
+
+
+/***********************************************************************//**
+Keeps a copy of a block which is not forwarded yet
+
+While the gate is closed the history keeps the last pre_blocks blocks: the
+oldest one is dropped and its samples are skipped. When the gate opens,
+the block which opened it is added to them and they are all forwarded.
+
+***************************************************************************/
+
+void squelch_gate::hold(const void * samples, size_t num_samps, uint64_t first_sample, const uhd::rx_metadata_t & md)
+{
+	if(num_samps > samps_per_block)
+		num_samps = samps_per_block;
+	size_t limit = open ? history.size() : config.pre_blocks;
+	if(limit == 0)
+	{
+		pending_skipped += num_samps;
+		num_skipped += num_samps;
+		return;
+	}
+	if(num_held == limit)
+	{
+		pending_skipped += history[oldest].num_samps;
+		num_skipped += history[oldest].num_samps;
+		oldest = (oldest + 1) % history.size();
+		num_held--;
+	}
+	squelch_block & block = history[(oldest + num_held) % history.size()];
+	memcpy(block.samples, samples, num_samps * sample_size);
+	block.num_samps = num_samps;
+	block.first_sample = first_sample;
+	block.md = md;
+	num_held++;
+}
+
+
+/// Empties the history once the held blocks have been forwarded
+void squelch_gate::release_held()
+{
+	oldest = 0;
+	num_held = 0;
+}
+
+
+/// Empties the history without forwarding it: the held samples are skipped
+void squelch_gate::drop_held()
+{
+	for(size_t index = 0; index < num_held; index++)
+	{
+		pending_skipped += get_held_block(index).num_samps;
+		num_skipped += get_held_block(index).num_samps;
+	}
+	release_held();
+}
+
+
+/// Counts num_samps samples given to the consumer and to the writer
+void squelch_gate::forwarded(size_t num_samps)
+{
+	num_forwarded += num_samps;
+}
+
+
+/***********************************************************************//**
+Samples skipped since the last call, to be given with the next forwarded
+block
+
+***************************************************************************/
+
+uint64_t squelch_gate::take_skipped()
+{
+	uint64_t skipped = pending_skipped;
+	pending_skipped = 0;
+	return skipped;
+}
@@ -0,0 +1,131 @@
+/***********************************************************************//**
+@file
+
+Energy detecting squelch of the sampling task
+
+The channel is idle most of the time. The squelch measures the power of
+each received block and only lets the blocks of the bursts through to
+the consumer and to the capture writer:
+
+- the level of a block is the highest mean power of its segments of
+  SQUELCH_SEGMENT samples, so that a short burst in a long block is not
+  diluted by the noise around it
+- the gate opens when the level reaches open_level and closes when it
+  stays below close_level (hysteresis) for post_blocks blocks (post
+  trigger)
+- while the gate is closed the last pre_blocks blocks are kept in a small
+  history ring, and forwarded ahead of the block which opens the gate
+  (pre trigger), so that the start of a burst is never cut
+
+The blocks which are never forwarded are counted as skipped; the capture
+writer marks them in the index of the capture file, distinct from the
+samples lost by the stream.
+
+***************************************************************************/
+
+#ifndef SQUELCH_H
+#define SQUELCH_H
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+#include "/usr/include/uhd/usrp/multi_usrp.hpp"
+#include "sample_format.h"
+#include "block_pool.h"
+
+
+/// Number of samples over which the power is averaged
+#define SQUELCH_SEGMENT 256
+
+
+/// Configuration of the squelch
+struct squelch_config
+{
+	squelch_config() : enable(false), open_level(-30), close_level(-33), pre_blocks(1), post_blocks(1) {}
+
+	bool enable;				/// False to forward every block
+	double open_level;			/// Level opening the gate in dBFS
+	double close_level;			/// Level under which the gate closes in dBFS (below open_level)
+	size_t pre_blocks;			/// Idle blocks forwarded before the block opening the gate
+	size_t post_blocks;			/// Blocks forwarded after the level fell below close_level
+};
+
+
+/// Block kept by the squelch while the gate is closed
+struct squelch_block
+{
+	char * samples;
+	size_t num_samps;
+	uint64_t first_sample;
+	uhd::rx_metadata_t md;
+};
+
+
+/***********************************************************************//**
+Squelch gate
+
+The gate belongs to the sampling thread. All its memory is allocated by
+the constructor: measure(), update() and hold() do not allocate.
+
+***************************************************************************/
+class squelch_gate
+{
+public:
+	/// Decision for a block
+	enum action
+	{
+		SQUELCH_IDLE,		/// The gate is closed: the block is given to hold()
+		SQUELCH_OPEN,		/// The gate opens: the held blocks then this block are forwarded
+		SQUELCH_ACTIVE		/// The gate is open: the block is forwarded
+	};
+
+	squelch_gate(size_t sample_size, size_t samps_per_block);
+	void configure(const squelch_config & config);
+	void reset();
+	bool is_enabled() const {return config.enable;}
+
+	template <typename T>
+	float measure(const T * samples, size_t num_samps);
+	action update(float level);
+
+	void hold(const void * samples, size_t num_samps, uint64_t first_sample, const uhd::rx_metadata_t & md);
+	/// Number of held blocks
+	size_t get_held() const {return num_held;}
+	/// Held block, 0 is the oldest
+	const squelch_block & get_held_block(size_t index) const {return history[(oldest + index) % history.size()];}
+	void release_held();
+	void drop_held();
+	void forwarded(size_t num_samps);
+	uint64_t take_skipped();
+
+	/// Level of the last block in dBFS
+	float get_level() const {return level;}
+	bool is_open() const {return open;}
+	/// Number of samples forwarded to the consumer and to the writer
+	uint64_t get_forwarded() const {return num_forwarded;}
+	/// Number of samples left out
+	uint64_t get_skipped() const {return num_skipped;}
+	/// Number of times the gate opened
+	uint64_t get_openings() const {return num_openings;}
+
+private:
+	squelch_config config;
+	size_t sample_size;			/// Size in bytes of one complex sample
+	size_t samps_per_block;
+	pool_vector<char>::type storage;	/// Samples of the history ring
+	std::vector<squelch_block> history;	/// pre_blocks + 1 slots
+	size_t oldest;				/// Slot of the oldest held block
+	size_t num_held;			/// Number of held blocks
+	pool_vector<uint32_t>::type power_sc16;	/// Power of the samples, sc16 blocks
+	float_buffer power_fc32;		/// Power of the samples, fc32 blocks
+	bool open;					/// State of the gate
+	size_t hang;				/// Blocks still forwarded below close_level
+	float level;
+	uint64_t pending_skipped;	/// Samples skipped since the last forwarded block
+	uint64_t num_forwarded;
+	uint64_t num_skipped;
+	uint64_t num_openings;
+};
+
+
+#endif
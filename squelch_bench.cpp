@@ -0,0 +1,306 @@
+/***********************************************************************//**
+@file
+
+Checks the squelch of the sampling task (squelch.h) and measures what it
+saves at several occupancies of the channel
+
+The sampling task runs on a simulated source, paced at the sample rate
+like a device, sending a burst
+every BURST_PERIOD seconds, longer or shorter to set the occupancy of the
+channel. The consumer searches the preambles (frame_sync) and demodulates
+the bursts (qpsk_demodulator), as receiver_test does. Each signal is
+received with the squelch disabled then enabled, and the program reports:
+- the fraction of the samples forwarded to the consumer and to the writer
+- the CPU time of the consumer and the bytes of the capture file
+- the cost of the level detector in millions of samples per second
+
+The program checks that with the squelch every burst is still
+found at its first sample (the pre trigger block holds the start of the
+preamble), that the capture file records the squelched spans without any
+gap, and that noise alone never opens the gate.
+
+Usage: squelchbench [-l label] [-j file]
+
+-l label stored in the results (e.g. the release)
+-j file receiving the results, one JSON object per line (default squelch_bench.json)
+
+The exit code is 1 if a burst is missed or a check fails.
+
+***************************************************************************/
+
+#define DEFINE_GLOBALS
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <unistd.h>
+#include "task_sampling.h"
+#include "sim_source.h"
+#include "frame_sync.h"
+#include "demodulator.h"
+#include "latency_stats.h"
+#include "bench_common.h"
+
+
+#define BENCH_RATE 125000.0
+#define BENCH_CENTER -20000.0	/// Carrier of the simulated bursts, as in receiver_test --sim
+#define BENCH_SYMBOL_RATE 12500.0
+#define BENCH_SAMPLES 250000	/// 2 s of signal
+#define BURST_PERIOD 0.25
+#define BLOCK_SAMPS 625			/// 5 ms blocks
+#define NOISE_RMS 0.05			/// -26 dBFS
+#define OPEN_LEVEL -16.0		/// Between the noise and the bursts (-6 dBFS)
+#define CAPTURE_NAME "squelch_bench.cap"
+
+
+/// One simulated channel
+struct squelch_case
+{
+	const char * name;
+	double occupancy;			/// Fraction of the time taken by the bursts, 0 for noise alone
+};
+
+static const squelch_case cases[] = {
+	{"noise only", 0},
+	{"5%", 0.05},
+	{"20%", 0.2},
+	{"50%", 0.5},
+};
+
+
+/// Results of one run
+struct squelch_result
+{
+	uint64_t received;			/// Samples received by the sampling task
+	uint64_t forwarded;			/// Samples handed to the consumer
+	uint64_t openings;
+	uint64_t consumer_ns;		/// CPU time of the consumer
+	uint64_t bytes;				/// Size of the samples in the capture file
+	uint64_t capture_gaps;		/// Gaps recorded in the capture index
+	uint64_t squelched;			/// Samples recorded as squelched in the capture
+	std::vector<uint64_t> frames;	/// First sample of each detected preamble
+};
+
+
+/***********************************************************************//**
+Receives one simulated signal and consumes it
+
+@return true if the task could not be started
+
+***************************************************************************/
+
+static bool run_case(const squelch_case & test, bool enable, squelch_result & result)
+{
+	sim_config sim;
+	sim.rate = BENCH_RATE;
+	sim.noise_rms = NOISE_RMS;
+	sim.burst_amplitude = test.occupancy > 0 ? 0.5 : 0;
+	sim.burst_freq = BENCH_CENTER;
+	sim.symbol_rate = BENCH_SYMBOL_RATE;
+	sim.burst_symbols = size_t(test.occupancy * BURST_PERIOD * BENCH_SYMBOL_RATE);
+	sim.burst_period = BURST_PERIOD;
+	sim.preamble = frame_sync_default_preamble();
+	sim.num_samples = BENCH_SAMPLES;
+	sim.paced = true;
+	sim_source source(sim);
+
+	frame_sync_config sync_config;
+	sync_config.rate = BENCH_RATE;
+	sync_config.center_freq = BENCH_CENTER;
+	sync_config.symbol_rate = BENCH_SYMBOL_RATE;
+	frame_sync sync;
+	demod_config demod_cfg;
+	demod_cfg.rate = BENCH_RATE;
+	demod_cfg.center_freq = BENCH_CENTER;
+	demod_cfg.symbol_rate = BENCH_SYMBOL_RATE;
+	qpsk_demodulator demod;
+	if(sync.configure(sync_config) || demod.configure(demod_cfg))
+		return true;
+	std::vector<frame_detection> detections(sync.max_output(BLOCK_SAMPS));
+	std::vector<sample_fc32> symbols(demod.max_output(BLOCK_SAMPS));
+	std::vector<int8_t> soft_bits(2 * symbols.size());
+
+	result.frames.clear();
+	result.consumer_ns = 0;
+	{
+		task_sampling rx_task(source, BLOCK_SAMPS, 32, CAPTURE_NAME);
+		squelch_config config;
+		config.enable = enable;
+		config.open_level = OPEN_LEVEL;
+		config.close_level = OPEN_LEVEL - 3;
+		config.pre_blocks = 1;
+		config.post_blocks = 1;
+		rx_task.set_squelch_config(config);
+		if(rx_task.start())
+			return true;
+
+		for(;;)
+		{
+			const input_block_t * block = rx_task.wait_buffer(1000);
+			if(block == NULL)
+			{
+				if(rx_task.get_fanout().is_closed())
+					break;
+				continue;
+			}
+			uint64_t start = thread_cpu_ns();
+			size_t count = sync.process(block->samples, block->num_samps, block->first_sample, block->md, &detections[0]);
+			demod.process(block->samples, block->num_samps, &symbols[0], &soft_bits[0]);
+			result.consumer_ns += thread_cpu_ns() - start;
+			for(size_t d = 0; d < count; d++)
+				result.frames.push_back(detections[d].sample);
+			rx_task.release_buffer();
+		}
+		pthread_join(rx_task.get_tid(), NULL);
+		size_t count = sync.flush(&detections[0]);
+		for(size_t d = 0; d < count; d++)
+			result.frames.push_back(detections[d].sample);
+
+		const squelch_gate & gate = rx_task.get_squelch();
+		const capture_writer & writer = rx_task.get_writer();
+		result.received = rx_task.get_continuity().get_samples();
+		result.forwarded = enable ? gate.get_forwarded() : result.received;
+		result.openings = gate.get_openings();
+		result.bytes = result.forwarded * sizeof(sample_sc16);
+		result.capture_gaps = writer.get_num_gaps();
+		result.squelched = writer.get_num_squelched();
+		if(writer.get_drops() || rx_task.get_overruns())
+			std::cout << "  " << writer.get_drops() << " blocks dropped by the writer, " << rx_task.get_overruns()
+				<< " lost by the consumer" << std::endl;
+	}
+	// The capture file is complete once the task is destroyed: check its header
+	capture_reader reader;
+	if(reader.open(CAPTURE_NAME))
+		return true;
+	result.bytes = reader.get_num_samples() * reader.get_header().sample_size;
+	result.capture_gaps = reader.get_header().num_gaps;
+	result.squelched = reader.get_header().num_squelched;
+	return false;
+}
+
+
+/***********************************************************************//**
+Checks a run with the squelch against the expected bursts
+
+@return Number of errors
+
+***************************************************************************/
+
+static int check_run(const squelch_case & test, const squelch_result & result)
+{
+	int errors = 0;
+	uint64_t period = uint64_t(BURST_PERIOD * BENCH_RATE);
+	// A preamble is reported once the correlator is one preamble past it
+	uint64_t preamble_samps = uint64_t(frame_sync_default_preamble().size() * BENCH_RATE / BENCH_SYMBOL_RATE);
+	size_t expected = 0;
+	for(uint64_t start = 0; test.occupancy > 0 && start + 2 * preamble_samps <= BENCH_SAMPLES; start += period)
+		expected++;
+	if(result.frames.size() != expected)
+	{
+		printf("  %zu preambles found, %zu expected\n", result.frames.size(), expected);
+		errors++;
+	}
+	for(size_t f = 0; f < result.frames.size(); f++)
+		if(result.frames[f] != f * period)
+		{
+			printf("  preamble %zu at sample %llu\n", f, (unsigned long long)result.frames[f]);
+			errors++;
+		}
+	if(result.capture_gaps)
+	{
+		printf("  %llu gaps recorded in the capture\n", (unsigned long long)result.capture_gaps);
+		errors++;
+	}
+	if(result.squelched + result.forwarded != result.received)
+	{
+		printf("  %llu samples recorded as squelched, %llu expected\n", (unsigned long long)result.squelched,
+			(unsigned long long)(result.received - result.forwarded));
+		errors++;
+	}
+	if(test.occupancy == 0 && result.openings)
+	{
+		printf("  noise opened the gate %llu times\n", (unsigned long long)result.openings);
+		errors++;
+	}
+	return errors;
+}
+
+
+/***********************************************************************//**
+Throughput of the level detector
+
+@return Millions of samples per second
+
+***************************************************************************/
+
+static double bench_detector()
+{
+	sim_config sim;
+	sim.noise_rms = NOISE_RMS;
+	sim_source source(sim);
+	source.start(0);
+	std::vector<sample_sc16> block(BLOCK_SAMPS);
+	source.generate(&block[0], block.size());
+	squelch_gate gate(sizeof(sample_sc16), BLOCK_SAMPS);
+	float level = 0;
+	uint64_t count = 0;
+	uint64_t start = monotonic_ns();
+	uint64_t now = start;
+	while(now < start + 200000000)
+	{
+		for(int repeat = 0; repeat < 100; repeat++)
+			level += gate.measure(&block[0], block.size());
+		count += 100 * block.size();
+		now = monotonic_ns();
+	}
+	bench_sink = level;
+	return count / ((now - start) * 1e-9) * 1e-6;
+}
+
+
+int main(int argc, char ** argv)
+{
+	bench_context bench("squelch_bench.json");
+	for(int index = 1; index < argc; index++)
+	{
+		if(bench.parse_option(argc, argv, index))
+		{
+			std::cout << "Usage: squelchbench [-l label] [-j file]" << std::endl;
+			return 1;
+		}
+	}
+	if(bench.open())
+		return 1;
+
+	printf("%-11s %8s %9s %8s %12s %12s %10s %8s\n", "occupancy", "squelch", "forwarded", "bursts", "consumer ms", "capture kB",
+		"squelched", "");
+	for(size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+	{
+		const squelch_case & test = cases[c];
+		for(int enable = 0; enable < 2; enable++)
+		{
+			squelch_result result;
+			if(run_case(test, enable != 0, result))
+				return 1;
+			int run_errors = check_run(test, result);
+			bench.errors += run_errors;
+			printf("%-11s %8s %8.1f%% %8zu %12.2f %12.1f %10llu %8s\n", test.name, enable ? "on" : "off",
+				100.0 * result.forwarded / result.received, result.frames.size(), result.consumer_ns * 1e-6, result.bytes / 1024.0,
+				(unsigned long long)result.squelched, run_errors ? "FAILED" : "ok");
+			fprintf(bench.record("squelch"), "\"occupancy\":%.2f,\"squelch\":%s,\"received\":%llu,\"forwarded\":%llu,\"openings\":%llu,"
+				"\"frames\":%zu,\"consumer_ns\":%llu,\"capture_bytes\":%llu,\"errors\":%d}\n", test.occupancy, enable ? "true" : "false",
+				(unsigned long long)result.received, (unsigned long long)result.forwarded, (unsigned long long)result.openings,
+				result.frames.size(), (unsigned long long)result.consumer_ns, (unsigned long long)result.bytes, run_errors);
+		}
+	}
+	unlink(CAPTURE_NAME);
+	unlink("rx_log.bin");
+
+	double detector_msps = bench_detector();
+	printf("Level detector: %.1f MS/s\n", detector_msps);
+	fprintf(bench.record("squelch_detector"), "\"msps\":%.3f}\n", detector_msps);
+
+	return bench.finish("Every burst forwarded");
+}
@@ -0,0 +1,270 @@
+/***********************************************************************//**
+@file
+
+Checks the FFT preamble correlator (frame_sync.h) on simulated bursts and
+compares its cost with a sliding correlation in the time domain
+
+The simulated source sends a burst every 0.1 s starting with the default
+preamble, off the expected carrier, with several noise levels. The blocks
+are given to the correlator with their first sample and a time_spec, as
+the sampling task does. The program checks that every burst is found
+once, at its first sample, with the time_spec of that sample, that the
+frequency estimate is close to the offset, and that noise alone gives no
+detection. Blocks of 997 samples, with a time_spec on one block out of
+three only, check the preambles across blocks and the time computed from
+an earlier block.
+
+Usage: syncbench [-t seconds] [-l label] [-j file]
+
+-t measuring time of each correlator in seconds (default 0.5)
+-l label stored in the results (e.g. the release)
+-j file receiving the results, one JSON object per line (default sync_bench.json)
+
+The exit code is 1 if a burst is missed, found at the wrong sample or
+time, or if noise is detected.
+
+***************************************************************************/
+
+#include <cstdio>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "frame_sync.h"
+#include "dsp_kernels.h"
+#include "sim_source.h"
+#include "latency_stats.h"
+#include "bench_common.h"
+
+
+#define BENCH_RATE 125000.0
+#define BENCH_CENTER -20000.0	/// Carrier of the simulated bursts, as in receiver_test --sim
+#define BENCH_SYMBOL_RATE 12500.0
+#define BENCH_SAMPLES 250000	/// 2 s of signal
+#define BURST_PERIOD 0.1
+#define BURST_SYMBOLS 64
+#define BLOCK_SAMPS 2172		/// Block of the sampling task for 20 ms
+#define ODD_BLOCK_SAMPS 997
+#define MAX_FREQ_ERROR 50.0		/// Error allowed on the frequency estimate in Hz
+#define START_TIME 1000.25		/// time_spec of the first sample
+
+
+/// One simulated signal
+struct sync_case
+{
+	const char * name;
+	double amplitude;			/// Amplitude of the bursts, 0 for noise alone
+	double noise_rms;
+	double freq_offset;			/// Offset of the bursts from the expected carrier in Hz
+};
+
+static const sync_case cases[] = {
+	{"clean", 0.5, 0.05, 0},
+	{"noise 0.3", 0.5, 0.3, 700},
+	{"noise 0.4", 0.5, 0.4, -950},
+	{"weak", 0.05, 0.01, 333},
+	{"noise only", 0, 0.3, 0},
+};
+
+
+static std::vector<sample_sc16> make_signal(const sync_case & test)
+{
+	sim_config sim;
+	sim.rate = BENCH_RATE;
+	sim.noise_rms = test.noise_rms;
+	sim.burst_amplitude = test.amplitude;
+	sim.burst_freq = BENCH_CENTER + test.freq_offset;
+	sim.symbol_rate = BENCH_SYMBOL_RATE;
+	sim.burst_symbols = BURST_SYMBOLS;
+	sim.burst_period = BURST_PERIOD;
+	sim.preamble = frame_sync_default_preamble();
+	sim_source source(sim);
+	source.start(0);
+	std::vector<sample_sc16> signal(BENCH_SAMPLES);
+	source.generate(&signal[0], signal.size());
+	return signal;
+}
+
+
+/***********************************************************************//**
+Runs the correlator on the signal cut in blocks
+
+@param time_every A time_spec is given with one block out of time_every
+
+***************************************************************************/
+
+static std::vector<frame_detection> run_sync(frame_sync & sync, const std::vector<sample_sc16> & signal, size_t block_samps,
+	size_t time_every)
+{
+	std::vector<frame_detection> found;
+	std::vector<frame_detection> detections(sync.max_output(block_samps));
+	for(size_t start = 0, block = 0; start < signal.size(); start += block_samps, block++)
+	{
+		size_t n = signal.size() - start < block_samps ? signal.size() - start : block_samps;
+		uhd::rx_metadata_t md;
+		md.has_time_spec = block % time_every == 0;
+		md.time_spec = uhd::time_spec_t(START_TIME) + uhd::time_spec_t::from_ticks(start, BENCH_RATE);
+		md.error_code = uhd::rx_metadata_t::ERROR_CODE_NONE;
+		size_t count = sync.process(&signal[start], n, start, md, &detections[0]);
+		found.insert(found.end(), detections.begin(), detections.begin() + count);
+	}
+	return found;
+}
+
+
+/***********************************************************************//**
+Compares the detections with the bursts of the signal
+
+@return Number of errors
+
+***************************************************************************/
+
+static int check_detections(const sync_case & test, const std::vector<frame_detection> & found, size_t preamble_samps,
+	double & worst_freq_error)
+{
+	uint64_t period = uint64_t(BURST_PERIOD * BENCH_RATE);
+	// A burst is found once L samples after its start have been correlated
+	size_t expected = test.amplitude > 0 ? (BENCH_SAMPLES - preamble_samps) / period + 1 : 0;
+	int errors = found.size() != expected;
+	worst_freq_error = 0;
+	for(size_t d = 0; d < found.size(); d++)
+	{
+		const frame_detection & detection = found[d];
+		uhd::time_spec_t expected_time = uhd::time_spec_t(START_TIME) + uhd::time_spec_t::from_ticks(d * period, BENCH_RATE);
+		double freq_error = fabs(detection.freq_offset - test.freq_offset);
+		worst_freq_error = freq_error > worst_freq_error ? freq_error : worst_freq_error;
+		if(detection.sample != d * period || !detection.has_time_spec ||
+			detection.time_spec.to_ticks(BENCH_RATE) != expected_time.to_ticks(BENCH_RATE) || freq_error > MAX_FREQ_ERROR)
+		{
+			errors++;
+			if(errors < 4)
+				printf("  detection %zu: sample %llu metric %.3f freq %.1f Hz (%.1f)\n", d, (unsigned long long)detection.sample,
+					detection.metric, detection.freq_offset, detection.coarse_freq);
+		}
+	}
+	return errors;
+}
+
+
+/***********************************************************************//**
+Throughput of the FFT correlator with all its frequency hypotheses
+
+@return Millions of input samples per second
+
+***************************************************************************/
+
+static double bench_fft(frame_sync & sync, const std::vector<sample_sc16> & signal, double seconds)
+{
+	std::vector<frame_detection> detections(sync.max_output(BLOCK_SAMPS));
+	uhd::rx_metadata_t md;
+	md.has_time_spec = false;
+	uint64_t first = 0;
+	uint64_t start = monotonic_ns();
+	uint64_t now = start;
+	while(now < start + uint64_t(seconds * 1e9))
+	{
+		for(size_t offset = 0; offset + BLOCK_SAMPS <= signal.size(); offset += BLOCK_SAMPS)
+		{
+			sync.process(&signal[offset], BLOCK_SAMPS, first, md, &detections[0]);
+			first += BLOCK_SAMPS;
+		}
+		now = monotonic_ns();
+	}
+	return first / ((now - start) * 1e-9) * 1e-6;
+}
+
+
+/***********************************************************************//**
+Throughput of a sliding correlation in the time domain, one frequency
+hypothesis
+
+@return Millions of input samples per second
+
+***************************************************************************/
+
+static double bench_time_domain(size_t preamble_samps, const std::vector<sample_sc16> & signal, double seconds)
+{
+	std::vector<sample_fc32> input(signal.size());
+	dsp_sc16_to_fc32(&signal[0], &input[0], signal.size());
+	std::vector<sample_fc32> reference(preamble_samps, sample_fc32(M_SQRT1_2, -M_SQRT1_2));
+	uint64_t samples = 0;
+	float total = 0;
+	uint64_t start = monotonic_ns();
+	uint64_t now = start;
+	while(now < start + uint64_t(seconds * 1e9))
+	{
+		for(size_t n = 0; n + preamble_samps <= input.size(); n++)
+			total += std::norm(dsp_fc32_dot(&input[n], &reference[0], preamble_samps));
+		samples += input.size() - preamble_samps + 1;
+		now = monotonic_ns();
+	}
+	bench_sink = total;
+	return samples / ((now - start) * 1e-9) * 1e-6;
+}
+
+
+int main(int argc, char ** argv)
+{
+	bench_context bench("sync_bench.json", 0.5);
+	for(int index = 1; index < argc; index++)
+	{
+		if(bench.parse_option(argc, argv, index))
+		{
+			std::cout << "Usage: syncbench [-t seconds] [-l label] [-j file]" << std::endl;
+			return 1;
+		}
+	}
+	if(bench.open())
+		return 1;
+
+	frame_sync_config config;
+	config.rate = BENCH_RATE;
+	config.center_freq = BENCH_CENTER;
+	config.symbol_rate = BENCH_SYMBOL_RATE;
+	frame_sync sync;
+	if(sync.configure(config))
+		return 1;
+	printf("Preamble of %zu samples, FFT of %zu points, %zu frequency hypotheses\n", sync.get_preamble_samps(),
+		sync.get_fft_size(), sync.get_num_hypotheses());
+
+	//------------------------------------------------
+	// Detections
+	//------------------------------------------------
+	printf("%-11s %9s %6s %9s %11s %8s\n", "signal", "freq Hz", "block", "detected", "freq error", "");
+	for(size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+	{
+		const sync_case & test = cases[c];
+		std::vector<sample_sc16> signal = make_signal(test);
+		const size_t block_sizes[] = {BLOCK_SAMPS, ODD_BLOCK_SAMPS};
+		const size_t time_every[] = {1, 3};
+		for(size_t b = 0; b < 2; b++)
+		{
+			sync.reset();
+			std::vector<frame_detection> found = run_sync(sync, signal, block_sizes[b], time_every[b]);
+			double freq_error;
+			int case_errors = check_detections(test, found, sync.get_preamble_samps(), freq_error);
+			bench.errors += case_errors;
+			printf("%-11s %9.1f %6zu %9zu %8.1f Hz %8s\n", test.name, test.freq_offset, block_sizes[b], found.size(), freq_error,
+				case_errors ? "FAILED" : "ok");
+			fprintf(bench.record("sync_check"), "\"signal\":\"%s\",\"freq\":%.1f,\"block\":%zu,\"detected\":%zu,\"freq_error\":%.2f,"
+				"\"errors\":%d}\n", test.name, test.freq_offset, block_sizes[b], found.size(), freq_error, case_errors);
+		}
+	}
+
+	//------------------------------------------------
+	// Throughput against the time domain
+	//------------------------------------------------
+	{
+		std::vector<sample_sc16> signal = make_signal(cases[1]);
+		sync.reset();
+		double fft_msps = bench_fft(sync, signal, bench.seconds);
+		double time_msps = bench_time_domain(sync.get_preamble_samps(), signal, bench.seconds);
+		double time_all_msps = time_msps / sync.get_num_hypotheses();
+		printf("FFT correlator: %.2f MS/s, time domain: %.2f MS/s for one hypothesis, %.3f MS/s for %zu (%.0fx)\n",
+			fft_msps, time_msps, time_all_msps, sync.get_num_hypotheses(), fft_msps / time_all_msps);
+		fprintf(bench.record("sync"), "\"preamble\":%zu,\"fft\":%zu,\"hypotheses\":%zu,\"fft_msps\":%.3f,\"time_msps\":%.3f,"
+			"\"time_all_msps\":%.4f}\n", sync.get_preamble_samps(), sync.get_fft_size(), sync.get_num_hypotheses(),
+			fft_msps, time_msps, time_all_msps);
+	}
+
+	return bench.finish("Every burst found at its first sample");
+}
@@ -2,6 +2,7 @@
 #include "task_sampling.h"
 #include "/usr/include/uhd/usrp/multi_usrp.hpp"
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <vector>
 #include <csignal>
@@ -14,28 +15,32 @@
 /***********************************************************************//**
 Constructor: Creates the resources required for the task
 
+@param src Source of the samples
+@param samps_per_buf Number of samples in each block
+@param num_bufs Number of blocks queued for the consumer (rounded up to a power of two)
+@param capture_name Name of the capture file. NULL to not write the samples to disk
 
 ***************************************************************************/
 
-task_sampling::task_sampling(uhd::usrp::multi_usrp::sptr & usrp_ref)
-:usrp(usrp_ref), exit_task(false), current_buf(0)
+template <typename T>
+task_sampling_t<T>::task_sampling_t(sample_source & src, size_t samps_per_buf, size_t num_bufs, const char * capture_name)
+:source(src), exit_task(false), otw_format("sc16"), fanout(num_bufs, samps_per_buf),
+ consumer(fanout.subscribe("consumer", num_bufs)), writer(sizeof(T)), capture(capture_name != NULL),
+ zero_fill(false), rx_rate(0), loop_histogram(NULL), squelch(sizeof(T), samps_per_buf)
 {
-	// Open the log file for the metadata
-	rx_log.open("rx_log.txt", std::ofstream::out);
-	if(rx_log.fail())
-	{
-		std::cout << " Metadata file could not be opened" << std::endl;
+	if(!capture)
+		return;
+	// The writer never gets the zeros of the gaps, and misses blocks rather than stalling the task
+	writer_feed.attach(fanout.subscribe("capture", TASK_WRITER_SLOTS, FANOUT_DROP, false));
+	writer.set_feed(&writer_feed);
+	// Open the sample file and the log file for the metadata
+#ifdef DEBUG_RX_LOG_TEXT
+	if(writer.open(capture_name, "rx_log.txt", true))
 		exit(1);
-	}
-	// Create a file to log the samples
-	rx_data.open("rx_data.txt", std::ofstream::out);
-	if(rx_data.fail())
-	{
-		std::cout << " Sample file could not be opened" << std::endl;
-		exit(2);
-	}
-
-
+#else
+	if(writer.open(capture_name, "rx_log.bin"))
+		exit(1);
+#endif
 }
 
 
@@ -45,46 +50,80 @@ Destructor: Deallocate the resources required for the task
 
 ***************************************************************************/
 
-task_sampling::~task_sampling()
+template <typename T>
+task_sampling_t<T>::~task_sampling_t()
 {
-	rx_log.close();
-	rx_data.close();
+	writer.stop();
+}
+
+
+/***********************************************************************//**
+Selects the over the wire format used by the next start()
+
+@param format "sc8" or "sc16"
+
+@return true if the format is not supported, false otherwise
 
+***************************************************************************/
+
+template <typename T>
+bool task_sampling_t<T>::set_otw_format(const std::string & format)
+{
+	if(!is_otw_format(format))
+	{
+		std::cout << "Unsupported over the wire format " << format << std::endl;
+		return true;
+	}
+	otw_format = format;
+	return false;
 }
 
 
 
 /***********************************************************************//**
-Starts the new thread
+Starts the new thread with the real-time settings given to set_rt_config()
 
 @return true if an error occurred, false otherwise
 
 
 ***************************************************************************/
 
-bool task_sampling::start()
+template <typename T>
+bool task_sampling_t<T>::start()
 	{
 	 
-	// Create a streamer object - This defines the size of the samples
-	uhd::stream_args_t rx_stream_args("sc16", "sc16");
-	rx_stream = usrp->get_rx_stream(rx_stream_args);
+	// Start the stream of the source in the format of the blocks
+	source.set_format(sample_traits<T>::cpu_format(), otw_format);
+	if(source.start(fanout.block_size()))
+	{
+		std::cout << "Sample source could not be started" << std::endl;
+		return true;
+	}
 	
-	// Create the thread atttributes
-	pthread_attr_t attr;
-	pthread_attr_init(&attr);
-	size_t stack_size;
-	pthread_attr_getstacksize(&attr, &stack_size);
-	std::cout << "Stack Size: " << stack_size << std::endl;	
-			
 	// Start the thread
 	exit_task = false;
-	current_buf = 0;
-	int res = pthread_create (&thread_id, &attr, &task_sampling::helper, this);
-	if(res)
+	fanout.reset();
+	squelch.reset();
+	rx_rate = source.get_rate();
+	continuity.reset(rx_rate);
+
+	// Describe the configuration of the radio in the capture file
+	capture_header header;
+	std::string snapshot;
+	source.describe(header, snapshot);
+	writer.set_header(header, snapshot);
+
+	// The writer thread must be running before the first block is submitted
+	if(capture && writer.start())
+	{
+		source.stop();
+		return true;
+	}
+	if(create_rt_thread(&thread_id, rt_config, &task_sampling_t::helper, this, "sampling_task"))
 	{
 		// an error in creating the thread occurred
-		// A message is displayed and the process aborts.
-		std::cout << "Thread for sampling_task could not be created" << std::endl;
+		writer.stop();
+		source.stop();
 		return true;
 	}
 	return false;				
@@ -95,10 +134,29 @@ bool task_sampling::start()
 Main function of the RX sampling task. This is the function which effectively
 runs in a different thread.
 
+Each recv() fills a free block of the pool, which is then published to
+every subscriber without copy. A subscriber which falls behind misses the
+block (or makes the task wait, see fanout_policy), without affecting the
+others.
+
+The loop only receives and hands the blocks over: the samples and the
+metadata are written to disk by the capture_writer thread, which reads
+the same blocks.
+
+The time stamp of each block is checked against the end of the previous
+one. Lost samples are counted and, if zero fill is enabled, replaced by
+zeros for the consumer so that it keeps the timing of the stream.
+
+When the squelch is enabled, the blocks of the idle channel are neither
+published nor written: the squelch keeps the last ones and forwards them
+ahead of the block which opens the gate. The samples which are never
+forwarded are not lost: they are not zero filled, and the next forwarded
+block tells the writer how many were left out.
 
 
 ***************************************************************************/
-void * task_sampling::run()
+template <typename T>
+void * task_sampling_t<T>::run()
 {
 
 	using namespace uhd;	
@@ -106,36 +164,103 @@ void * task_sampling::run()
 
 	std::cout << "Inside thread id  " << thread_id << std::endl;	
 
+	// Map the stack and check the scheduling before the first recv()
+	prefault_stack(rt_config.prefault_stack);
+	verify_rt_thread(rt_config, "sampling_task");
+
 	// Structure to store the metadata of each received buffer
 	rx_metadata_t md;
-	// Send the command to start receiving data	
-	stream_cmd_t stream_cmd(stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
-	stream_cmd.num_samps = g_inbuf[0].size();
-	stream_cmd.stream_now = true;
-	stream_cmd.time_spec = time_spec_t();
-	usrp->issue_stream_cmd(stream_cmd);
-
-	current_buf = 0;
-	// Infinite loop which fills each buffer alternatively
+
+	// Loop which fills the blocks of the pool until stopped or until the
+	// source has no more samples
 	size_t rx_num;
-	while(!exit_task)
+	uint64_t loop_start = monotonic_ns();
+	while(!exit_task && !source.is_done())
 	{
 		// Get the samples
-		size_t buf_size = g_inbuf[current_buf].size();		
-		rx_num = rx_stream->recv(&g_inbuf[current_buf].front(), buf_size, md, 5,false);
-		
-		// We write the info to the log file
-		rx_log << std::endl;
-		rx_log << "Samples Received: " << rx_num <<std::endl;
-		display_rx_metadata(md, rx_log);
-
-		// We write the data to the binary data file in an unformatted way
-		// Fromat of data is I16Q16I16Q16....
-		rx_data.write(reinterpret_cast<const char*>(&(g_inbuf[current_buf].front())), g_inbuf[current_buf].size()*sizeof(input_buf_t::value_type)); 
-		
-		// Switch buffer at each iteration
-		current_buf ^= 1;
+		block_t * block = fanout.acquire_write();
+		rx_num = source.recv(block->samples, block->capacity, md, 5);
+		block->num_samps = rx_num;
+		block->md = md;
+		block->skipped = 0;
+
+		// Check the continuity of the stream
+		uint64_t gap = continuity.update(md, rx_num);
+		block->first_sample = continuity.get_next_sample() - rx_num;
+
+		// The blocks without samples carry errors for the log: they are never squelched
+		squelch_gate::action action = squelch_gate::SQUELCH_ACTIVE;
+		if(squelch.is_enabled() && rx_num)
+			action = squelch.update(squelch.measure(block->samples, rx_num));
+
+		if(action == squelch_gate::SQUELCH_IDLE)
+			squelch.hold(block->samples, rx_num, block->first_sample, md);
+		else if(action == squelch_gate::SQUELCH_OPEN)
+		{
+			// Pre trigger blocks then this one, each in its own block of the pool
+			squelch.hold(block->samples, rx_num, block->first_sample, md);
+			size_t num_held = squelch.get_held();
+			for(size_t index = 0; index < num_held; index++)
+			{
+				const squelch_block & held = squelch.get_held_block(index);
+				block_t * out = fanout.acquire_write();
+				memcpy(out->samples, held.samples, held.num_samps * sizeof(T));
+				out->num_samps = held.num_samps;
+				out->md = held.md;
+				out->first_sample = held.first_sample;
+				out->skipped = 0;
+				forward(out, index + 1 == num_held ? gap : 0);
+			}
+			squelch.release_held();
+		}
+		else
+			forward(block, gap);
+
+		if(loop_histogram)
+		{
+			uint64_t now = monotonic_ns();
+			loop_histogram->record(now - loop_start);
+			loop_start = now;
+		}
 	}
 	
+	// Stop the stream and wake up the consumer and the writer
+	source.stop();
+	fanout.close();
+	writer.stop();
+
+	// The idle samples after the last forwarded block are not lost either
+	squelch.drop_held();
+	if(capture)
+		writer.add_squelched(squelch.take_skipped());
 	return NULL;
-}
\ No newline at end of file
+}
+
+
+/***********************************************************************//**
+Publishes a filled block to the consumer, the writer thread and the other
+subscribers
+
+@param block Block returned by the last acquire_write() of the fan-out
+@param gap Number of samples lost just before the block
+
+***************************************************************************/
+
+template <typename T>
+void task_sampling_t<T>::forward(block_t * block, uint64_t gap)
+{
+	if(block->num_samps)
+	{
+		block->skipped = squelch.take_skipped();
+		squelch.forwarded(block->num_samps);
+	}
+	if(gap && zero_fill)
+		fanout.publish_zeros_before(gap, rx_rate);
+	fanout.publish();
+}
+
+
+// Host sample formats supported by the sampling task
+template class task_sampling_t<sample_sc8>;
+template class task_sampling_t<sample_sc16>;
+template class task_sampling_t<sample_fc32>;
@@ -15,6 +15,17 @@ Declaration ot type required to perform the sampling of data
 #include <cstdio>
 #include <iostream>
 #include <fstream>
+#include "block_fanout.h"
+#include "capture_writer.h"
+#include "rx_continuity.h"
+#include "rt_thread.h"
+#include "sample_source.h"
+#include "latency_stats.h"
+#include "sample_format.h"
+#include "squelch.h"
+
+// Number of blocks queued for the capture writer
+#define TASK_WRITER_SLOTS 32
 
 #ifdef DEFINE_GLOBALS
 	#define EXTERN
@@ -23,45 +34,99 @@ Declaration ot type required to perform the sampling of data
 #endif	
 
 
-typedef short sampling_type ; // samples are 16 bits signed I and Q
-typedef std::vector<std::complex<sampling_type> > input_buf_t;
-
-// Buffers to store the input samples in a ping-pong fashion
-EXTERN input_buf_t g_inbuf[2];
-
-
-
 /***********************************************************************//**
 This class represents the task which is running the sampling of the
 data and filling the buffers
 
+Each block is received once and published without copy through a
+block_fanout to its subscribers: the consumer (wait_buffer), the capture
+writer and any other reader added with subscribe() before start().
+
+The task is a template on the host sample type (sample_sc8, sample_sc16
+or sample_fc32, see sample_format.h): the pool, the blocks and the
+consumers all work on this type and UHD converts the samples directly
+into it. The over the wire format is chosen with set_otw_format().
+The three types are instantiated in task_sampling.cpp.
+
 This class is a singleton
 
 ***************************************************************************/
-class task_sampling
+template <typename T>
+class task_sampling_t
 {
 public:
-	task_sampling(uhd::usrp::multi_usrp::sptr & usrp);
+	typedef T sample_type;
+	typedef block_fanout<T> fanout_t;
+	typedef typename fanout_t::block_t block_t;
+	typedef typename fanout_t::subscriber_t subscriber_t;
+
+	task_sampling_t(sample_source & source, size_t samps_per_buf, size_t num_bufs = 8, const char * capture_name = "rx_data.cap");
 	bool start();
 	void stop() { exit_task = true;}
-	/// Returns a reference to the buffer which can be processed by other tasks
-	input_buf_t &get_buffer() {current_buf == 0? g_inbuf[1]:g_inbuf[0];}
+	/// Over the wire format ("sc8" or "sc16") requested from the source by the next start()
+	bool set_otw_format(const std::string & format);
+	/// Returns the fan-out publishing the blocks filled by the task
+	fanout_t &get_fanout() {return fanout;}
+	/// Adds a reader of the blocks (e.g. a monitor). Must be called before start()
+	subscriber_t &subscribe(const char * name, size_t num_slots, fanout_policy policy = FANOUT_DROP)
+		{return fanout.subscribe(name, num_slots, policy);}
+	/// Selects whether the task drops the blocks (default) or waits when the consumer is late
+	void set_consumer_policy(fanout_policy policy) {consumer.set_policy(policy);}
+	/// Waits for the next filled block. release_buffer() must be called once it has been processed
+	const block_t * wait_buffer(int timeout_ms = -1) {return consumer.wait_read(timeout_ms);}
+	/// Returns the block obtained with wait_buffer() to the sampling task
+	void release_buffer() {consumer.release();}
+	/// Number of blocks lost because the consumer did not keep up
+	uint64_t get_overruns() const {return consumer.get_drops() + fanout.get_overruns();}
+	/// Returns the writer storing the samples on disk
+	const capture_writer &get_writer() const {return writer;}
+	/// Returns the continuity and error counters of the stream
+	const rx_continuity &get_continuity() const {return continuity;}
+	/// When enabled, the samples lost in a gap are replaced by zeros for the consumer
+	void set_zero_fill(bool enable) {zero_fill = enable;}
+	/// Real-time settings of the sampling thread, used by the next start()
+	void set_rt_config(const thread_rt_config & config) {rt_config = config;}
+	/// Real-time settings of the capture writer thread, used by the next start()
+	void set_writer_rt_config(const thread_rt_config & config) {writer.set_rt_config(config);}
+	/// Records the duration of each iteration of the receive loop. NULL disables the measurement
+	void set_loop_histogram(latency_histogram * hist) {loop_histogram = hist;}
+	/// Settings of the squelch gating the consumer and the writer, used by the next start()
+	void set_squelch_config(const squelch_config & config) {squelch.configure(config);}
+	/// Returns the squelch. Its counters are valid once the thread is stopped
+	const squelch_gate &get_squelch() const {return squelch;}
 	/// Returns the  thread identifier
 	pthread_t get_tid() {return thread_id;}
-	~task_sampling();
+	~task_sampling_t();
 
 private:
-	static void * helper(void * arg) {return static_cast<task_sampling*>(arg)->run();}
-	uhd::usrp::multi_usrp::sptr & usrp;/// Hardware interface
-	uhd::rx_streamer::sptr rx_stream;  /// rx_streamer object to control the stream
+	static void * helper(void * arg) {return static_cast<task_sampling_t*>(arg)->run();}
+	sample_source & source;	/// Source of the samples (hardware, replay or simulation)
 	void * run();			/// Main routine of the task
-	std::ofstream  rx_log;		/// ostream to write the metadata associated with each buffer
-	std::ofstream  rx_data;		/// osstream to write the sample data
+	void forward(block_t * block, uint64_t gap);
 	pthread_t thread_id;	/// ID of the thread
-	bool exit_task;		/// Set to true to stop the task
-	int current_buf;		/// Buffer curretnly filled by the task
+	thread_rt_config rt_config;	/// Real-time settings of the thread
+	volatile bool exit_task;		/// Set to true to stop the task
+	std::string otw_format;	/// Over the wire format of the stream
+	fanout_t fanout;		/// Blocks filled by the task and published to the subscribers
+	subscriber_t & consumer;	/// Subscription read with wait_buffer()
+	capture_subscription<T> writer_feed;	/// Subscription of the writer thread
+	capture_writer writer;	/// Thread writing the samples and metadata to disk
+	bool capture;			/// False if the samples are not written to disk
+	rx_continuity continuity;	/// Checks the time stamps and counts the errors of the stream
+	bool zero_fill;			/// True to publish zeros for the lost samples
+	double rx_rate;			/// Sample rate of the stream
+	latency_histogram * loop_histogram;	/// Duration of the iterations of run(), may be NULL
+	squelch_gate squelch;	/// Drops the blocks of the idle channel
 	
 };
 
 
+// The historical 16 bits task and its types
+typedef short sampling_type ; // samples are 16 bits signed I and Q
+typedef std::vector<std::complex<sampling_type> > input_buf_t;
+typedef task_sampling_t<sample_sc16> task_sampling;
+typedef task_sampling::fanout_t input_fanout_t;
+typedef task_sampling::block_t input_block_t;
+
+
 #endif
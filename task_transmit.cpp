@@ -0,0 +1,338 @@
+#include "task_transmit.h"
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include <iostream>
+#include <pthread.h>
+
+
+/// Suspends the calling thread for the given time in us
+static void sleep_us(long us)
+{
+	struct timespec delay;
+	delay.tv_sec = us / 1000000;
+	delay.tv_nsec = (us % 1000000) * 1000;
+	nanosleep(&delay, NULL);
+}
+
+
+/***********************************************************************//**
+Constructor: Creates the resources required for the task
+
+@param dst Destination of the samples
+@param samps_per_buf Number of samples in each block
+@param num_bufs Number of blocks in the ring (rounded up to a power of two)
+@param prefill_bufs Number of blocks queued before the first send(), at
+most the size of the ring. 0 to send as soon as a block is published
+
+***************************************************************************/
+
+template <typename T>
+task_transmit_t<T>::task_transmit_t(sample_sink & dst, size_t samps_per_buf, size_t num_bufs, size_t prefill_bufs)
+:sink(dst), ring(NULL), prefill(prefill_bufs), exit_task(false), otw_format("sc16"),
+ send_timeout(0.1), in_burst(false), loop_histogram(NULL)
+{
+	// The indexes of the ring are on their own cache lines
+	void * mem = NULL;
+	if(posix_memalign(&mem, CACHE_LINE_SIZE, sizeof(ring_t)))
+		throw std::bad_alloc();
+	ring = new(mem) ring_t(num_bufs, samps_per_buf);
+	if(prefill > ring->size())
+		prefill = ring->size();
+}
+
+
+/***********************************************************************//**
+Destructor: Deallocates the ring. The thread must be stopped
+
+
+***************************************************************************/
+
+template <typename T>
+task_transmit_t<T>::~task_transmit_t()
+{
+	ring->~ring_t();
+	free(ring);
+}
+
+
+/***********************************************************************//**
+Selects the over the wire format used by the next start()
+
+@param format "sc8" or "sc16"
+
+@return true if the format is not supported, false otherwise
+
+***************************************************************************/
+
+template <typename T>
+bool task_transmit_t<T>::set_otw_format(const std::string & format)
+{
+	if(!is_otw_format(format))
+	{
+		std::cout << "Unsupported over the wire format " << format << std::endl;
+		return true;
+	}
+	otw_format = format;
+	return false;
+}
+
+
+/***********************************************************************//**
+Starts the new thread with the real-time settings given to set_rt_config()
+
+The blocks published before start() are kept. After finish() the ring is
+emptied for the new stream.
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+template <typename T>
+bool task_transmit_t<T>::start()
+{
+	// Start the stream of the sink in the format of the blocks
+	sink.set_format(sample_traits<T>::cpu_format(), otw_format);
+	if(sink.start())
+	{
+		std::cout << "Sample sink could not be started" << std::endl;
+		return true;
+	}
+
+	if(ring->is_closed())
+		ring->reset();
+	exit_task = false;
+	in_burst = false;
+	stats = tx_stats();
+	if(create_rt_thread(&thread_id, rt_config, &task_transmit_t::helper, this, "transmit_task"))
+	{
+		// an error in creating the thread occurred
+		sink.stop();
+		return true;
+	}
+	return false;
+}
+
+
+/***********************************************************************//**
+Producer: Returns the next free block of the ring, waiting while the ring
+is full
+
+The producer normally runs ahead of the transmitter by the depth of the
+ring, so that waiting for a free block only throttles it: the wait
+sleeps TX_PRODUCER_POLL_US between checks rather than adding a wake-up
+to the transmit thread. The samples, num_samps and md of the block must
+be set before publish_block(). num_samps starts at 0 and md at the
+default (a block in the middle of a burst, sent as soon as possible).
+
+@param timeout_ms Maximum wait in ms. -1 to wait until a block is free
+
+@return Pointer to the block, or NULL on timeout or if the task is
+stopped or finished
+
+***************************************************************************/
+
+template <typename T>
+typename task_transmit_t<T>::block_t * task_transmit_t<T>::acquire_block(int timeout_ms)
+{
+	uint64_t start = monotonic_ns();
+	while(ring->depth() >= ring->size())
+	{
+		if(exit_task || ring->is_closed())
+			return NULL;
+		if(timeout_ms >= 0 && monotonic_ns() - start >= uint64_t(timeout_ms) * 1000000)
+			return NULL;
+		sleep_us(TX_PRODUCER_POLL_US);
+	}
+	if(exit_task || ring->is_closed())
+		return NULL;
+	block_t * block = ring->acquire_write();
+	block->num_samps = 0;
+	block->md = uhd::tx_metadata_t();
+	return block;
+}
+
+
+/***********************************************************************//**
+Main function of the TX task. This is the function which effectively runs
+in a different thread.
+
+Each published block is sent with its metadata, then released to the
+producer. The async messages are read without waiting after each block,
+and with a short wait while the ring is empty, so that reading them
+never delays a send(). An empty ring while a burst is open means that
+the producer is late: it is counted as starved, and the device reports
+an underflow if its buffer runs dry too.
+
+At the end the open burst is ended with an empty end_of_burst packet and
+the last messages (the ack of the last burst) are collected.
+
+
+***************************************************************************/
+
+template <typename T>
+void * task_transmit_t<T>::run()
+{
+	std::cout << "Inside thread id  " << thread_id << std::endl;
+
+	// Map the stack and check the scheduling before the first send()
+	prefault_stack(rt_config.prefault_stack);
+	verify_rt_thread(rt_config, "transmit_task");
+
+	// Fill the device buffer ahead of the output
+	while(!exit_task && !ring->is_closed() && ring->depth() < prefill)
+		sleep_us(TX_PRODUCER_POLL_US);
+
+	bool empty = false;
+	uint64_t loop_start = monotonic_ns();
+	while(!exit_task)
+	{
+		const block_t * block = ring->try_read();
+		if(block == NULL)
+		{
+			// The last blocks may have been published just before the ring was closed
+			if(ring->is_closed() && (block = ring->try_read()) == NULL)
+				break;
+			if(block == NULL)
+			{
+				// Counted once each time the ring runs dry
+				if(in_burst && !empty)
+					stats.starved++;
+				empty = true;
+				block = ring->wait_read(TX_IDLE_WAIT_MS);
+				poll_async(0);
+				if(block == NULL)
+					continue;
+			}
+		}
+		empty = false;
+		send_block(block);
+		ring->release();
+		poll_async(0);
+
+		if(loop_histogram)
+		{
+			uint64_t now = monotonic_ns();
+			loop_histogram->record(now - loop_start);
+			loop_start = now;
+		}
+	}
+
+	// End the burst so that the device does not wait for more samples
+	if(in_burst)
+	{
+		uhd::tx_metadata_t md;
+		md.end_of_burst = true;
+		T zero = T();
+		sink.send(&zero, 0, md, send_timeout);
+		in_burst = false;
+	}
+	while(poll_async(0.1))
+		;
+	sink.stop();
+
+	// The producer must not wait for free blocks anymore
+	exit_task = true;
+	return NULL;
+}
+
+
+/***********************************************************************//**
+Sends one block, in several send() calls if the device does not accept
+all the samples before the timeout. Only the first call carries the
+start of burst and the time
+
+@param block Block read from the ring
+
+@return Number of samples accepted
+
+***************************************************************************/
+
+template <typename T>
+size_t task_transmit_t<T>::send_block(const block_t * block)
+{
+	uhd::tx_metadata_t md = block->md;
+	if(md.start_of_burst || !in_burst)
+		stats.bursts++;
+	size_t sent = 0;
+	do
+	{
+		size_t count = sink.send(block->samples + sent, block->num_samps - sent, md, send_timeout);
+		sent += count;
+		md.start_of_burst = false;
+		md.has_time_spec = false;
+		if(sent < block->num_samps)
+		{
+			stats.short_sends++;
+			poll_async(0);
+		}
+	}
+	while(sent < block->num_samps && !exit_task);
+	in_burst = !block->md.end_of_burst;
+	stats.blocks++;
+	stats.samples += sent;
+	return sent;
+}
+
+
+/***********************************************************************//**
+Reads the async messages of the device and counts them
+
+@param timeout Wait for the first message in s
+
+@return Number of messages read
+
+***************************************************************************/
+
+template <typename T>
+size_t task_transmit_t<T>::poll_async(double timeout)
+{
+	uhd::async_metadata_t md;
+	size_t count = 0;
+	while(sink.recv_async_msg(md, timeout))
+	{
+		switch(md.event_code)
+		{
+		case uhd::async_metadata_t::EVENT_CODE_BURST_ACK:
+			stats.burst_acks++;
+			break;
+		case uhd::async_metadata_t::EVENT_CODE_UNDERFLOW:
+		case uhd::async_metadata_t::EVENT_CODE_UNDERFLOW_IN_PACKET:
+			stats.underflows++;
+			break;
+		case uhd::async_metadata_t::EVENT_CODE_TIME_ERROR:
+			stats.late++;
+			break;
+		case uhd::async_metadata_t::EVENT_CODE_SEQ_ERROR:
+		case uhd::async_metadata_t::EVENT_CODE_SEQ_ERROR_IN_BURST:
+			stats.seq_errors++;
+			break;
+		default:
+			stats.other_events++;
+			break;
+		}
+		count++;
+		timeout = 0;
+	}
+	return count;
+}
+
+
+template <typename T>
+void task_transmit_t<T>::print_stats(std::ostream & os) const
+{
+	char line[256];
+	snprintf(line, sizeof(line), "Transmit: %llu samples in %llu blocks, %llu bursts, %llu acks, %llu underflows, %llu late, "
+		"%llu sequence errors, ring empty %llu times, %llu short sends",
+		(unsigned long long)stats.samples, (unsigned long long)stats.blocks, (unsigned long long)stats.bursts,
+		(unsigned long long)stats.burst_acks, (unsigned long long)stats.underflows, (unsigned long long)stats.late,
+		(unsigned long long)stats.seq_errors, (unsigned long long)stats.starved, (unsigned long long)stats.short_sends);
+	os << line << std::endl;
+}
+
+
+// Host sample formats supported by the transmit task
+template class task_transmit_t<sample_sc8>;
+template class task_transmit_t<sample_sc16>;
+template class task_transmit_t<sample_fc32>;
@@ -0,0 +1,130 @@
+/***********************************************************************//**
+@file
+
+Declaration of the task sending the samples to the transmitter
+
+
+***************************************************************************/
+
+#ifndef TASK_TRANSMIT_H
+#define TASK_TRANSMIT_H
+
+#include <ostream>
+#include <stdint.h>
+#include "/usr/include/uhd/usrp/multi_usrp.hpp"
+#include "sample_ring.h"
+#include "sample_sink.h"
+#include "rt_thread.h"
+#include "latency_stats.h"
+#include "sample_format.h"
+
+// Time the transmit thread waits for a block before polling the async messages, in ms
+#define TX_IDLE_WAIT_MS 1
+// Time the producer sleeps while the ring is full, in us
+#define TX_PRODUCER_POLL_US 200
+
+
+/// Counters of the transmit task
+struct tx_stats
+{
+	tx_stats() : blocks(0), samples(0), bursts(0), short_sends(0), starved(0), underflows(0), late(0),
+		seq_errors(0), burst_acks(0), other_events(0) {}
+
+	uint64_t blocks;		/// Blocks sent
+	uint64_t samples;		/// Samples accepted by the sink
+	uint64_t bursts;		/// Bursts started (start_of_burst, or the first block of the stream)
+	uint64_t short_sends;	/// send() calls which timed out before accepting all the samples
+	uint64_t starved;		/// Times the ring was empty while a burst was open. Harmless while the device buffer lasts
+	uint64_t underflows;	/// EVENT_CODE_UNDERFLOW and EVENT_CODE_UNDERFLOW_IN_PACKET messages
+	uint64_t late;			/// EVENT_CODE_TIME_ERROR messages: bursts whose time_spec was past
+	uint64_t seq_errors;	/// EVENT_CODE_SEQ_ERROR and EVENT_CODE_SEQ_ERROR_IN_BURST messages
+	uint64_t burst_acks;	/// EVENT_CODE_BURST_ACK messages
+	uint64_t other_events;	/// Other async messages
+};
+
+
+/***********************************************************************//**
+This class represents the task which sends the samples to the
+transmitter, the counterpart of task_sampling
+
+The application (the producer) fills the blocks of a lock-free ring:
+acquire_block() returns a free block, the producer writes its samples,
+num_samps and md (start_of_burst, end_of_burst and, for a timed burst,
+has_time_spec and time_spec), then publish_block() hands it over. The
+transmit thread sends the blocks in order with their metadata and reads
+the async messages of the device to count the underflows and the late
+bursts.
+
+The thread waits for prefill blocks before the first send(), so that
+the device buffer is filled ahead of the output and the producer has the
+depth of the ring as a margin. Blocks may be published before start().
+finish() lets the thread send the blocks queued and end the open burst;
+stop() abandons them.
+
+The task takes the same real-time settings as the sampling task, so
+that both run side by side in a full-duplex modem. It is a template on
+the host sample type, instantiated for sc8, sc16 and fc32.
+
+***************************************************************************/
+template <typename T>
+class task_transmit_t
+{
+public:
+	typedef T sample_type;
+	typedef sample_ring<T, tx_block<T> > ring_t;
+	typedef typename ring_t::block_t block_t;
+
+	task_transmit_t(sample_sink & sink, size_t samps_per_buf, size_t num_bufs = 8, size_t prefill = 0);
+	~task_transmit_t();
+	bool start();
+	/// Stops the thread without sending the blocks queued
+	void stop() {exit_task = true;}
+	/// Lets the thread send the blocks queued and end the open burst, then stop
+	void finish() {ring->close();}
+	/// Over the wire format ("sc8" or "sc16") requested from the sink by the next start()
+	bool set_otw_format(const std::string & format);
+
+	// Producer
+	block_t * acquire_block(int timeout_ms = -1);
+	/// Hands the block returned by acquire_block() over to the thread
+	void publish_block() {ring->publish();}
+	/// Number of blocks queued for the thread
+	size_t depth() const {return ring->depth();}
+	/// Number of samples in each block
+	size_t block_size() const {return ring->block_size();}
+
+	/// Real-time settings of the transmit thread, used by the next start()
+	void set_rt_config(const thread_rt_config & config) {rt_config = config;}
+	/// Records the duration of each iteration of the transmit loop. NULL disables the measurement
+	void set_loop_histogram(latency_histogram * hist) {loop_histogram = hist;}
+	/// Timeout of each send() call in s
+	void set_send_timeout(double timeout) {send_timeout = timeout;}
+	/// Returns the counters. Valid once the thread is stopped
+	const tx_stats &get_stats() const {return stats;}
+	void print_stats(std::ostream & os) const;
+	/// Returns the  thread identifier
+	pthread_t get_tid() {return thread_id;}
+
+private:
+	static void * helper(void * arg) {return static_cast<task_transmit_t*>(arg)->run();}
+	void * run();			/// Main routine of the task
+	size_t send_block(const block_t * block);
+	size_t poll_async(double timeout);
+	sample_sink & sink;		/// Destination of the samples (hardware or simulation)
+	ring_t * ring;			/// Blocks filled by the producer, on their own cache lines
+	size_t prefill;			/// Blocks queued before the first send()
+	pthread_t thread_id;	/// ID of the thread
+	thread_rt_config rt_config;	/// Real-time settings of the thread
+	volatile bool exit_task;	/// Set to true to stop the task
+	std::string otw_format;	/// Over the wire format of the stream
+	double send_timeout;	/// Timeout of each send() in s
+	bool in_burst;			/// True from the first block of a burst until its end_of_burst
+	latency_histogram * loop_histogram;	/// Duration of the iterations of run(), may be NULL
+	tx_stats stats;			/// Counters of the task
+};
+
+
+typedef task_transmit_t<sample_sc16> task_transmit;
+
+
+#endif
@@ -0,0 +1,191 @@
+/***********************************************************************//**
+@file
+
+Runs the transmit task (task_transmit.h) on the simulated transmitter
+(sim_sink.h) and checks the timed bursts and the async message counters
+
+Scenarios:
+- bursts: timed bursts in the future, ring prefilled. No underflow, no
+  late burst, one ack per burst, every sample played once and in order
+- late: bursts timed in the past. Each one is reported late and dropped
+- continuous: a continuous stream produced faster than the sample rate.
+  No underflow. The ring may run dry while the device buffer is full
+- starved: a continuous stream produced slower than the sample rate. The
+  device underflows and the task counts the same underflows as the device
+- unpaced: the continuous stream on a device which plays the samples as
+  soon as they are sent, to measure the throughput of the ring and the
+  task
+
+The producer stamps each sample with its number and computes the checksum
+of the samples it publishes, which must match the checksum of the device.
+
+Usage: txbench [-l label] [-j file]
+
+-l label stored in the results (e.g. the release)
+-j file receiving the results, one JSON object per line (default tx_bench.json)
+
+The exit code is 1 if a check fails.
+
+***************************************************************************/
+
+#include <cstdio>
+#include <iostream>
+#include <unistd.h>
+#include "task_transmit.h"
+#include "sim_sink.h"
+#include "bench_common.h"
+
+
+#define TX_RATE 1e6				/// Sample rate of the simulated transmitter
+#define TX_BLOCK_SAMPS 2000		/// 2 ms at TX_RATE
+#define TX_RING_BLOCKS 8
+#define TX_PREFILL 4
+
+
+/// One scenario of the benchmark
+struct tx_scenario
+{
+	const char * name;
+	bool paced;				/// Device playing at the sample rate
+	size_t num_bursts;		/// Number of timed bursts. 0 for a continuous stream
+	size_t burst_blocks;	/// Blocks of each burst, or of the continuous stream
+	double first_time;		/// Time of the first burst after the start of the device, in s (negative: past)
+	double burst_period;	/// Time between the starts of two bursts in s
+	long producer_sleep_us;	/// Time the producer sleeps after each block
+};
+
+
+/***********************************************************************//**
+Runs one scenario and checks its counters
+
+@return Number of failed checks
+
+***************************************************************************/
+static int run_scenario(const tx_scenario & scenario, bench_context & bench)
+{
+	sim_sink_config config;
+	config.rate = TX_RATE;
+	config.paced = scenario.paced;
+	sim_sink sink(config);
+	task_transmit tx(sink, TX_BLOCK_SAMPS, TX_RING_BLOCKS, TX_PREFILL);
+	latency_histogram loop;
+	tx.set_loop_histogram(&loop);
+	if(tx.start())
+		return 1;
+
+	size_t num_bursts = scenario.num_bursts ? scenario.num_bursts : 1;
+	uint64_t checksum = SIM_CHECKSUM_INIT;
+	uint64_t number = 0;
+	uint64_t start = monotonic_ns();
+	for(size_t burst = 0; burst < num_bursts; burst++)
+	{
+		for(size_t index = 0; index < scenario.burst_blocks; index++)
+		{
+			task_transmit::block_t * block = tx.acquire_block();
+			if(block == NULL)
+				break;
+			for(size_t sample = 0; sample < TX_BLOCK_SAMPS; sample++, number++)
+				block->samples[sample] = sample_sc16(short(number & 0xffff), short(number >> 16));
+			block->num_samps = TX_BLOCK_SAMPS;
+			block->md.start_of_burst = index == 0;
+			block->md.end_of_burst = index + 1 == scenario.burst_blocks;
+			if(index == 0 && scenario.num_bursts)
+			{
+				block->md.has_time_spec = true;
+				block->md.time_spec = uhd::time_spec_t(scenario.first_time + burst * scenario.burst_period);
+			}
+			checksum = sim_checksum(checksum, block->samples, TX_BLOCK_SAMPS * sizeof(sample_sc16));
+			tx.publish_block();
+			if(scenario.producer_sleep_us)
+				usleep(scenario.producer_sleep_us);
+		}
+	}
+	tx.finish();
+	pthread_join(tx.get_tid(), NULL);
+	uint64_t elapsed = monotonic_ns() - start;
+
+	const tx_stats & stats = tx.get_stats();
+	uint64_t total = num_bursts * scenario.burst_blocks * TX_BLOCK_SAMPS;
+	printf("\n%s: %.2f MS/s, loop p99 %.1f us\n", scenario.name, sink.get_samples() * 1e3 / elapsed, loop.percentile(99) * 1e-3);
+	tx.print_stats(std::cout);
+
+	// Counters expected for each kind of scenario
+	int errors = 0;
+	bool late = scenario.first_time < 0;
+	bool starved = scenario.producer_sleep_us > 0;
+	if(stats.samples != total || stats.bursts != num_bursts || sink.get_bursts() != num_bursts)
+	{
+		printf("FAILED: %llu samples in %llu bursts sent for %llu in %zu\n", (unsigned long long)stats.samples,
+			(unsigned long long)stats.bursts, (unsigned long long)total, num_bursts);
+		errors++;
+	}
+	if(stats.late != sink.get_late() || stats.underflows != sink.get_underflows() || sink.get_lost_events())
+	{
+		printf("FAILED: the task counted %llu late and %llu underflows, the device %llu and %llu (%llu messages lost)\n",
+			(unsigned long long)stats.late, (unsigned long long)stats.underflows, (unsigned long long)sink.get_late(),
+			(unsigned long long)sink.get_underflows(), (unsigned long long)sink.get_lost_events());
+		errors++;
+	}
+	if(late)
+	{
+		if(stats.late != num_bursts || stats.burst_acks || sink.get_dropped() != total)
+		{
+			printf("FAILED: %llu late bursts and %llu acks for %zu bursts in the past\n", (unsigned long long)stats.late,
+				(unsigned long long)stats.burst_acks, num_bursts);
+			errors++;
+		}
+	}
+	else
+	{
+		if(stats.late || stats.burst_acks != num_bursts || sink.get_samples() != total || sink.get_checksum() != checksum)
+		{
+			printf("FAILED: %llu late, %llu acks for %zu bursts, %llu samples played of %llu, checksum %s\n",
+				(unsigned long long)stats.late, (unsigned long long)stats.burst_acks, num_bursts,
+				(unsigned long long)sink.get_samples(), (unsigned long long)total, sink.get_checksum() == checksum ? "ok" : "wrong");
+			errors++;
+		}
+		if(starved ? stats.underflows == 0 : stats.underflows != 0)
+		{
+			printf("FAILED: %llu underflows with a producer %s than the sample rate\n", (unsigned long long)stats.underflows,
+				starved ? "slower" : "faster");
+			errors++;
+		}
+	}
+
+	fprintf(bench.record("tx"), "\"scenario\":\"%s\",\"paced\":%s,\"bursts\":%zu,\"samples\":%llu,\"msps\":%.3f,\"underflows\":%llu,"
+		"\"late\":%llu,\"acks\":%llu,\"starved\":%llu,\"loop_p99_us\":%.1f,\"ok\":%s}\n", scenario.name, scenario.paced ? "true" : "false", num_bursts, (unsigned long long)stats.samples,
+		sink.get_samples() * 1e3 / elapsed, (unsigned long long)stats.underflows, (unsigned long long)stats.late,
+		(unsigned long long)stats.burst_acks, (unsigned long long)stats.starved, loop.percentile(99) * 1e-3, errors ? "false" : "true");
+	return errors;
+}
+
+
+int main(int argc, char ** argv)
+{
+	bench_context bench("tx_bench.json");
+	for(int index = 1; index < argc; index++)
+	{
+		if(bench.parse_option(argc, argv, index))
+		{
+			std::cout << "Usage: txbench [-l label] [-j file]" << std::endl;
+			return 1;
+		}
+	}
+	if(bench.open())
+		return 1;
+
+	// 10 ms bursts every 20 ms, and 0.5 s streams
+	const tx_scenario scenarios[] =
+	{
+		{"bursts", true, 20, 5, 0.05, 0.02, 0},
+		{"late", true, 10, 5, -0.01, 0, 0},
+		{"continuous", true, 0, 250, 0, 0, 0},
+		{"starved", true, 0, 100, 0, 0, 3000},
+		{"unpaced", false, 0, 20000, 0, 0, 0},
+	};
+	for(size_t index = 0; index < sizeof(scenarios) / sizeof(scenarios[0]); index++)
+		bench.errors += run_scenario(scenarios[index], bench);
+
+	printf("\n");
+	return bench.finish("Every burst sent on time");
+}
@@ -0,0 +1,92 @@
+#include "uhd_sink.h"
+#include <sstream>
+#include <iostream>
+
+
+/***********************************************************************//**
+Constructor
+
+@param usrp_ref Hardware interface
+
+***************************************************************************/
+
+uhd_sink::uhd_sink(uhd::usrp::multi_usrp::sptr & usrp_ref)
+:usrp(usrp_ref)
+{
+}
+
+
+/***********************************************************************//**
+Creates the streamer for the current formats and packet size hint
+
+The streamer is kept as long as the formats and the hint do not change,
+so that prepare() can be called before start() to read the packet size.
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool uhd_sink::prepare()
+{
+	using namespace uhd;
+
+	std::ostringstream key;
+	key << cpu_format << "/" << otw_format << "/" << hint_spp;
+	if(tx_stream && stream_format == key.str())
+		return false;
+
+	stream_args_t tx_stream_args(cpu_format, otw_format);
+	if(hint_spp)
+	{
+		std::ostringstream spp;
+		spp << hint_spp;
+		tx_stream_args.args["spp"] = spp.str();
+	}
+	tx_stream.reset();
+	try
+	{
+		tx_stream = usrp->get_tx_stream(tx_stream_args);
+	}
+	catch(std::exception &e)
+	{
+		// Format not supported by the device
+		std::cout << "Could not create the " << cpu_format << "/" << otw_format << " TX stream: " << e.what() << std::endl;
+		return true;
+	}
+	if(!tx_stream)
+		return true;
+	stream_format = key.str();
+	return false;
+}
+
+
+/***********************************************************************//**
+Prepares the streamer. The device starts transmitting with the first
+send(), at the time_spec of the first burst if it has one
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool uhd_sink::start()
+{
+	return prepare();
+}
+
+
+size_t uhd_sink::send(const void * buf, size_t num_samps, const uhd::tx_metadata_t & md, double timeout)
+{
+	return tx_stream->send(buf, num_samps, md, timeout);
+}
+
+
+bool uhd_sink::recv_async_msg(uhd::async_metadata_t & md, double timeout)
+{
+	return tx_stream->recv_async_msg(md, timeout);
+}
+
+
+/// The transmit task ends the last burst before stopping: nothing to send to the device
+void uhd_sink::stop()
+{
+}
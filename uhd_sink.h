@@ -0,0 +1,40 @@
+/***********************************************************************//**
+@file
+
+Declaration of the sample sink sending to the USRP through UHD
+
+
+***************************************************************************/
+
+#ifndef UHD_SINK_H
+#define UHD_SINK_H
+
+#include "sample_sink.h"
+
+
+/***********************************************************************//**
+Sample sink sending the samples to an USRP with an uhd::tx_streamer
+
+***************************************************************************/
+class uhd_sink : public sample_sink
+{
+public:
+	uhd_sink(uhd::usrp::multi_usrp::sptr & usrp);
+
+	bool prepare();
+	size_t get_packet_samps() {return tx_stream ? tx_stream->get_max_num_samps() : 0;}
+	bool start();
+	size_t send(const void * buf, size_t num_samps, const uhd::tx_metadata_t & md, double timeout);
+	bool recv_async_msg(uhd::async_metadata_t & md, double timeout);
+	void stop();
+	double get_rate() {return usrp->get_tx_rate();}
+	uhd::time_spec_t get_time_now() {return usrp->get_time_now();}
+
+private:
+	uhd::usrp::multi_usrp::sptr & usrp;/// Hardware interface
+	uhd::tx_streamer::sptr tx_stream;  /// tx_streamer object to send the samples
+	std::string stream_format;	/// Formats and spp the streamer was created with
+};
+
+
+#endif
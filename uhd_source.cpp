@@ -0,0 +1,149 @@
+#include "uhd_source.h"
+#include "uhd_utilities.h"
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <iostream>
+
+
+/***********************************************************************//**
+Constructor
+
+@param usrp_ref Hardware interface
+
+***************************************************************************/
+
+uhd_source::uhd_source(uhd::usrp::multi_usrp::sptr & usrp_ref)
+:usrp(usrp_ref), has_tune_result(false)
+{
+}
+
+
+/***********************************************************************//**
+Creates the streamer for the current formats and packet size hint
+
+The streamer is kept as long as the formats and the hint do not change,
+so that prepare() can be called before start() to read the packet size.
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool uhd_source::prepare()
+{
+	using namespace uhd;
+
+	std::ostringstream key;
+	key << cpu_format << "/" << otw_format << "/" << hint_spp;
+	if(rx_stream && stream_format == key.str())
+		return false;
+
+	// Create a streamer object - This defines the size of the samples
+	stream_args_t rx_stream_args(cpu_format, otw_format);
+	if(hint_spp)
+	{
+		std::ostringstream spp;
+		spp << hint_spp;
+		rx_stream_args.args["spp"] = spp.str();
+	}
+	rx_stream.reset();
+	try
+	{
+		rx_stream = usrp->get_rx_stream(rx_stream_args);
+	}
+	catch(std::exception &e)
+	{
+		// Format not supported by the device
+		std::cout << "Could not create the " << cpu_format << "/" << otw_format << " stream: " << e.what() << std::endl;
+		return true;
+	}
+	if(!rx_stream)
+		return true;
+	stream_format = key.str();
+	return false;
+}
+
+
+/***********************************************************************//**
+Starts the continuous stream
+
+@param samps_per_buf Number of samples requested by each recv()
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool uhd_source::start(size_t samps_per_buf)
+{
+	using namespace uhd;
+
+	if(prepare())
+		return true;
+
+	// Send the command to start receiving data
+	stream_cmd_t stream_cmd(stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
+	stream_cmd.num_samps = samps_per_buf;
+	stream_cmd.stream_now = true;
+	stream_cmd.time_spec = time_spec_t();
+	usrp->issue_stream_cmd(stream_cmd);
+	return false;
+}
+
+
+size_t uhd_source::recv(void * buf, size_t num_samps, uhd::rx_metadata_t & md, double timeout)
+{
+	return rx_stream->recv(buf, num_samps, md, timeout, false);
+}
+
+
+void uhd_source::stop()
+{
+	using namespace uhd;
+	usrp->issue_stream_cmd(stream_cmd_t(stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS));
+}
+
+
+/***********************************************************************//**
+Fills the header of the capture file with the current configuration of
+the receiver
+
+@param header Header to fill
+@param snapshot Receives the output of get_rx_parameters()
+
+***************************************************************************/
+
+void uhd_source::describe(capture_header & header, std::string & snapshot)
+{
+	init_capture_header(header);
+	strncpy(header.cpu_format, cpu_format.c_str(), sizeof(header.cpu_format) - 1);
+	strncpy(header.otw_format, otw_format.c_str(), sizeof(header.otw_format) - 1);
+	header.host_start_time = time(NULL);
+	header.sample_rate = usrp->get_rx_rate();
+	header.center_freq = usrp->get_rx_freq();
+	if(has_tune_result)
+	{
+		header.target_rf_freq = tune_result.target_rf_freq;
+		header.actual_rf_freq = tune_result.actual_rf_freq;
+		header.target_dsp_freq = tune_result.target_dsp_freq;
+		header.actual_dsp_freq = tune_result.actual_dsp_freq;
+	}
+	try
+	{
+		header.gain = usrp->get_rx_gain();
+	}
+	catch(uhd::runtime_error &e)
+	{
+	}
+	try
+	{
+		header.bandwidth = usrp->get_rx_bandwidth();
+	}
+	catch(uhd::runtime_error &e)
+	{
+	}
+	strncpy(header.antenna, usrp->get_rx_antenna().c_str(), sizeof(header.antenna) - 1);
+
+	std::ostringstream text;
+	get_rx_parameters(usrp, 0, text);
+	snapshot = text.str();
+}
@@ -0,0 +1,44 @@
+/***********************************************************************//**
+@file
+
+Declaration of the sample source reading the USRP through UHD
+
+
+***************************************************************************/
+
+#ifndef UHD_SOURCE_H
+#define UHD_SOURCE_H
+
+#include "sample_source.h"
+
+
+/***********************************************************************//**
+Sample source reading the samples from an USRP with an uhd::rx_streamer
+
+***************************************************************************/
+class uhd_source : public sample_source
+{
+public:
+	uhd_source(uhd::usrp::multi_usrp::sptr & usrp);
+
+	bool prepare();
+	size_t get_packet_samps() {return rx_stream ? rx_stream->get_max_num_samps() : 0;}
+	bool start(size_t samps_per_buf);
+	size_t recv(void * buf, size_t num_samps, uhd::rx_metadata_t & md, double timeout);
+	void stop();
+	double get_rate() {return usrp->get_rx_rate();}
+	void describe(capture_header & header, std::string & snapshot);
+
+	/// Records the result of the last tune request in the header of the capture file
+	void set_tune_result(const uhd::tune_result_t & result) {tune_result = result; has_tune_result = true;}
+
+private:
+	uhd::usrp::multi_usrp::sptr & usrp;/// Hardware interface
+	uhd::rx_streamer::sptr rx_stream;  /// rx_streamer object to control the stream
+	std::string stream_format;	/// Formats and spp the streamer was created with
+	uhd::tune_result_t tune_result;	/// Result of the last tune request, for the capture header
+	bool has_tune_result;	/// True if set_tune_result() has been called
+};
+
+
+#endif
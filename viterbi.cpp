@@ -0,0 +1,444 @@
+#include "viterbi.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+
+/// Number of trellis steps depunctured before running the ACS
+#define VITERBI_BATCH 256
+/// Initial metric of the states other than 0: the encoder starts in state 0
+#define VITERBI_START_PENALTY 1024
+
+
+/// DVB puncturing patterns
+static const viterbi_puncture punctures[] =
+{
+	{"1/2", "1", "1"},
+	{"2/3", "10", "11"},
+	{"3/4", "101", "110"},
+	{"5/6", "10101", "11010"},
+	{"7/8", "1000101", "1111010"},
+};
+
+
+/***********************************************************************//**
+Returns the puncturing pattern of a rate, NULL if the rate is not
+supported
+
+***************************************************************************/
+
+const viterbi_puncture * viterbi_find_puncture(const std::string & rate)
+{
+	for(size_t index = 0; index < sizeof(punctures) / sizeof(punctures[0]); index++)
+		if(rate == punctures[index].rate)
+			return &punctures[index];
+	return NULL;
+}
+
+
+static inline unsigned parity(unsigned value)
+{
+	return __builtin_parity(value);
+}
+
+
+uint8_t viterbi_branch_bits(size_t j)
+{
+	unsigned sr = unsigned(j) << 1;
+	return uint8_t(parity(sr & VITERBI_POLY_A) | (parity(sr & VITERBI_POLY_B) << 1));
+}
+
+
+/***********************************************************************//**
+Scalar add-compare-select, the reference of the SIMD versions
+
+The old states j and j + 32 both lead to the new states 2j and 2j + 1.
+The branch of state j + 32 and the branch of the input 1 give the
+complement of the bits of the branch of state j for the input 0, whose
+metric is m: their metric is 508 - m.
+
+***************************************************************************/
+
+static void scalar_acs(int16_t * metrics, const int8_t * symbols, uint64_t * decisions, size_t num_steps)
+{
+	uint8_t branch[VITERBI_STATES / 2];
+	for(size_t j = 0; j < VITERBI_STATES / 2; j++)
+		branch[j] = viterbi_branch_bits(j);
+
+	int16_t next[VITERBI_STATES];
+	for(size_t step = 0; step < num_steps; step++)
+	{
+		int s0 = symbols[2 * step];
+		int s1 = symbols[2 * step + 1];
+		uint64_t d = 0;
+		for(size_t j = 0; j < VITERBI_STATES / 2; j++)
+		{
+			int16_t m = int16_t(254 + ((branch[j] & 1) ? s0 : -s0) + ((branch[j] & 2) ? s1 : -s1));
+			int16_t mp = int16_t(508 - m);
+			int16_t a0 = int16_t(metrics[j] + m);
+			int16_t b0 = int16_t(metrics[j + 32] + mp);
+			int16_t a1 = int16_t(metrics[j] + mp);
+			int16_t b1 = int16_t(metrics[j + 32] + m);
+			next[2 * j] = b0 < a0 ? b0 : a0;
+			next[2 * j + 1] = b1 < a1 ? b1 : a1;
+			d |= uint64_t(b0 < a0) << (2 * j);
+			d |= uint64_t(b1 < a1) << (2 * j + 1);
+		}
+		int16_t base = next[0];
+		for(size_t s = 0; s < VITERBI_STATES; s++)
+			metrics[s] = int16_t(next[s] - base);
+		decisions[step] = d;
+	}
+}
+
+
+static const viterbi_kernel_table scalar_table =
+{
+	"scalar",
+	scalar_acs
+};
+
+
+const viterbi_kernel_table & viterbi_scalar_kernels()
+{
+	return scalar_table;
+}
+
+
+/***********************************************************************//**
+Returns every table usable on this machine, the scalar table first and
+the fastest last
+
+***************************************************************************/
+
+void viterbi_available_kernels(std::vector<const viterbi_kernel_table *> & tables)
+{
+	tables.clear();
+	tables.push_back(&scalar_table);
+	if(viterbi_neon_kernels())
+		tables.push_back(viterbi_neon_kernels());
+	if(viterbi_sse2_kernels())
+		tables.push_back(viterbi_sse2_kernels());
+}
+
+
+/***********************************************************************//**
+Selects the fastest table the first time it is called
+
+DSP_KERNELS forces the choice of the table, as for the DSP kernels.
+
+***************************************************************************/
+
+static const viterbi_kernel_table * select_kernels()
+{
+	std::vector<const viterbi_kernel_table *> tables;
+	viterbi_available_kernels(tables);
+	const char * forced = getenv("DSP_KERNELS");
+	if(forced != NULL)
+	{
+		for(size_t index = 0; index < tables.size(); index++)
+			if(strcmp(tables[index]->name, forced) == 0)
+				return tables[index];
+		std::cout << "Viterbi: DSP_KERNELS=" << forced << " is not available, using " << tables.back()->name << std::endl;
+	}
+	return tables.back();
+}
+
+
+const viterbi_kernel_table & viterbi_kernels()
+{
+	static const viterbi_kernel_table * selected = select_kernels();
+	return *selected;
+}
+
+
+conv_encoder::conv_encoder()
+:puncture(&punctures[0]), period(1)
+{
+	reset();
+}
+
+
+/***********************************************************************//**
+Selects the code rate
+
+@return true if the rate is not supported, false otherwise
+
+***************************************************************************/
+
+bool conv_encoder::configure(const std::string & rate)
+{
+	puncture = viterbi_find_puncture(rate);
+	if(puncture == NULL)
+	{
+		std::cout << "Unsupported code rate " << rate << std::endl;
+		puncture = &punctures[0];
+		return true;
+	}
+	period = strlen(puncture->x);
+	reset();
+	return false;
+}
+
+
+/// Starts a frame: the encoder is in state 0
+void conv_encoder::reset()
+{
+	phase = 0;
+	shift = 0;
+}
+
+
+/***********************************************************************//**
+Encodes bits
+
+@param bits Input bits, one per byte
+@param num_bits Number of input bits
+@param coded Receives max_output(num_bits) coded bits at most
+
+@return Number of coded bits
+
+***************************************************************************/
+
+size_t conv_encoder::process(const uint8_t * bits, size_t num_bits, uint8_t * coded)
+{
+	size_t count = 0;
+	for(size_t index = 0; index < num_bits; index++)
+	{
+		unsigned sr = (shift << 1) | (bits[index] & 1);
+		if(puncture->x[phase] == '1')
+			coded[count++] = uint8_t(parity(sr & VITERBI_POLY_A));
+		if(puncture->y[phase] == '1')
+			coded[count++] = uint8_t(parity(sr & VITERBI_POLY_B));
+		if(++phase == period)
+			phase = 0;
+		shift = sr & (VITERBI_STATES - 1);
+	}
+	return count;
+}
+
+
+/***********************************************************************//**
+Ends a frame with K - 1 zero bits, which bring the encoder back to state 0
+
+@param coded Receives max_output(VITERBI_K - 1) coded bits at most
+
+@return Number of coded bits
+
+***************************************************************************/
+
+size_t conv_encoder::flush(uint8_t * coded)
+{
+	static const uint8_t tail[VITERBI_K - 1] = {0, 0, 0, 0, 0, 0};
+	size_t count = process(tail, VITERBI_K - 1, coded);
+	reset();
+	return count;
+}
+
+
+viterbi_decoder::viterbi_decoder()
+:kernels(&viterbi_kernels()), puncture(&punctures[0]), period(1), num_pairs(0), num_steps(0), num_decided(0)
+{
+	configure(config);
+}
+
+
+/***********************************************************************//**
+Selects the rate and allocates the decisions
+
+@return true if an error occurred, false otherwise
+
+***************************************************************************/
+
+bool viterbi_decoder::configure(const viterbi_config & cfg)
+{
+	const viterbi_puncture * p = viterbi_find_puncture(cfg.rate);
+	if(p == NULL)
+	{
+		std::cout << "Unsupported code rate " << cfg.rate << std::endl;
+		return true;
+	}
+	if(cfg.output_chunk == 0 || cfg.traceback_depth < VITERBI_K)
+	{
+		std::cout << "Viterbi traceback of " << cfg.traceback_depth << " steps too short" << std::endl;
+		return true;
+	}
+	config = cfg;
+	puncture = p;
+	period = strlen(puncture->x);
+	history.assign(config.traceback_depth + config.output_chunk, 0);
+	pairs.assign(2 * VITERBI_BATCH + 2, 0);
+	reset();
+	return false;
+}
+
+
+void viterbi_decoder::set_kernels(const viterbi_kernel_table * table)
+{
+	kernels = table ? table : &viterbi_kernels();
+}
+
+
+/// Starts a frame: the encoder is expected in state 0
+void viterbi_decoder::reset()
+{
+	phase = 0;
+	half = 0;
+	num_pairs = 0;
+	for(size_t s = 0; s < VITERBI_STATES; s++)
+		metrics[s] = s ? VITERBI_START_PENALTY : 0;
+	num_steps = 0;
+	num_decided = 0;
+}
+
+
+size_t viterbi_decoder::max_output(size_t num_soft) const
+{
+	// Every step of the patterns has one symbol sent at least
+	return num_soft + 1 + config.output_chunk;
+}
+
+
+/// State with the lowest path metric
+size_t viterbi_decoder::best_state() const
+{
+	size_t best = 0;
+	for(size_t s = 1; s < VITERBI_STATES; s++)
+		if(metrics[s] < metrics[best])
+			best = s;
+	return best;
+}
+
+
+/***********************************************************************//**
+Traces the survivor back from the last step
+
+@param state State of the survivor at the last step
+@param depth Number of steps traced back
+@param count Number of bits output, the oldest ones of the depth
+
+@return count
+
+***************************************************************************/
+
+size_t viterbi_decoder::traceback(size_t state, size_t depth, size_t count, uint8_t * bits)
+{
+	const size_t size = history.size();
+	uint64_t first = num_steps - depth;
+	for(uint64_t step = num_steps; step-- > first; )
+	{
+		if(step < first + count)
+			bits[step - first] = uint8_t(state & 1);
+		unsigned d = unsigned(history[step % size] >> state) & 1;
+		state = (state >> 1) | (d << (VITERBI_K - 2));
+	}
+	num_decided += count;
+	return count;
+}
+
+
+/***********************************************************************//**
+Runs the ACS on the depunctured pairs and decides the bits which have
+been traced back far enough
+
+@return Number of bits written to bits
+
+***************************************************************************/
+
+size_t viterbi_decoder::run_steps(size_t count, uint8_t * bits)
+{
+	const size_t size = history.size();
+	size_t out = 0;
+	size_t done = 0;
+	while(done < count)
+	{
+		// A run must not wrap around the history nor overwrite undecided steps
+		size_t pos = size_t(num_steps % size);
+		size_t n = count - done;
+		if(n > size - pos)
+			n = size - pos;
+		size_t pending = size_t(num_steps - num_decided);
+		if(n > size - pending)
+			n = size - pending;
+		kernels->acs(metrics, &pairs[2 * done], &history[pos], n);
+		num_steps += n;
+		done += n;
+		if(num_steps - num_decided == size)
+			out += traceback(best_state(), size, config.output_chunk, bits + out);
+	}
+	return out;
+}
+
+
+/***********************************************************************//**
+Decodes soft bits
+
+@param soft Soft bits in the order of transmission (punctured)
+@param num_soft Number of soft bits
+@param bits Receives max_output(num_soft) decoded bits at most, one per byte
+
+@return Number of decoded bits. The bits come out traceback_depth steps
+or more after their soft bits
+
+***************************************************************************/
+
+size_t viterbi_decoder::process(const int8_t * soft, size_t num_soft, uint8_t * bits)
+{
+	size_t out = 0;
+	size_t index = 0;
+	for(;;)
+	{
+		// Depuncture: 0 where nothing was sent
+		while(num_pairs < VITERBI_BATCH)
+		{
+			char sent = half ? puncture->y[phase] : puncture->x[phase];
+			int8_t value = 0;
+			if(sent == '1')
+			{
+				if(index == num_soft)
+					break;
+				value = soft[index++];
+			}
+			pairs[2 * num_pairs + half] = value;
+			if(++half == 2)
+			{
+				half = 0;
+				num_pairs++;
+				if(++phase == period)
+					phase = 0;
+			}
+		}
+		if(num_pairs == 0)
+			break;
+		out += run_steps(num_pairs, bits + out);
+		// Keep the first symbol of an incomplete pair
+		pairs[0] = pairs[2 * num_pairs];
+		num_pairs = 0;
+		if(index == num_soft)
+			break;
+	}
+	return out;
+}
+
+
+/***********************************************************************//**
+Ends a frame: decides every remaining bit and resets the decoder
+
+@param terminated true if the frame ends with the K - 1 zero bits of
+conv_encoder::flush(): the traceback starts from state 0 and the tail
+bits are not output
+@param bits Receives max_flush() bits at most
+
+@return Number of decoded bits
+
+***************************************************************************/
+
+size_t viterbi_decoder::flush(bool terminated, uint8_t * bits)
+{
+	size_t pending = size_t(num_steps - num_decided);
+	size_t count = traceback(terminated ? 0 : best_state(), pending, pending, bits);
+	if(terminated)
+		count = count > VITERBI_K - 1 ? count - (VITERBI_K - 1) : 0;
+	reset();
+	return count;
+}
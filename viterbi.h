@@ -0,0 +1,183 @@
+/***********************************************************************//**
+@file
+
+Convolutional code of the link: encoder and soft decision Viterbi decoder
+
+The code is the K = 7, rate 1/2 code of CCSDS and DVB (polynomials 171
+and 133 octal), punctured to 2/3, 3/4, 5/6 or 7/8 with the DVB patterns.
+
+The decoder takes the soft bits of the demodulator (qpsk_demodulator):
+int8 values, positive for a 0, negative for a 1, 0 for nothing known.
+The punctured symbols are put back as 0. The branch metric is the
+distance of the two soft symbols to the expected bits, so the path
+metrics are small integers: they are kept in int16 and normalised at
+every step (the spread of the 64 metrics is bounded by six branches).
+
+The add-compare-select of the 64 states is the whole cost of the decoder.
+It exists in a scalar version, the reference, and in SIMD versions
+selected like the DSP kernels (see dsp_kernels.h): NEON on the E100 at
+compile time, SSE2 on x86 at run time. All the versions make the same
+integer operations, so they give the same decisions bit for bit.
+
+The traceback runs every output_chunk steps over traceback_depth +
+output_chunk steps and outputs the oldest output_chunk bits: the latency
+of a bit is bounded by traceback_depth + output_chunk steps.
+
+***************************************************************************/
+
+#ifndef VITERBI_H
+#define VITERBI_H
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+#include "block_pool.h"
+
+
+#define VITERBI_K 7
+#define VITERBI_STATES 64
+/// Polynomials with the newest input bit in bit 0 (171 and 133 octal with the newest bit first)
+#define VITERBI_POLY_A 0x4f
+#define VITERBI_POLY_B 0x6d
+
+
+/// Table of the add-compare-select kernels of one instruction set
+struct viterbi_kernel_table
+{
+	const char * name;		/// Instruction set ("scalar", "sse2", "neon")
+
+	/***********************************************************************
+	Runs num_steps trellis steps
+
+	metrics: the 64 path metrics, updated and normalised (metric of state
+	0 subtracted) after each step
+	symbols: two soft symbols per step
+	decisions: receives 64 bits per step, bit s set when the survivor of
+	state s comes from the old state s / 2 + 32
+	***********************************************************************/
+	void (*acs)(int16_t * metrics, const int8_t * symbols, uint64_t * decisions, size_t num_steps);
+};
+
+
+const viterbi_kernel_table & viterbi_kernels();
+const viterbi_kernel_table & viterbi_scalar_kernels();
+void viterbi_available_kernels(std::vector<const viterbi_kernel_table *> & tables);
+
+// Tables of the SIMD versions. NULL when not supported by the build or the CPU
+const viterbi_kernel_table * viterbi_sse2_kernels();
+const viterbi_kernel_table * viterbi_neon_kernels();
+
+/// Expected output bits of the branch of old state j (0 .. 31) for the input bit 0, bit 0 for polynomial A
+uint8_t viterbi_branch_bits(size_t j);
+
+
+/// Puncturing pattern of a code rate
+struct viterbi_puncture
+{
+	const char * rate;		/// "1/2", "2/3", ...
+	const char * x;			/// 1 where the output of polynomial A is sent, one character per input bit
+	const char * y;			/// Same for polynomial B
+};
+
+const viterbi_puncture * viterbi_find_puncture(const std::string & rate);
+
+
+/***********************************************************************//**
+Convolutional encoder
+
+The bits are given one per byte (0 or 1), the coded bits come out one per
+byte in the order of transmission, after puncturing.
+
+***************************************************************************/
+class conv_encoder
+{
+public:
+	typedef uint8_t output_type;
+
+	conv_encoder();
+	bool configure(const std::string & rate);
+	void reset();
+
+	/// Maximum number of coded bits produced from num_bits input bits
+	size_t max_output(size_t num_bits) const {return 2 * num_bits + 2;}
+	size_t process(const uint8_t * bits, size_t num_bits, uint8_t * coded);
+	size_t flush(uint8_t * coded);
+
+private:
+	const viterbi_puncture * puncture;
+	size_t period;				/// Number of input bits of the puncturing pattern
+	size_t phase;				/// Position of the next input bit in the pattern
+	unsigned shift;				/// Last K - 1 input bits, the newest in bit 0
+};
+
+
+/// Configuration of the decoder
+struct viterbi_config
+{
+	viterbi_config() : rate("1/2"), traceback_depth(96), output_chunk(32) {}
+
+	std::string rate;			/// "1/2", "2/3", "3/4", "5/6" or "7/8"
+	size_t traceback_depth;		/// Steps traced back before a bit is decided (5 K at rate 1/2, more when punctured)
+	size_t output_chunk;		/// Number of bits decided by each traceback
+};
+
+
+/***********************************************************************//**
+Streaming soft decision Viterbi decoder
+
+process() accepts any number of soft bits and outputs the bits decided
+so far, so the output does not depend on how the soft bits are cut into
+blocks. flush() ends a frame: with a terminated frame (K - 1 zero bits
+appended by conv_encoder::flush()) the traceback starts from state 0 and
+the tail bits are removed.
+
+The decoder does not allocate once configured.
+
+***************************************************************************/
+class viterbi_decoder
+{
+public:
+	typedef uint8_t output_type;
+
+	viterbi_decoder();
+	bool configure(const viterbi_config & config);
+	/// Uses the kernels of another table (benchmarks). NULL for viterbi_kernels()
+	void set_kernels(const viterbi_kernel_table * table);
+	void reset();
+
+	/// Maximum number of bits produced from num_soft soft bits
+	size_t max_output(size_t num_soft) const;
+	/// Maximum number of bits produced by flush()
+	size_t max_flush() const {return history.size();}
+
+	size_t process(const int8_t * soft, size_t num_soft, uint8_t * bits);
+	size_t flush(bool terminated, uint8_t * bits);
+
+	/// Number of trellis steps run since reset()
+	uint64_t get_num_steps() const {return num_steps;}
+	/// Number of bits output since reset()
+	uint64_t get_num_bits() const {return num_decided;}
+	const char * get_kernel_name() const {return kernels->name;}
+
+private:
+	size_t run_steps(size_t count, uint8_t * bits);
+	size_t traceback(size_t state, size_t depth, size_t count, uint8_t * bits);
+	size_t best_state() const;
+
+	viterbi_config config;
+	const viterbi_kernel_table * kernels;
+	const viterbi_puncture * puncture;
+	size_t period;				/// Number of input bits of the puncturing pattern
+	size_t phase;				/// Position in the pattern of the pair being filled
+	size_t half;				/// 0 or 1: symbol of the pair being filled
+	pool_vector<int8_t>::type pairs;	/// Depunctured symbols waiting for the ACS, two per step
+	size_t num_pairs;			/// Number of complete pairs in pairs
+	int16_t metrics[VITERBI_STATES];	/// Path metrics
+	pool_vector<uint64_t>::type history;	/// Decisions of the last traceback_depth + output_chunk steps
+	uint64_t num_steps;			/// Trellis steps run
+	uint64_t num_decided;		/// Steps whose bit has been output
+};
+
+
+#endif
@@ -0,0 +1,211 @@
+/***********************************************************************//**
+@file
+
+Checks the Viterbi decoder (viterbi.h) and measures its throughput with
+every ACS kernel of the machine
+
+For every code rate, random bits are encoded, mapped to soft bits as the
+demodulator gives them (+-32 for the ideal points, see demod_config), with
+gaussian noise for a given Eb/N0, and decoded. The program checks:
+- that the decoder corrects every bit without noise
+- that every kernel gives the same bits as the scalar reference
+- that the output does not depend on how the soft bits are cut into blocks
+- that at rate 1/2 the bit error rate at 4 dB is below 1e-3, and at every
+  rate below the error rate of uncoded BPSK
+
+The throughput is in decoded bits per second on one core.
+
+Usage: viterbibench [-t seconds] [-e ebn0] [-l label] [-j file]
+
+-t measuring time of each kernel and rate in seconds (default 0.3)
+-e Eb/N0 of the error rate measurement in dB (default 4)
+-l label stored in the results (e.g. the release)
+-j file receiving the results, one JSON object per line (default viterbi_bench.json)
+
+The exit code is 1 if a check fails.
+
+***************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include "viterbi.h"
+#include "latency_stats.h"
+#include "bench_common.h"
+
+
+#define BENCH_BITS 100000		/// Bits of the frame of each check
+#define SOFT_SCALE 32.0			/// Soft bit of an ideal constellation point
+#define ODD_BLOCK 997			/// Soft bits per call of the streaming check
+#define MAX_BER_HALF 1e-3		/// Error rate allowed at rate 1/2 and 4 dB
+
+static const char * rates[] = {"1/2", "2/3", "3/4", "5/6", "7/8"};
+
+
+static double gaussian()
+{
+	double u1 = (bench_random() + 1.0) / 4294967297.0;
+	double u2 = bench_random() / 4294967296.0;
+	return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+
+/***********************************************************************//**
+Encodes a terminated frame and maps it to soft bits
+
+@param sigma Standard deviation of the noise, relative to the ideal point
+
+***************************************************************************/
+
+static void make_frame(const char * rate, const std::vector<uint8_t> & bits, double sigma, std::vector<int8_t> & soft)
+{
+	conv_encoder encoder;
+	encoder.configure(rate);
+	std::vector<uint8_t> coded(encoder.max_output(bits.size() + VITERBI_K));
+	size_t count = encoder.process(&bits[0], bits.size(), &coded[0]);
+	count += encoder.flush(&coded[count]);
+	soft.resize(count);
+	for(size_t n = 0; n < count; n++)
+	{
+		double value = SOFT_SCALE * ((coded[n] ? -1 : 1) + sigma * gaussian());
+		value = floor(value + 0.5);
+		soft[n] = int8_t(value > 127 ? 127 : (value < -127 ? -127 : value));
+	}
+}
+
+
+/***********************************************************************//**
+Decodes a terminated frame
+
+@param block Number of soft bits per call of process()
+
+***************************************************************************/
+
+static std::vector<uint8_t> decode(const char * rate, const viterbi_kernel_table * table, const std::vector<int8_t> & soft, size_t block)
+{
+	viterbi_config config;
+	config.rate = rate;
+	viterbi_decoder decoder;
+	decoder.configure(config);
+	decoder.set_kernels(table);
+	std::vector<uint8_t> bits(decoder.max_output(soft.size()) + decoder.max_flush());
+	size_t count = 0;
+	for(size_t start = 0; start < soft.size(); start += block)
+	{
+		size_t n = soft.size() - start < block ? soft.size() - start : block;
+		count += decoder.process(&soft[start], n, &bits[count]);
+	}
+	count += decoder.flush(true, &bits[count]);
+	bits.resize(count);
+	return bits;
+}
+
+
+static size_t count_errors(const std::vector<uint8_t> & sent, const std::vector<uint8_t> & decoded)
+{
+	if(sent.size() != decoded.size())
+		return sent.size();
+	size_t errors = 0;
+	for(size_t n = 0; n < sent.size(); n++)
+		errors += sent[n] != decoded[n];
+	return errors;
+}
+
+
+/***********************************************************************//**
+Throughput of the decoder on a continuous stream
+
+@return Decoded bits per second
+
+***************************************************************************/
+
+static double bench_decoder(const char * rate, const viterbi_kernel_table * table, const std::vector<int8_t> & soft, double seconds)
+{
+	viterbi_config config;
+	config.rate = rate;
+	viterbi_decoder decoder;
+	decoder.configure(config);
+	decoder.set_kernels(table);
+	const size_t block = 4096;
+	std::vector<uint8_t> bits(decoder.max_output(block));
+	uint64_t decoded = 0;
+	uint64_t start = thread_cpu_ns();
+	uint64_t now = start;
+	while(now < start + uint64_t(seconds * 1e9))
+	{
+		for(size_t offset = 0; offset + block <= soft.size(); offset += block)
+			decoded += decoder.process(&soft[offset], block, &bits[0]);
+		now = thread_cpu_ns();
+	}
+	return decoded / ((now - start) * 1e-9);
+}
+
+
+int main(int argc, char ** argv)
+{
+	double ebn0 = 4;
+	bench_context bench("viterbi_bench.json", 0.3);
+	for(int index = 1; index < argc; index++)
+	{
+		if(strcmp(argv[index], "-e") == 0 && index + 1 < argc)
+			ebn0 = atof(argv[++index]);
+		else if(bench.parse_option(argc, argv, index))
+		{
+			std::cout << "Usage: viterbibench [-t seconds] [-e ebn0] [-l label] [-j file]" << std::endl;
+			return 1;
+		}
+	}
+	if(bench.open())
+		return 1;
+
+	std::vector<const viterbi_kernel_table *> tables;
+	viterbi_available_kernels(tables);
+	std::vector<uint8_t> bits(BENCH_BITS);
+	for(size_t n = 0; n < bits.size(); n++)
+		bits[n] = bench_random() & 1;
+	double uncoded_ber = 0.5 * erfc(sqrt(pow(10, ebn0 / 10)));
+
+	printf("Eb/N0 %.1f dB, uncoded BER %.2e\n", ebn0, uncoded_ber);
+	printf("%-5s %-7s %10s %10s %12s %8s\n", "rate", "kernel", "clean", "BER", "Mbit/s", "");
+	for(size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+	{
+		const char * rate = rates[r];
+		const viterbi_puncture * puncture = viterbi_find_puncture(rate);
+		// Input bits of the pattern over the coded bits sent
+		size_t period = strlen(puncture->x);
+		double code_rate = double(period) / double(std::count(puncture->x, puncture->x + period, '1')
+			+ std::count(puncture->y, puncture->y + period, '1'));
+		double sigma = sqrt(1 / (2 * code_rate * pow(10, ebn0 / 10)));
+
+		std::vector<int8_t> clean, noisy;
+		make_frame(rate, bits, 0, clean);
+		make_frame(rate, bits, sigma, noisy);
+		std::vector<uint8_t> reference = decode(rate, &viterbi_scalar_kernels(), noisy, noisy.size());
+
+		for(size_t t = 0; t < tables.size(); t++)
+		{
+			int case_errors = 0;
+			size_t clean_errors = count_errors(bits, decode(rate, tables[t], clean, clean.size()));
+			std::vector<uint8_t> decoded = decode(rate, tables[t], noisy, noisy.size());
+			size_t bit_errors = count_errors(bits, decoded);
+			double ber = double(bit_errors) / bits.size();
+			case_errors += clean_errors != 0;
+			case_errors += decoded != reference;
+			case_errors += decode(rate, tables[t], noisy, ODD_BLOCK) != decoded;
+			case_errors += ber >= uncoded_ber;
+			case_errors += r == 0 && ber >= MAX_BER_HALF;
+			double bps = bench_decoder(rate, tables[t], noisy, bench.seconds);
+			bench.errors += case_errors;
+			printf("%-5s %-7s %10zu %10.2e %12.2f %8s\n", rate, tables[t]->name, clean_errors, ber, bps * 1e-6,
+				case_errors ? "FAILED" : "ok");
+			fprintf(bench.record("viterbi"), "\"rate\":\"%s\",\"kernel\":\"%s\",\"ebn0\":%.2f,\"ber\":%.3e,\"clean_errors\":%zu,"
+				"\"bits_per_s\":%.0f,\"errors\":%d}\n", rate, tables[t]->name, ebn0, ber, clean_errors, bps, case_errors);
+		}
+	}
+
+	return bench.finish("Every check passed");
+}
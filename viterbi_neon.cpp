@@ -0,0 +1,105 @@
+/***********************************************************************//**
+@file
+
+NEON version of the Viterbi add-compare-select for the Cortex-A8 of the
+E100
+
+Same organisation as the SSE2 version (viterbi_x86.cpp): eight registers
+of int16 path metrics, one butterfly per lane, vzip to put the new
+metrics back in the order of the states. NEON has no movemask: the
+decisions narrowed to bytes are weighted by their bit and summed with
+pairwise additions.
+
+***************************************************************************/
+
+#include "viterbi.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+
+
+static void neon_acs(int16_t * metrics, const int8_t * symbols, uint64_t * decisions, size_t num_steps)
+{
+	// Masks negating the soft symbols where the branch expects a 0
+	int16x8_t mask_a[4], mask_b[4];
+	for(size_t k = 0; k < 4; k++)
+	{
+		int16_t a[8], b[8];
+		for(size_t lane = 0; lane < 8; lane++)
+		{
+			uint8_t bits = viterbi_branch_bits(8 * k + lane);
+			a[lane] = (bits & 1) ? 0 : -1;
+			b[lane] = (bits & 2) ? 0 : -1;
+		}
+		mask_a[k] = vld1q_s16(a);
+		mask_b[k] = vld1q_s16(b);
+	}
+	static const uint8_t weight_bytes[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+	const uint8x16_t weights = vld1q_u8(weight_bytes);
+	int16x8_t pm[8];
+	for(size_t r = 0; r < 8; r++)
+		pm[r] = vld1q_s16(metrics + 8 * r);
+	const int16x8_t k254 = vdupq_n_s16(254);
+	const int16x8_t k508 = vdupq_n_s16(508);
+
+	for(size_t step = 0; step < num_steps; step++)
+	{
+		int16x8_t s0 = vdupq_n_s16(symbols[2 * step]);
+		int16x8_t s1 = vdupq_n_s16(symbols[2 * step + 1]);
+		int16x8_t next[8];
+		uint64_t d = 0;
+		for(size_t k = 0; k < 4; k++)
+		{
+			int16x8_t c0 = vsubq_s16(veorq_s16(s0, mask_a[k]), mask_a[k]);
+			int16x8_t c1 = vsubq_s16(veorq_s16(s1, mask_b[k]), mask_b[k]);
+			int16x8_t m = vaddq_s16(vaddq_s16(c0, c1), k254);
+			int16x8_t mp = vsubq_s16(k508, m);
+			int16x8_t a0 = vaddq_s16(pm[k], m);
+			int16x8_t b0 = vaddq_s16(pm[k + 4], mp);
+			int16x8_t a1 = vaddq_s16(pm[k], mp);
+			int16x8_t b1 = vaddq_s16(pm[k + 4], m);
+			int16x8x2_t n = vzipq_s16(vminq_s16(a0, b0), vminq_s16(a1, b1));
+			uint16x8x2_t dz = vzipq_u16(vcgtq_s16(a0, b0), vcgtq_s16(a1, b1));
+			// New states 16k .. 16k + 15
+			next[2 * k] = n.val[0];
+			next[2 * k + 1] = n.val[1];
+			uint8x16_t bytes = vandq_u8(vcombine_u8(vmovn_u16(dz.val[0]), vmovn_u16(dz.val[1])), weights);
+			uint8x8_t sum = vpadd_u8(vget_low_u8(bytes), vget_high_u8(bytes));
+			sum = vpadd_u8(sum, sum);
+			sum = vpadd_u8(sum, sum);
+			d |= uint64_t(vget_lane_u8(sum, 0) | (vget_lane_u8(sum, 1) << 8)) << (16 * k);
+		}
+		// Subtract the metric of state 0 from every state
+		int16x8_t base = vdupq_lane_s16(vget_low_s16(next[0]), 0);
+		for(size_t r = 0; r < 8; r++)
+			pm[r] = vsubq_s16(next[r], base);
+		decisions[step] = d;
+	}
+
+	for(size_t r = 0; r < 8; r++)
+		vst1q_s16(metrics + 8 * r, pm[r]);
+}
+
+
+static const viterbi_kernel_table neon_table =
+{
+	"neon",
+	neon_acs
+};
+
+
+const viterbi_kernel_table * viterbi_neon_kernels()
+{
+	return &neon_table;
+}
+
+
+#else
+
+const viterbi_kernel_table * viterbi_neon_kernels()
+{
+	return NULL;
+}
+
+#endif
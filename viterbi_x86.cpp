@@ -0,0 +1,121 @@
+/***********************************************************************//**
+@file
+
+SSE2 version of the Viterbi add-compare-select
+
+The 64 path metrics are int16 and stay in eight registers during a run
+of steps. Each register of old metrics holds the states j .. j + 7, and
+the register four places further the states j + 32 .. j + 39, which lead
+to the same new states: a butterfly is one lane. The two new metrics of
+each lane are interleaved back into the order of the states, and the
+decisions packed to bytes give 16 bits per movemask.
+
+Compiled with the target attribute like dsp_kernels_x86.cpp, so that the
+file does not need any special compiler flag.
+
+***************************************************************************/
+
+#include "viterbi.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#define VITERBI_SSE2 __attribute__((target("sse2")))
+
+
+/***********************************************************************//**
+Masks negating the soft symbols where the branch expects a 0
+
+A soft symbol s gives the cost 127 - s for a 0 and 127 + s for a 1:
+x ^ mask - mask is -x with the mask set, x without.
+
+***************************************************************************/
+
+VITERBI_SSE2 static void sse2_branch_masks(__m128i * mask_a, __m128i * mask_b)
+{
+	for(size_t k = 0; k < 4; k++)
+	{
+		int16_t a[8], b[8];
+		for(size_t lane = 0; lane < 8; lane++)
+		{
+			uint8_t bits = viterbi_branch_bits(8 * k + lane);
+			a[lane] = (bits & 1) ? 0 : -1;
+			b[lane] = (bits & 2) ? 0 : -1;
+		}
+		mask_a[k] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+		mask_b[k] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+	}
+}
+
+
+VITERBI_SSE2 static void sse2_acs(int16_t * metrics, const int8_t * symbols, uint64_t * decisions, size_t num_steps)
+{
+	__m128i mask_a[4], mask_b[4];
+	sse2_branch_masks(mask_a, mask_b);
+	__m128i pm[8];
+	for(size_t r = 0; r < 8; r++)
+		pm[r] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(metrics + 8 * r));
+	const __m128i k254 = _mm_set1_epi16(254);
+	const __m128i k508 = _mm_set1_epi16(508);
+
+	for(size_t step = 0; step < num_steps; step++)
+	{
+		__m128i s0 = _mm_set1_epi16(symbols[2 * step]);
+		__m128i s1 = _mm_set1_epi16(symbols[2 * step + 1]);
+		__m128i next[8];
+		uint64_t d = 0;
+		for(size_t k = 0; k < 4; k++)
+		{
+			__m128i c0 = _mm_sub_epi16(_mm_xor_si128(s0, mask_a[k]), mask_a[k]);
+			__m128i c1 = _mm_sub_epi16(_mm_xor_si128(s1, mask_b[k]), mask_b[k]);
+			__m128i m = _mm_add_epi16(_mm_add_epi16(c0, c1), k254);
+			__m128i mp = _mm_sub_epi16(k508, m);
+			__m128i a0 = _mm_add_epi16(pm[k], m);
+			__m128i b0 = _mm_add_epi16(pm[k + 4], mp);
+			__m128i a1 = _mm_add_epi16(pm[k], mp);
+			__m128i b1 = _mm_add_epi16(pm[k + 4], m);
+			__m128i n0 = _mm_min_epi16(a0, b0);
+			__m128i n1 = _mm_min_epi16(a1, b1);
+			__m128i d0 = _mm_cmpgt_epi16(a0, b0);
+			__m128i d1 = _mm_cmpgt_epi16(a1, b1);
+			// New states 16k .. 16k + 15
+			next[2 * k] = _mm_unpacklo_epi16(n0, n1);
+			next[2 * k + 1] = _mm_unpackhi_epi16(n0, n1);
+			__m128i bytes = _mm_packs_epi16(_mm_unpacklo_epi16(d0, d1), _mm_unpackhi_epi16(d0, d1));
+			d |= uint64_t(_mm_movemask_epi8(bytes) & 0xffff) << (16 * k);
+		}
+		// Subtract the metric of state 0 from every state
+		__m128i base = _mm_shufflelo_epi16(next[0], 0);
+		base = _mm_unpacklo_epi64(base, base);
+		for(size_t r = 0; r < 8; r++)
+			pm[r] = _mm_sub_epi16(next[r], base);
+		decisions[step] = d;
+	}
+
+	for(size_t r = 0; r < 8; r++)
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(metrics + 8 * r), pm[r]);
+}
+
+
+static const viterbi_kernel_table sse2_table =
+{
+	"sse2",
+	sse2_acs
+};
+
+
+const viterbi_kernel_table * viterbi_sse2_kernels()
+{
+	return __builtin_cpu_supports("sse2") ? &sse2_table : NULL;
+}
+
+
+#else
+
+const viterbi_kernel_table * viterbi_sse2_kernels()
+{
+	return NULL;
+}
+
+#endif